@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+/* size of the arena blocks, bigger objects get their own block */
+#define ARENA_BLOCK	65536
+#define ARENA_ALIGN	8
+
+
+/* ----
+ * arena_alloc()
+ * ----
+ * allocate memory from an arena, the memory is not cleared;
+ * it is only released with the whole arena, return NULL if
+ * there is not enough memory
+ */
+
+void *
+arena_alloc(struct t_arena *arena, int size)
+{
+	struct t_arenablk *blk;
+	char *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (size > arena->left) {
+		/* big object, the current block is kept */
+		if (size > (ARENA_BLOCK / 4)) {
+			if ((blk = (void *)malloc(sizeof(struct t_arenablk) + size)) == NULL)
+				return (NULL);
+			if (arena->list) {
+				blk->next = arena->list->next;
+				arena->list->next = blk;
+			}
+			else {
+				blk->next = NULL;
+				arena->list = blk;
+			}
+			return (blk->data);
+		}
+
+		/* new block, the end of the current one is lost */
+		if ((blk = (void *)malloc(sizeof(struct t_arenablk) + ARENA_BLOCK)) == NULL)
+			return (NULL);
+		blk->next = arena->list;
+		arena->list = blk;
+		arena->ptr  = (char *)blk->data;
+		arena->left = ARENA_BLOCK;
+	}
+
+	ptr = arena->ptr;
+	arena->ptr  += size;
+	arena->left -= size;
+	return (ptr);
+}
+
+
+/* ----
+ * arena_strdup()
+ * ----
+ * copy a string in an arena
+ */
+
+char *
+arena_strdup(struct t_arena *arena, const char *str)
+{
+	char *ptr;
+	int   len;
+
+	len = strlen(str) + 1;
+	if ((ptr = arena_alloc(arena, len)) == NULL)
+		return (NULL);
+	memcpy(ptr, str, len);
+	return (ptr);
+}
+
+
+/* ----
+ * arena_free()
+ * ----
+ * release all the memory allocated from an arena
+ */
+
+void
+arena_free(struct t_arena *arena)
+{
+	struct t_arenablk *blk, *next;
+
+	for (blk = arena->list; blk; blk = next) {
+		next = blk->next;
+		free(blk);
+	}
+	memset(arena, 0, sizeof(struct t_arena));
+}
@@ -6,14 +6,6 @@
 #include "externs.h"
 #include "protos.h"
 
-int in_if;			/* set when we are in an .if statement */
-int if_expr;		/* set when parsing an .if expression */
-int if_level;		/* level of nested .if's */
-int if_state[256];	/* status when entering the .if */
-int if_flag[256];	/* .if/.else status */
-int skip_lines;		/* set when lines must be skipped */
-int continued_line;	/* set when a line is the continuation of another line */
-
 
 /* ----
  * assemble()
@@ -21,61 +13,82 @@ int continued_line;	/* set when a line is the continuation of another line */
  * translate source line to machine language
  */
 void
-assemble(void)
+assemble(struct t_context *ctx)
 {
+	struct t_lexinfo *lex;
+	struct t_lexline lx;
 	struct t_line *ptr;
 	char *buf;
 	char c;
-	char local_check;
 	int	 flag;
-	int	 ip, i, j;		/* prlnbuf pointer */
+	int	 ip, i;		/* prlnbuf pointer */
+	int	 lp;
 
 	/* init variables */
-	lablptr = NULL;
-	continued_line = 0;
-	data_loccnt = -1;
-	data_size = 3;
-	data_level = 1;
+	ctx->lablptr = NULL;
+	ctx->continued_line = 0;
+	ctx->data_loccnt = -1;
+	ctx->data_size = 3;
+	ctx->data_level = 1;
+	ctx->fix_type = FIX_NONE;
 
 	/* macro definition */
-	if (in_macro) {
-		i = SFIELD;
-		if (colsym(&i))
-			if (prlnbuf[i] == ':')
+	if (ctx->in_macro) {
+		lex = ctx->lexptr;
+		if ((ctx->pass == LAST_PASS) && (lex) && (lex->state == LEX_MACRO)) {
+			println(ctx);
+			i = lex->arg_pos;
+			flag = lexload(ctx, lex);
+		}
+		else {
+			i = SFIELD;
+			if (colsym(ctx, &i))
+				if (ctx->prlnbuf[i] == ':')
+					i++;
+			while (cclass(ctx->prlnbuf[i]) & CC_SPACE)
 				i++;
-		while (isspace(prlnbuf[i]))
-			i++;
-		if (pass == LAST_PASS)
-			println();
-		if (oplook(&i) >= 0) {
-			if (opflg == PSEUDO) {
-				if (opval == P_MACRO) {
-					error("Can not nest macro definitions!");
+			if (ctx->pass == LAST_PASS)
+				println(ctx);
+			flag = oplook(ctx, &i);
+
+			/* keep the result for the last pass */
+			if ((ctx->pass == FIRST_PASS) && (lex) && (lex->state == LEX_NONE))
+				if ((flag != -1) && (i < ctx->lexlimit))
+					lexsave(ctx, lex, LEX_MACRO, flag, i);
+		}
+		if (flag >= 0) {
+			if (ctx->opflg == PSEUDO) {
+				if (ctx->opval == P_MACRO) {
+					error(ctx, "Can not nest macro definitions!");
 					return;
 				}
-				if (opval == P_ENDM) {
-					if (!check_eol(&i))
+				if (ctx->opval == P_ENDM) {
+					if (!check_eol(ctx, &i))
 						return;
-					in_macro = 0;
+					ctx->in_macro = 0;
 					return;
 				}
 			}
 		}
-		if (pass == FIRST_PASS) {
-			ptr = (void *)malloc(sizeof(struct t_line));
-			buf = (void *)malloc(strlen(&prlnbuf[SFIELD]) + 1);
+		if ((ctx->pass == FIRST_PASS) || ctx->single_pass) {
+			ptr = arena_alloc(&ctx->macro_arena, sizeof(struct t_line));
+			buf = arena_strdup(&ctx->macro_arena, &ctx->prlnbuf[SFIELD]);
 			if ((ptr == NULL) || (buf == NULL)) {
-				error("Out of memory!");
+				error(ctx, "Out of memory!");
 				return;
 			}
-			strcpy(buf, &prlnbuf[SFIELD]);
 			ptr->next = NULL;
 			ptr->data = buf;
-			if (mlptr)
-			    mlptr->next = ptr;
+			memset(&ptr->lex, 0, sizeof(struct t_lexinfo));
+			if (!macro_parseline(ctx, ptr)) {
+				error(ctx, "Out of memory!");
+				return;
+			}
+			if (ctx->mlptr)
+			    ctx->mlptr->next = ptr;
 			else
-				mptr->line = ptr;
-		    mlptr = ptr;
+				ctx->mptr->line = ptr;
+		    ctx->mlptr = ptr;
 		}
 		return;
 	}
@@ -84,57 +97,71 @@ assemble(void)
 	 * check for a '.else' or '.endif'
 	 * to toggle state
 	 */
-	if (in_if) {
+	if (ctx->in_if) {
+		lex = ctx->lexptr;
 		i = SFIELD;
-		while (isspace(prlnbuf[i]))
+		while (cclass(ctx->prlnbuf[i]) & CC_SPACE)
 			i++;
-		if (oplook(&i) >= 0) {
-			if (opflg == PSEUDO) {
-				switch (opval) {
+		if ((ctx->pass == LAST_PASS) && (lex) && (lex->state == LEX_CODE) &&
+			(lex->label_len == 0) && (lex->macro == NULL)) {
+			i = lex->arg_pos;
+			flag = lexload(ctx, lex);
+		}
+		else
+			flag = oplook(ctx, &i);
+		if (flag >= 0) {
+			if (ctx->opflg == PSEUDO) {
+				switch (ctx->opval) {
 				case P_IF:			// .if
 				case P_IFDEF:		// .ifdef
 				case P_IFNDEF:		// .ifndef
-					if (skip_lines) {
-						if_level++;
-						if_state[if_level] = 0;
+					if (ctx->skip_lines) {
+						ctx->if_level++;
+						ctx->if_state[ctx->if_level] = 0;
 					}
 					break;
 
 				case P_ELSE:		// .else
-					if (!check_eol(&i))
+					if (!check_eol(ctx, &i))
 						return;
-					if (if_state[if_level]) {
-						skip_lines = !if_flag[if_level];
-						if (pass == LAST_PASS)
-							println();
+					if (ctx->if_state[ctx->if_level]) {
+						ctx->skip_lines = !ctx->if_flag[ctx->if_level];
+						if (ctx->skip_lines)
+							skip_begin(ctx);
+						else
+							skip_end(ctx);
+						if (ctx->pass == LAST_PASS)
+							println(ctx);
 					}
 					return;
 
 				case P_ENDIF:		// .endif
-					if (!check_eol(&i))
+					if (!check_eol(ctx, &i))
 						return;
-					if (if_state[if_level] && (pass == LAST_PASS))
-						println();
-					skip_lines = !if_state[if_level];
-					if_level--;
-					if (if_level == 0)
-						in_if = 0;
+					if (ctx->if_state[ctx->if_level] && (ctx->pass == LAST_PASS))
+						println(ctx);
+					if (ctx->skip_lines && ctx->if_state[ctx->if_level])
+						skip_end(ctx);
+					ctx->skip_lines = !ctx->if_state[ctx->if_level];
+					ctx->if_level--;
+					if (ctx->if_level == 0)
+						ctx->in_if = 0;
 					return;
 				}
 			}
 		}
 	}
 
-	if (skip_lines)
+	if (ctx->skip_lines)
 		return;
 
 	/* comment line */
-	c = prlnbuf[SFIELD];
+	c = ctx->prlnbuf[SFIELD];
 	if (c == ';' || c == '*' || c == '\0') {
 //		if (c == '\0')
-			lastlabl = NULL;
-		if (pass == LAST_PASS)
-			println();
+			ctx->lastlabl = NULL;
+		if (ctx->pass == LAST_PASS)
+			println(ctx);
 		return;
 	}
 
@@ -144,107 +171,131 @@ assemble(void)
 
 
 //..............................................................
-	/* search for a label */
-	i = SFIELD;
-	j = 0;
-	while (isspace(prlnbuf[i]))
-		i++;
-    local_check=prlnbuf[i + j];
-	for (;;) {
-		c = prlnbuf[i + j];
-		if (isdigit(c) && (j == 0))
-			break;
-		if (!isalnum(c) && (c != '_') && (c != '.') && (c != '@'))
-		{ if((local_check=='.' || local_check=='@') && ((c=='-') || (c=='+')))
-            { }
-          else { break;}
+	/* the line was already analyzed in the first pass */
+	lex = ctx->lexptr;
+	if ((ctx->pass == LAST_PASS) && (lex) && (lex->state == LEX_CODE)) {
+		if (lex->label_len) {
+			ctx->symbol[0] = lex->label_len;
+			memcpy(&ctx->symbol[1], &ctx->prlnbuf[lex->label_pos], lex->label_len);
+			ctx->symbol[lex->label_len + 1] = '\0';
+
+			/* global labels are kept, locals depend on the scope */
+			if (lex->label) {
+				ctx->lablptr = lex->label;
+				if (!ctx->in_region)
+					ctx->lablptr->refcnt++;
+			}
+			else if ((ctx->lablptr = stlook(ctx, 1)) == NULL)
+				return;
 		}
-
-		j++;
+		ip = lex->arg_pos;
+		ctx->mptr = lex->macro;
+		flag = ctx->mptr ? 0 : lexload(ctx, lex);
 	}
-	if ((j == 0) || ((i != SFIELD) && (c != ':')))
-		i = SFIELD;
 	else {
-		if (colsym(&i) != 0)
-			if ((lablptr = stlook(1)) == NULL)
-				return;
-		if ((lablptr) && (prlnbuf[i] == ':'))
-			i++;
-	}
+		/* get the label and the instruction or macro name */
+		lexline(ctx, &lx);
+		lp = 0;
+
+		if (lx.label_len) {
+			lp = lx.label_pos;
+			if (setsym(ctx, lx.label_pos, lx.label_len)) {
+				if ((ctx->lablptr = stlookh(ctx, lx.label_hash, 1)) == NULL)
+					return;
+			}
+			else {
+				/* reserved symbol, its colon is not skipped */
+				i = lx.label_pos + lx.label_len;
+				while (cclass(ctx->prlnbuf[i]) & CC_SPACE)
+					i++;
+				lexname(ctx, i, &lx);
+			}
+		}
 
-//..............................................................
-	/* skip spaces */
-	while (isspace(prlnbuf[i]))
-		i++;
+		/* is it a macro? */
+		flag = 0;
+		ip = lx.name_end;
+		ctx->mptr = macro_find(ctx, lx.macro, lx.macro_hash);
+
+		/* an instruction then */
+		if (ctx->mptr == NULL) {
+			ip = lx.op_end;
+			flag = opfind(ctx, &lx);
+		}
+
+		/* keep the result for the last pass */
+		if ((ctx->pass == FIRST_PASS) && (lex) && (lex->state == LEX_NONE)) {
+			if ((flag != -1) && (ip < ctx->lexlimit)) {
+				lexsave(ctx, lex, LEX_CODE, flag, ip);
+				lex->macro = ctx->mptr;
+				if (ctx->lablptr) {
+					lex->label_pos = lp;
+					lex->label_len = ctx->symbol[0];
+					if (ctx->symbol[1] != '.' && ctx->symbol[1] != '@')
+						lex->label = ctx->lablptr;
+				}
+			}
+		}
+	}
 
-	/* is it a macro? */
-	ip = i;
-	mptr = macro_look(&ip);
-	if (mptr) {
+	if (ctx->mptr) {
 		/* define label */
-		labldef(loccnt, 1);
+		labldef(ctx, ctx->loccnt, 1);
 
 		/* output location counter */
-		if (pass == LAST_PASS) {
-			if (!asm_opt[OPT_MACRO])
-				loadlc((page << 13) + loccnt, 0);
+		if (ctx->pass == LAST_PASS) {
+			if (!ctx->asm_opt[OPT_MACRO])
+				loadlc(ctx, (ctx->page << 13) + ctx->loccnt, 0);
 		}
 
 		/* get macro args */
-		if (!macro_getargs(ip))
+		if (!macro_getargs(ctx, ip))
 			return;
 
 		/* output line */
-		if (pass == LAST_PASS)
-			println();
+		if (ctx->pass == LAST_PASS)
+			println(ctx);
 
 		/* ok */
-		mcntmax++;
-		mcounter = mcntmax;
-		expand_macro = 1;
-		mlptr = mptr->line;
+		ctx->mcntmax++;
+		ctx->mcounter = ctx->mcntmax;
+		ctx->expand_macro = 1;
+		ctx->mlptr = ctx->mptr->line;
 		return;
 	}
 
-
-
-
-
-//..............................................................
-	/* an instruction then */
-	ip = i;
-	flag = oplook(&ip);
+	/* no instruction */
 	if (flag < 0) {
-		labldef(loccnt, 1);
+		labldef(ctx, ctx->loccnt, 1);
 		if (flag == -1)
-            { error("Unknown instruction!"); }
-		if ((flag == -2) && (pass == LAST_PASS)) {
-			if (lablptr)
-				loadlc(loccnt, 0);
-			println();
+            { error(ctx, "Unknown instruction!"); }
+		if ((flag == -2) && (ctx->pass == LAST_PASS)) {
+			if (ctx->lablptr)
+				loadlc(ctx, ctx->loccnt, 0);
+			println(ctx);
 		}
-		lastlabl = NULL;
+		ctx->lastlabl = NULL;
 		return;
 	}
 
 	/* generate code */
-	if (opflg == PSEUDO)
-		do_pseudo(&ip);
-	else if (labldef(loccnt, 1) == -1)
+	if (ctx->opflg == PSEUDO)
+		do_pseudo(ctx, &ip);
+	else if (labldef(ctx, ctx->loccnt, 1) == -1)
 		return;
 	else {
 		/* output infos */
-		data_loccnt = loccnt;
+		ctx->data_loccnt = ctx->loccnt;
 
 		/* check if we are in the CODE section */
-		if (section != S_CODE)
-			fatal_error("Instructions not allowed in this section!");
+		if (ctx->section != S_CODE)
+			fatal_error(ctx, "Instructions not allowed in this section!");
 
 		/* generate code */
-		opproc(&ip);
+		ctx->opproc(ctx, &ip);
 
 		/* reset last label pointer */
-		lastlabl = NULL;
+		ctx->lastlabl = NULL;
 	}
 }
 
@@ -259,91 +310,62 @@ assemble(void)
  */
 
 int
-oplook(int *idx)
+oplook(struct t_context *ctx, int *idx)
 {
-	struct t_opcode *ptr;
-	char name[16];
-	char c;
-	int flag;
-	int hash;
-	int	i;
+	struct t_lexline lx;
 
-	/* get instruction name */
-	i = 0;
-	opext = 0;
-	flag = 0;
-	hash = 0;
+	lexname(ctx, *idx, &lx);
+	*idx = lx.op_end;
 
-	for (;;) {
-		c = toupper(prlnbuf[*idx]);
-		if (c == ' ' || c == '\t' || c == '\0' || c == ';')
-			break;
-		if (!isalnum(c) && c != '.' && c != '@' && c != '*' && c != '=')
-			return (-1);
-		if (i == 15)
-			return (-1);
-
-		/* handle instruction extension */
-		if (c == '.' && i) {
-			if (flag)
-				return (-1);
-			flag = 1;
-			(*idx)++;
-			continue;
-		}
-		if (flag) {
-			if (opext)
-				return (-1);
-			opext = c;
-			(*idx)++;
-			continue;
-		}
+	return (opfind(ctx, &lx));
+}
 
-		/* store char */
-		name[i++] = c;
-		hash += c;
-		hash  = (hash << 3) + (hash >> 5) + c;
-		(*idx)++;
 
-		/* break if '=' directive */
-		if (c == '=')
-			break;
-	}
+/* ----
+ * opfind()
+ * ----
+ * search an instruction found by the line analysis,
+ * same return values as oplook()
+ */
 
-	/* check extension */
-	if (flag) {
-		if ((opext != 'L') && (opext != 'H'))
-			return (-1);
-	}
+int
+opfind(struct t_context *ctx, struct t_lexline *lx)
+{
+	const struct t_ophash *oh = ctx->machine->op_hash;
+	struct t_opcode *ptr;
+	unsigned int hash;
+	unsigned int slot;
+	int	i;
 
-	/* end name string */
-	name[i] = '\0';
+	ctx->opext = lx->opext;
 
-	/* return if no instruction */
-	if (i == 0)
-		return (-2);
+	/* no valid instruction name */
+	if ((i = lx->op_len) < 0)
+		return (i);
 
-	/* search the instruction in the hash table */
-	ptr = inst_tbl[hash & 0xFF];
-
-	while (ptr) {
-		if (!strcmp(name, ptr->name)) {
-			opproc = ptr->proc;
-			opflg  = ptr->flag;
-			opval  = ptr->value;
-			optype = ptr->type_idx;
-
-			if (opext) {
-				/* no extension for pseudos */
-				if (opflg == PSEUDO)
-					return (-1);
-				/* extension valid only for these addressing modes */
-				if (!(opflg & (IMM|ZP|ZP_X|ZP_IND_Y|ABS|ABS_X|ABS_Y)))
-					return (-1);
-			}
-			return (i);
+	/* search the instruction, the hash is perfect
+	 * so there is only one slot to check
+	 */
+	hash = lx->op_hash;
+	slot = ((hash >> 16) ^ oh->disp[hash & (oh->nb_disp - 1)]) & (oh->size - 1);
+
+	if ((oh->len[slot] == i) && !memcmp(lx->op, ctx->machine->op_tbl[slot]->name, i)) {
+		ptr = ctx->machine->op_tbl[slot];
+		ctx->opptr  = ptr;
+		ctx->opproc = ptr->proc;
+		ctx->opflg  = ptr->flag;
+		ctx->opval  = ptr->value;
+		ctx->optype = ptr->type_idx;
+
+		if (ctx->opext) {
+			/* no extension for pseudos */
+			if (ctx->opflg == PSEUDO)
+				return (-1);
+			/* extension valid only for these addressing modes */
+			if (!(ctx->opflg & (IMM|ZP|ZP_X|ZP_IND_Y|ABS|ABS_X|ABS_Y)))
+				return (-1);
 		}
-		ptr = ptr->next;
+		return (i);
 	}
 
 	/* didn't find this instruction */
@@ -352,46 +374,85 @@ oplook(int *idx)
 
 
 /* ----
- * addinst()
+ * lexsave()
  * ----
- * add a list of instructions to the instruction
- * hash table
+ * keep the result of a line analysis, the last pass
+ * will use it instead of parsing the line again
  */
 
 void
-addinst(struct t_opcode *optbl)
+lexsave(struct t_context *ctx, struct t_lexinfo *lex, int state, int flag, int ip)
 {
-	int hash;
-	int len;
-	int i;
-	char *ptr;
-	char  c;
+	lex->state   = state;
+	lex->opcode  = (flag < 0) ? NULL : ctx->opptr;
+	lex->opext   = ctx->opext;
+	lex->arg_pos = ip;
+	lex->macro   = NULL;
+	lex->label   = NULL;
+	lex->label_pos = 0;
+	lex->label_len = 0;
+}
 
-	if (optbl == NULL)
-		return;
 
-	/* parse list */
-	while (optbl->name) {
-		/* calculate instruction hash value */
-		hash = 0;
-		len  = strlen(optbl->name);
-		ptr  = optbl->name;
-
-		for (i = 0; i < len; i++) {
-			c = *ptr++;
-			hash += c;
-			hash  = (hash << 3) + (hash >> 5) + c;
-		}
+/* ----
+ * lexload()
+ * ----
+ * restore the instruction found by a previous line analysis
+ * return 0 if found, -2 if no instruction
+ */
+
+int
+lexload(struct t_context *ctx, struct t_lexinfo *lex)
+{
+	ctx->opext = lex->opext;
+
+	if ((ctx->opptr = lex->opcode) == NULL)
+		return (-2);
+
+	ctx->opproc = ctx->opptr->proc;
+	ctx->opflg  = ctx->opptr->flag;
+	ctx->opval  = ctx->opptr->value;
+	ctx->optype = ctx->opptr->type_idx;
+	return (0);
+}
+
+
+/* ----
+ * opinit()
+ * ----
+ * fill the instruction table of a machine from its
+ * perfect hash, 'optbl' holds the base instructions,
+ * the base pseudos and the machine instructions and
+ * pseudos; return 0 if there is not enough memory,
+ * or if the hash was not generated from these tables
+ */
 
-		hash &= 0xFF;
+int
+opinit(struct t_machine *mach, const struct t_ophash *hash, struct t_opcode **optbl)
+{
+	int op;
+	int i;
+
+	mach->op_tbl = (void *)calloc(hash->size, sizeof(struct t_opcode *));
+	if (mach->op_tbl == NULL)
+		return (0);
 
-		/* insert the instruction in the hash table */
-		optbl->next = inst_tbl[hash];
-		inst_tbl[hash] = optbl;
+	for (i = 0; i < hash->size; i++) {
+		if ((op = hash->slot[i]) < 0)
+			continue;
+		mach->op_tbl[i] = &optbl[op >> 8][op & 0xFF];
 
-		/* next instruction */
-		optbl++;
+		/* same name at that index */
+		if ((mach->op_tbl[i]->name == NULL) || strcmp(mach->op_tbl[i]->name, hash->name[i])) {
+			free(mach->op_tbl);
+			mach->op_tbl = NULL;
+			return (0);
+		}
 	}
+	mach->op_hash = hash;
+
+	/* ok */
+	return (1);
 }
 
 
@@ -402,14 +463,14 @@ addinst(struct t_opcode *optbl)
  */
 
 int
-check_eol(int *ip)
+check_eol(struct t_context *ctx, int *ip)
 {
-	while (isspace(prlnbuf[*ip]))
+	while (cclass(ctx->prlnbuf[*ip]) & CC_SPACE)
 		(*ip)++;
-	if (prlnbuf[*ip] == ';' || prlnbuf[*ip] == '\0')
+	if (ctx->prlnbuf[*ip] == ';' || ctx->prlnbuf[*ip] == '\0')
 		return (1);
 	else {
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return (0);
 	}
 }
@@ -417,97 +478,193 @@ check_eol(int *ip)
 /* .if pseudo */
 
 void
-do_if(int *ip)
+do_if(struct t_context *ctx, int *ip)
 {
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get expression */
-	if_expr = 1;
-	if (!evaluate(ip, ';')) {
-		if_expr = 0;
+	ctx->if_expr = 1;
+	if (!evaluate(ctx, ip, ';')) {
+		ctx->if_expr = 0;
 		return;
 	}
-	if_expr = 0;
+	ctx->if_expr = 0;
 
 	/* check for '.if' stack overflow */
-	if (if_level == 255) {
-		fatal_error("Too many nested IF/ENDIF!");
+	if (ctx->if_level == 255) {
+		fatal_error(ctx, "Too many nested IF/ENDIF!");
 		return;
 	}
-	in_if = 1;
-	if_level++;
-	if_state[if_level] = !skip_lines;
-	if (!skip_lines)
-		 skip_lines = if_flag[if_level] = value ? 0 : 1;
-
-	if (pass == LAST_PASS) {
-		loadlc(value, 1);
-		println();
+	ctx->in_if = 1;
+	ctx->if_level++;
+	ctx->if_state[ctx->if_level] = !ctx->skip_lines;
+	if (!ctx->skip_lines) {
+		ctx->skip_lines = ctx->if_flag[ctx->if_level] = ctx->value ? 0 : 1;
+		if (ctx->skip_lines)
+			skip_begin(ctx);
+	}
+
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value, 1);
+		println(ctx);
 	}
 }
 
 /* .else pseudo */
 
 void
-do_else(int *ip)
+do_else(struct t_context *ctx, int *ip)
 {
     (void)ip;
-	if (!in_if)
-		fatal_error("Unexpected ELSE!");
+	if (!ctx->in_if)
+		fatal_error(ctx, "Unexpected ELSE!");
 }
 
 /* .endif pseudo */
 
 void
-do_endif(int *ip)
+do_endif(struct t_context *ctx, int *ip)
 {
     (void)ip;
-	if (!in_if)
-		fatal_error("Unexpected ENDIF!");
+	if (!ctx->in_if)
+		fatal_error(ctx, "Unexpected ENDIF!");
 }
 
 /* .ifdef/.ifndef pseudo */
 
 void
-do_ifdef(int *ip)
+do_ifdef(struct t_context *ctx, int *ip)
 {
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* get symbol */
-	if (!colsym(ip)) {
-		error("Syntax error!");
+	if (!colsym(ctx, ip)) {
+		error(ctx, "Syntax error!");
 		return;
 	}
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
-	lablptr = stlook(0);
+	ctx->lablptr = stlook(ctx, 0);
+
+	/* the symbol could be seen later */
+	if ((ctx->lablptr == NULL) && ctx->single_pass)
+		fixup_probe(ctx, FIX_IFDEF, ctx->symbol, st_hash(ctx->symbol));
 
 	/* check for '.if' stack overflow */
-	if (if_level == 255) {
-		fatal_error("Too many nested IF/ENDIF!");
+	if (ctx->if_level == 255) {
+		fatal_error(ctx, "Too many nested IF/ENDIF!");
 		return;
 	}
-	in_if = 1;
-	if_level++;
-	if_state[if_level] = !skip_lines;
-	if (!skip_lines) {
-		if (optype) {
+	ctx->in_if = 1;
+	ctx->if_level++;
+	ctx->if_state[ctx->if_level] = !ctx->skip_lines;
+	if (!ctx->skip_lines) {
+		if (ctx->optype) {
 			/* .ifdef */
-			skip_lines = if_flag[if_level] = (lablptr == NULL) ? 1 : 0;
+			ctx->skip_lines = ctx->if_flag[ctx->if_level] = (ctx->lablptr == NULL) ? 1 : 0;
 		}
 		else {
 			/* .ifndef */
-			skip_lines = if_flag[if_level] = (lablptr == NULL) ? 0 : 1;
+			ctx->skip_lines = ctx->if_flag[ctx->if_level] = (ctx->lablptr == NULL) ? 0 : 1;
 		}
+		if (ctx->skip_lines)
+			skip_begin(ctx);
 	}
 
-	if (pass == LAST_PASS) {
-		loadlc(!skip_lines, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, !ctx->skip_lines, 1);
+		println(ctx);
 	}
 }
 
+/* ----
+ * skip_begin()
+ * ----
+ * a block is disabled by the current line, remember it if it's
+ * a source line so the end of the block can be kept
+ */
+
+void
+skip_begin(struct t_context *ctx)
+{
+	struct t_source *src;
+
+	ctx->skip_start = NULL;
+	if (ctx->expand_macro || (ctx->infile_num == 0))
+		return;
+
+	src = ctx->input_file[ctx->infile_num].src;
+	if ((ctx->slnum > 0) && (ctx->slnum <= src->nb_lines))
+		ctx->skip_start = &src->line[ctx->slnum - 1];
+}
+
+
+/* ----
+ * skip_end()
+ * ----
+ * the disabled block ends on the current line; the blocks are
+ * only made of source lines of a same file, the next passes can
+ * go directly to the end of the block; the regions of a parallel
+ * last pass share the lines, they don't keep it
+ */
+
+void
+skip_end(struct t_context *ctx)
+{
+	struct t_source *src;
+
+	if (ctx->skip_start && !ctx->expand_macro && !ctx->in_region) {
+		src = ctx->input_file[ctx->infile_num].src;
+		if ((ctx->skip_start >= src->line) &&
+			(ctx->skip_start < &src->line[ctx->slnum - 1]))
+			ctx->skip_start->skip_end = ctx->slnum;
+	}
+	ctx->skip_start = NULL;
+}
+
+
+/* ----
+ * skip_scan()
+ * ----
+ * move to the next source line of a disabled block that can be
+ * a conditional directive, the other lines are not even read;
+ * goes directly to the end of the block if it is known; the
+ * lines are still counted, the regions of a parallel last pass
+ * are found by their count in the first pass
+ */
+
+void
+skip_scan(struct t_context *ctx)
+{
+	struct t_source *src;
+	unsigned char *ptr;
+	int c, slnum;
+
+	src = ctx->input_file[ctx->infile_num].src;
+	slnum = ctx->slnum;
+
+	/* end of the block found in a previous pass */
+	if (ctx->skip_start && (ctx->skip_start->skip_end > ctx->slnum) &&
+		(ctx->skip_start == &src->line[ctx->slnum - 1]))
+		ctx->slnum = ctx->skip_start->skip_end - 1;
+
+	/* the conditional directives are the first word of the line,
+	 * IF, IFDEF, IFNDEF, ELSE and ENDIF, with or without a dot
+	 */
+	while (ctx->slnum < src->nb_lines) {
+		ptr = (unsigned char *)src->line[ctx->slnum].data;
+		while (cclass(*ptr) & CC_SPACE)
+			ptr++;
+		if (*ptr == '.')
+			ptr++;
+		c = *ptr | 0x20;
+		if ((c == 'i') || (c == 'e'))
+			break;
+		ctx->slnum++;
+	}
+	ctx->line_cnt += ctx->slnum - slnum;
+}
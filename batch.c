@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+#include "pceas.h"
+
+#ifdef WIN32
+#define batch_lock(b)
+#define batch_unlock(b)
+#else
+#include <unistd.h>
+#define batch_lock(b)   pthread_mutex_lock(&(b)->lock)
+#define batch_unlock(b) pthread_mutex_unlock(&(b)->lock)
+#endif
+
+#define BATCH_MAX_ARGS	64
+#define BATCH_MAX_JOBS	64
+
+
+/* ----
+ * batch_run()
+ * ----
+ * assemble the targets listed in the batch file, each line holds
+ * the options and the input file of a target; they are added to
+ * the command line options and the targets are assembled by
+ * several threads sharing the include files
+ */
+
+int
+batch_run(int argc, char **argv)
+{
+	struct t_batch batch;
+	struct t_target *target;
+	struct t_shared *shared;
+	char *args[BATCH_MAX_ARGS];
+	char  line[1024];
+	FILE *fp;
+	int   nb_args, max_targets;
+	int   nb_jobs;
+	int   lnum;
+	int   i, j;
+#ifndef WIN32
+	pthread_t thread[BATCH_MAX_JOBS];
+#endif
+
+	/* open the batch file */
+	if ((fp = fopen(batch_name, "r")) == NULL) {
+		printf("Can not open batch file '%s'!\n", batch_name);
+		return (1);
+	}
+	if ((shared = pceas_shared_new()) == NULL) {
+		fclose(fp);
+		printf("Not enough memory!\n");
+		return (1);
+	}
+
+	memset(&batch, 0, sizeof(batch));
+	max_targets = 0;
+	lnum = 0;
+
+	/* get the targets */
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lnum++;
+
+		/* skip empty lines and comments */
+		nb_args = batch_parse(line, args, BATCH_MAX_ARGS);
+		if (nb_args == 0)
+			continue;
+		if (nb_args < 0) {
+			printf("%s(%i): too many arguments!\n", batch_name, lnum);
+			batch.errcnt++;
+			continue;
+		}
+
+		/* grow the target list */
+		if (batch.nb_targets == max_targets) {
+			max_targets = max_targets ? (max_targets * 2) : 16;
+			target = (void *)realloc(batch.target, max_targets * sizeof(struct t_target));
+			if (target == NULL) {
+				printf("Not enough memory!\n");
+				batch.errcnt++;
+				break;
+			}
+			batch.target = target;
+		}
+		target = &batch.target[batch.nb_targets];
+
+		/* the target command line is the batch
+		 * command line followed by the target options
+		 */
+		target->line = lnum;
+		target->ret  = 1;
+		target->argc = argc + nb_args;
+		target->argv = (void *)malloc((target->argc + 1) * sizeof(char *));
+		target->ctx  = new_context();
+
+		if ((target->argv == NULL) || (target->ctx == NULL)) {
+			free(target->argv);
+			pceas_delete(target->ctx);
+			printf("Not enough memory!\n");
+			batch.errcnt++;
+			break;
+		}
+		for (i = 0; i < argc; i++)
+			target->argv[i] = argv[i];
+		for (i = 0; i < nb_args; i++)
+			target->argv[argc + i] = strdup(args[i]);
+		target->argv[target->argc] = NULL;
+
+		/* get the target options */
+		if ((get_options(target->ctx, target->argc, target->argv) >= 0) ||
+			(target->ctx->in_fname[0] == '\0')) {
+			printf("%s(%i): invalid target!\n", batch_name, lnum);
+			batch.errcnt++;
+			pceas_delete(target->ctx);
+			for (i = 0; i < nb_args; i++)
+				free(target->argv[argc + i]);
+			free(target->argv);
+			continue;
+		}
+
+		/* messages are kept until the target is done */
+		pceas_set_messages(target->ctx, NULL);
+		pceas_set_shared(target->ctx, shared);
+		init_path(target->ctx);
+		batch.nb_targets++;
+	}
+	fclose(fp);
+
+	/* number of threads */
+	nb_jobs = batch_jobs;
+#ifndef WIN32
+	if (nb_jobs <= 0)
+		nb_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nb_jobs > batch.nb_targets)
+		nb_jobs = batch.nb_targets;
+	if (nb_jobs > BATCH_MAX_JOBS)
+		nb_jobs = BATCH_MAX_JOBS;
+	if (nb_jobs < 1)
+		nb_jobs = 1;
+
+	/* assemble */
+#ifdef WIN32
+	batch_worker(&batch);
+#else
+	pthread_mutex_init(&batch.lock, NULL);
+
+	for (i = 0, j = 0; i < nb_jobs; i++) {
+		if (pthread_create(&thread[j], NULL, batch_worker, &batch) == 0)
+			j++;
+	}
+
+	/* no thread could be started, do the job */
+	if (j == 0)
+		batch_worker(&batch);
+
+	while (j)
+		pthread_join(thread[--j], NULL);
+
+	pthread_mutex_destroy(&batch.lock);
+#endif
+
+	/* cleanup */
+	for (i = 0; i < batch.nb_targets; i++) {
+		target = &batch.target[i];
+		for (j = argc; j < target->argc; j++)
+			free(target->argv[j]);
+		free(target->argv);
+	}
+	free(batch.target);
+	pceas_shared_delete(shared);
+
+	/* result */
+	if (batch.errcnt) {
+		printf("# %d target(s) failed\n", batch.errcnt);
+		return (1);
+	}
+	return (0);
+}
+
+
+/* ----
+ * batch_worker()
+ * ----
+ * assemble targets until there are no more left
+ */
+
+void *
+batch_worker(void *arg)
+{
+	struct t_batch *batch = arg;
+	struct t_target *target;
+	const unsigned char *msg;
+	int i;
+
+	for (;;) {
+		/* get a target */
+		batch_lock(batch);
+		i = batch->next++;
+		batch_unlock(batch);
+
+		if (i >= batch->nb_targets)
+			break;
+		target = &batch->target[i];
+
+		/* assemble */
+		target->ret = assemble_target(target->ctx, target->argc, target->argv);
+
+		/* display its messages */
+		batch_lock(batch);
+		printf("[%s]\n", target->ctx->in_fname);
+		if ((msg = pceas_output(target->ctx, PCEAS_OUT_MSG, NULL)) != NULL)
+			fputs((const char *)msg, stdout);
+		fflush(stdout);
+		if (target->ret)
+			batch->errcnt++;
+		batch_unlock(batch);
+
+		/* free the context, the outputs are saved */
+		pceas_delete(target->ctx);
+		target->ctx = NULL;
+	}
+
+	return (NULL);
+}
+
+
+/* ----
+ * batch_parse()
+ * ----
+ * split a line of the batch file into arguments, double quotes
+ * can be used for names with spaces; the line is modified,
+ * return the number of arguments or -1 if there are too many
+ */
+
+int
+batch_parse(char *line, char **argv, int max)
+{
+	char *ptr, *dst;
+	int   nb;
+
+	nb  = 0;
+	ptr = line;
+
+	for (;;) {
+		/* skip spaces */
+		while ((*ptr == ' ') || (*ptr == '\t') || (*ptr == '\r') || (*ptr == '\n'))
+			ptr++;
+
+		/* end of line or comment */
+		if ((*ptr == '\0') || (*ptr == '#') || (*ptr == ';'))
+			break;
+		if (nb == max)
+			return (-1);
+
+		/* get an argument */
+		argv[nb++] = dst = ptr;
+
+		while (*ptr && (*ptr != ' ') && (*ptr != '\t') && (*ptr != '\r') && (*ptr != '\n')) {
+			if (*ptr == '"') {
+				ptr++;
+				while (*ptr && (*ptr != '"'))
+					*dst++ = *ptr++;
+				if (*ptr)
+					ptr++;
+			}
+			else
+				*dst++ = *ptr++;
+		}
+		if (*ptr)
+			ptr++;
+		*dst = '\0';
+	}
+
+	return (nb);
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+#ifdef WIN32
+#include <direct.h>
+#include <process.h>
+#define mkdir(name, mode) _mkdir(name)
+#define getpid _getpid
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_MAGIC "pceas-cache 1"
+
+/* options not part of the cache key, they have an argument */
+static const char *cache_skip_opt[] = { "cache", "batch", "jobs", "j", NULL };
+
+
+/* ----
+ * cache_hash()
+ * ----
+ * 64-bit FNV-1a hash
+ */
+
+unsigned long long
+cache_hash(unsigned long long hash, void *data, int len)
+{
+	unsigned char *ptr = data;
+
+	while (len--) {
+		hash ^= *ptr++;
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+
+/* ----
+ * cache_filehash()
+ * ----
+ * hash a file content, return 0 if the file can not be read
+ */
+
+int
+cache_filehash(char *name, unsigned long long *hash)
+{
+	unsigned char buf[4096];
+	FILE *fp;
+	int   len, err;
+
+	if ((fp = fopen(name, "rb")) == NULL)
+		return (0);
+
+	*hash = 0xcbf29ce484222325ULL;
+	while ((len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		*hash = cache_hash(*hash, buf, len);
+	err = ferror(fp);
+	fclose(fp);
+	return (!err);
+}
+
+
+/* ----
+ * cache_copy()
+ * ----
+ * copy a file, the copy must have the content hashed in
+ * 'hash'; return 0 if it can not be made or is different
+ */
+
+int
+cache_copy(char *dst, char *src, unsigned long long hash)
+{
+	unsigned char buf[4096];
+	unsigned long long h;
+	FILE *in, *out;
+	size_t len;
+	int   err;
+
+	if ((in = fopen(src, "rb")) == NULL)
+		return (0);
+	if ((out = fopen(dst, "wb")) == NULL) {
+		fclose(in);
+		return (0);
+	}
+
+	err = 0;
+	h = 0xcbf29ce484222325ULL;
+	while ((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if (fwrite(buf, 1, len, out) != len) {
+			err = 1;
+			break;
+		}
+		h = cache_hash(h, buf, (int)len);
+	}
+	if (ferror(in))
+		err = 1;
+	fclose(in);
+	if (fclose(out))
+		err = 1;
+
+	/* a file changed or cut short is not used */
+	if (h != hash)
+		err = 1;
+	return (!err);
+}
+
+
+/* ----
+ * cache_add()
+ * ----
+ * add a file to a cache file list, files are only added once
+ */
+
+void
+cache_add(struct t_context *ctx, struct t_cachefile **list, char *name, char *path)
+{
+	struct t_cachefile *file, **last;
+
+	if (!ctx->cache_rec)
+		return;
+
+	/* check if the file is already in the list */
+	for (last = list; *last; last = &(*last)->next) {
+		if (!strcmp((*last)->path, path) && !strcmp((*last)->name, name))
+			return;
+	}
+
+	/* add it */
+	if ((file = (void *)malloc(sizeof(struct t_cachefile))) == NULL) {
+		ctx->cache_rec = 0;
+		return;
+	}
+	if (!cache_filehash(path, &file->hash)) {
+		/* the build can not be cached if the file can't be read */
+		free(file);
+		ctx->cache_rec = 0;
+		return;
+	}
+	strncpy(file->name, name, sizeof(file->name) - 1);
+	file->name[sizeof(file->name) - 1] = '\0';
+	strncpy(file->path, path, sizeof(file->path) - 1);
+	file->path[sizeof(file->path) - 1] = '\0';
+	file->next = NULL;
+	*last = file;
+}
+
+
+/* ----
+ * cache_dep()
+ * ----
+ * record a file read during the assembly, 'name' is the file
+ * name given in the source and 'path' the file found in the
+ * include path
+ */
+
+void
+cache_dep(struct t_context *ctx, char *name, char *path)
+{
+	cache_add(ctx, &ctx->dep_list, name, path);
+}
+
+
+/* ----
+ * cache_out()
+ * ----
+ * record a file written by the assembler
+ */
+
+void
+cache_out(struct t_context *ctx, char *name)
+{
+	cache_add(ctx, &ctx->out_list, name, name);
+}
+
+
+/* ----
+ * cache_manifest()
+ * ----
+ * get the manifest file name of the current build
+ */
+
+void
+cache_manifest(struct t_context *ctx, char *name)
+{
+	sprintf(name, "%s%s%016llx.man", ctx->cache_dir, PATH_SEPARATOR_STRING, ctx->cache_key);
+}
+
+
+/* ----
+ * cache_skip()
+ * ----
+ * check if a command line argument is an option that does not
+ * change the outputs, return the number of arguments used by
+ * the option or 0
+ */
+
+int
+cache_skip(char *arg)
+{
+	int i, l, n;
+
+	l = strspn(arg, "-");
+	if ((l != 1) && (l != 2))
+		return (0);
+
+	for (i = 0; cache_skip_opt[i]; i++) {
+		n = strlen(cache_skip_opt[i]);
+		if (strncmp(&arg[l], cache_skip_opt[i], n))
+			continue;
+		if (arg[l + n] == '\0')
+			return (2);
+		if (arg[l + n] == '=')
+			return (1);
+		if ((n == 1) && (l == 1))
+			return (1);
+	}
+	return (0);
+}
+
+
+/* ----
+ * cache_lookup()
+ * ----
+ * build the cache key from the command line options and the
+ * include path, then check if an identical build was already
+ * done; in this case restore its outputs and return 1
+ */
+
+int
+cache_lookup(struct t_context *ctx, int argc, char **argv)
+{
+	struct t_cachefile *file, *list, *next;
+	unsigned long long hash, h;
+	char  line[1024];
+	char  name[512];
+	char  path[512];
+	char  found[256];
+	char  type[8];
+	char *env;
+	FILE *fp, *dep;
+	int   valid;
+	int   i, l;
+
+	/* the key covers the assembler version, the options and the
+	 * include path; the cache directory and the batch options are
+	 * not part of it
+	 */
+	ctx->cache_key = 0xcbf29ce484222325ULL;
+	ctx->cache_key = cache_hash(ctx->cache_key, CACHE_MAGIC, strlen(CACHE_MAGIC) + 1);
+	ctx->cache_key = cache_hash(ctx->cache_key, ctx->machine->asm_title, strlen(ctx->machine->asm_title) + 1);
+	ctx->cache_key = cache_hash(ctx->cache_key, __DATE__ __TIME__, strlen(__DATE__ __TIME__) + 1);
+
+	for (i = 1; i < argc; i++) {
+		if ((l = cache_skip(argv[i])) != 0) {
+			i += l - 1;
+			continue;
+		}
+		ctx->cache_key = cache_hash(ctx->cache_key, argv[i], strlen(argv[i]) + 1);
+	}
+
+	env = getenv(ctx->machine->include_env);
+	if (env)
+		ctx->cache_key = cache_hash(ctx->cache_key, env, strlen(env) + 1);
+	ctx->cache_key = cache_hash(ctx->cache_key, "", 1);
+
+	/* from now on, record the files read by the assembler */
+	ctx->cache_rec = 1;
+
+	/* read the manifest */
+	cache_manifest(ctx, name);
+	if ((fp = fopen(name, "r")) == NULL)
+		return (0);
+
+	valid = 0;
+	list  = NULL;
+
+	if (fgets(line, sizeof(line), fp) && !strncmp(line, CACHE_MAGIC, strlen(CACHE_MAGIC))) {
+		valid = 1;
+
+		while (fgets(line, sizeof(line), fp)) {
+			if (sscanf(line, "%7[^\t]\t%llx\t%511[^\t]\t%511[^\n]", type, &hash, path, name) != 4) {
+				valid = 0;
+				break;
+			}
+
+			/* dependency, search it again in the include path
+			 * and check that it's still the same file
+			 */
+			if (!strcmp(type, "dep")) {
+				if ((dep = search_file(ctx, name, "rb", found)) == NULL) {
+					valid = 0;
+					break;
+				}
+				fclose(dep);
+				if (strcmp(found, path) || !cache_filehash(found, &h) || (h != hash)) {
+					valid = 0;
+					break;
+				}
+			}
+
+			/* output */
+			else if (!strcmp(type, "out")) {
+				if ((file = (void *)malloc(sizeof(struct t_cachefile))) == NULL) {
+					valid = 0;
+					break;
+				}
+				file->hash = hash;
+				strncpy(file->name, name, sizeof(file->name) - 1);
+				file->name[sizeof(file->name) - 1] = '\0';
+				file->next = list;
+				list = file;
+			}
+			else {
+				valid = 0;
+				break;
+			}
+		}
+	}
+	fclose(fp);
+
+	/* restore outputs */
+	for (file = list; file && valid; file = file->next) {
+		sprintf(path, "%s%s%016llx.bin", ctx->cache_dir, PATH_SEPARATOR_STRING, file->hash);
+		if (!cache_copy(file->name, path, file->hash)) {
+			msg_printf(ctx, "Can not restore '%s' from the cache!\n", file->name);
+			valid = 0;
+		}
+	}
+	for (file = list; file; file = next) {
+		next = file->next;
+		free(file);
+	}
+
+	if (valid) {
+		msg_printf(ctx, "outputs restored from cache\n");
+		ctx->cache_rec = 0;
+	}
+
+	return (valid);
+}
+
+
+/* ----
+ * cache_store()
+ * ----
+ * save the outputs of the current build in the cache
+ */
+
+void
+cache_store(struct t_context *ctx)
+{
+	struct t_cachefile *file;
+	char  name[512];
+	char  temp[576];
+	unsigned long long hash;
+	FILE *fp;
+	int   err;
+
+	if (!ctx->cache_rec)
+		return;
+
+	mkdir(ctx->cache_dir, 0777);
+
+	/* store outputs, they are named after their content so
+	 * identical outputs of different builds are shared; a
+	 * damaged copy already in the cache is replaced
+	 */
+	for (file = ctx->out_list; file; file = file->next) {
+		sprintf(name, "%s%s%016llx.bin", ctx->cache_dir, PATH_SEPARATOR_STRING, file->hash);
+		if (cache_filehash(name, &hash) && (hash == file->hash))
+			continue;
+		sprintf(temp, "%s.%d.%lx", name, (int)getpid(), (unsigned long)(size_t)ctx);
+		if (!cache_copy(temp, file->path, file->hash)) {
+			remove(temp);
+			return;
+		}
+		remove(name);
+		if (rename(temp, name)) {
+			remove(temp);
+			return;
+		}
+	}
+
+	/* write the manifest */
+	cache_manifest(ctx, name);
+	sprintf(temp, "%s.%d.%lx", name, (int)getpid(), (unsigned long)(size_t)ctx);
+
+	if ((fp = fopen(temp, "w")) == NULL)
+		return;
+
+	fprintf(fp, "%s\n", CACHE_MAGIC);
+	for (file = ctx->dep_list; file; file = file->next)
+		fprintf(fp, "dep\t%016llx\t%s\t%s\n", file->hash, file->path, file->name);
+	for (file = ctx->out_list; file; file = file->next)
+		fprintf(fp, "out\t%016llx\t%s\t%s\n", file->hash, file->path, file->name);
+
+	/* an incomplete manifest is never used */
+	err = ferror(fp);
+	if (fclose(fp) || err || rename(temp, name))
+		remove(temp);
+}
@@ -5,9 +5,20 @@
 #include "externs.h"
 #include "protos.h"
 
-unsigned char auto_inc;
-unsigned char auto_tag;
-unsigned int  auto_tag_value;
+int  opvaltab[6][16] = {
+   {0x08, 0x08, 0x04, 0x14, 0x14, 0x11, 0x00, 0x10,  // CPX CPY LDX LDY
+	0x0C, 0x1C, 0x18, 0x2C, 0x3C, 0x00, 0x00, 0x00},
+   {0x00, 0x00, 0x04, 0x14, 0x14, 0x00, 0x00, 0x00,  // ST0 ST1 ST2 TAM TMA
+	0x0C, 0x1C, 0x1C, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x00, 0x89, 0x24, 0x34, 0x00, 0x00, 0x00, 0x00,  // BIT
+	0x2C, 0x3C, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x3A, 0x00, 0xC6, 0xD6, 0x00, 0x00, 0x00, 0x00,  // DEC
+	0xCE, 0xDE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x1A, 0x00, 0xE6, 0xF6, 0x00, 0x00, 0x00, 0x00,  // INC
+	0xEE, 0xFE, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+   {0x00, 0x00, 0x64, 0x74, 0x00, 0x00, 0x00, 0x00,  // STZ
+	0x9C, 0x9E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+};
 
 
 /* ----
@@ -17,20 +28,20 @@ unsigned int  auto_tag_value;
  */
 
 void
-class1(int *ip)
+class1(struct t_context *ctx, int *ip)
 {
-	check_eol(ip);
+	check_eol(ctx, ip);
 
 	/* update location counter */
-	loccnt++;
+	ctx->loccnt++;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcode */
-		putbyte(data_loccnt, opval);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -42,36 +53,39 @@ class1(int *ip)
  */
 
 void
-class2(int *ip)
+class2(struct t_context *ctx, int *ip)
 {
 	unsigned int addr;
 
 	/* update location counter */
-	loccnt += 2;
+	ctx->loccnt += 2;
 
 	/* get destination address */
-	if (!evaluate(ip, ';'))
+	ctx->fix_type = FIX_REL;
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcode */
-		putbyte(data_loccnt, opval);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
 
 		/* calculate branch offset */
-		addr = value - (loccnt + (page << 13));
+		addr = ctx->value - (ctx->loccnt + (ctx->page << 13));
 
-		/* check range */
-		if (addr > 0x7F && addr < 0xFFFFFF80) {
-			error("Branch address out of range!");
+		/* check range, a forward branch is checked once patched */
+		if (addr > 0x7F && addr < 0xFFFFFF80 && !ctx->fix_pend) {
+			fixup_error(ctx, "Branch address out of range!");
 			return;
 		}
 
 		/* offset */
-		putbyte(data_loccnt+1, addr);
+		putbyte(ctx, ctx->data_loccnt+1, addr);
+		if (ctx->fix_pend)
+			fixup_place(ctx, ctx->data_loccnt+1);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -83,21 +97,21 @@ class2(int *ip)
  */
 
 void
-class3(int *ip)
+class3(struct t_context *ctx, int *ip)
 {
-	check_eol(ip);
+	check_eol(ctx, ip);
 
 	/* update location counter */
-	loccnt += 2;
+	ctx->loccnt += 2;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcodes */
-		putbyte(data_loccnt, opval);
-		putbyte(data_loccnt+1, optype);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
+		putbyte(ctx, ctx->data_loccnt+1, ctx->optype);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -109,7 +123,7 @@ class3(int *ip)
  */
 
 void
-class4(int *ip)
+class4(struct t_context *ctx, int *ip)
 {
 	char buffer[32];
 	char c;
@@ -117,17 +131,17 @@ class4(int *ip)
 	int	i;
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* low/high byte prefix string */
-	if (isalpha(prlnbuf[*ip])) {
+	if (isalpha(ctx->prlnbuf[*ip])) {
 		len = 0;
 		i = *ip;
 
 		/* extract string */
 		for (;;) {
-			c = prlnbuf[i];
+			c = ctx->prlnbuf[i];
 			if (c == '\0' || c == ' ' || c == '\t' || c == ';')
 				break;
 			if ((!isalpha(c) && c != '_') || (len == 31)) {
@@ -143,47 +157,48 @@ class4(int *ip)
 			buffer[len] = '\0';
 
 			if (strcasecmp(buffer, "low_byte") == 0) {
-				opext = 'L';
+				ctx->opext = 'L';
 				*ip = i;
 			}
 			if (strcasecmp(buffer, "high_byte") == 0) {
-				opext = 'H';
+				ctx->opext = 'H';
 				*ip = i;
 			}
 		}
 	}
 
 	/* get operand */
-	mode = getoperand(ip, opflg, ';');
+	ctx->fix_type = FIX_OPERAND;
+	mode = getoperand(ctx, ip, ctx->opflg, ';');
 	if (!mode)
 		return;
 
 	/* make opcode */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		for (i = 0; i < 32; i++) {
 			if (mode & (1 << i))
 				break;
 		}
-		opval += opvaltab[optype][i];
+		ctx->opval += opvaltab[ctx->optype][i];
 	}
 
 	/* auto-tag */
-	if (auto_tag) {
-		if (pass == LAST_PASS) {
-			putbyte(loccnt, 0xA0);
-			putbyte(loccnt+1, auto_tag_value);
+	if (ctx->auto_tag) {
+		if (ctx->pass == LAST_PASS) {
+			putbyte(ctx, ctx->loccnt, 0xA0);
+			putbyte(ctx, ctx->loccnt+1, ctx->auto_tag_value);
 		}
-		loccnt += 2;
+		ctx->loccnt += 2;
 	}
 
 	/* generate code */
 	switch(mode) {
 	case ACC:
 		/* one byte */
-		if (pass == LAST_PASS)
-			putbyte(loccnt, opval);
+		if (ctx->pass == LAST_PASS)
+			putbyte(ctx, ctx->loccnt, ctx->opval);
 
-		loccnt++;
+		ctx->loccnt++;
 		break;
 
 	case IMM:
@@ -194,11 +209,13 @@ class4(int *ip)
 	case ZP_IND_X:
 	case ZP_IND_Y:
 		/* two bytes */
-		if (pass == LAST_PASS) {
-			putbyte(loccnt, opval);
-			putbyte(loccnt+1, value);
+		if (ctx->pass == LAST_PASS) {
+			putbyte(ctx, ctx->loccnt, ctx->opval);
+			putbyte(ctx, ctx->loccnt+1, ctx->value);
+			if (ctx->fix_pend)
+				fixup_place(ctx, ctx->loccnt+1);
 		}
-		loccnt += 2;
+		ctx->loccnt += 2;
 		break;
 
 	case ABS:
@@ -207,25 +224,27 @@ class4(int *ip)
 	case ABS_IND:
 	case ABS_IND_X:
 		/* three bytes */
-		if (pass == LAST_PASS) {
-			putbyte(loccnt, opval);
-			putword(loccnt+1, value);
+		if (ctx->pass == LAST_PASS) {
+			putbyte(ctx, ctx->loccnt, ctx->opval);
+			putword(ctx, ctx->loccnt+1, ctx->value);
+			if (ctx->fix_pend)
+				fixup_place(ctx, ctx->loccnt+1);
 		}
-		loccnt += 3;
+		ctx->loccnt += 3;
 		break;
 	}
 
 	/* auto-increment */
-	if (auto_inc) {
-		if (pass == LAST_PASS)
-			putbyte(loccnt, auto_inc);
+	if (ctx->auto_inc) {
+		if (ctx->pass == LAST_PASS)
+			putbyte(ctx, ctx->loccnt, ctx->auto_inc);
 
-		loccnt += 1;
+		ctx->loccnt += 1;
 	}
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -236,46 +255,46 @@ class4(int *ip)
  */
 
 void
-class5(int *ip)
+class5(struct t_context *ctx, int *ip)
 {
 	int	zp;
 	unsigned int addr;
 	int mode;
 
 	/* update location counter */
-	loccnt += 3;
+	ctx->loccnt += 3;
 
 	/* get first operand */
-	mode = getoperand(ip, ZP, ',');
-	zp   = value;
+	mode = getoperand(ctx, ip, ZP, ',');
+	zp   = ctx->value;
 	if (!mode)
 		return;
 
 	/* get second operand */
-	mode = getoperand(ip, ABS, ';');
+	mode = getoperand(ctx, ip, ABS, ';');
 	if (!mode)
 		return;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcodes */
-		putbyte(data_loccnt, opval);
-		putbyte(data_loccnt+1, zp);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
+		putbyte(ctx, ctx->data_loccnt+1, zp);
 
 		/* calculate branch offset */
-		addr = value - (loccnt + (page << 13));
+		addr = ctx->value - (ctx->loccnt + (ctx->page << 13));
 
 		/* check range */
 		if (addr > 0x7F && addr < 0xFFFFFF80) {
-			error("Branch address out of range!");
+			fixup_error(ctx, "Branch address out of range!");
 			return;
 		}
 
 		/* offset */
-		putbyte(data_loccnt+2, addr);
+		putbyte(ctx, ctx->data_loccnt+2, addr);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -287,37 +306,37 @@ class5(int *ip)
  */
 
 void
-class6(int *ip)
+class6(struct t_context *ctx, int *ip)
 {
 	int	i;
 	int addr[3];
 
 	/* update location counter */
-	loccnt +=7;
+	ctx->loccnt +=7;
 
 	/* get operands */
     for (i = 0; i < 3; i++) {
-		if (!evaluate(ip, (i < 2) ? ',' : ';'))
+		if (!evaluate(ctx, ip, (i < 2) ? ',' : ';'))
 			return;
-		if (pass == LAST_PASS) {
-			if (value & 0xFFFF0000) {
-				error("Operand size error!");
-				return;
+		if (ctx->pass == LAST_PASS) {
+			if (ctx->value & 0xFFFF0000) {
+				if (fixup_error(ctx, "Operand size error!"))
+					return;
 			}
 		}
-	    addr[i] = value;
+	    addr[i] = ctx->value;
 	}
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcodes */
-		putbyte(data_loccnt, opval);
-		putword(data_loccnt+1, addr[0]);
-		putword(data_loccnt+3, addr[1]);
-		putword(data_loccnt+5, addr[2]);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
+		putword(ctx, ctx->data_loccnt+1, addr[0]);
+		putword(ctx, ctx->data_loccnt+3, addr[1]);
+		putword(ctx, ctx->data_loccnt+5, addr[2]);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -329,62 +348,62 @@ class6(int *ip)
  */
 
 void
-class7(int *ip)
+class7(struct t_context *ctx, int *ip)
 {
 	int mode;
 	int addr, imm;
 
 	/* get first operand */
-	mode = getoperand(ip, IMM, ',');
-	imm  = value;
+	mode = getoperand(ctx, ip, IMM, ',');
+	imm  = ctx->value;
 	if (!mode)
 		return;
 
 	/* get second operand */
-	mode = getoperand(ip, (ZP | ZP_X | ABS | ABS_X), ';');
-	addr = value;
+	mode = getoperand(ctx, ip, (ZP | ZP_X | ABS | ABS_X), ';');
+	addr = ctx->value;
 	if (!mode)
 		return;
 
 	/* make opcode */
 	if (mode & (ZP | ZP_X))
-		opval = 0x83;
+		ctx->opval = 0x83;
 	if (mode & (ABS | ABS_X))
-		opval = 0x93;
+		ctx->opval = 0x93;
 	if (mode & (ZP_X | ABS_X))
-		opval+= 0x20;
+		ctx->opval+= 0x20;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* opcodes */
-		putbyte(loccnt, opval);
-		putbyte(loccnt+1, imm);
+		putbyte(ctx, ctx->loccnt, ctx->opval);
+		putbyte(ctx, ctx->loccnt+1, imm);
 
 		if (mode & (ZP | ZP_X))
 			/* zero page */
-			putbyte(loccnt+2, addr);
+			putbyte(ctx, ctx->loccnt+2, addr);
 		else
 			/* absolute */
-			putword(loccnt+2, addr);
+			putword(ctx, ctx->loccnt+2, addr);
 	}
 
 	/* update location counter */ 
 	if (mode & (ZP | ZP_X))
-		loccnt += 3;
+		ctx->loccnt += 3;
 	else
-		loccnt += 4;
+		ctx->loccnt += 4;
 
 	/* auto-increment */
-	if (auto_inc) {
-		if (pass == LAST_PASS)
-			putbyte(loccnt, auto_inc);
+	if (ctx->auto_inc) {
+		if (ctx->pass == LAST_PASS)
+			putbyte(ctx, ctx->loccnt, ctx->auto_inc);
 
-		loccnt += 1;
+		ctx->loccnt += 1;
 	}
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -395,32 +414,32 @@ class7(int *ip)
  */
 
 void
-class8(int *ip)
+class8(struct t_context *ctx, int *ip)
 {
 	int mode;
 
 	/* update location counter */
-	loccnt += 2;
+	ctx->loccnt += 2;
 
 	/* get operand */
-	mode = getoperand(ip, IMM, ';');
+	mode = getoperand(ctx, ip, IMM, ';');
 	if (!mode)
 		return;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* check page index */
-		if (value & 0xF8) {
-			error("Incorrect page index!");
+		if (ctx->value & 0xF8) {
+			fixup_error(ctx, "Incorrect page index!");
 			return;
 		}
 
 		/* opcodes */
-		putbyte(data_loccnt, opval);
-		putbyte(data_loccnt+1, (1 << value));
+		putbyte(ctx, ctx->data_loccnt, ctx->opval);
+		putbyte(ctx, ctx->data_loccnt+1, (1 << ctx->value));
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -432,39 +451,39 @@ class8(int *ip)
  */
 
 void
-class9(int *ip)
+class9(struct t_context *ctx, int *ip)
 {
 	int bit;
 	int mode;
 
 	/* update location counter */
-	loccnt += 2;
+	ctx->loccnt += 2;
 
 	/* get the bit index */
-	mode = getoperand(ip, IMM, ',');
-	bit  = value;
+	mode = getoperand(ctx, ip, IMM, ',');
+	bit  = ctx->value;
 	if (!mode)
 		return;
 
 	/* get the zero page address */
-	mode = getoperand(ip, ZP, ';');
+	mode = getoperand(ctx, ip, ZP, ';');
 	if (!mode)
 		return;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* check bit number */
 		if (bit > 7) {
-			error("Incorrect bit number!");
+			fixup_error(ctx, "Incorrect bit number!");
 			return;
 		}
 
 		/* opcodes */
-		putbyte(data_loccnt, opval + (bit << 4));
-		putbyte(data_loccnt+1, value);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval + (bit << 4));
+		putbyte(ctx, ctx->data_loccnt+1, ctx->value);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -476,7 +495,7 @@ class9(int *ip)
  */
 
 void
-class10(int *ip)
+class10(struct t_context *ctx, int *ip)
 {
 	int bit;
 	int zp;
@@ -484,51 +503,51 @@ class10(int *ip)
 	unsigned int addr;
 
 	/* update location counter */
-	loccnt += 3;
+	ctx->loccnt += 3;
 
 	/* get the bit index */
-	mode = getoperand(ip, IMM, ',');
-	bit  = value;
+	mode = getoperand(ctx, ip, IMM, ',');
+	bit  = ctx->value;
 	if (!mode)
 		return;
 
 	/* get the zero page address */
-	mode = getoperand(ip, ZP, ',');
-	zp   = value;
+	mode = getoperand(ctx, ip, ZP, ',');
+	zp   = ctx->value;
 	if (!mode)
 		return;
 
 	/* get the jump address */
-	mode = getoperand(ip, ABS, ';');
+	mode = getoperand(ctx, ip, ABS, ';');
 	if (!mode)
 		return;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* check bit number */
 		if (bit > 7) {
-			error("Incorrect bit number!");
+			fixup_error(ctx, "Incorrect bit number!");
 			return;
 		}
 
 		/* opcodes */
-		putbyte(data_loccnt, opval + (bit << 4));
-		putbyte(data_loccnt+1, zp);
+		putbyte(ctx, ctx->data_loccnt, ctx->opval + (bit << 4));
+		putbyte(ctx, ctx->data_loccnt+1, zp);
 
 		/* calculate branch offset */
-		addr = value - (loccnt + (page << 13));
+		addr = ctx->value - (ctx->loccnt + (ctx->page << 13));
 
 		/* check range */
 		if (addr > 0x7F && addr < 0xFFFFFF80) {
-			error("Branch address out of range!");
+			fixup_error(ctx, "Branch address out of range!");
 			return;
 		}
 
 		/* offset */
-		putbyte(data_loccnt+2, addr);
+		putbyte(ctx, ctx->data_loccnt+2, addr);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
@@ -539,7 +558,7 @@ class10(int *ip)
  */
 
 int
-getoperand(int *ip, int flag, int last_char)
+getoperand(struct t_context *ctx, int *ip, int flag, int last_char)
 {
 	unsigned int tmp;
 	char c;
@@ -549,25 +568,25 @@ getoperand(int *ip, int flag, int last_char)
 	int end;
 
 	/* init */
-	auto_inc = 0;
-	auto_tag = 0;
+	ctx->auto_inc = 0;
+	ctx->auto_tag = 0;
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* check addressing mode */
-	switch (prlnbuf[*ip]) {
+	switch (ctx->prlnbuf[*ip]) {
 	case '\0':
 	case ';':
 		/* no operand */
-		error("Operand missing!");
+		error(ctx, "Operand missing!");
 		return (0);
 
 	case 'A':
 	case 'a':
 		/* accumulator */
-		c = prlnbuf[(*ip)+1];
+		c = ctx->prlnbuf[(*ip)+1];
 		if (isspace(c) || c == '\0' || c == ';' || c == ',') {
 			mode = ACC;
 			(*ip)++;
@@ -576,7 +595,7 @@ getoperand(int *ip, int flag, int last_char)
 
 	default:
 		/* other */
-		switch(prlnbuf[*ip]) {
+		switch(ctx->prlnbuf[*ip]) {
 		case '#':
 			/* immediate */
 			mode = IMM;
@@ -602,7 +621,7 @@ getoperand(int *ip, int flag, int last_char)
 		}
 
 		/* get value */
-		if (!evaluate(ip, 0))
+		if (!evaluate(ctx, ip, 0))
 			return (0);
 
 		/* check addressing mode */
@@ -611,7 +630,7 @@ getoperand(int *ip, int flag, int last_char)
 		pos = 0;
 
 		while (!end) {
-			c = prlnbuf[*ip];
+			c = ctx->prlnbuf[*ip];
 			if (c == ';' || c == '\0')
 				break;
 			switch (toupper(c)) {
@@ -627,7 +646,7 @@ getoperand(int *ip, int flag, int last_char)
 				code++;
 			case ']':		/* ] = 3 */
 				code++;
-				if (prlnbuf[*ip + 1] == '.') {
+				if (ctx->prlnbuf[*ip + 1] == '.') {
 					end = 1;
 					break;
 				}
@@ -669,28 +688,28 @@ getoperand(int *ip, int flag, int last_char)
 		  (*ip) += 2;
 
 			/* get tag */
-			tmp = value;
+			tmp = ctx->value;
 
-			if (!evaluate(ip, 0))
+			if (!evaluate(ctx, ip, 0))
 				return (0);
 
 			/* ok */
-			auto_tag = 1;
-			auto_tag_value = value;
-			value = tmp;
+			ctx->auto_tag = 1;
+			ctx->auto_tag_value = ctx->value;
+			ctx->value = tmp;
 		}
 		/* indexed modes with post-increment */
 		else if (code == 0x051440) {
 			mode &= (ABS_Y | ZP_Y);			// ,Y++
-			auto_inc = 0xC8;
+			ctx->auto_inc = 0xC8;
 		}
 		else if (code == 0x052440) {
 			mode &= (ABS_X | ZP_X);			// ,X++
-			auto_inc = 0xE8;
+			ctx->auto_inc = 0xE8;
 		}
 		else if (code == 0x351440) {
 			mode &= (ZP_IND_Y);				// ],Y++
-			auto_inc = 0xC8;
+			ctx->auto_inc = 0xC8;
 		}
 
 		/* absolute, zp, or immediate (or error) */
@@ -701,47 +720,53 @@ getoperand(int *ip, int flag, int last_char)
 		}
 
 		/* check value on last pass */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			/* zp modes */
 			if (mode & (ZP | ZP_X | ZP_Y | ZP_IND | ZP_IND_X | ZP_IND_Y) & flag) {
 				/* extension stuff */
-				if (opext && !auto_inc) {
+				if (ctx->opext && !ctx->auto_inc) {
 					if (mode & (ZP_IND | ZP_IND_X | ZP_IND_Y))
-						error("Instruction extension not supported in indirect modes!");
-					if (opext == 'H')
-						value++;
+						fixup_error(ctx, "Instruction extension not supported in indirect modes!");
+					if (ctx->opext == 'H')
+						ctx->value++;
 				}
 				/* check address validity */
-				if ((value & 0xFFFFFF00) && ((value & 0xFFFFFF00) != machine->ram_base))
-					error("Incorrect zero page address!");
+				if ((ctx->value & 0xFFFFFF00) && ((ctx->value & 0xFFFFFF00) != ctx->machine->ram_base))
+					fixup_error(ctx, "Incorrect zero page address!");
+				if (ctx->fix_pend)
+					fixup_operand(ctx, FIX_ZP);
 			}
 
 			/* immediate mode */
 			else if (mode & (IMM) & flag) {
 				/* extension stuff */
-				if (opext == 'L')
-					value = (value & 0xFF);
-				else if (opext == 'H')
-					value = (value & 0xFF00) >> 8;
+				if (ctx->opext == 'L')
+					ctx->value = (ctx->value & 0xFF);
+				else if (ctx->opext == 'H')
+					ctx->value = (ctx->value & 0xFF00) >> 8;
 				else {
 					/* check value validity */
-					if ((value > 0xFF) && (value < 0xFFFFFF00))
-						error("Incorrect immediate value!");
+					if ((ctx->value > 0xFF) && (ctx->value < 0xFFFFFF00))
+						fixup_error(ctx, "Incorrect immediate value!");
 				}
+				if (ctx->fix_pend)
+					fixup_operand(ctx, FIX_IMM);
 			}
 
 			/* absolute modes */
 			else if (mode & (ABS | ABS_X | ABS_Y | ABS_IND | ABS_IND_X) & flag) {
 				/* extension stuff */
-				if (opext && !auto_inc) {
+				if (ctx->opext && !ctx->auto_inc) {
 					if (mode & (ABS_IND | ABS_IND_X))
-						error("Instruction extension not supported in indirect modes!");
-					if (opext == 'H')
-						value++;
+						fixup_error(ctx, "Instruction extension not supported in indirect modes!");
+					if (ctx->opext == 'H')
+						ctx->value++;
 				}
 				/* check address validity */
-				if (value & 0xFFFF0000)
-					error("Incorrect absolute address!");
+				if (ctx->value & 0xFFFF0000)
+					fixup_error(ctx, "Incorrect absolute address!");
+				if (ctx->fix_pend)
+					fixup_operand(ctx, FIX_ABS);
 			}
 		}
 		break;
@@ -750,23 +775,23 @@ getoperand(int *ip, int flag, int last_char)
 	/* compare addressing mode */
 	mode &= flag;
 	if (!mode) {
-		error("Incorrect addressing mode!");
+		error(ctx, "Incorrect addressing mode!");
 		return (0);
 	}
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* get last char */
-	c = prlnbuf[*ip];
+	c = ctx->prlnbuf[*ip];
 
 	/* check if it's what the user asked for */
 	switch (last_char) {
 	case ';':
 		/* last operand */
 		if (c != ';' && c != '\0') {
-			error("Syntax error!");
+			error(ctx, "Syntax error!");
 			return (0);
 		}
 		(*ip)++;
@@ -775,7 +800,7 @@ getoperand(int *ip, int flag, int last_char)
 	case ',':
 		/* need more operands */
 		if (c != ',') {
-			error("Operand missing!");
+			error(ctx, "Operand missing!");
 			return (0);
 		}
 		(*ip)++;
@@ -794,29 +819,29 @@ getoperand(int *ip, int flag, int last_char)
  */
 
 int
-getstring(int *ip, char *buffer, int size)
+getstring(struct t_context *ctx, int *ip, char *buffer, int size)
 {
 	char c;
 	int i;
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* string must be enclosed */
-	if (prlnbuf[(*ip)++] != '\"') {
-		error("Incorrect string syntax!");
+	if (ctx->prlnbuf[(*ip)++] != '\"') {
+		error(ctx, "Incorrect string syntax!");
 		return (0);
 	}
 
 	/* get string */
 	i = 0;
 	for (;;) {
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 		if (c == '\"')
 			break;
 		if (i >= size) {
-			error("String too long!");
+			error(ctx, "String too long!");
 			return (0);
 		}
 		buffer[i++] = c;
@@ -826,7 +851,7 @@ getstring(int *ip, char *buffer, int size)
 	buffer[i] = '\0';
 
 	/* skip spaces */
-	while (isspace(prlnbuf[*ip]))
+	while (isspace(ctx->prlnbuf[*ip]))
 		(*ip)++;
 
 	/* ok */
@@ -24,29 +24,29 @@ char pseudo_flag[] = {
  */
 
 void
-do_pseudo(int *ip)
+do_pseudo(struct t_context *ctx, int *ip)
 {
 	char str[80];
 	int old_bank;
 	int size;
 	char check_opval_flag;                  //internal debug var
 
-	check_opval_flag = pseudo_flag[opval];  //internal debug var
+	check_opval_flag = pseudo_flag[ctx->opval];  //internal debug var
 
 	/* check if the directive is allowed in the current section */
-	if (!(pseudo_flag[opval] & (1 << section)))
+	if (!(pseudo_flag[ctx->opval] & (1 << ctx->section)))
 	{
-		fatal_error("Directive not allowed in the current section!");
+		fatal_error(ctx, "Directive not allowed in the current section!");
 	}
 
 	/* save current location */
-	old_bank = bank;
+	old_bank = ctx->bank;
 
 	/* execute directive */
-	opproc(ip);
+	ctx->opproc(ctx, ip);
 
 	/* reset last label pointer */
-	switch (opval) {
+	switch (ctx->opval) {
 	case P_VRAM:
 	case P_PAL:
 		break;
@@ -55,24 +55,24 @@ do_pseudo(int *ip)
 	case P_DW:
 	case P_DWL:
 	case P_DWH:
-		if (lastlabl) {
-			if(lastlabl->data_type != P_DB)
-		 	   lastlabl = NULL;
+		if (ctx->lastlabl) {
+			if(ctx->lastlabl->ext->data_type != P_DB)
+		 	   ctx->lastlabl = NULL;
 		}
 		break;
 
 	default:
-		if (lastlabl) {
-			if(lastlabl->data_type != opval)
-		 	   lastlabl = NULL;
+		if (ctx->lastlabl) {
+			if(ctx->lastlabl->ext->data_type != ctx->opval)
+		 	   ctx->lastlabl = NULL;
 		}
 		break;
 	}
 
 	/* bank overflow warning */
-	if (pass == LAST_PASS) {
-		if (asm_opt[OPT_WARNING]) {
-			switch (opval) {
+	if (ctx->pass == LAST_PASS) {
+		if (ctx->asm_opt[OPT_WARNING]) {
+			switch (ctx->opval) {
 			case P_INCBIN:
 			case P_INCCHR:
 			case P_INCSPR:
@@ -80,11 +80,11 @@ do_pseudo(int *ip)
 			case P_INCBAT:
 			case P_INCTILE:
 			case P_INCMAP:
-				if (bank != old_bank) {
-					size = ((bank - old_bank - 1) * 8192) + loccnt;
+				if (ctx->bank != old_bank) {
+					size = ((ctx->bank - old_bank - 1) * 8192) + ctx->loccnt;
 					if (size) {
 						sprintf(str, "Warning, bank overflow by %i bytes!\n", size);
-						warning(str);
+						warning(ctx, str);
 					}
 				}
 				break;
@@ -101,14 +101,18 @@ do_pseudo(int *ip)
  */
 
 void
-do_list(int *ip)
+do_list(struct t_context *ctx, int *ip)
 {
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
-	asm_opt[OPT_LIST] = 1;
-	xlist = 1;
+	/* the listing is made by the last pass */
+	if (ctx->single_pass && ctx->list_level)
+		fixup_abort(ctx);
+
+	ctx->asm_opt[OPT_LIST] = 1;
+	ctx->xlist = 1;
 }
 
 
@@ -119,13 +123,13 @@ do_list(int *ip)
  */
 
 void
-do_mlist(int *ip)
+do_mlist(struct t_context *ctx, int *ip)
 {
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
-	asm_opt[OPT_MACRO] = 1;
+	ctx->asm_opt[OPT_MACRO] = 1;
 }
 
 
@@ -136,13 +140,13 @@ do_mlist(int *ip)
  */
 
 void
-do_nolist(int *ip)
+do_nolist(struct t_context *ctx, int *ip)
 {
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
-	asm_opt[OPT_LIST] = 0;
+	ctx->asm_opt[OPT_LIST] = 0;
 }
 
 
@@ -153,13 +157,13 @@ do_nolist(int *ip)
  */
 
 void
-do_nomlist(int *ip)
+do_nomlist(struct t_context *ctx, int *ip)
 {
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
-	asm_opt[OPT_MACRO] = mlist_opt;
+	ctx->asm_opt[OPT_MACRO] = ctx->mlist_opt;
 }
 
 
@@ -170,34 +174,37 @@ do_nomlist(int *ip)
  */
 
 void
-do_db(int *ip)
+do_db(struct t_context *ctx, int *ip)
 {
+	struct t_putbuf buf;
 	unsigned char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_level  = 2;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_level  = 2;
 
 	/* skip spaces */
-	while (isspace(prlnbuf[++(*ip)]));
+	while (isspace(ctx->prlnbuf[++(*ip)]));
 
-	/* get bytes */
+	/* get bytes, they are stored by runs */
+	putbuf_start(&buf, ctx->loccnt, 0);
 	for (;;) {
 		/* ASCII string */
-		if (prlnbuf[*ip] == '\"') {
+		if (ctx->prlnbuf[*ip] == '\"') {
 			for (;;) {
-				c = prlnbuf[++(*ip)];
+				c = ctx->prlnbuf[++(*ip)];
 				if (c == '\"')
 					break;
 				if (c == '\0') {
-					error("Unterminated ASCII string!");
+					error(ctx, "Unterminated ASCII string!");
+					putbuf_flush(ctx, &buf);
 					return;
 				}
 				if (c == '\\') {
-					c = prlnbuf[++(*ip)];
+					c = ctx->prlnbuf[++(*ip)];
 					switch(c) {
 					case 'r':
 						c = '\r';
@@ -211,64 +218,63 @@ do_db(int *ip)
 					}
 				}
 				/* store char on last pass */
-				if (pass == LAST_PASS)
-					putbyte(loccnt, c);
+				if (ctx->pass == LAST_PASS)
+					putbuf_byte(ctx, &buf, c);
 
 				/* update location counter */
-				loccnt++;
+				ctx->loccnt++;
 			}
 			(*ip)++;
 		}
 		/* bytes */
 		else {
-			/* get a byte */
-			if (!evaluate(ip, 0))
+			/* get a byte, the literals are not evaluated */
+			ctx->fix_type = FIX_BYTE;
+			if (!getliteral(ctx, ip) && !evaluate(ctx, ip, 0)) {
+				putbuf_flush(ctx, &buf);
 				return;
+			}
 
 			/* update location counter */
-			loccnt++;
+			ctx->loccnt++;
 
 			/* store byte on last pass */
-			if (pass == LAST_PASS) {
+			if (ctx->pass == LAST_PASS) {
 				/* check for overflow */
-				if ((value > 0xFF) && (value < 0xFFFFFF80)) {
-					error("Overflow error!");
-					return;
+				if ((ctx->value > 0xFF) && (ctx->value < 0xFFFFFF80)) {
+					if (fixup_error(ctx, "Overflow error!")) {
+						putbuf_flush(ctx, &buf);
+						return;
+					}
 				}
 
 				/* store byte */
-				putbyte(loccnt - 1, value);
+				putbuf_byte(ctx, &buf, ctx->value);
+				if (ctx->fix_pend)
+					fixup_place(ctx, ctx->loccnt - 1);
 			}
 		}
 
 		/* check if there's another byte */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if (c != ',')
 			break;
 	}
+	putbuf_flush(ctx, &buf);
 
 	/* check error */
 	if (c != ';' && c != '\0') {
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return;
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_DB;
-		lablptr->data_size = loccnt - data_loccnt;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_DB)
-				lastlabl->data_size += loccnt - data_loccnt;
-		}
-	}
+	lablsize(ctx, P_DB, ctx->loccnt - ctx->data_loccnt);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -279,67 +285,69 @@ do_db(int *ip)
  */
 
 void
-do_dw(int *ip)
+do_dw(struct t_context *ctx, int *ip)
 {
+	struct t_putbuf buf;
 	char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 2;
-	data_level  = 2;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 2;
+	ctx->data_level  = 2;
 
-	/* get data */
+	/* get data, it is stored by runs */
+	putbuf_start(&buf, ctx->loccnt, 1);
 	for (;;) {
-		/* get a word */
-		if (!evaluate(ip, 0))
+		/* get a word, the literals are not evaluated */
+		ctx->fix_type = FIX_WORD;
+		if (!getliteral(ctx, ip) && !evaluate(ctx, ip, 0)) {
+			putbuf_flush(ctx, &buf);
 			return;
+		}
 
 		/* update location counter */
-		loccnt += 2;
+		ctx->loccnt += 2;
 
 		/* store word on last pass */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			/* check for overflow */
-			if ((value > 0xFFFF) && (value < 0xFFFF8000)) {
-				error("Overflow error!");
-				return;
+			if ((ctx->value > 0xFFFF) && (ctx->value < 0xFFFF8000)) {
+				if (fixup_error(ctx, "Overflow error!")) {
+					putbuf_flush(ctx, &buf);
+					return;
+				}
 			}
 
 			/* store word */
-			putword(loccnt-2, value);
+			putbuf_byte(ctx, &buf, ctx->value & 0xFF);
+			putbuf_byte(ctx, &buf, (ctx->value >> 8) & 0xFF);
+			if (ctx->fix_pend)
+				fixup_place(ctx, ctx->loccnt - 2);
 		}
 
 		/* check if there's another word */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if (c != ',')
 			break;
 	}
+	putbuf_flush(ctx, &buf);
 
 	/* check error */
 	if (c != ';' && c != '\0') {
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return;
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_DB;
-		lablptr->data_size = loccnt - data_loccnt;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_DB)
-				lastlabl->data_size += loccnt - data_loccnt;
-		}
-	}
+	lablsize(ctx, P_DB, ctx->loccnt - ctx->data_loccnt);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -350,133 +358,135 @@ do_dw(int *ip)
  */
 
 void
-do_dwl(int *ip)
+do_dwl(struct t_context *ctx, int *ip)
 {
+	struct t_putbuf buf;
 	char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 1;
-	data_level  = 2;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 1;
+	ctx->data_level  = 2;
 
-	/* get data */
+	/* get data, it is stored by runs */
+	putbuf_start(&buf, ctx->loccnt, 0);
 	for (;;) {
-		/* get a word */
-		if (!evaluate(ip, 0))
+		/* get a word, the literals are not evaluated */
+		ctx->fix_type = FIX_DWL;
+		if (!getliteral(ctx, ip) && !evaluate(ctx, ip, 0)) {
+			putbuf_flush(ctx, &buf);
 			return;
+		}
 
 		/* update location counter */
-		loccnt += 1;
+		ctx->loccnt += 1;
 
 		/* store word on last pass */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			/* check for overflow */
-			if ((value > 0xFFFF) && (value < 0xFFFF8000)) {
-				error("Overflow error!");
-				return;
+			if ((ctx->value > 0xFFFF) && (ctx->value < 0xFFFF8000)) {
+				if (fixup_error(ctx, "Overflow error!")) {
+					putbuf_flush(ctx, &buf);
+					return;
+				}
 			}
 
 			/* store word */
-			putbyte(loccnt - 1, (value & 0xff));
+			putbuf_byte(ctx, &buf, (ctx->value & 0xff));
+			if (ctx->fix_pend)
+				fixup_place(ctx, ctx->loccnt - 1);
 		}
 
 		/* check if there's another word */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if (c != ',')
 			break;
 	}
+	putbuf_flush(ctx, &buf);
 
 	/* check error */
 	if (c != ';' && c != '\0') {
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return;
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_DB;
-		lablptr->data_size = loccnt - data_loccnt;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_DB)
-				lastlabl->data_size += loccnt - data_loccnt;
-		}
-	}
+	lablsize(ctx, P_DB, ctx->loccnt - ctx->data_loccnt);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
 
 void
-do_dwh(int *ip)
+do_dwh(struct t_context *ctx, int *ip)
 {
+	struct t_putbuf buf;
 	char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 1;
-	data_level  = 2;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 1;
+	ctx->data_level  = 2;
 
-	/* get data */
+	/* get data, it is stored by runs */
+	putbuf_start(&buf, ctx->loccnt, 0);
 	for (;;) {
-		/* get a word */
-		if (!evaluate(ip, 0))
+		/* get a word, the literals are not evaluated */
+		ctx->fix_type = FIX_DWH;
+		if (!getliteral(ctx, ip) && !evaluate(ctx, ip, 0)) {
+			putbuf_flush(ctx, &buf);
 			return;
+		}
 
 		/* update location counter */
-		loccnt += 1;
+		ctx->loccnt += 1;
 
 		/* store word on last pass */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			/* check for overflow */
-			if ((value > 0xFFFF) && (value < 0xFFFF8000)) {
-				error("Overflow error!");
-				return;
+			if ((ctx->value > 0xFFFF) && (ctx->value < 0xFFFF8000)) {
+				if (fixup_error(ctx, "Overflow error!")) {
+					putbuf_flush(ctx, &buf);
+					return;
+				}
 			}
 
 			/* store word */
-			putbyte(loccnt - 1, ((value>>8) & 0xff));
+			putbuf_byte(ctx, &buf, ((ctx->value>>8) & 0xff));
+			if (ctx->fix_pend)
+				fixup_place(ctx, ctx->loccnt - 1);
 		}
 
 		/* check if there's another word */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if (c != ',')
 			break;
 	}
+	putbuf_flush(ctx, &buf);
 
 	/* check error */
 	if (c != ';' && c != '\0') {
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return;
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_DB;
-		lablptr->data_size = loccnt - data_loccnt;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_DB)
-				lastlabl->data_size += loccnt - data_loccnt;
-		}
-	}
+	lablsize(ctx, P_DB, ctx->loccnt - ctx->data_loccnt);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -488,19 +498,19 @@ do_dwh(int *ip)
  */
 
 void
-do_equ(int *ip)
+do_equ(struct t_context *ctx, int *ip)
 {
 	/* get value */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
 	/* assign value to the label */
-	labldef(value, 0);
+	labldef(ctx, ctx->value, 0);
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(value, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value, 1);
+		println(ctx);
 	}
 }
 
@@ -512,30 +522,30 @@ do_equ(int *ip)
  */
 
 void
-do_page(int *ip)
+do_page(struct t_context *ctx, int *ip)
 {
 	/* not allowed in procs */
-	if (proc_ptr) {
-		fatal_error("PAGE can not be changed in procs!");
+	if (ctx->proc_ptr) {
+		fatal_error(ctx, "PAGE can not be changed in procs!");
 		return;
 	}
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get page index */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
-	if (value > 7) {
-		error("Invalid page index!");
+	if (ctx->value > 7) {
+		error(ctx, "Invalid page index!");
 		return;
 	}
-	page = value;
+	ctx->page = ctx->value;
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(value << 13, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value << 13, 1);
+		println(ctx);
 	}
 }
 
@@ -547,32 +557,32 @@ do_page(int *ip)
  */
 
 void
-do_org(int *ip)
+do_org(struct t_context *ctx, int *ip)
 {
 	/* get the .org value */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
 	/* check for undefined symbol - they are not allowed in .org */
-	if (undef != 0) {
-		error("Undefined symbol in operand field!");
+	if (ctx->undef != 0) {
+		error(ctx, "Undefined symbol in operand field!");
 		return;
 	}
 
 	/* section switch */
-	switch (section) {
+	switch (ctx->section) {
 	case S_ZP:
 		/* zero page section */
-		if ((value & 0xFFFFFF00) && ((value & 0xFFFFFF00) != machine->ram_base)) {
-			error("Invalid address!");
+		if ((ctx->value & 0xFFFFFF00) && ((ctx->value & 0xFFFFFF00) != ctx->machine->ram_base)) {
+			error(ctx, "Invalid address!");
 			return;
 		}
 		break;
 
 	case S_BSS:
 		/* ram section */
-		if ((value < machine->ram_base) || (value >= (machine->ram_base + machine->ram_limit))) {
-			error("Invalid address!");
+		if ((ctx->value < ctx->machine->ram_base) || (ctx->value >= (ctx->machine->ram_base + ctx->machine->ram_limit))) {
+			error(ctx, "Invalid address!");
 			return;
 		}
 		break;
@@ -580,30 +590,30 @@ do_org(int *ip)
 	case S_CODE:
 	case S_DATA:
 		/* not allowed in procs */
-		if (proc_ptr) {
-			fatal_error("ORG can not be changed in procs!");
+		if (ctx->proc_ptr) {
+			fatal_error(ctx, "ORG can not be changed in procs!");
 			return;
 		}
 
 		/* code and data section */
-		if (value & 0xFFFF0000) {
-			error("Invalid address!");
+		if (ctx->value & 0xFFFF0000) {
+			error(ctx, "Invalid address!");
 			return;
 		}
-		page = (value >> 13) & 0x07;
+		ctx->page = (ctx->value >> 13) & 0x07;
 		break;
 	}
 
 	/* set location counter */
-	loccnt = (value & 0x1FFF);
+	ctx->loccnt = (ctx->value & 0x1FFF);
 
 	/* set label value if there was one */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output line on last pass */
-	if (pass == LAST_PASS) {
-		loadlc(value, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value, 1);
+		println(ctx);
 	}
 }
 
@@ -615,29 +625,29 @@ do_org(int *ip)
  */
 
 void
-do_bank(int *ip)
+do_bank(struct t_context *ctx, int *ip)
 {
 	char name[128];
 
 	/* not allowed in procs */
-	if (proc_ptr) {
-		fatal_error("Bank can not be changed in procs!");
+	if (ctx->proc_ptr) {
+		fatal_error(ctx, "Bank can not be changed in procs!");
 		return;
 	}
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get bank index */
-	if (!evaluate(ip, 0))
+	if (!evaluate(ctx, ip, 0))
 		return;
-	if ((int)value > bank_limit) {
-		error("Bank index out of range!");
+	if ((int)ctx->value > ctx->bank_limit) {
+		error(ctx, "Bank index out of range!");
 		return;
 	}
 
 	/* check if there's a bank name */
-	switch (prlnbuf[*ip]) {
+	switch (ctx->prlnbuf[*ip]) {
 	case ';':
 	case '\0':
 		break;
@@ -645,51 +655,51 @@ do_bank(int *ip)
 	case ',':
 		/* get name */
 		(*ip)++;
-		if (!getstring(ip, name, 63))
+		if (!getstring(ctx, ip, name, 63))
 			return;
 
 		/* check name validity */
-		if (strlen(bank_name[value])) {
-			if (strcasecmp(bank_name[value], name)) {
-				error("Different bank names not allowed!");
+		if (strlen(ctx->bank_name[ctx->value])) {
+			if (strcasecmp(ctx->bank_name[ctx->value], name)) {
+				error(ctx, "Different bank names not allowed!");
 				return;
 			}
 		}
 
 		/* copy name */
-		strcpy(bank_name[value], name);
+		strcpy(ctx->bank_name[ctx->value], name);
 
 		/* check end of line */
-		if (!check_eol(ip))
+		if (!check_eol(ctx, ip))
 			return;
 
 		/* ok */
 		break;
 
 	default:
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 		return;
 	}
 
 	/* backup current bank infos */
-	bank_glabl[section][bank]  = glablptr;
-	bank_loccnt[section][bank] = loccnt;
-	bank_page[section][bank]   = page;
+	ctx->bank_glabl[ctx->section][ctx->bank]  = ctx->glablptr;
+	ctx->bank_loccnt[ctx->section][ctx->bank] = ctx->loccnt;
+	ctx->bank_page[ctx->section][ctx->bank]   = ctx->page;
 
 	/* get new bank infos */
-	bank     = value;
-	page     = bank_page[section][bank];
-	loccnt   = bank_loccnt[section][bank];
-	glablptr = bank_glabl[section][bank];
+	ctx->bank     = ctx->value;
+	ctx->page     = ctx->bank_page[ctx->section][ctx->bank];
+	ctx->loccnt   = ctx->bank_loccnt[ctx->section][ctx->bank];
+	ctx->glablptr = ctx->bank_glabl[ctx->section][ctx->bank];
 
 	/* update the max bank counter */
-	if (max_bank < bank)
-		max_bank = bank;
+	if (ctx->max_bank < ctx->bank)
+		ctx->max_bank = ctx->bank;
 
 	/* output on last pass */
-	if (pass == LAST_PASS) {
-		loadlc(bank, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->bank, 1);
+		println(ctx);
 	}
 }
 
@@ -701,15 +711,15 @@ do_bank(int *ip)
  */
 
 void
-do_incbin(int *ip)
+do_incbin(struct t_context *ctx, int *ip)
 {
-	FILE *fp;
+	struct t_file *file;
 	char *p;
 	char fname[128];
 	int  size;
 
 	/* get file name */
-	if (!getstring(ip, fname, 127))
+	if (!getstring(ctx, ip, fname, 127))
 		return;
 
 	/* get file extension */
@@ -717,75 +727,60 @@ do_incbin(int *ip)
 		if (!strchr(p, PATH_SEPARATOR)) {
 			/* check if it's a mx file */
 			if (!strcasecmp(p, ".mx")) {
-				do_mx(fname);
+				do_mx(ctx, fname);
 				return;
 			}
 			/* check if it's a map file */
 			if (!strcasecmp(p, ".fmp")) {
-				if (pce_load_map(fname, 0))
+				if (pce_load_map(ctx, fname, 0))
 					return;
 			}
 		}
 	}
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* open file */
-	if ((fp = open_file(fname, "rb")) == NULL) {
-		fatal_error("Can not open file!");
+	if ((file = open_file(ctx, fname)) == NULL) {
+		fatal_error(ctx, "Can not open file!");
 		return;
 	}
 
 	/* get file size */
-	fseek(fp, 0, SEEK_END);
-	size = ftell(fp);
-	fseek(fp, 0, SEEK_SET);
+	size = file->size;
 
 	/* check if it will fit in the rom */
-	if (((bank << 13) + loccnt + size) > rom_limit) {
-		fclose(fp);
-		error("ROM overflow!");
+	if (((ctx->bank << 13) + ctx->loccnt + size) > ctx->rom_limit) {
+		error(ctx, "ROM overflow!");
 		return;
 	}
 
 	/* load data on last pass */
-	if (pass == LAST_PASS) {
-		fread(&rom[bank][loccnt], 1, size, fp);
-		memset(&map[bank][loccnt], section + (page << 5), size);
+	if (ctx->pass == LAST_PASS) {
+		memcpy(&ctx->rom[ctx->bank][ctx->loccnt], file->data, size);
+		memset(&ctx->map[ctx->bank][ctx->loccnt], ctx->section + (ctx->page << 5), size);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 
-	/* close file */
-	fclose(fp);
-
 	/* update bank and location counters */
-	bank  += (loccnt + size) >> 13;
-	loccnt = (loccnt + size) & 0x1FFF;
-	if (bank > max_bank) {
-		if (loccnt)
-			max_bank = bank;
+	ctx->bank  += (ctx->loccnt + size) >> 13;
+	ctx->loccnt = (ctx->loccnt + size) & 0x1FFF;
+	if (ctx->bank > ctx->max_bank) {
+		if (ctx->loccnt)
+			ctx->max_bank = ctx->bank;
 		else
-			max_bank = bank - 1;
+			ctx->max_bank = ctx->bank - 1;
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_INCBIN;
-		lablptr->data_size = size;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_INCBIN)
-				lastlabl->data_size += size;
-		}
-	}
+	lablsize(ctx, P_INCBIN, size);
 }
 
 
@@ -796,10 +791,10 @@ do_incbin(int *ip)
  */
 
 void
-do_mx(char *fname)
+do_mx(struct t_context *ctx, char *fname)
 {
-	FILE *fp;
-	char *ptr;
+	struct t_file *file;
+	char *ptr, *end;
 	char type;
 	char line[256];
 	unsigned char buffer[128];
@@ -807,23 +802,32 @@ do_mx(char *fname)
 	int flag = 0;
 	int size = 0;
 	int cnt, addr, chksum;
-	int i;
+	int i, pos, len;
 
 	/* open the file */
-	if ((fp = open_file(fname, "r")) == NULL) {
-		fatal_error("Can not open file!");
+	if ((file = open_file(ctx, fname)) == NULL) {
+		fatal_error(ctx, "Can not open file!");
 		return;
 	}
 
 	/* read loop */
-	while (fgets(line, 254, fp) != NULL) {
+	for (pos = 0; pos < file->size; pos += len) {
+		/* get a line, the same way fgets() does it */
+		ptr = (char *)&file->data[pos];
+		end = memchr(ptr, '\n', file->size - pos);
+		len = end ? (end - ptr + 1) : (file->size - pos);
+		if (len > 253)
+			len = 253;
+		memcpy(line, ptr, len);
+		line[len] = '\0';
+
 		if (line[0] == 'S') {
 			/* get record type */
 			type = line[1];
 
 			/* error on unsupported records */
 			if ((type != '2') && (type != '8')) {
-				error("Unsupported S-record type!");
+				error(ctx, "Unsupported S-record type!");
 				return;
 			}
 
@@ -832,7 +836,7 @@ do_mx(char *fname)
 			addr = htoi(&line[4], 6);
 
 			if ((strlen(line) < 12) || (cnt < 4) || (addr == -1)) {
-				error("Incorrect S-record line!");
+				error(ctx, "Incorrect S-record line!");
 				return;
 			}
 
@@ -854,7 +858,7 @@ do_mx(char *fname)
 				ptr += 2;
 
 				if (data == -1) {
-					error("Syntax error in a S-record line!");
+					error(ctx, "Syntax error in a S-record line!");
 					return;
 				}
 			}
@@ -864,7 +868,7 @@ do_mx(char *fname)
 			chksum = (~chksum) & 0xFF;
 
 			if (data != chksum) {
-				error("Checksum error!");
+				error(ctx, "Checksum error!");
 				return;
 			}
 
@@ -876,62 +880,50 @@ do_mx(char *fname)
 			if (type == '2') {
 				/* set the location counter */
 				if (addr & 0xFFFF0000) {
-					error("Invalid address!");
+					error(ctx, "Invalid address!");
 					return;
 				}
-				page   = (addr >> 13) & 0x07;
-				loccnt = (addr & 0x1FFF);
+				ctx->page   = (addr >> 13) & 0x07;
+				ctx->loccnt = (addr & 0x1FFF);
 
 				/* define label */
 				if (flag == 0) {
 					flag  = 1;
-					labldef(loccnt, 1);
+					labldef(ctx, ctx->loccnt, 1);
 
 					/* output */
-					if (pass == LAST_PASS)
-						loadlc(loccnt, 0);
+					if (ctx->pass == LAST_PASS)
+						loadlc(ctx, ctx->loccnt, 0);
 				}
 
 				/* copy data */
-				if (pass == LAST_PASS) {
+				if (ctx->pass == LAST_PASS) {
 					for (i = 0; i < cnt; i++)
-						putbyte(loccnt + i, buffer[i]);
+						putbyte(ctx, ctx->loccnt + i, buffer[i]);
 				}
 
 				/* update location counter */
-				loccnt += cnt;
+				ctx->loccnt += cnt;
 				size   += cnt;
 			}
 		}
 	}
 
-	/* close file */
-	fclose(fp);
-
 	/* define label */
 	if (flag == 0) {
-		labldef(loccnt, 1);
+		labldef(ctx, ctx->loccnt, 1);
 
 		/* output */
-		if (pass == LAST_PASS)
-			loadlc(loccnt, 0);
+		if (ctx->pass == LAST_PASS)
+			loadlc(ctx, ctx->loccnt, 0);
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_INCBIN;
-		lablptr->data_size = size;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_INCBIN)
-				lastlabl->data_size += size;
-		}
-	}
+	lablsize(ctx, P_INCBIN, size);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -942,26 +934,26 @@ do_mx(char *fname)
  */
 
 void
-do_include(int *ip)
+do_include(struct t_context *ctx, int *ip)
 {
 	char fname[128];
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get file name */
-	if (!getstring(ip, fname, 127))
+	if (!getstring(ctx, ip, fname, 127))
 		return;
 
 	/* open file */
-	if (open_input(fname) == -1) {
-		fatal_error("Can not open file!");
+	if (open_input(ctx, fname) == -1) {
+		fatal_error(ctx, "Can not open file!");
 		return;
 	}
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -972,26 +964,26 @@ do_include(int *ip)
  */
 
 void
-do_rsset(int *ip)
+do_rsset(struct t_context *ctx, int *ip)
 {
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get value */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
-	if (value & 0xFFFF0000) {
-		error("Address out of range!");
+	if (ctx->value & 0xFFFF0000) {
+		error(ctx, "Address out of range!");
 		return;
 	}
 
 	/* set 'rs' base */
-	rsbase = value;
+	ctx->rsbase = ctx->value;
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(rsbase, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->rsbase, 1);
+		println(ctx);
 	}
 }
 
@@ -1003,25 +995,25 @@ do_rsset(int *ip)
  */
 
 void
-do_rs(int *ip)
+do_rs(struct t_context *ctx, int *ip)
 {
 	/* define label */
-	labldef(rsbase, 0);
+	labldef(ctx, ctx->rsbase, 0);
 
 	/* get the number of bytes to reserve */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
 	/* ouput line */
-	if (pass == LAST_PASS) {
-		loadlc(rsbase, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->rsbase, 1);
+		println(ctx);
 	}
 
 	/* update 'rs' base */
-	rsbase += value;
-	if (rsbase & 0xFFFF0000)
-		error("Address out of range!");
+	ctx->rsbase += ctx->value;
+	if (ctx->rsbase & 0xFFFF0000)
+		error(ctx, "Address out of range!");
 }
 
 
@@ -1032,28 +1024,28 @@ do_rs(int *ip)
  */
 
 void
-do_ds(int *ip)
+do_ds(struct t_context *ctx, int *ip)
 {
 	unsigned int limit = 0;
 	int addr;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* get the number of bytes to reserve */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
 	/* section switch */
-	switch (section) {
+	switch (ctx->section) {
 	case S_ZP:
 		/* zero page section */
-		limit = machine->zp_limit;
+		limit = ctx->machine->zp_limit;
 		break;
 
 	case S_BSS:
 		/* ram section */
-		limit = machine->ram_limit;
+		limit = ctx->machine->ram_limit;
 		break;
 
 	case S_CODE:
@@ -1064,45 +1056,49 @@ do_ds(int *ip)
 	}
 
 	/* check range */
-	if ((loccnt + value) > limit) {
-		error("Out of range!");
+	if ((ctx->loccnt + ctx->value) > limit) {
+		error(ctx, "Out of range!");
 		return;
 	}
 
 	/* update max counter for zp and bss sections */
-	addr = loccnt + value;
+	addr = ctx->loccnt + ctx->value;
 
-	switch (section) {
+	switch (ctx->section) {
 	case S_ZP:
 		/* zero page */
-		if (addr > max_zp)
-			max_zp = addr;
+		if (addr > ctx->max_zp)
+			ctx->max_zp = addr;
 		break;
 
 	case S_BSS:
 		/* ram page */
-		if (addr > max_bss)
-			max_bss = addr;
+		if (addr > ctx->max_bss)
+			ctx->max_bss = addr;
 		break;
 	}
 
 	/* output line on last pass */
-	if (pass == LAST_PASS) {
-		switch (section) {
+	if (ctx->pass == LAST_PASS) {
+		switch (ctx->section) {
 		case S_CODE:
 		case S_DATA:
-			memset(&rom[bank][loccnt], 0, value);
-			memset(&map[bank][loccnt], section + (page << 5), value);
-			if (bank > max_bank)
-				max_bank = bank;
+			memset(&ctx->rom[ctx->bank][ctx->loccnt], 0, ctx->value);
+			memset(&ctx->map[ctx->bank][ctx->loccnt], ctx->section + (ctx->page << 5), ctx->value);
+			if (ctx->single_pass) {
+				if (ctx->bank > ctx->fix_bank)
+					ctx->fix_bank = ctx->bank;
+			}
+			else if (ctx->bank > ctx->max_bank)
+				ctx->max_bank = ctx->bank;
 			break;
 		}
-		loadlc(loccnt, 0);
-		println();
+		loadlc(ctx, ctx->loccnt, 0);
+		println(ctx);
 	}
 
 	/* update location counter */
-	loccnt += value;
+	ctx->loccnt += ctx->value;
 }
 
 
@@ -1113,10 +1109,10 @@ do_ds(int *ip)
  */
 
 void
-do_fail(int *ip)
+do_fail(struct t_context *ctx, int *ip)
 {
     (void)ip;
-    fatal_error("Compilation failed!");
+    fatal_error(ctx, "Compilation failed!");
 }
 
 
@@ -1127,36 +1123,36 @@ do_fail(int *ip)
  */
 
 void
-do_section(int *ip)
+do_section(struct t_context *ctx, int *ip)
 {
     (void)ip;
-	if (proc_ptr) {
-		if (optype == S_DATA) {
-			fatal_error("No data segment in procs!");
+	if (ctx->proc_ptr) {
+		if (ctx->optype == S_DATA) {
+			fatal_error(ctx, "No data segment in procs!");
 			return;
 		}
 	}
-	if (section != optype) {
+	if (ctx->section != ctx->optype) {
 		/* backup current section data */
-		section_bank[section] = bank;
-		bank_glabl[section][bank] = glablptr;
-		bank_loccnt[section][bank] = loccnt;
-		bank_page[section][bank] = page;
+		ctx->section_bank[ctx->section] = ctx->bank;
+		ctx->bank_glabl[ctx->section][ctx->bank] = ctx->glablptr;
+		ctx->bank_loccnt[ctx->section][ctx->bank] = ctx->loccnt;
+		ctx->bank_page[ctx->section][ctx->bank] = ctx->page;
 
 		/* change section */
-		section = optype;
+		ctx->section = ctx->optype;
 
 		/* switch to the new section */
-		bank = section_bank[section];
-		page = bank_page[section][bank];
-		loccnt = bank_loccnt[section][bank];
-		glablptr = bank_glabl[section][bank];
+		ctx->bank = ctx->section_bank[ctx->section];
+		ctx->page = ctx->bank_page[ctx->section][ctx->bank];
+		ctx->loccnt = ctx->bank_loccnt[ctx->section][ctx->bank];
+		ctx->glablptr = ctx->bank_glabl[ctx->section][ctx->bank];
 	}
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(loccnt + (page << 13), 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->loccnt + (ctx->page << 13), 1);
+		println(ctx);
 	}
 }
 
@@ -1168,7 +1164,7 @@ do_section(int *ip)
  */
 
 void
-do_incchr(int *ip)
+do_incchr(struct t_context *ctx, int *ip)
 {
 	unsigned char buffer[32];
 	int i, j;
@@ -1178,16 +1174,16 @@ do_incchr(int *ip)
 	int size;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
-	if (!pcx_parse_args(0, pcx_nb_args, &x, &y, &w, &h, 8))
+	if (!pcx_parse_args(ctx, 0, ctx->pcx_nb_args, &x, &y, &w, &h, 8))
 		return;
 
 	/* pack data */
@@ -1198,29 +1194,20 @@ do_incchr(int *ip)
 			ty = y + (i << 3);
 
 			/* get tile */
-			size   = pcx_pack_8x8_tile(buffer, tx, ty);
+			size   = pcx_pack_8x8_tile(ctx, buffer, tx, ty);
 			total += size;
 
 			/* store tile */
-			putbuffer(buffer, size);
+			putbuffer(ctx, buffer, size);
 		}
 	}
 
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_INCCHR;
-		lablptr->data_size = total;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_INCCHR)
-				lastlabl->data_size += total;
-		}
-	}
+	lablsize(ctx, P_INCCHR, total);
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -1231,7 +1218,7 @@ do_incchr(int *ip)
  */
 
 void
-do_opt(int *ip)
+do_opt(struct t_context *ctx, int *ip)
 {
 	char c;
 	char flag;
@@ -1241,11 +1228,11 @@ do_opt(int *ip)
 
 	for (;;) {
 		/* skip spaces */
-		while (isspace(prlnbuf[*ip]))
+		while (isspace(ctx->prlnbuf[*ip]))
 			(*ip)++;
 
 		/* get char */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		/* no option */
 		if (c == ',')
@@ -1263,11 +1250,11 @@ do_opt(int *ip)
 			if (c == ',' || c == ';' || c == '\0')
 				break;
 			if (i > 31) {
-				error("Syntax error!");
+				error(ctx, "Syntax error!");
 				return;
 			}
 			name[i++] = c;
-			c = prlnbuf[(*ip)++];
+			c = ctx->prlnbuf[(*ip)++];
 		}
 
 		/* get option flag */
@@ -1285,20 +1272,20 @@ do_opt(int *ip)
 		else if (!strcasecmp(name, "o"))
 			opt = OPT_OPTIMIZE;
 		else {
-			error("Unknown option!");
+			error(ctx, "Unknown option!");
 			return;
 		}
 
 		/* set option */
 		if (flag == '+')
-			asm_opt[opt] = 1;
+			ctx->asm_opt[opt] = 1;
 		if (flag == '-')
-			asm_opt[opt] = 0;
+			ctx->asm_opt[opt] = 0;
 	}
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
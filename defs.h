@@ -1,3 +1,7 @@
+#include <stdarg.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
 #include "version.h"
 
 /* path separator */
@@ -30,11 +34,29 @@
 #define CHUNKY_TILE		1
 #define PACKED_TILE		2
 
+/* character classes, see lex.c */
+#define CC_SPACE	0x01
+#define CC_DIGIT	0x02
+#define CC_ALPHA	0x04
+#define CC_SYM		0x08	/* '_', '.' and '@' */
+#define CC_OPCH		0x10	/* '.', '@', '*' and '=' */
+#define CC_STOP		0x20	/* end of a name: ' ', '\t', ';' and '\0' */
+#define CC_ALNUM	(CC_DIGIT | CC_ALPHA)
+#define cclass(c)	cc_class[(unsigned char)(c)]
+
 /* line buffer length */
 #define LAST_CH_POS	158
 #define SFIELD	26
 #define SBOLSZ	64
 
+/* compiled expression length */
+#define EXPR_CODE_MAX	64
+
+/* compiled functions */
+#define FUNC_TEXT	0x01	/* the body can only be expanded */
+#define FUNC_PURE	0x02	/* the body only uses its arguments */
+#define FUNC_MEMO	16		/* number of results kept */
+
 /* macro argument types */
 #define NO_ARG			0
 #define ARG_REG			1
@@ -43,6 +65,15 @@
 #define ARG_INDIRECT	4
 #define ARG_STRING		5
 #define ARG_LABEL		6
+#define ARG_SYMBOL		-1	/* type depends on the symbol table */
+
+/* macro line slots */
+#define MS_END		0	/* end of the line */
+#define MS_ARG		1	/* \1 - \9 */
+#define MS_COUNT	2	/* \@ */
+#define MS_NBARGS	3	/* \# */
+#define MS_TYPE		4	/* \?1 - \?9 */
+#define MS_ERROR	5	/* invalid reference */
 
 /* section types */
 #define S_ZP	0
@@ -147,18 +178,188 @@
 #define FIRST_PASS	0
 #define LAST_PASS	1
 
+/* line analysis states */
+#define LEX_NONE	0	/* not analysed yet */
+#define LEX_CODE	1	/* label, instruction or macro call */
+#define LEX_MACRO	2	/* line of a macro definition */
+
+/* fixups of the single pass */
+#define FIX_NONE	0
+#define FIX_BYTE	1	/* .db value */
+#define FIX_WORD	2	/* .dw value */
+#define FIX_DWL		3	/* .dwl value */
+#define FIX_DWH		4	/* .dwh value */
+#define FIX_OPERAND	5	/* instruction operand, see getoperand() */
+#define FIX_IMM		6	/* immediate value */
+#define FIX_LOW		7	/* immediate low byte */
+#define FIX_HIGH	8	/* immediate high byte */
+#define FIX_ZP		9	/* zero page address */
+#define FIX_ABS		10	/* absolute address */
+#define FIX_REL		11	/* branch destination */
+#define FIX_DEFINED	12	/* symbol tested before its definition */
+#define FIX_IFDEF	13	/* symbol tested before it was seen */
+#define FIX_ARGTYPE	14	/* symbol given to a macro before its definition */
+
+/* include files read ahead */
+#define PREFETCH_JOBS	4	/* number of threads */
+#define PF_QUEUED	0	/* not read yet */
+#define PF_BUSY		1	/* being read */
+#define PF_READY	2	/* read, not used yet */
+#define PF_DONE		3	/* given to the context */
+
+/* regions of the last pass assembled in parallel */
+#define REGION_JOBS		16	/* max. number of threads */
+#define REGION_MAX		64	/* boundaries kept by the first pass */
+#define REGION_LINES	256	/* lines between two boundaries, doubled
+							 * each time there are too many */
+
+/* declarations kept by the watch mode */
+#define WS_NONE		0	/* not made yet */
+#define WS_READY	1	/* used by the builds */
+#define WS_FAILED	2	/* not usable until its files change */
+
 /* structs */
+struct t_context;
+
 typedef struct t_opcode {
 	struct t_opcode *next;
 	char  *name;
-	void (*proc)(int *);
+	void (*proc)(struct t_context *, int *);
 	int    flag;
 	int    value;
 	int    type_idx;
 } t_opcode;
 
+typedef struct t_ophash {	/* generated by opgen.c */
+	unsigned int seed;
+	int nb_disp;		/* number of displacements, a power of 2 */
+	int size;		/* number of slots, a power of 2 */
+	const unsigned short *disp;
+	const short *slot;	/* table << 8 | index, -1 if free */
+	const unsigned char *len;	/* length of the names */
+	const char *const *name;	/* names, NULL if free */
+} t_ophash;
+
+typedef struct t_exprop {	/* instruction of a compiled expression */
+	int  op;			/* OP_xxx, or EX_xxx for the values */
+	int  value;			/* EX_CONST value */
+	struct t_symbol *sym;	/* EX_SYMBOL or EX_LOCAL symbol */
+	struct t_symbol *scope;	/* global symbol the local was found in */
+} t_exprop;
+
+typedef struct t_expr {		/* compiled expression, see evaluate() */
+	struct t_expr *next;	/* next expression of the line */
+	short start;		/* operand index in prlnbuf */
+	short end;			/* index after the expression */
+	char  last_char;	/* end char asked for */
+	unsigned char nb;	/* number of instructions */
+	struct t_exprop code[1];
+} t_expr;
+
+typedef struct t_fixup {	/* forward reference of the single pass */
+	struct t_fixup *next;
+	int  type;			/* FIX_xxx */
+	int  bank;			/* location of the value in the rom */
+	int  offset;
+	int  adjust;		/* added to the value */
+	char *name;			/* symbol tested, FIX_DEFINED to FIX_ARGTYPE */
+	unsigned int hash;
+	int  nb;			/* number of instructions */
+	struct t_exprop code[1];
+} t_fixup;
+
+typedef struct t_lexinfo {
+	struct t_opcode *opcode;	/* instruction or pseudo, NULL if none */
+	struct t_macro  *macro;		/* macro call, NULL if none */
+	struct t_symbol *label;		/* global label, NULL if none or local */
+	unsigned char state;		/* LEX_NONE, LEX_CODE or LEX_MACRO */
+	unsigned char opext;		/* instruction extension */
+	unsigned char label_pos;	/* label index in prlnbuf */
+	unsigned char label_len;	/* label length, 0 if no label */
+	unsigned char arg_pos;		/* operand field index in prlnbuf */
+	struct t_expr *expr;		/* expressions compiled in this line */
+} t_lexinfo;
+
+typedef struct t_lexline {	/* start of a line, see lexline() */
+	int  label_pos;		/* label index in prlnbuf */
+	int  label_len;		/* label length, 0 if no label */
+	unsigned int label_hash;	/* st_hash() of the label */
+	int  name_end;		/* end of the macro name */
+	char macro[33];		/* macro name with its length, empty if invalid */
+	unsigned int macro_hash;	/* st_hash() of the macro name */
+	char op[16];		/* instruction name, in upper case */
+	int  op_len;		/* its length, -1 if invalid, -2 if none */
+	int  op_end;		/* end of the instruction name */
+	unsigned int op_hash;	/* hash of the instruction name */
+	char opext;		/* instruction extension */
+} t_lexline;
+
+typedef struct t_srcline {
+	char *data;
+	int   len;
+	int   skip_end;	/* end of the disabled block it starts, 0 if unknown */
+	struct t_lexinfo lex;
+} t_srcline;
+
+typedef struct t_source {
+	struct t_source  *next;
+	struct t_srcline *line;
+	char *text;
+	int   nb_lines;
+	struct t_shfile *shared;	/* shared file, owner of the text */
+	char  name[116];
+} t_source;
+
+typedef struct t_cachefile {
+	struct t_cachefile *next;
+	unsigned long long hash;
+	char  name[256];
+	char  path[256];
+} t_cachefile;
+
+typedef struct t_file {
+	struct t_file *next;
+	struct t_shfile *shared;	/* shared file, owner of the data */
+	unsigned char *data;
+	int   size;
+	char  name[256];
+	char  path[256];	/* file found in the include path, if any */
+} t_file;
+
+typedef struct t_dir {	/* directory content, to search files */
+	struct t_dir *next;
+	char **names;	/* sorted file names */
+	char  *text;
+	int    nb_names;
+	char   path[256];
+} t_dir;
+
+typedef struct t_arenablk {
+	struct t_arenablk *next;
+	double data[1];	/* start of the objects, aligned */
+} t_arenablk;
+
+typedef struct t_arena {	/* objects released all at once */
+	struct t_arenablk *list;
+	char *ptr;		/* free space in the current block */
+	int   left;
+} t_arena;
+
+typedef struct t_buffer {
+	char *data;
+	int   size;
+	int   max;
+} t_buffer;
+
+typedef struct t_putbuf {	/* run of data bytes stored at once */
+	unsigned char data[256];
+	int   offset;		/* location of the first byte */
+	int   size;
+	int   word;		/* set if stored by words */
+} t_putbuf;
+
 typedef struct t_input_info {
-	FILE *fp;
+	struct t_source *src;
 	int   lnum;
 	int   if_level;
 	char  name[116];
@@ -176,45 +377,110 @@ typedef struct t_proc {
 	int  call;
 	int  type;
 	int  refcnt;
-	char name[SBOLSZ];
+	char *name;		/* interned */
 } t_proc;
 
+typedef struct t_symslot {	/* entry of a symbol index */
+	unsigned int hash;
+	struct t_symbol *sym;	/* NULL if the slot is free */
+} t_symslot;
+
+typedef struct t_symindex {	/* hashed index of symbols */
+	struct t_symslot *slot;	/* open addressing slots */
+	int nb;			/* number of symbols */
+	int size;		/* number of slots, a power of 2 */
+} t_symindex;
+
+typedef struct t_symext {	/* rarely used symbol fields */
+	struct t_proc   *proc;
+	struct t_symindex local_idx;	/* index of the local symbols */
+	int  vram;
+	int  pal;
+	int  reserved;
+	int  data_type;
+	int  data_size;
+} t_symext;
+
 typedef struct t_symbol {
-	struct t_symbol *next;
+	struct t_symbol *next;	/* next local symbol */
 	struct t_symbol *local;
-	struct t_proc   *proc;
+	struct t_symext *ext;
+	char *name;		/* interned, starts with its length */
+	unsigned int hash;	/* hash of the name */
 	int  type;
 	int  value;
 	int  bank;
 	int  page;
 	int  nb;
 	int  size;
-	int  vram;
-	int  pal;
 	int  refcnt;
-	int  reserved;
-	int  data_type;
-	int  data_size;
-	char name[SBOLSZ];
 } t_symbol;
 
+typedef struct t_nameslot {	/* entry of the name pool */
+	unsigned int hash;
+	char *name;		/* NULL if the slot is free */
+} t_nameslot;
+
+typedef struct t_namepool {	/* interned names */
+	struct t_arena arena;
+	struct t_nameslot *slot;
+	int nb;
+	int size;		/* number of slots, a power of 2 */
+} t_namepool;
+
+typedef struct t_symtab {	/* global symbol table */
+	struct t_symbol **list;	/* symbols, in definition order */
+	struct t_symindex idx;	/* index of the symbols */
+	int nb;			/* number of symbols */
+	int max;		/* size of the list */
+} t_symtab;
+
+typedef struct t_mslot {	/* argument reference in a macro line */
+	unsigned char  type;
+	unsigned char  arg;
+	unsigned short len;	/* length of the text before it */
+} t_mslot;
+
 typedef struct t_line {
 	struct t_line *next;
 	char *data;
+	char *text;		/* data without the argument references */
+	struct t_mslot *slot;
+	int   subst;	/* offset of the first argument reference */
+	struct t_lexinfo lex;
 } t_line;
 
 typedef struct t_macro {
 	struct t_macro *next;
 	struct t_line *line;
-	char name[SBOLSZ];
+	char *name;		/* interned */
 } t_macro;
 
+typedef struct t_funcmemo {	/* result of a function call */
+	int  valid;
+	unsigned int arg[9];
+	unsigned int value;
+} t_funcmemo;
+
 typedef struct t_func {
 	struct t_func *next;
 	char line[128];
-	char name[SBOLSZ];
+	char *name;		/* interned */
+	int  flag;		/* FUNC_TEXT, FUNC_PURE */
+	struct t_exprop *code;	/* compiled body, NULL if not compiled yet */
+	int  nb;		/* its number of instructions */
+	int  nb_args;	/* number of arguments it uses */
+	int  depth;		/* size of the value stack it needs */
+	struct t_funcmemo memo[FUNC_MEMO];	/* results with constant arguments */
 } t_func;
 
+typedef struct t_funcarg {	/* argument of a compiled function call */
+	int  type;		/* T_DECIMAL, T_SYMBOL or T_PC */
+	unsigned int value;
+	unsigned int hash;	/* st_hash() of the symbol */
+	char name[SBOLSZ + 1];	/* symbol, with its length */
+} t_funcarg;
+
 typedef struct t_tile {
 	struct t_tile *next;
 	unsigned char *data;
@@ -235,9 +501,431 @@ typedef struct t_machine {
 	unsigned int ram_bank;
 	struct t_opcode *inst;
 	struct t_opcode *pseudo_inst;
-    int  (*pack_8x8_tile)(unsigned char *, void *, int, int);
-    int  (*pack_16x16_tile)(unsigned char *, void *, int,  int);
-    int  (*pack_16x16_sprite)(unsigned char *, void *, int,  int);
-    void (*write_header)(FILE *, int);
+    int  (*pack_8x8_tile)(struct t_context *, unsigned char *, void *, int, int);
+    int  (*pack_16x16_tile)(struct t_context *, unsigned char *, void *, int,  int);
+    int  (*pack_16x16_sprite)(struct t_context *, unsigned char *, void *, int,  int);
+    void (*write_header)(struct t_context *, struct t_buffer *, int);
+	const struct t_ophash *op_hash;	/* perfect hash of the instructions */
+	struct t_opcode **op_tbl;	/* instructions, indexed by the hash */
+	int inst_init;	/* set when the instruction table is built */
 } MACHINE;
 
+typedef struct PCX_HEADER {		/* pcx file header */
+	unsigned char manufacturer, version;
+	unsigned char encoding;
+	unsigned char bpp;
+	unsigned char xmin[2], ymin[2], xmax[2], ymax[2];
+	unsigned char xdpi[2], ydpi[2];
+	unsigned char colormap[16][3];
+	unsigned char reserved;
+	unsigned char np;
+	unsigned char bytes_per_line[2];
+	unsigned char palette_info[2];
+	unsigned char xscreen[2], yscreen[2];
+	unsigned char pad[54];
+} PCX_HEADER;
+
+typedef struct INES {		/* INES rom header */
+	unsigned char id[4];
+	unsigned char prg;
+	unsigned char chr;
+	unsigned char mapper[2];
+	unsigned char unused[8];
+} INES;
+
+typedef struct t_image {	/* decoded pcx picture */
+	struct PCX_HEADER header;
+	int  w, h;
+	int  nb_colors;
+	unsigned char  pal[256][3];
+	unsigned char *buf;
+} t_image;
+
+typedef struct t_shfile {	/* file shared by several assemblies */
+	struct t_shfile *next;
+	struct t_image  *image;	/* decoded picture, if used as a pcx */
+	struct t_source *src;	/* lines, if used as a source */
+	unsigned char *data;
+	int   size;
+	char  path[256];
+} t_shfile;
+
+typedef struct t_shared {	/* files shared by several assemblies */
+#ifndef WIN32
+	pthread_mutex_t lock;
+#endif
+	struct t_shfile *file_list;
+	struct t_dir    *dir_list;	/* directories searched */
+} t_shared;
+
+typedef struct t_pfitem {	/* include file read ahead */
+	struct t_pfitem *next;
+	char   name[128];	/* name given to src_open() */
+	char   path[256];	/* file found in the include paths */
+	unsigned char *data;
+	int    size;
+	struct t_shfile *shared;	/* shared file, if the store is used */
+	struct t_source *src;	/* its lines, NULL if not found */
+	int    state;		/* PF_xxx */
+} t_pfitem;
+
+typedef struct t_prefetch {	/* include files read ahead */
+#ifndef WIN32
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;	/* signaled when a file is queued or read */
+	pthread_t thread[PREFETCH_JOBS];
+#endif
+	int    nb_threads;
+	int    stop;		/* set to stop the threads */
+	struct t_pfitem *list;
+} t_prefetch;
+
+typedef struct t_target {	/* batch target */
+	struct t_context *ctx;
+	int    argc;
+	char **argv;
+	int    line;	/* line in the batch file */
+	int    ret;		/* assembly result */
+} t_target;
+
+typedef struct t_batch {	/* batch of targets */
+#ifndef WIN32
+	pthread_mutex_t lock;
+#endif
+	struct t_target *target;
+	int nb_targets;
+	int next;		/* next target to assemble */
+	int errcnt;		/* number of failed targets */
+} t_batch;
+
+typedef struct t_snapshot {	/* precompiled include files */
+	int  rsbase;
+	int  mcntmax;
+	int  section;
+	int  bank;
+	int  page;
+	int  loccnt;
+	int  section_bank[4];
+	int  bank_loccnt[4];
+	int  bank_page[4];
+	char glabl[SBOLSZ];
+	char bank_glabl[4][SBOLSZ];
+	struct t_symbol *glablptr;
+	struct t_symbol *bank_glablptr[4];
+	int  nb_names;
+	char (*names)[128];	/* sources, they are not included again */
+} t_snapshot;
+
+typedef struct t_region {	/* state at the start of a region */
+	int  line;		/* lines assembled before it */
+	int  label_size;	/* size attribute of the last label */
+	int  infile_num;	/* compared from here */
+	struct t_input_info input_file[8];
+	int  slnum;
+	int  page;
+	int  bank;
+	int  loccnt;
+	int  section;
+	int  section_bank[4];
+	int  bank_loccnt[4][256];
+	int  bank_page[4][256];
+	struct t_symbol *bank_glabl[4][256];
+	struct t_symbol *glablptr;
+	struct t_symbol *lastlabl;
+	struct t_srcline *skip_start;
+	int  rsbase;
+	int  proc_nb;
+	int  mcounter, mcntmax;
+	int  mcntlast;
+	char mcntstr[16];
+	int  xlist;
+	int  asm_opt[8];
+	int  in_if;
+	int  if_level;
+	int  if_state[256];
+	int  if_flag[256];
+} t_region;
+
+typedef struct t_regwrite {	/* symbol field set when a region is kept */
+	int *ptr;
+	int  value;
+} t_regwrite;
+
+typedef struct t_regjob {	/* region assembled by a thread */
+#ifndef WIN32
+	pthread_t thread;
+	int    started;
+#endif
+	struct t_context *ctx;	/* its context, NULL if not assembled */
+	struct t_region   end;	/* state at its end */
+	int    ok;		/* set if it can be kept */
+	int    redo;		/* set if assembled again once its calls are set */
+} t_regjob;
+
+typedef struct t_stream {	/* binary data reader */
+	unsigned char *ptr;
+	unsigned char *end;
+	int error;
+} t_stream;
+
+typedef struct t_watch {	/* directories watched for changes */
+	int  fd;
+	int  nb_dirs;
+	int  wd[256];
+	char dir[256][256];	/* directory prefix of the files */
+	int  snap_state;	/* WS_xxx */
+	char snap_src[4096];	/* include lines starting the input file */
+	int  snap_len;
+	unsigned char *snap;	/* snapshot of their declarations */
+	int  snap_size;
+	int  nb_paths;
+	char (*path)[256];	/* files of the snapshot */
+} t_watch;
+
+/* assembler context, all the state of an assembly */
+typedef struct t_context {
+	/* rom */
+	unsigned char rom[128][8192];
+	unsigned char map[128][8192];
+	char bank_name[128][64];
+	int  bank_loccnt[4][256];
+	int  bank_page[4][256];
+	int  max_zp;		/* higher used address in zero page */
+	int  max_bss;		/* higher used address in ram */
+	int  max_bank;		/* last bank used */
+	int  data_loccnt;	/* data location counter */
+	int  data_size;		/* size of binary output (in bytes) */
+	int  data_level;	/* data output level, must be <= listlevel to be outputed */
+	int  loccnt;		/* location counter */
+	int  bank;			/* current bank */
+	int  bank_base;		/* bank base index */
+	int  rom_limit;		/* rom max. size in bytes */
+	int  bank_limit;	/* bank limit */
+	int  page;			/* page */
+	int  rsbase;		/* .rs counter */
+	int  section;		/* current section: S_ZP, S_BSS, S_CODE or S_DATA */
+	int  section_bank[4];	/* current bank for each section */
+	int  stop_pass;		/* stop the program; set by fatal_error() */
+	int  errcnt;		/* error counter */
+	struct t_machine *machine;
+	struct t_symtab   sym_tbl;	/* global symbols */
+	struct t_arena    sym_arena;	/* all the symbols */
+	struct t_arena    symext_arena;	/* their rarely used fields */
+	struct t_namepool names;	/* names of the symbols, macros, functions and procs */
+	struct t_symbol  *lablptr;	/* label pointer into symbol table */
+	struct t_symbol  *glablptr;	/* pointer to the latest defined global label */
+	struct t_symbol  *lastlabl;	/* last label we have seen */
+	struct t_symbol  *bank_glabl[4][256];	/* latest global symbol for each bank */
+	struct t_opcode  *opptr;	/* last instruction found */
+	void (*opproc)(struct t_context *, int *);	/* instruction gen proc */
+	int  opflg;		/* instruction flags */
+	int  opval;		/* instruction value */
+	int  optype;	/* instruction type */
+	char opext;		/* instruction extension (.l or .h) */
+	int  pass;		/* pass counter */
+	char prlnbuf[LAST_CH_POS+4];	/* input line buffer */
+	char tmplnbuf[LAST_CH_POS+4];	/* temporary line buffer */
+	int  slnum;				/* source line number counter */
+	char symbol[SBOLSZ+1];	/* temporary symbol storage */
+	int  undef;				/* undefined symbol in expression flg  */
+	unsigned int value;		/* operand field value */
+
+	/* options */
+	char  in_fname[256];	/* file names, input */
+	char  out_fname[256];	/* output */
+	char  bin_fname[256];	/* binary */
+	char  lst_fname[256];	/* listing */
+	char  sym_fname[256];	/* symbol table */
+	unsigned char ipl_buffer[4096];
+	char  zeroes[2048];	/* CDROM sector full of zeores */
+	int   dump_seg;
+	int   overlayflag;
+	int   develo_opt;
+	int   header_opt;
+	int   srec_opt;
+	int   run_opt;
+	int   scd_opt;
+	int   cd_opt;
+	int   mx_opt;
+	int   mlist_opt;	/* macro listing main flag */
+	int   xlist;		/* listing file main flag */
+	int   list_level;	/* output level */
+	int   asm_opt[8];	/* assembler options */
+	int   zero_need;	/* counter for trailing empty sectors on CDROM */
+
+	/* input */
+	int    infile_error;
+	int    infile_num;
+	struct t_input_info input_file[8];
+	struct t_source  *src_list;	/* loaded source files */
+	struct t_file    *file_list;	/* files loaded in memory */
+	int  (*file_reader)(void *, const char *, unsigned char **, int *);
+	void  *file_user;	/* file reader user data */
+	struct t_shared  *shared;	/* files shared with other assemblies */
+	struct t_dir     *dir_list;	/* include directories searched */
+	int    prefetch_opt;	/* set to read the include files ahead */
+	struct t_prefetch *prefetch;
+	struct t_lexinfo *lexptr;	/* analysis of the current line */
+	int    lexlimit;	/* first prlnbuf index altered by a macro argument */
+	char  *incpath;
+	int   *str_offset;
+	int    remaining;
+	int    incpathSize;
+	int    str_offsetCount;
+	int    incpathCount;
+
+	/* outputs */
+	FILE  *msg_fp;		/* messages, kept in msg_buf when not set */
+	struct t_buffer msg_buf;
+	struct t_buffer lst_buf;	/* listing */
+	struct t_buffer sym_buf;	/* symbol table */
+	struct t_buffer out_buf;	/* rom image or s-record file */
+
+	/* build cache */
+	char   cache_dir[256];	/* cache directory, empty if not used */
+	int    cache_rec;	/* set when dependencies must be recorded */
+	char   dep_fname[256];	/* dependency file, empty if not written */
+	char   snap_fname[256];	/* snapshot loaded before the source */
+	int    snap_opt;	/* set to make a snapshot instead of a rom */
+	int    obj_opt;		/* set to make an object file instead of a rom */
+	char **link_name;	/* object files linked, instead of assembling */
+	int    link_nb;
+	struct t_snapshot *snap;
+	struct t_cachefile *dep_list;	/* files read by the assembler */
+	struct t_cachefile *out_list;	/* files written by the assembler */
+	unsigned long long cache_key;	/* hash of the command line and environment */
+
+	/* conditional assembly */
+	int  in_if;			/* set when we are in an .if statement */
+	int  if_expr;		/* set when parsing an .if expression */
+	int  if_level;		/* level of nested .if's */
+	int  if_state[256];	/* status when entering the .if */
+	int  if_flag[256];	/* .if/.else status */
+	int  skip_lines;	/* set when lines must be skipped */
+	struct t_srcline *skip_start;	/* source line that disabled the block */
+	int  continued_line;	/* set when a line is the continuation of another line */
+
+	/* expressions */
+	unsigned int  op_stack[64];	/* operator stack */
+	unsigned int val_stack[64];	/* value stack */
+	int op_idx, val_idx;	/* index in the operator and value stacks */
+	int need_operator;		/* when set await an operator, else await a value */
+	unsigned char *expr;	/* pointer to the expression string */
+	unsigned char *expr_stack[16];	/* expression stack */
+	struct t_symbol *expr_lablptr;	/* pointer to the lastest label */
+	int expr_lablcnt;		/* number of label seen in an expression */
+	struct t_exprop expr_code[EXPR_CODE_MAX];	/* expression being compiled */
+	int expr_nb;			/* its number of instructions, -1 if not compiled */
+	struct t_arena expr_arena;	/* compiled expressions */
+
+	/* single pass */
+	int  single_opt;	/* set to assemble in a single pass */
+	int  single_pass;	/* set while the first pass also generates the code */
+	int  fix_type;		/* fixup allowed for the next evaluation */
+	int  fix_bank;		/* last bank written by the single pass */
+	int  fix_refs;		/* references to the symbols set after the first pass */
+	struct t_fixup *fix_pend;	/* fixup of the last evaluation, not placed yet */
+	struct t_fixup *fix_list;	/* placed fixups */
+	struct t_fixup *fix_last;
+	struct t_arena  fix_arena;
+
+	/* parallel last pass */
+	int  jobs;			/* threads of the last pass, serial if 1 or less */
+	int  line_cnt;		/* lines assembled in the pass */
+	int  region_step;	/* lines between two boundaries, 0 if not used */
+	int  region_nb;		/* boundaries found by the first pass */
+	struct t_region *region;
+	int  region_end;	/* line_cnt ending the region run, 0 if none */
+	int  in_region;		/* set in the contexts running a region */
+	int  region_err;	/* set when the region must be assembled again */
+	int  region_size;	/* size attribute of the last label in a region */
+	struct t_regwrite *reg_write;	/* its writes to the symbols */
+	int  reg_nb, reg_max;
+	struct t_proc **reg_call;	/* its calls to procs without code */
+	int  call_nb, call_max;
+
+	/* code */
+	unsigned char auto_inc;
+	unsigned char auto_tag;
+	unsigned int  auto_tag_value;
+
+	/* macros */
+	int  mopt;
+	int  in_macro;
+	int  expand_macro;
+	char marg[8][10][80];
+	int  marglen[8][9];			/* computed once per call */
+	signed char margtype[8][9];
+	char mnbargs[8];
+	int  midx;
+	int  mcounter, mcntmax;
+	int  mcntlast;				/* counter of mcntstr */
+	char mcntstr[16];
+	int  mcntstack[8];
+	struct t_line  *mstack[8];
+	struct t_line  *mlptr;
+	struct t_macro *macro_tbl[256];
+	struct t_macro *mptr;
+	struct t_arena  macro_arena;	/* macros and their lines */
+
+	/* functions */
+	struct t_func *func_tbl[256];
+	struct t_func *func_ptr;
+	struct t_arena func_arena;
+	char func_line[128];
+	char func_arg[8][10][80];
+	int  func_idx;
+	struct t_func *func_cur;	/* function being compiled */
+	struct t_exprop func_code[EXPR_CODE_MAX];	/* its body */
+	int  func_nb;		/* its number of instructions, -1 if none */
+	int  func_level;	/* func_idx of its call */
+	int  func_opidx;	/* op_idx of its call */
+	int  func_argn;		/* argument being read */
+	int  func_errcnt;	/* errors before its call */
+
+	/* procs */
+	struct t_proc *proc_tbl[256];
+	struct t_proc *proc_ptr;
+	struct t_arena proc_arena;
+	struct t_proc *proc_first;
+	struct t_proc *proc_last;
+	int proc_nb;
+	int call_ptr;
+	int call_bank;
+
+	/* pcx */
+	struct PCX_HEADER pcx;	/* pcx file header */
+	char pcx_name[128];		/* pcx file name */
+	int  pcx_w, pcx_h;		/* pcx dimensions */
+	int  pcx_nb_colors;		/* number of colors in the pcx */
+	int  pcx_nb_args;		/* number of argument */
+	unsigned int   pcx_arg[8];	/* pcx args array */
+	unsigned char *pcx_buf;		/* pointer to the pcx buffer */
+	int  pcx_shared;		/* set when the pcx buffer is shared */
+	unsigned char  pcx_pal[256][3];		/* palette */
+	unsigned char  pcx_plane[128][4];	/* plane buffer */
+	unsigned int     tile_offset;	/* offset in the tile reference table */
+	struct t_tile    tile[256];		/* tile info table */
+	struct t_tile   *tile_tbl[256];	/* tile hash table */
+	struct t_symbol *tile_lablptr;	/* tile symbol reference */
+
+	/* mml */
+	unsigned int snd_wave;
+	unsigned int snd_octave;
+	unsigned int snd_volume;
+	unsigned int snd_length;
+	unsigned int snd_tempo;
+	unsigned int snd_timebase;
+	unsigned int snd_ticks_h, snd_ticks_l;
+	int snd_wave_flag;
+	int snd_off;
+
+	/* machine specific */
+	unsigned char buffer[16384];	/* buffer for .inc and .def directives */
+	unsigned char header[512];	/* rom header */
+	struct INES ines;	/* ines rom header */
+	int ines_prg;		/* number of prg banks */
+	int ines_chr;		/* number of character banks */
+	int ines_mapper[2];	/* rom mapper type */
+} t_context;
+
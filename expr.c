@@ -26,84 +26,110 @@ static const int op_pri[] = {
  */
 
 int
-evaluate(int *ip, char last_char)
+evaluate(struct t_context *ctx, int *ip, char last_char)
 {
+	struct t_lexinfo *lex;
+	struct t_expr *ex;
 	int end, level;
 	int op, type;
 	int arg;
+	int start, errcnt;
 	int i;
 	unsigned char c;
 
+	/* the expression may have been compiled by a previous
+	 * evaluation of this line, the text before the first
+	 * macro argument is always the same
+	 */
+	lex = ctx->lexptr;
+	ctx->expr_nb = (ctx->single_pass || (ctx->obj_opt && (ctx->pass == LAST_PASS))) ? 0 : -1;
+	ctx->func_nb = -1;
+	if (lex && !ctx->continued_line && (*ip < ctx->lexlimit)) {
+		for (ex = lex->expr; ex; ex = ex->next) {
+			if ((ex->start == *ip) && (ex->last_char == last_char))
+				return (expr_run(ctx, ex, ip));
+		}
+
+		/* not by the regions of a parallel last pass,
+		 * they share the line
+		 */
+		if (!ctx->in_region)
+			ctx->expr_nb = 0;
+	}
+	start = *ip;
+	errcnt = ctx->errcnt;
+
 	end = 0;
 	level = 0;
-	undef = 0;
-	op_idx = 0;
-	val_idx = 0;
-	value = 0;
-	val_stack[0] = 0;
-	need_operator = 0;
-	expr_lablptr = NULL;
-	expr_lablcnt = 0;
+	ctx->undef = 0;
+	ctx->op_idx = 0;
+	ctx->val_idx = 0;
+	ctx->value = 0;
+	ctx->val_stack[0] = 0;
+	ctx->need_operator = 0;
+	ctx->expr_lablptr = NULL;
+	ctx->expr_lablcnt = 0;
 	op = OP_START;
-	func_idx = 0;
+	ctx->func_idx = 0;
 
 	/* array index to pointer */
-	expr = (unsigned char*)&prlnbuf[*ip];
+	ctx->expr = (unsigned char*)&ctx->prlnbuf[*ip];
 
 	/* skip spaces */
 cont:
-	while (isspace(*expr))
-		expr++;
+	while (isspace(*ctx->expr))
+		ctx->expr++;
 
 	/* search for a continuation char */
-	if (*expr == '\\') {
+	if (*ctx->expr == '\\') {
 		/* skip spaces */
 		i = 1;
-		while (isspace(expr[i]))
+		while (isspace(ctx->expr[i]))
 			i++;
 
 		/* check if end of line */
-		if (expr[i] == ';' || expr[i] == '\0') {
+		if (ctx->expr[i] == ';' || ctx->expr[i] == '\0') {
 			/* output */
-			if (!continued_line) {
+			if (!ctx->continued_line) {
 				/* replace '\' with three dots */
-				strcpy((char*)expr, "...");
+				strcpy((char*)ctx->expr, "...");
 
 				/* store the current line */
-				strcpy(tmplnbuf, prlnbuf);
+				strcpy(ctx->tmplnbuf, ctx->prlnbuf);
 			}
 
 			/* ok */
-			continued_line++;
+			ctx->continued_line++;
+			ctx->expr_nb = -1;
 
 			/* read a new line */
-			if (readline() == -1)
+			if (readline(ctx) == -1)
 				return (0);
 
 			/* rewind line pointer and continue */
-			expr = (unsigned char*)&prlnbuf[SFIELD];
+			ctx->expr = (unsigned char*)&ctx->prlnbuf[SFIELD];
 			goto cont;
 		}
 	}
 
 	/* parser main loop */
 	while (!end) {
-		c = *expr;
+		c = *ctx->expr;
 
 		/* number */
 		if (isdigit(c)) {
-			if (need_operator)
+			if (ctx->need_operator)
 				goto error;
-			if (!push_val(T_DECIMAL))
+			if (!push_val(ctx, T_DECIMAL))
 				return (0);
 		}
 
 		/* symbol */
 		else
 		if (isalpha(c) || c == '_' || c == '.' || c == '@') {
-			if (need_operator)
+			if (ctx->need_operator)
 				goto error;
-			if (!push_val(T_SYMBOL))
+			if (!push_val(ctx, T_SYMBOL))
 				return (0);
 		}
 
@@ -112,161 +138,168 @@ cont:
 			switch (c) {
 			/* function arg */
 			case '\\':
-				if (func_idx == 0) {
-					error("Syntax error in expression!");
+				if (ctx->func_idx == 0) {
+					error(ctx, "Syntax error in expression!");
 					return (0);
 				}
-				expr++;
-				c = *expr++;
+				ctx->expr++;
+				c = *ctx->expr++;
 				if (c < '1' || c > '9') {
-					error("Invalid function argument index!");
+					error(ctx, "Invalid function argument index!");
 					return (0);
 				}
 				arg = c - '1';
-				expr_stack[func_idx++] = expr;
-				expr = (unsigned char*)func_arg[func_idx - 2][arg];
+
+				/* argument of a function being compiled */
+				if ((ctx->func_nb >= 0) && (ctx->func_idx == ctx->func_level + 1)) {
+					if (ctx->func_arg[ctx->func_level][arg][0] == '\0')
+						ctx->func_nb = -1;
+					ctx->func_argn = arg;
+				}
+				ctx->expr_stack[ctx->func_idx++] = ctx->expr;
+				ctx->expr = (unsigned char*)ctx->func_arg[ctx->func_idx - 2][arg];
 				break;
 
 			/* hexa prefix */
  			case '$':
-				if (need_operator)
+				if (ctx->need_operator)
 					goto error;
-				if (!push_val(T_HEXA))
+				if (!push_val(ctx, T_HEXA))
 					return (0);
 				break;
 
 			/* character prefix */
 			case '\'':
-				if (need_operator)
+				if (ctx->need_operator)
 					goto error;
-				if (!push_val(T_CHAR))
+				if (!push_val(ctx, T_CHAR))
 					return (0);
 				break;
 
 			/* round brackets */
 			case '(':
-				if (need_operator)
+				if (ctx->need_operator)
 					goto error;
-				if (!push_op(OP_OPEN))
+				if (!push_op(ctx, OP_OPEN))
 					return (0);
 				level++;
-				expr++;
+				ctx->expr++;
 				break;
 			case ')':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					goto error;
 				if (level == 0)
 					goto error;
-				while (op_stack[op_idx] != OP_OPEN) {
-					if (!do_op())
+				while (ctx->op_stack[ctx->op_idx] != OP_OPEN) {
+					if (!do_op(ctx))
 						return (0);
 				}
-				op_idx--;
+				ctx->op_idx--;
 				level--;
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* not equal, left shift, lower, lower or equal */
 			case '<':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					goto error;
-				expr++;
-				switch (*expr) {
+				ctx->expr++;
+				switch (*ctx->expr) {
 				case '>':
 					op = OP_NOT_EQUAL;
-					expr++;
+					ctx->expr++;
 					break;
 				case '<':
 					op = OP_SHL;
-					expr++;
+					ctx->expr++;
 					break;
 				case '=':
 					op = OP_LOWER_EQUAL;
-					expr++;
+					ctx->expr++;
 					break;
 				default:
 					op = OP_LOWER;
 					break;
 				}
-				if (!push_op(op))
+				if (!push_op(ctx, op))
 					return (0);
 				break;
 
 			/* right shift, higher, higher or equal */
 			case '>':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					goto error;
-				expr++;
-				switch (*expr) {
+				ctx->expr++;
+				switch (*ctx->expr) {
 				case '>':
 					op = OP_SHR;
-					expr++;
+					ctx->expr++;
 					break;
 				case '=':
 					op = OP_HIGHER_EQUAL;
-					expr++;
+					ctx->expr++;
 					break;
 				default:
 					op = OP_HIGHER;
 					break;
 				}
-				if (!push_op(op))
+				if (!push_op(ctx, op))
 					return (0);
 				break;
 
 			/* equal */
 			case '=':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					goto error;
-				if (!push_op(OP_EQUAL))
+				if (!push_op(ctx, OP_EQUAL))
 					return (0);
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* one complement */
 			case '~':
-				if (need_operator)
+				if (ctx->need_operator)
 					goto error;
-				if (!push_op(OP_COM))
+				if (!push_op(ctx, OP_COM))
 					return (0);
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* sub, neg */
 			case '-':
-				if (need_operator)
+				if (ctx->need_operator)
 					op = OP_SUB;
 				else
 					op = OP_NEG;
-				if (!push_op(op))
+				if (!push_op(ctx, op))
 					return (0);
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* not, not equal */
 			case '!':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					op = OP_NOT;
 				else {
 					op = OP_NOT_EQUAL;
-					expr++;
-					if (*expr != '=')
+					ctx->expr++;
+					if (*ctx->expr != '=')
 						goto error;
 				}
-				if (!push_op(op))
+				if (!push_op(ctx, op))
 					return (0);
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* binary prefix, current PC */
 			case '%':
 			case '*':
-				if (!need_operator) {
+				if (!ctx->need_operator) {
 					if (c == '%')
 						type = T_BINARY;
 					else
 						type = T_PC;
-					if (!push_val(type))
+					if (!push_val(ctx, type))
 						return (0);
 					break;
 				}
@@ -277,7 +310,7 @@ cont:
 			case '&':
 			case '^':
 			case '|':
-				if (!need_operator)
+				if (!ctx->need_operator)
 					goto error;
 				switch (c) {
 				case '%': op = OP_MOD; break;
@@ -288,15 +321,15 @@ cont:
 				case '^': op = OP_XOR; break;
 				case '|': op = OP_OR;  break;
 				}
-				if (!push_op(op))
+				if (!push_op(ctx, op))
 					return (0);
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* skip immediate operand prefix if in macro */
 			case '#':
-				if (expand_macro)
-					expr++;
+				if (ctx->expand_macro)
+					ctx->expr++;
 				else
 					end = 3;
 				break;
@@ -304,14 +337,20 @@ cont:
 			/* space or tab */
 			case ' ':
 			case '\t':
-				expr++;
+				ctx->expr++;
 				break;
 
 			/* end of line */
 			case '\0':
-				if (func_idx) {
-					func_idx--;
-					expr = expr_stack[func_idx];
+				if (ctx->func_idx) {
+					ctx->func_idx--;
+					ctx->expr = ctx->expr_stack[ctx->func_idx];
+
+					/* end of a function being compiled */
+					if ((ctx->func_nb >= 0) && (ctx->func_idx == ctx->func_level)) {
+						if (!func_save(ctx))
+							return (0);
+					}
 					break;
 				}
 			case ';':
@@ -327,53 +366,158 @@ cont:
 		}
 	}
 
-	if (!need_operator)
+	if (!ctx->need_operator)
 		goto error;
 	if (level != 0)
 		goto error;
-	while (op_stack[op_idx] != OP_START) {
-		if (!do_op())
+	while (ctx->op_stack[ctx->op_idx] != OP_START) {
+		if (!do_op(ctx))
 			return (0);
 	}
 
 	/* get the expression value */
-	value = val_stack[val_idx];
-
-	/* any undefined symbols? trap that if in the last pass */
-	if (undef) {
-		if (pass == LAST_PASS)
-			error("Undefined symbol in operand field!");
+	ctx->value = ctx->val_stack[ctx->val_idx];
+
+	/* any undefined symbols? trap that if in the last pass,
+	 * the single pass keeps the expression for later and the
+	 * object files for the linker
+	 */
+	if (ctx->undef) {
+		if (ctx->single_pass || (ctx->obj_opt && (ctx->pass == LAST_PASS)))
+			fixup_defer(ctx, ctx->expr_code, ctx->expr_nb);
+		else if (ctx->pass == LAST_PASS)
+			error(ctx, "Undefined symbol in operand field!");
 	}
+	ctx->fix_type = FIX_NONE;
 
 	/* check if the last char is what the user asked for */
 	switch (last_char) {
 	case ';':
 		if (end != 1)
 			goto error;
-		expr++;
+		ctx->expr++;
 		break;
 	case ',':
 		if (end != 2) {
-			error("Argument missing!");
+			error(ctx, "Argument missing!");
 			return (0);
 		}
-		expr++;
+		ctx->expr++;
 		break;
 	}
 
 	/* convert back the pointer to an array index */
-   *ip = (int)expr - (int)prlnbuf;
+   *ip = (int)ctx->expr - (int)ctx->prlnbuf;
+
+	/* keep the compiled expression if it was evaluated
+	 * without error, for the next evaluations of the line
+	 */
+	if (lex && (ctx->expr_nb > 0) && (ctx->errcnt == errcnt) && (*ip < ctx->lexlimit))
+		expr_save(ctx, lex, start, *ip, last_char);
 
 	/* ok */
 	return (1);
 
 	/* syntax error */
 error:
-	error("Syntax error in expression!");
+	error(ctx, "Syntax error in expression!");
 	return (0);
 }
 
 
+/* ----
+ * getliteral()
+ * ----
+ * fast path for the data tables, get a value made of a single
+ * number or char, optionally negated; return 0 without error
+ * for anything else, the value must then be evaluated
+ */
+
+int
+getliteral(struct t_context *ctx, int *ip)
+{
+	unsigned char *ptr;
+	unsigned int val, mul;
+	int neg, nb, c;
+
+	ptr = (unsigned char *)&ctx->prlnbuf[*ip];
+	while (isspace(*ptr))
+		ptr++;
+
+	neg = 0;
+	if (*ptr == '-') {
+		neg = 1;
+		ptr++;
+	}
+
+	/* char */
+	if (*ptr == '\'') {
+		val = ptr[1];
+		if ((val == 0) || (ptr[2] != '\''))
+			return (0);
+		ptr += 3;
+	}
+
+	/* number, extracted like push_val() does */
+	else {
+		c = *ptr;
+		if (c == '$') {
+			mul = 16;
+			ptr++;
+		}
+		else if (c == '%') {
+			mul = 2;
+			ptr++;
+		}
+		else if (isdigit(c)) {
+			mul = 10;
+			if ((c == '0') && (toupper(ptr[1]) == 'X')) {
+				mul = 16;
+				ptr += 2;
+			}
+		}
+		else
+			return (0);
+
+		val = 0;
+		nb = 0;
+		for (;; ptr++) {
+			c = *ptr;
+			if (isdigit(c))
+				c -= '0';
+			else if (isalpha(c))
+				c = toupper(c) - 'A' + 10;
+			else if ((c == '_') && (mul == 2))
+				continue;
+			else
+				break;
+			if ((unsigned int)c >= mul)
+				break;
+			val = (val * mul) + c;
+			nb++;
+		}
+		if (nb == 0)
+			return (0);
+	}
+
+	/* it must be the whole value */
+	while ((*ptr == ' ') || (*ptr == '\t'))
+		ptr++;
+	if ((*ptr != ',') && (*ptr != ';') && (*ptr != '\0'))
+		return (0);
+
+	/* same state as after evaluate() */
+	ctx->value = neg ? -val : val;
+	ctx->undef = 0;
+	ctx->need_operator = 1;
+	ctx->expr_lablptr = NULL;
+	ctx->expr_lablcnt = 0;
+	ctx->expr = ptr;
+	*ip = (char *)ptr - ctx->prlnbuf;
+	return (1);
+}
+
+
 /* ----
  * push_val()
  * ----
@@ -381,76 +525,94 @@ error:
  */
 
 int
-push_val(int type)
+push_val(struct t_context *ctx, int type)
 {
 	unsigned int mul, val;
+	struct t_func *func;
 	int op;
 	char c;
 
 	val = 0;
-	c = *expr;
+	c = *ctx->expr;
 
 	switch (type) {
 	/* program counter */
 	case T_PC:
-		if (data_loccnt == -1)
-			val = (loccnt + (page << 13));
+		if (ctx->data_loccnt == -1)
+			val = (ctx->loccnt + (ctx->page << 13));
 		else
-			val = (data_loccnt + (page << 13));
-		expr++;
+			val = (ctx->data_loccnt + (ctx->page << 13));
+		ctx->expr++;
 		break;
 
 	/* char ascii value */
 	case T_CHAR:
-		expr++;
-		val = *expr++;
-		if ((*expr != c) || (val == 0)) {
-			error("Syntax Error!");
+		ctx->expr++;
+		val = *ctx->expr++;
+		if ((*ctx->expr != c) || (val == 0)) {
+			error(ctx, "Syntax Error!");
 			return (0);
 		}
-		expr++;
+		ctx->expr++;
 		break;
 
 	/* symbol */
 	case T_SYMBOL:
 		/* extract it */
-		if (!getsym())
+		if (!getsym(ctx))
 			return (0);
 
 		/* an user function? */
-		if (func_look()) {
-			if (!func_getargs())
+		if (func_look(ctx)) {
+			func = ctx->func_ptr;
+			if (!func_getargs(ctx))
 				return (0);
 
-			expr_stack[func_idx++] = expr;
-			expr = (unsigned char*)func_ptr->line;
+			/* use its compiled body if possible */
+			switch (func_call(ctx, func)) {
+			case -1:
+				return (0);
+			case 1:
+				return (1);
+			}
+
+			/* else expand it */
+			ctx->expr_stack[ctx->func_idx++] = ctx->expr;
+			ctx->expr = (unsigned char*)func->line;
 			return (1);
 		}
 
 		/* a predefined function? */
-		op = check_keyword();
+		op = check_keyword(ctx);
 		if (op) {
-			if (!push_op(op))
+			expr_emit(ctx, EX_FUNC, 0, NULL);
+			if (!push_op(ctx, op))
 				return (0);
 			else
 				return (1);
 		}
 
 		/* search the symbol */
-		expr_lablptr = stlook(1);
+		ctx->expr_lablptr = stlook(ctx, 1);
 
 		/* check if undefined, if not get its value */
-		if (expr_lablptr == NULL)
+		if (ctx->expr_lablptr == NULL)
 			return (0);
-		else if (expr_lablptr->type == UNDEF)
-			undef++;
-		else if (expr_lablptr->type == IFUNDEF)
-			undef++;
+		else if (ctx->expr_lablptr->type == UNDEF)
+			ctx->undef++;
+		else if (ctx->expr_lablptr->type == IFUNDEF)
+			ctx->undef++;
 		else
-			val = expr_lablptr->value;
+			val = ctx->expr_lablptr->value;
 
 		/* remember we have seen a symbol in the expression */
-		expr_lablcnt++;
+		ctx->expr_lablcnt++;
+
+		/* the local symbols depend on the scope */
+		if ((ctx->symbol[1] == '.') || (ctx->symbol[1] == '@'))
+			expr_emit(ctx, EX_LOCAL, 0, ctx->expr_lablptr);
+		else
+			expr_emit(ctx, EX_SYMBOL, 0, ctx->expr_lablptr);
 		break;
 
 	/* binary number %1100_0011 */
@@ -465,9 +627,9 @@ push_val(int type)
 
 	/* decimal number 48 (or hexa 0x5F) */
 	case T_DECIMAL:
-		if((c == '0') && (toupper(expr[1]) == 'X')) {
+		if((c == '0') && (toupper(ctx->expr[1]) == 'X')) {
 			mul = 16;
-			expr++;
+			ctx->expr++;
 		}
 		else {
 			mul = 10;
@@ -476,8 +638,8 @@ push_val(int type)
 		/* extract a number */
 	extract:
 		for (;;) {
-			expr++;
-			c = *expr;
+			ctx->expr++;
+			c = *ctx->expr;
 
 			if (isdigit(c))
 				c -= '0';
@@ -501,18 +663,22 @@ push_val(int type)
 		break;
 	}
 
+	/* compile the constants and the program counter */
+	if (type != T_SYMBOL)
+		expr_emit(ctx, (type == T_PC) ? EX_PC : EX_CONST, val, NULL);
+
 	/* check for too big expression */
-	if (val_idx == 63) {
-		error("Expression too complex!");
+	if (ctx->val_idx == 63) {
+		error(ctx, "Expression too complex!");
 		return (0);
 	}
 
 	/* push the result on the value stack */
-	val_idx++;
-	val_stack[val_idx] = val;
+	ctx->val_idx++;
+	ctx->val_stack[ctx->val_idx] = val;
 
 	/* next must be an operator */
-	need_operator = 1;
+	ctx->need_operator = 1;
 
 	/* ok */
 	return (1);
@@ -526,7 +692,7 @@ push_val(int type)
  */
 
 int
-getsym(void)
+getsym(struct t_context *ctx)
 {
 	int	valid;
 	int	i;
@@ -537,12 +703,12 @@ getsym(void)
 	i = 0;
 
 	/* get the symbol, stop to the first 'non symbol' char */
-	local_check = *expr;
+	local_check = *ctx->expr;
     while (valid) {
-        c = *expr;
+        c = *ctx->expr;
         if (isalpha(c) || c == '_' || c == '.' || c == '@' || (isdigit(c) && i >= 1)) {
-            symbol[++i] = c;
-            expr++;
+            ctx->symbol[++i] = c;
+            ctx->expr++;
         }
     /*    else if((local_check=='.') && ((c=='-') || (c=='+'))) {
             symbol[++i] = c;
@@ -555,23 +721,23 @@ getsym(void)
 
 	/* is it a reserved symbol? */
 	if (i == 1) {
-		switch (toupper(symbol[1])) {
+		switch (toupper(ctx->symbol[1])) {
 		case 'A':
 		case 'X':
 		case 'Y':
-			error("Symbol is reserved (A, X or Y)!");
+			error(ctx, "Symbol is reserved (A, X or Y)!");
 			i = 0;
 		}
 	}
 
 	/* store symbol length */
-	symbol[0] = i;
-	symbol[i+1] = '\0';
+	ctx->symbol[0] = i;
+	ctx->symbol[i+1] = '\0';
 
     if (i > SBOLSZ - 1) {
         char errorstr[512];
-        snprintf(errorstr, 512, "Symbol name too long ('%s' is %d chars long, max is %d)", symbol + 1, i, SBOLSZ - 1);
-        fatal_error(errorstr);
+        snprintf(errorstr, 512, "Symbol name too long ('%s' is %d chars long, max is %d)", ctx->symbol + 1, i, SBOLSZ - 1);
+        fatal_error(ctx, errorstr);
     }
 
 	return (i);
@@ -585,7 +751,7 @@ getsym(void)
  */
 
 int
-getsym_op(void)
+getsym_op(struct t_context *ctx)
 {
 	int	valid;
 	int	i;
@@ -596,18 +762,18 @@ getsym_op(void)
 	i = 0;
 
 	/* get the symbol, stop to the first 'non symbol' char */
-	local_check = *expr;
+	local_check = *ctx->expr;
 	while (valid) {
-		c = *expr;
+		c = *ctx->expr;
 		if (isalpha(c) || c == '_' || c == '.' || c == '@' || (isdigit(c) && i >= 1)) {
 			if (i < SBOLSZ - 1)
-				symbol[++i] = c;
-			expr++;
+				ctx->symbol[++i] = c;
+			ctx->expr++;
 		}
 		else if((local_check=='.' || local_check=='@') && ((c=='-') || (c=='+'))) {
                 if (i < SBOLSZ - 1)
-                    symbol[++i] = c;
-                expr++;
+                    ctx->symbol[++i] = c;
+                ctx->expr++;
              }
             else {
                 valid = 0;
@@ -616,18 +782,18 @@ getsym_op(void)
 
 	/* is it a reserved symbol? */
 	if (i == 1) {
-		switch (toupper(symbol[1])) {
+		switch (toupper(ctx->symbol[1])) {
 		case 'A':
 		case 'X':
 		case 'Y':
-			error("Symbol is reserved (A, X or Y)!");
+			error(ctx, "Symbol is reserved (A, X or Y)!");
 			i = 0;
 		}
 	}
 
 	/* store symbol length */
-	symbol[0] = i;
-	symbol[i+1] = '\0';
+	ctx->symbol[0] = i;
+	ctx->symbol[i+1] = '\0';
 	return (i);
 }
 
@@ -658,26 +824,43 @@ static const struct
  * verify if the current symbol is a reserved function
  */
 int
-check_keyword(void)
+check_keyword(struct t_context *ctx)
+{
+	int op;
+
+	/* check if its an assembler function */
+	op = keyword_op(ctx);
+
+	/* extra setup for functions that send back symbol infos */
+	if(op)
+	{
+		ctx->expr_lablptr = NULL;
+		ctx->expr_lablcnt = 0;
+	}
+	/* ok */
+	return (op);
+}
+
+/* ----
+ * keyword_op()
+ * ----
+ * get the operator of a predefined function, 0 if
+ * the current symbol is not one
+ */
+
+int
+keyword_op(struct t_context *ctx)
 {
 	int op = 0;
 	int i;
-	/* check if its an assembler function */
 	for(i=0; (0 == op) && (i<10); i++)
 	{
-		if(((MACHINE_ALL == keyword[i].machine_type) || (machine->type == keyword[i].machine_type)) && 
-			(!strcasecmp(symbol, keyword[i].name)))
+		if(((MACHINE_ALL == keyword[i].machine_type) || (ctx->machine->type == keyword[i].machine_type)) && 
+			(!strcasecmp(ctx->symbol, keyword[i].name)))
 		{
 			op = keyword[i].op;
 		}
 	}
-	/* extra setup for functions that send back symbol infos */
-	if(op)
-	{
-		expr_lablptr = NULL;
-		expr_lablcnt = 0;
-	}
-	/* ok */
 	return (op);
 }
 
@@ -688,21 +871,21 @@ check_keyword(void)
  */
 
 int
-push_op(int op)
+push_op(struct t_context *ctx, int op)
 {
 	if (op != OP_OPEN) {
-		while (op_pri[op_stack[op_idx]] >= op_pri[op]) {
-			if (!do_op())
+		while (op_pri[ctx->op_stack[ctx->op_idx]] >= op_pri[op]) {
+			if (!do_op(ctx))
 				return (0);
 		}
 	}
-	if (op_idx == 63) {
-		error("Expression too complex!");
+	if (ctx->op_idx == 63) {
+		error(ctx, "Expression too complex!");
 		return (0);
 	}
-	op_idx++;
-	op_stack[op_idx] = op;
-	need_operator = 0;
+	ctx->op_idx++;
+	ctx->op_stack[ctx->op_idx] = op;
+	ctx->need_operator = 0;
 	return (1);
 }
 
@@ -714,88 +897,122 @@ push_op(int op)
  */
 
 int
-do_op(void)
+do_op(struct t_context *ctx)
 {
-	int val[2];
 	int op;
 
 	/* operator */
-	op = op_stack[op_idx--];
+	op = ctx->op_stack[ctx->op_idx--];
+
+	/* apply it */
+	if (!exec_op(ctx, op))
+		return (0);
+
+	/* compile it */
+	expr_emit(ctx, op, ctx->val_stack[ctx->val_idx], NULL);
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * exec_op()
+ * ----
+ * apply an operator to the value stack, the functions
+ * use the last symbol seen in the expression
+ */
+
+int
+exec_op(struct t_context *ctx, int op)
+{
+	int val[2];
 
 	/* first arg */
-	val[0] = val_stack[val_idx];
+	val[0] = ctx->val_stack[ctx->val_idx];
 
 	/* second arg */
 	if (op_pri[op] < 9)
-		val[1] = val_stack[--val_idx];
+		val[1] = ctx->val_stack[--ctx->val_idx];
 
 	switch (op) {
 	/* BANK */
 	case OP_BANK:
-		if (!check_func_args("BANK"))
+		if (!check_func_args(ctx, "BANK"))
 			return (0);
-		if (pass == LAST_PASS) {
-			if (expr_lablptr->bank == RESERVED_BANK) {
-				error("No BANK index for this symbol!");
-				val[0] = 0;
-				break;
+		/* the bank of an imported symbol is set by the linker */
+		if ((ctx->pass == LAST_PASS) && !(ctx->obj_opt && (ctx->expr_lablptr->type == UNDEF))) {
+			if (ctx->expr_lablptr->bank == RESERVED_BANK) {
+				if (fixup_error(ctx, "No BANK index for this symbol!")) {
+					val[0] = 0;
+					break;
+				}
 			}
 		}
-		val[0] = expr_lablptr->bank;
+		val[0] = ctx->expr_lablptr->bank;
 		break;
 
 	/* PAGE */
 	case OP_PAGE:
-		if (!check_func_args("PAGE"))
+		if (!check_func_args(ctx, "PAGE"))
 			return (0);
-		val[0] = expr_lablptr->page;
+		val[0] = ctx->expr_lablptr->page;
 		break;
 
 	/* VRAM */
 	case OP_VRAM:
-		if (!check_func_args("VRAM"))
+		if (!check_func_args(ctx, "VRAM"))
 			return (0);
-		if (pass == LAST_PASS) {
-			if (expr_lablptr->vram == -1)
-				error("No VRAM address for this symbol!");
+		if (ctx->pass == LAST_PASS) {
+			if (ctx->expr_lablptr->ext->vram == -1)
+				fixup_error(ctx, "No VRAM address for this symbol!");
 		}
-		val[0] = expr_lablptr->vram;
+		val[0] = ctx->expr_lablptr->ext->vram;
 		break;
 
 	/* PAL */
 	case OP_PAL:
-		if (!check_func_args("PAL"))
+		if (!check_func_args(ctx, "PAL"))
 			return (0);
-		if (pass == LAST_PASS) {
-			if (expr_lablptr->pal == -1)
-				error("No palette index for this symbol!");
+		if (ctx->pass == LAST_PASS) {
+			if (ctx->expr_lablptr->ext->pal == -1)
+				fixup_error(ctx, "No palette index for this symbol!");
 		}
-		val[0] = expr_lablptr->pal;
+		val[0] = ctx->expr_lablptr->ext->pal;
 		break;
 
 	/* DEFINED */
 	case OP_DEFINED:
-		if (!check_func_args("DEFINED"))
+		if (!check_func_args(ctx, "DEFINED"))
 			return (0);
-		if ((expr_lablptr->type != IFUNDEF) && (expr_lablptr->type != UNDEF))
+		if ((ctx->expr_lablptr->type != IFUNDEF) && (ctx->expr_lablptr->type != UNDEF))
 			val[0] = 1;
 		else {
 			val[0] = 0;
-			undef--;
+			ctx->undef--;
+			if (ctx->single_pass)
+				fixup_probe(ctx, FIX_DEFINED, ctx->expr_lablptr->name, ctx->expr_lablptr->hash);
 		}
 		break;
 
 	/* SIZEOF */
 	case OP_SIZEOF:
-		if (!check_func_args("SIZEOF"))
+		if (!check_func_args(ctx, "SIZEOF"))
 			return (0);
-		if (pass == LAST_PASS) {
-			if (expr_lablptr->data_type == -1) {
-				error("No size attributes for this symbol!");
-				return (0);
+		if (ctx->pass == LAST_PASS) {
+			if (ctx->expr_lablptr->ext->data_type == -1) {
+				if (fixup_error(ctx, "No size attributes for this symbol!"))
+					return (0);
 			}
 		}
-		val[0] = expr_lablptr->data_size;
+
+		/* the size of the last label is being set again,
+		 * a region of a parallel last pass keeps its own
+		 */
+		if (ctx->in_region && (ctx->expr_lablptr == ctx->lastlabl))
+			val[0] = ctx->region_size;
+		else
+			val[0] = ctx->expr_lablptr->ext->data_size;
 		break;
 
 	/* HIGH */
@@ -822,7 +1039,7 @@ do_op(void)
 
     case OP_DIV:
         if (val[0] == 0) {
-			error("Divide by zero!");
+			error(ctx, "Divide by zero!");
 			return (0);
 		}
         val[0] = val[1] / val[0];
@@ -830,7 +1047,7 @@ do_op(void)
 
 	case OP_MOD:
         if (val[0] == 0) {
-			error("Divide by zero!");
+			error(ctx, "Divide by zero!");
 			return (0);
 		}
         val[0] = val[1] % val[0];
@@ -893,12 +1110,12 @@ do_op(void)
         break;
 
     default:
-		error("Invalid operator in expression!");
+		error(ctx, "Invalid operator in expression!");
 		return (0);
     }
 
 	/* result */
-    val_stack[val_idx] = val[0];
+    ctx->val_stack[ctx->val_idx] = val[0];
     return (1);
 }
 
@@ -910,20 +1127,310 @@ do_op(void)
  */
 
 int
-check_func_args(char *func_name)
+check_func_args(struct t_context *ctx, char *func_name)
 {
 	char string[64];
 
-	if (expr_lablcnt == 1)
+	if (ctx->expr_lablcnt == 1)
 		return (1);
-	else if (expr_lablcnt == 0)
+	else if (ctx->expr_lablcnt == 0)
 		sprintf(string, "No symbol in function %s!", func_name);
 	else {
 		sprintf(string, "Too many symbols in function %s!", func_name);
 	}
 
 	/* output message */
-	error(string);
+	error(ctx, string);
 	return (0);
 }
 
+
+
+/* ----
+ * expr_emit()
+ * ----
+ * add an instruction to the expression being compiled and
+ * to the function body being compiled, the values read in
+ * the arguments of the function are its argument slots
+ */
+
+void
+expr_emit(struct t_context *ctx, int op, int value, struct t_symbol *sym)
+{
+	if (ctx->expr_nb >= 0)
+		ctx->expr_nb = expr_add(ctx, ctx->expr_code, ctx->expr_nb, op, value, sym);
+
+	if (ctx->func_nb >= 0) {
+		if ((ctx->func_idx == ctx->func_level + 2) && (op >= EX_CONST) && (op != EX_FUNC)) {
+			op = EX_ARG;
+			value = ctx->func_argn;
+			sym = NULL;
+		}
+		ctx->func_nb = expr_add(ctx, ctx->func_code, ctx->func_nb, op, value, sym);
+	}
+}
+
+
+/* ----
+ * expr_add()
+ * ----
+ * add an instruction to a compiled expression, the
+ * operators applied to constants are replaced by their
+ * result; return the new number of instructions, -1
+ * if the expression is too complex
+ */
+
+int
+expr_add(struct t_context *ctx, struct t_exprop *code, int nb, int op, int value, struct t_symbol *sym)
+{
+	/* fold constants, the symbol functions are kept */
+	if ((op < OP_DEFINED) || (op == OP_HIGH) || (op == OP_LOW)) {
+		if (op_pri[op] < 9) {
+			if ((nb >= 2) && (code[nb - 1].op == EX_CONST) && (code[nb - 2].op == EX_CONST)) {
+				code[nb - 2].value = value;
+				return (nb - 1);
+			}
+		}
+		else {
+			if ((nb >= 1) && (code[nb - 1].op == EX_CONST)) {
+				code[nb - 1].value = value;
+				return (nb);
+			}
+		}
+	}
+
+	/* too complex, it will be parsed each time */
+	if (nb == EXPR_CODE_MAX)
+		return (-1);
+
+	code[nb].op = op;
+	code[nb].value = value;
+	code[nb].sym = sym;
+	code[nb].scope = (op == EX_LOCAL) ? ctx->glablptr : NULL;
+	return (nb + 1);
+}
+
+
+/* ----
+ * expr_save()
+ * ----
+ * attach the compiled expression to the line analysis
+ */
+
+void
+expr_save(struct t_context *ctx, struct t_lexinfo *lex, int start, int end, char last_char)
+{
+	struct t_expr *ex, **last;
+	int size;
+
+	size = sizeof(struct t_expr) + (ctx->expr_nb - 1) * sizeof(struct t_exprop);
+	if ((ex = arena_alloc(&ctx->expr_arena, size)) == NULL)
+		return;
+
+	ex->next = NULL;
+	ex->start = start;
+	ex->end = end;
+	ex->last_char = last_char;
+	ex->nb = ctx->expr_nb;
+	memcpy(ex->code, ctx->expr_code, ctx->expr_nb * sizeof(struct t_exprop));
+
+	/* keep them in the order of the line */
+	for (last = &lex->expr; *last; last = &(*last)->next)
+		;
+	*last = ex;
+}
+
+
+/* ----
+ * expr_run()
+ * ----
+ * evaluate a compiled expression, same results and
+ * messages as if it was parsed
+ */
+
+int
+expr_run(struct t_context *ctx, struct t_expr *ex, int *ip)
+{
+	ctx->undef = 0;
+	ctx->op_idx = 0;
+	ctx->val_idx = 0;
+	ctx->val_stack[0] = 0;
+	ctx->expr_lablptr = NULL;
+	ctx->expr_lablcnt = 0;
+
+	if (!expr_exec(ctx, ex->code, ex->nb, NULL))
+		return (0);
+
+	/* get the expression value */
+	ctx->value = ctx->val_stack[ctx->val_idx];
+
+	/* any undefined symbols? trap that if in the last pass */
+	if (ctx->undef) {
+		if (ctx->single_pass || (ctx->obj_opt && (ctx->pass == LAST_PASS)))
+			fixup_defer(ctx, ex->code, ex->nb);
+		else if (ctx->pass == LAST_PASS)
+			error(ctx, "Undefined symbol in operand field!");
+	}
+	ctx->fix_type = FIX_NONE;
+
+	/* skip the expression */
+	ctx->expr = (unsigned char*)&ctx->prlnbuf[ex->end];
+	*ip = ex->end;
+	return (1);
+}
+
+
+/* ----
+ * expr_exec()
+ * ----
+ * run compiled instructions on the value stack, 'arg' are
+ * the arguments of a function body; the instructions run
+ * are added to the expression being compiled
+ */
+
+int
+expr_exec(struct t_context *ctx, struct t_exprop *code, int nb, struct t_funcarg *arg)
+{
+	struct t_symbol *sym;
+	unsigned int val;
+	int op, i;
+
+	for (i = 0; i < nb; i++, code++) {
+		op = code->op;
+		sym = NULL;
+
+		switch (op) {
+		case EX_ARG:
+			/* a symbol is searched each time, like in the text */
+			if (arg[code->value].type == T_SYMBOL) {
+				memcpy(ctx->symbol, arg[code->value].name, arg[code->value].name[0] + 1);
+				ctx->symbol[arg[code->value].name[0] + 1] = '\0';
+				if ((sym = stlookh(ctx, arg[code->value].hash, 1)) == NULL)
+					return (0);
+				op = ((ctx->symbol[1] == '.') || (ctx->symbol[1] == '@')) ? EX_LOCAL : EX_SYMBOL;
+				goto symbol;
+			}
+			if (arg[code->value].type == T_PC) {
+				op = EX_PC;
+				goto pc;
+			}
+			op = EX_CONST;
+			val = arg[code->value].value;
+			break;
+
+		case EX_CONST:
+			val = code->value;
+			break;
+
+		case EX_PC:
+		pc:
+			if (ctx->data_loccnt == -1)
+				val = (ctx->loccnt + (ctx->page << 13));
+			else
+				val = (ctx->data_loccnt + (ctx->page << 13));
+			break;
+
+		case EX_LOCAL:
+			/* search the symbol again if the scope changed */
+			if (code->scope != ctx->glablptr) {
+				sym = code->sym;
+				memcpy(ctx->symbol, sym->name, sym->name[0] + 1);
+				ctx->symbol[sym->name[0] + 1] = '\0';
+				if ((sym = stlookh(ctx, sym->hash, 1)) == NULL)
+					return (0);
+				if (!ctx->in_region) {
+					code->sym = sym;
+					code->scope = ctx->glablptr;
+				}
+				goto symbol;
+			}
+			sym = code->sym;
+			if (!ctx->in_region)
+				sym->refcnt++;
+			goto symbol;
+
+		case EX_SYMBOL:
+			sym = code->sym;
+			if (!ctx->in_region)
+				sym->refcnt++;
+
+		symbol:
+			/* same as push_val() */
+			ctx->expr_lablptr = sym;
+			val = 0;
+			if ((sym->type == UNDEF) || (sym->type == IFUNDEF))
+				ctx->undef++;
+			else
+				val = sym->value;
+			ctx->expr_lablcnt++;
+			break;
+
+		case EX_FUNC:
+			/* same as check_keyword() */
+			ctx->expr_lablptr = NULL;
+			ctx->expr_lablcnt = 0;
+			expr_emit(ctx, op, 0, NULL);
+			continue;
+
+		default:
+			if (!exec_op(ctx, op))
+				return (0);
+			expr_emit(ctx, op, ctx->val_stack[ctx->val_idx], NULL);
+			continue;
+		}
+
+		/* push the value */
+		expr_emit(ctx, op, val, sym);
+		ctx->val_idx++;
+		ctx->val_stack[ctx->val_idx] = val;
+	}
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * expr_check()
+ * ----
+ * get the size of the value stack needed by compiled
+ * instructions, return 1 if they only use constants,
+ * arguments and operators that can be folded
+ */
+
+int
+expr_check(struct t_exprop *code, int nb, int *depth)
+{
+	int pure, size, i;
+
+	pure = 1;
+	size = 0;
+	*depth = 0;
+
+	for (i = 0; i < nb; i++) {
+		switch (code[i].op) {
+		case EX_CONST:
+		case EX_ARG:
+			size++;
+			break;
+		case EX_SYMBOL:
+		case EX_LOCAL:
+		case EX_PC:
+			pure = 0;
+			size++;
+			break;
+		case EX_FUNC:
+			pure = 0;
+			break;
+		default:
+			if ((code[i].op >= OP_DEFINED) && (code[i].op != OP_HIGH) && (code[i].op != OP_LOW))
+				pure = 0;
+			if (op_pri[code[i].op] < 9)
+				size--;
+			break;
+		}
+		if (*depth < size)
+			*depth = size;
+	}
+	return (pure);
+}
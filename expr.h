@@ -40,13 +40,13 @@
 #define OP_PAL		27
 #define OP_SIZEOF	28
 
-unsigned int  op_stack[64] = { OP_START };	/* operator stack */
-unsigned int val_stack[64];	/* value stack */
-int op_idx, val_idx;	/* index in the operator and value stacks */
-int need_operator;		/* when set await an operator, else await a value */
-unsigned char *expr;	/* pointer to the expression string */
-unsigned char *expr_stack[16];	/* expression stack */
-struct t_symbol *expr_lablptr;	/* pointer to the lastest label */
-int expr_lablcnt;		/* number of label seen in an expression */
+/* compiled expression values */
+#define EX_CONST	32
+#define EX_SYMBOL	33
+#define EX_LOCAL	34
+#define EX_PC		35
+#define EX_FUNC		36	/* predefined function, forget the symbols seen */
+#define EX_ARG		37	/* argument of a function body */
+
 
 #endif /* PCEAS_EXPR_H */
@@ -0,0 +1,468 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+#include "expr.h"
+
+/* the symbols set after the first pass */
+static char *fix_symbols[] = {
+	"_bss_end", "_bank_base", "_nb_bank", "_call_bank", NULL
+};
+
+
+/* ----
+ * fixup_start()
+ * ----
+ * prepare the single pass, the first pass then generates the
+ * code too; the values of the symbols not defined yet are kept
+ * as fixups and patched at the end of the pass
+ */
+
+void
+fixup_start(struct t_context *ctx)
+{
+	ctx->single_pass = 1;
+	ctx->fix_type = FIX_NONE;
+	ctx->fix_bank = 0;
+	ctx->fix_refs = fixup_refs(ctx);
+	ctx->fix_pend = NULL;
+	ctx->fix_list = NULL;
+	ctx->fix_last = NULL;
+}
+
+
+/* ----
+ * fixup_abort()
+ * ----
+ * give up the single pass, the symbols are defined as in
+ * a first pass so it goes on as one; the code generated
+ * so far is cleared and the last pass will be run
+ */
+
+void
+fixup_abort(struct t_context *ctx)
+{
+	ctx->single_pass = 0;
+	ctx->pass = FIRST_PASS;
+	ctx->fix_pend = NULL;
+	ctx->fix_list = NULL;
+	fixup_reset(ctx);
+}
+
+
+/* ----
+ * fixup_reset()
+ * ----
+ * clear the outputs of the single pass before the last pass
+ */
+
+void
+fixup_reset(struct t_context *ctx)
+{
+	memset(ctx->rom, 0xFF, 8192 * 128);
+	memset(ctx->map, 0xFF, 8192 * 128);
+	ctx->lst_buf.size = 0;
+	ctx->tile_lablptr = NULL;
+}
+
+
+/* ----
+ * fixup_fail()
+ * ----
+ * an undefined symbol can not be patched, the single pass is
+ * given up; the last pass of an object file reports it
+ */
+
+void
+fixup_fail(struct t_context *ctx)
+{
+	ctx->fix_pend = NULL;
+	if (ctx->single_pass)
+		fixup_abort(ctx);
+	else
+		error(ctx, "Undefined symbol in operand field!");
+}
+
+
+/* ----
+ * fixup_defer()
+ * ----
+ * keep an expression just evaluated with undefined symbols,
+ * it must be placed with fixup_place() before the next one;
+ * only the operands and the data tables asking for it can be
+ * patched, the single pass is given up for the other ones;
+ * the fixups of an object file are patched by the linker
+ */
+
+void
+fixup_defer(struct t_context *ctx, struct t_exprop *code, int nb)
+{
+	struct t_fixup *fix;
+	struct t_exprop *ptr;
+	int type, op;
+	int i;
+
+	type = ctx->fix_type;
+	ctx->fix_type = FIX_NONE;
+
+	if ((type == FIX_NONE) || (ctx->fix_pend) || (nb <= 0)) {
+		fixup_fail(ctx);
+		return;
+	}
+
+	/* the symbol functions and the divisions could fail
+	 * once the symbols are known, the linker knows the
+	 * banks of the symbols imported
+	 */
+	for (i = 0; i < nb; i++) {
+		op = code[i].op;
+		if (ctx->obj_opt && ((op == OP_BANK) || (op == OP_PAGE)))
+			continue;
+		if ((op == OP_DIV) || (op == OP_MOD) ||
+		   ((op >= OP_DEFINED) && (op < EX_CONST) && (op != OP_HIGH) && (op != OP_LOW)) ||
+			(op == EX_ARG)) {
+			fixup_fail(ctx);
+			return;
+		}
+	}
+
+	fix = arena_alloc(&ctx->fix_arena, sizeof(struct t_fixup) + (nb - 1) * sizeof(struct t_exprop));
+	if (fix == NULL) {
+		fixup_fail(ctx);
+		return;
+	}
+
+	/* the location counter and the scope of the local
+	 * symbols are the ones of the current line
+	 */
+	ptr = fix->code;
+	for (i = 0; i < nb; i++, ptr++) {
+		*ptr = code[i];
+		ptr->scope = NULL;
+		if (ptr->op == EX_LOCAL)
+			ptr->op = EX_SYMBOL;
+		if (ptr->op == EX_PC) {
+			ptr->op = EX_CONST;
+			if (ctx->data_loccnt == -1)
+				ptr->value = ctx->loccnt + (ctx->page << 13);
+			else
+				ptr->value = ctx->data_loccnt + (ctx->page << 13);
+		}
+	}
+
+	fix->next = NULL;
+	fix->type = type;
+	fix->nb = nb;
+	fix->adjust = 0;
+
+	/* branch offset */
+	if (type == FIX_REL)
+		fix->adjust = -(ctx->loccnt + (ctx->page << 13));
+
+	ctx->fix_pend = fix;
+
+	/* the value is not checked until it's patched */
+	ctx->value = 0;
+}
+
+
+/* ----
+ * fixup_operand()
+ * ----
+ * set the kind of value of an instruction operand, same
+ * adjustments as in getoperand()
+ */
+
+void
+fixup_operand(struct t_context *ctx, int type)
+{
+	struct t_fixup *fix = ctx->fix_pend;
+
+	if (fix->type != FIX_OPERAND)
+		return;
+
+	if (type == FIX_IMM) {
+		if (ctx->opext == 'L')
+			type = FIX_LOW;
+		else if (ctx->opext == 'H')
+			type = FIX_HIGH;
+	}
+	else {
+		if ((ctx->opext == 'H') && !ctx->auto_inc)
+			fix->adjust = 1;
+	}
+	fix->type = type;
+}
+
+
+/* ----
+ * fixup_place()
+ * ----
+ * place the pending fixup in the current bank
+ */
+
+void
+fixup_place(struct t_context *ctx, int offset)
+{
+	struct t_fixup *fix = ctx->fix_pend;
+
+	ctx->fix_pend = NULL;
+	if (fix->type == FIX_OPERAND) {
+		fixup_fail(ctx);
+		return;
+	}
+
+	fix->bank = ctx->bank;
+	fix->offset = offset;
+
+	if (ctx->fix_list)
+		ctx->fix_last->next = fix;
+	else
+		ctx->fix_list = fix;
+	ctx->fix_last = fix;
+}
+
+
+/* ----
+ * fixup_probe()
+ * ----
+ * remember a symbol the single pass saw undefined while
+ * testing it, the last pass could see it defined; FIX_IFDEF
+ * is for the tests where it only has to exist, FIX_ARGTYPE
+ * for the ones only seeing the constants
+ */
+
+void
+fixup_probe(struct t_context *ctx, int type, char *name, unsigned int hash)
+{
+	struct t_fixup *fix;
+
+	/* the local symbols depend on the scope */
+	if ((name[1] == '.') || (name[1] == '@')) {
+		fixup_abort(ctx);
+		return;
+	}
+
+	fix = arena_alloc(&ctx->fix_arena, sizeof(struct t_fixup));
+	if ((fix == NULL) || ((name = name_intern(&ctx->names, name, hash)) == NULL)) {
+		fixup_abort(ctx);
+		return;
+	}
+
+	fix->next = NULL;
+	fix->type = type;
+	fix->name = name;
+	fix->hash = hash;
+	fix->nb = 0;
+
+	if (ctx->fix_list)
+		ctx->fix_last->next = fix;
+	else
+		ctx->fix_list = fix;
+	ctx->fix_last = fix;
+}
+
+
+/* ----
+ * fixup_error()
+ * ----
+ * error only checked by the last pass, the single pass is given
+ * up and goes on as a first pass so that it's reported by the
+ * last pass, after the errors of the first pass; return 1 if
+ * the error was reported
+ */
+
+int
+fixup_error(struct t_context *ctx, char *msg)
+{
+	if (ctx->single_pass) {
+		fixup_abort(ctx);
+		return (0);
+	}
+	error(ctx, msg);
+	return (1);
+}
+
+
+/* ----
+ * fixup_end()
+ * ----
+ * end of the single pass, the symbols are now known as after
+ * a first pass; it is given up if the symbols set after the
+ * first pass were used, their values were not the final ones
+ */
+
+void
+fixup_end(struct t_context *ctx)
+{
+	if (fixup_refs(ctx) != ctx->fix_refs)
+		fixup_abort(ctx);
+	else
+		ctx->pass = FIRST_PASS;
+}
+
+
+/* ----
+ * fixup_apply()
+ * ----
+ * patch the fixups once all the symbols are known, return 0
+ * if one of them can not be resolved or if its value must be
+ * reported as an error, the last pass must then be run
+ */
+
+int
+fixup_apply(struct t_context *ctx)
+{
+	struct t_symbol *sym;
+	struct t_fixup *fix;
+
+	ctx->expr_nb = -1;
+	ctx->func_nb = -1;
+
+	for (fix = ctx->fix_list; fix; fix = fix->next) {
+		/* symbols tested, the result must be the same */
+		if (fix->nb == 0) {
+			sym = st_search(&ctx->sym_tbl.idx, fix->name, fix->hash);
+			if (sym == NULL)
+				continue;
+			if (fix->type == FIX_IFDEF)
+				return (0);
+			if ((sym->type == UNDEF) || (sym->type == IFUNDEF))
+				continue;
+			if ((fix->type == FIX_DEFINED) || (sym->bank == RESERVED_BANK))
+				return (0);
+			continue;
+		}
+
+		if (!fixup_patch(ctx, fix))
+			return (0);
+	}
+
+	/* update rom size */
+	if (ctx->fix_bank > ctx->max_bank)
+		ctx->max_bank = ctx->fix_bank;
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * fixup_patch()
+ * ----
+ * write the value of a fixup in the rom, return 0 if one of
+ * its symbols is undefined or if its value is out of range
+ */
+
+int
+fixup_patch(struct t_context *ctx, struct t_fixup *fix)
+{
+	unsigned char *rom;
+	unsigned int val;
+	int size;
+
+	ctx->undef = 0;
+	ctx->val_idx = 0;
+	ctx->val_stack[0] = 0;
+	ctx->expr_lablptr = NULL;
+	ctx->expr_lablcnt = 0;
+
+	if (!expr_exec(ctx, fix->code, fix->nb, NULL) || ctx->undef)
+		return (0);
+	val = ctx->val_stack[ctx->val_idx] + fix->adjust;
+
+	/* same checks as in the last pass */
+	size = 1;
+	switch (fix->type) {
+	case FIX_BYTE:
+		if ((val > 0xFF) && (val < 0xFFFFFF80))
+			return (0);
+		break;
+
+	case FIX_WORD:
+		if ((val > 0xFFFF) && (val < 0xFFFF8000))
+			return (0);
+		size = 2;
+		break;
+
+	case FIX_DWL:
+		if ((val > 0xFFFF) && (val < 0xFFFF8000))
+			return (0);
+		break;
+
+	case FIX_DWH:
+		if ((val > 0xFFFF) && (val < 0xFFFF8000))
+			return (0);
+		val >>= 8;
+		break;
+
+	case FIX_IMM:
+		if ((val > 0xFF) && (val < 0xFFFFFF00))
+			return (0);
+		break;
+
+	case FIX_HIGH:
+		val = (val & 0xFF00) >> 8;
+		break;
+
+	case FIX_ZP:
+		if ((val & 0xFFFFFF00) && ((val & 0xFFFFFF00) != ctx->machine->ram_base))
+			return (0);
+		break;
+
+	case FIX_ABS:
+		if (val & 0xFFFF0000)
+			return (0);
+		size = 2;
+		break;
+
+	case FIX_REL:
+		if ((val > 0x7F) && (val < 0xFFFFFF80))
+			return (0);
+		break;
+	}
+
+	/* the values out of the bank are dropped */
+	if ((fix->bank >= RESERVED_BANK) || (fix->offset + size > 0x2000))
+		return (1);
+
+	rom = &ctx->rom[fix->bank][fix->offset];
+	rom[0] = val & 0xFF;
+	if (size == 2)
+		rom[1] = (val >> 8) & 0xFF;
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * fixup_refs()
+ * ----
+ * count the references to the symbols set after the first
+ * pass, they can't be used by the single pass
+ */
+
+int
+fixup_refs(struct t_context *ctx)
+{
+	struct t_symbol *sym;
+	unsigned int hash;
+	char *name;
+	int nb, i;
+
+	nb = 0;
+	for (i = 0; fix_symbols[i]; i++) {
+		ctx->symbol[0] = strlen(fix_symbols[i]);
+		strcpy(&ctx->symbol[1], fix_symbols[i]);
+		hash = st_hash(ctx->symbol);
+
+		name = name_look(&ctx->names, ctx->symbol, hash);
+		sym  = name ? st_search(&ctx->sym_tbl.idx, name, hash) : NULL;
+		if (sym)
+			nb += sym->refcnt;
+	}
+	return (nb);
+}
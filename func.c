@@ -5,12 +5,7 @@
 #include "defs.h"
 #include "externs.h"
 #include "protos.h"
-
-struct t_func *func_tbl[256];
-struct t_func *func_ptr;
-char func_line[128];
-char func_arg[8][10][80];
-int  func_idx;
+#include "expr.h"
 
 
 /* ----
@@ -20,33 +15,33 @@ int  func_idx;
  */
 
 void
-do_func(int *ip)
+do_func(struct t_context *ctx, int *ip)
 {
-	if (pass == LAST_PASS)
-		println();
+	if ((ctx->pass == LAST_PASS) && !ctx->single_pass)
+		println(ctx);
 	else {
 		/* error checking */
-		if (lablptr == NULL) {
-			error("No name for this function!");
+		if (ctx->lablptr == NULL) {
+			error(ctx, "No name for this function!");
 			return;
 		}
-		if (lablptr->refcnt) {
-			switch (lablptr->type) {
+		if (ctx->lablptr->refcnt) {
+			switch (ctx->lablptr->type) {
 			case MACRO:
-				fatal_error("Symbol already used by a macro!");
+				fatal_error(ctx, "Symbol already used by a macro!");
 
 			case FUNC:
-				fatal_error("Function already defined!");
+				fatal_error(ctx, "Function already defined!");
 				return;
 
 			default:
-				fatal_error("Symbol already used by a label!");
+				fatal_error(ctx, "Symbol already used by a label!");
 				return;
 			}
 		}
 
 		/* install this new function in the hash table */
-		if (!func_install(*ip))
+		if (!func_install(ctx, *ip))
 			return;
 	} 
 }
@@ -54,21 +49,24 @@ do_func(int *ip)
 /* search a function */
 
 int
-func_look(void)
+func_look(struct t_context *ctx)
 {
+	char *name;
 	int hash;
 
 	/* search the function in the hash table */
-	hash = symhash();
-	func_ptr = func_tbl[hash];
-	while (func_ptr) {
-		if (!strcmp(&symbol[1], func_ptr->name))
+	if ((name = name_look(&ctx->names, ctx->symbol, st_hash(ctx->symbol))) == NULL)
+		return (0);
+	hash = symhash(ctx);
+	ctx->func_ptr = ctx->func_tbl[hash];
+	while (ctx->func_ptr) {
+		if (ctx->func_ptr->name == name)
 			break;			
-		func_ptr = func_ptr->next;
+		ctx->func_ptr = ctx->func_ptr->next;
 	}
 
 	/* ok */
-	if (func_ptr)
+	if (ctx->func_ptr)
 		return (1);
 
 	/* didn't find a function with this name */
@@ -78,35 +76,39 @@ func_look(void)
 /* install a function in the hash table */
 
 int
-func_install(int ip)
+func_install(struct t_context *ctx, int ip)
 {
 	int hash;
 
 	/* mark the function name as reserved */
-	lablptr->type = FUNC;
+	ctx->lablptr->type = FUNC;
 
 	/* check function name syntax */
-	if (strchr(&symbol[1], '.')) {
-		error("Invalid function name!");
+	if (strchr(&ctx->symbol[1], '.')) {
+		error(ctx, "Invalid function name!");
 		return (0);
 	}
 
 	/* extract function body */
-	if (func_extract(ip) == -1)
+	if (func_extract(ctx, ip) == -1)
 		return (0);
 
 	/* allocate a new func struct */
-	if ((func_ptr = (void *)malloc(sizeof(struct t_func))) == NULL) {
-		error("Out of memory!");
+	if ((ctx->func_ptr = arena_alloc(&ctx->func_arena, sizeof(struct t_func))) == NULL) {
+		error(ctx, "Out of memory!");
 		return (0);
 	}
+	memset(ctx->func_ptr, 0, sizeof(struct t_func));
 
 	/* initialize it */
-	strcpy(func_ptr->name, &symbol[1]);
-	strcpy(func_ptr->line, func_line);
-	hash = symhash();
-	func_ptr->next = func_tbl[hash];
-	func_tbl[hash] = func_ptr;
+	if ((ctx->func_ptr->name = name_intern(&ctx->names, ctx->symbol, st_hash(ctx->symbol))) == NULL) {
+		error(ctx, "Out of memory!");
+		return (0);
+	}
+	strcpy(ctx->func_ptr->line, ctx->func_line);
+	hash = symhash(ctx);
+	ctx->func_ptr->next = ctx->func_tbl[hash];
+	ctx->func_tbl[hash] = ctx->func_ptr;
 
 	/* ok */
 	return (1);
@@ -115,7 +117,7 @@ func_install(int ip)
 /* extract function body */
 
 int
-func_extract(int ip)
+func_extract(struct t_context *ctx, int ip)
 {
 	char *ptr;
 	char  c;
@@ -123,17 +125,17 @@ func_extract(int ip)
 	int   end;
 
 	/* skip spaces */
-	while (isspace(prlnbuf[ip]))
+	while (isspace(ctx->prlnbuf[ip]))
 		ip++;
 
 	/* get function body */
-	ptr = func_line;
+	ptr = ctx->func_line;
 	max_arg = 0;
 	end = 0;
 	i = 0;
 
 	while (!end) {
-		c = prlnbuf[ip++];
+		c = ctx->prlnbuf[ip++];
 		switch (c) {
 		/* end of line */	
 		case ';':
@@ -146,9 +148,9 @@ func_extract(int ip)
 		case '\\':
 		   *ptr++ = c;
 		    i++;
-			c = prlnbuf[ip++];
+			c = ctx->prlnbuf[ip++];
 			if ((c < '1') || (c > '9')) {
-				error("Invalid function argument!");
+				error(ctx, "Invalid function argument!");
 				return (-1);
 			}
 			arg = c - '1';
@@ -160,7 +162,7 @@ func_extract(int ip)
 		   *ptr++ = c;
 		    i++;
 			if (i == 127) {
-				error("Function line too long!");
+				error(ctx, "Function line too long!");
 				return (-1);
 			}
 			break;
@@ -174,48 +176,48 @@ func_extract(int ip)
 /* extract function args */
 
 int
-func_getargs(void)
+func_getargs(struct t_context *ctx)
 {
 	char c, *ptr, *line;
 	int arg, level, space, flag;
 	int i, x;
 
 	/* can not nest too much macros */
-	if (func_idx == 7) {
-		error("Too many nested function calls!");
+	if (ctx->func_idx == 7) {
+		error(ctx, "Too many nested function calls!");
 		return (0);
 	}
 
 	/* skip spaces */
-	while (isspace(*expr))
-		expr++;
+	while (isspace(*ctx->expr))
+		ctx->expr++;
 
 	/* function args must be enclosed in parenthesis */
-	if (*expr++ != '(')
+	if (*ctx->expr++ != '(')
 		return (0);
 
 	/* initialize args */
     line = NULL;
-	ptr  = func_arg[func_idx][0];
+	ptr  = ctx->func_arg[ctx->func_idx][0];
 	arg  = 0;
 
 	for (i = 0; i < 9; i++)
-		func_arg[func_idx][i][0] = '\0';
+		ctx->func_arg[ctx->func_idx][i][0] = '\0';
 
 	/* get args one by one */
 	for (;;) {
 		/* skip spaces */
-		while (isspace(*expr))
-			expr++;
+		while (isspace(*ctx->expr))
+			ctx->expr++;
 
-		c = *expr++;
+		c = *ctx->expr++;
 		switch (c) {
 		/* empty arg */
 		case ',':
 			arg++;
-			ptr = func_arg[func_idx][arg];
+			ptr = ctx->func_arg[ctx->func_idx][arg];
 			if (arg == 9) {
-				error("Too many arguments for a function!");
+				error(ctx, "Too many arguments for a function!");
 				return (0);
 			}
 			break;
@@ -223,7 +225,7 @@ func_getargs(void)
 		/* end of line */	
 		case ';':
 		case '\0':
-			error("Syntax error in function call!");
+			error(ctx, "Syntax error in function call!");
 			return (0);
 
 		/* end of function */
@@ -243,7 +245,7 @@ func_getargs(void)
 						break;
 					else {
 						flag = 0;
-						c = *expr++;
+						c = *ctx->expr++;
 						continue;
 					}
 				}
@@ -255,16 +257,16 @@ func_getargs(void)
 						break;
 				}
 				else if (c == '\\') {
-					if (func_idx == 0) {
-						error("Syntax error!");
+					if (ctx->func_idx == 0) {
+						error(ctx, "Syntax error!");
 						return (0);
 					}
-					c = *expr++;
+					c = *ctx->expr++;
 					if (c < '1' || c > '9') {
-						error("Invalid function argument index!");
+						error(ctx, "Invalid function argument index!");
 						return (0);
 					}
-					line = func_arg[func_idx - 1][c - '1'];
+					line = ctx->func_arg[ctx->func_idx - 1][c - '1'];
 					flag = 1;
 					c = *line++;
 					continue;
@@ -292,19 +294,330 @@ func_getargs(void)
 					ptr[i++] = c;
 				}
 				if (i == 80) {
-					error("Invalid function argument length!");
+					error(ctx, "Invalid function argument length!");
 					return (0);
 				}
 				x++;
 				if (flag)
 					c = *line++;
 				else
-					c = *expr++;
+					c = *ctx->expr++;
 			}
 			ptr[i] = '\0';
-			expr--;
+			ctx->expr--;
+			break;
+		}
+	}
+}
+
+
+/* ----
+ * func_call()
+ * ----
+ * evaluate a function call with the compiled body of the
+ * function; the text of the body is expanded in the
+ * expression so the compiled body can only be used when
+ * the call is the whole operand and when its arguments
+ * are single values; the body is compiled during the first
+ * expansion of such a call; return 1 if the call was
+ * evaluated, 0 if it must be expanded, -1 on error
+ */
+
+int
+func_call(struct t_context *ctx, struct t_func *func)
+{
+	struct t_funcarg arg[9];
+	unsigned char *ptr;
+	int nb, i;
+
+	/* a function calling another one is not compiled */
+	if (ctx->func_nb >= 0) {
+		ctx->func_cur->flag |= FUNC_TEXT;
+		ctx->func_nb = -1;
+		return (0);
+	}
+	if (func->flag & FUNC_TEXT)
+		return (0);
+
+	/* the call must be the whole operand, nothing before */
+	if (ctx->op_stack[ctx->op_idx] > OP_OPEN)
+		return (0);
+
+	/* and nothing after */
+	for (ptr = ctx->expr; (*ptr == ' ') || (*ptr == '\t'); ptr++)
+		;
+	switch (*ptr) {
+	case ',':
+	case ';':
+	case ')':
+		break;
+	case '\0':
+		if (ctx->func_idx == 0)
 			break;
+		return (0);
+	default:
+		return (0);
+	}
+
+	/* get the arguments, an empty one can not be used */
+	nb = func->code ? func->nb_args : 9;
+	for (i = 0; i < nb; i++) {
+		if (!func_getarg(ctx, &arg[i], ctx->func_arg[ctx->func_idx][i])) {
+			if (func->code || ctx->func_arg[ctx->func_idx][i][0])
+				return (0);
 		}
 	}
+
+	/* compile the body while it's expanded, the
+	 * parenthesis must be balanced
+	 */
+	if (func->code == NULL) {
+		/* not by the regions of a parallel last pass,
+		 * they share the function
+		 */
+		if (ctx->in_region) {
+			region_abort(ctx);
+			return (0);
+		}
+		for (i = 0, ptr = (unsigned char *)func->line; *ptr && (i >= 0); ptr++) {
+			if (*ptr == '(')
+				i++;
+			if (*ptr == ')')
+				i--;
+		}
+		if (i != 0) {
+			func->flag |= FUNC_TEXT;
+			return (0);
+		}
+		ctx->func_cur = func;
+		ctx->func_nb = 0;
+		ctx->func_level = ctx->func_idx;
+		ctx->func_opidx = ctx->op_idx;
+		ctx->func_errcnt = ctx->errcnt;
+		return (0);
+	}
+
+	/* run it */
+	return (func_run(ctx, func, arg));
+}
+
+
+/* ----
+ * func_getarg()
+ * ----
+ * get a function argument made of a single number, symbol
+ * or program counter; return 0 if it's something else
+ */
+
+int
+func_getarg(struct t_context *ctx, struct t_funcarg *arg, char *text)
+{
+	unsigned int val, mul;
+	int c, i;
+
+	val = 0;
+	mul = 0;
+	arg->type = T_DECIMAL;
+
+	switch (text[0]) {
+	/* program counter */
+	case '*':
+		if (text[1] != '\0')
+			return (0);
+		arg->type = T_PC;
+		return (1);
+
+	/* character */
+	case '\'':
+		if ((text[1] == '\0') || (text[2] != '\'') || (text[3] != '\0'))
+			return (0);
+		arg->value = (unsigned char)text[1];
+		return (1);
+
+	/* numbers */
+	case '$':
+		mul = 16;
+		text++;
+		break;
+	case '%':
+		mul = 2;
+		text++;
+		break;
+	case '0':
+		if (cc_upper[(unsigned char)text[1]] == 'X') {
+			mul = 16;
+			text += 2;
+		}
+		else
+			mul = 10;
+		break;
+	default:
+		if (cclass(text[0]) & CC_DIGIT)
+			mul = 10;
+		break;
+	}
+
+	if (mul) {
+		if (text[0] == '\0')
+			return (0);
+		for (; *text; text++) {
+			c = cc_upper[(unsigned char)*text];
+			if ((c == '_') && (mul == 2))
+				continue;
+			if (cclass(c) & CC_DIGIT)
+				c -= '0';
+			else if ((c >= 'A') && (c <= 'F'))
+				c -= 'A' - 10;
+			else
+				return (0);
+			if ((unsigned int)c >= mul)
+				return (0);
+			val = (val * mul) + c;
+		}
+		arg->value = val;
+		return (1);
+	}
+
+	/* symbol */
+	if (!(cclass(text[0]) & (CC_ALPHA | CC_SYM)))
+		return (0);
+	for (i = 0; text[i]; i++) {
+		if (!(cclass(text[i]) & (CC_ALNUM | CC_SYM)) || (i == SBOLSZ - 1))
+			return (0);
+		ctx->symbol[i + 1] = text[i];
+	}
+	ctx->symbol[0] = i;
+	ctx->symbol[i + 1] = '\0';
+
+	/* not a register, a predefined or an user function */
+	if (i == 1) {
+		switch (cc_upper[(unsigned char)text[0]]) {
+		case 'A':
+		case 'X':
+		case 'Y':
+			return (0);
+		}
+	}
+	if (keyword_op(ctx) || func_look(ctx))
+		return (0);
+
+	arg->type = T_SYMBOL;
+	arg->hash = st_hash(ctx->symbol);
+	memcpy(arg->name, ctx->symbol, i + 2);
+	return (1);
+}
+
+
+/* ----
+ * func_save()
+ * ----
+ * end of the expansion of the function being compiled,
+ * apply the operators of its body and keep it
+ */
+
+int
+func_save(struct t_context *ctx)
+{
+	struct t_func *func = ctx->func_cur;
+	int i;
+
+	/* errors are reported by the expansion */
+	if (!ctx->need_operator || (ctx->errcnt != ctx->func_errcnt)) {
+		ctx->func_nb = -1;
+		return (1);
+	}
+
+	/* the call is the whole operand, the operators
+	 * can be applied before the end of the operand
+	 */
+	while (ctx->op_idx > ctx->func_opidx) {
+		if (!do_op(ctx))
+			return (0);
+	}
+	if (ctx->func_nb <= 0)
+		return (1);
+
+	/* keep the compiled body */
+	if ((func->code = arena_alloc(&ctx->func_arena, ctx->func_nb * sizeof(struct t_exprop))) == NULL) {
+		ctx->func_nb = -1;
+		return (1);
+	}
+	memcpy(func->code, ctx->func_code, ctx->func_nb * sizeof(struct t_exprop));
+	func->nb = ctx->func_nb;
+	func->nb_args = 0;
+	for (i = 0; i < func->nb; i++) {
+		if ((func->code[i].op == EX_ARG) && (func->nb_args <= func->code[i].value))
+			func->nb_args = func->code[i].value + 1;
+	}
+	if (expr_check(func->code, func->nb, &func->depth))
+		func->flag |= FUNC_PURE;
+
+	ctx->func_nb = -1;
+	return (1);
+}
+
+
+/* ----
+ * func_run()
+ * ----
+ * evaluate a function call with its compiled body, the
+ * results of the calls with constant arguments are kept
+ * when the body only uses its arguments
+ */
+
+int
+func_run(struct t_context *ctx, struct t_func *func, struct t_funcarg *arg)
+{
+	struct t_funcmemo *memo;
+	unsigned int hash;
+	int errcnt, i;
+
+	/* too complex, the expansion reports it */
+	if (ctx->val_idx + func->depth > 63)
+		return (0);
+
+	/* search a previous result */
+	memo = NULL;
+	if (func->flag & FUNC_PURE) {
+		hash = 0x811C9DC5;
+		for (i = 0; i < func->nb_args; i++) {
+			if (arg[i].type != T_DECIMAL)
+				break;
+			hash = (hash ^ arg[i].value) * 0x01000193;
+		}
+		if (i == func->nb_args) {
+			memo = &func->memo[(hash ^ (hash >> 16)) & (FUNC_MEMO - 1)];
+			if (memo->valid) {
+				for (i = 0; i < func->nb_args; i++) {
+					if (memo->arg[i] != arg[i].value)
+						break;
+				}
+				if (i == func->nb_args) {
+					expr_emit(ctx, EX_CONST, memo->value, NULL);
+					ctx->val_idx++;
+					ctx->val_stack[ctx->val_idx] = memo->value;
+					ctx->need_operator = 1;
+					return (1);
+				}
+			}
+		}
+	}
+
+	/* run the body */
+	errcnt = ctx->errcnt;
+	if (!expr_exec(ctx, func->code, func->nb, arg))
+		return (-1);
+
+	/* keep the result */
+	if (memo && (ctx->errcnt == errcnt) && !ctx->in_region) {
+		for (i = 0; i < func->nb_args; i++)
+			memo->arg[i] = arg[i].value;
+		memo->value = ctx->val_stack[ctx->val_idx];
+		memo->valid = 1;
+	}
+
+	/* next must be an operator */
+	ctx->need_operator = 1;
+	return (1);
 }
 
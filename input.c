@@ -2,6 +2,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
+#if !defined(WIN32) && !defined(__APPLE__)
+#include <dirent.h>
+#endif
 #include "defs.h"
 #include "externs.h"
 #include "protos.h"
@@ -10,15 +14,6 @@
 #define INCREMENT_BASE 16
 #define INCREMENT_BASE_MASK 15
 
-int    infile_error;
-int    infile_num;
-struct t_input_info input_file[8];
-static char    *incpath			= NULL;
-static int	   *str_offset		= NULL;
-static int	   remaining		= 0;
-static int     incpathSize		= 0;
-static int     str_offsetCount	= 0;
-static int     incpathCount		= 0;
 
 /* ----
  * void cleanup_path()
@@ -26,13 +21,13 @@ static int     incpathCount		= 0;
  * clean up allocated paths
  */
 void
-cleanup_path(void)
+cleanup_path(struct t_context *ctx)
 {
-	if(incpath)
-		free(incpath);
+	if(ctx->incpath)
+		free(ctx->incpath);
 		
-	if(str_offset)
-		free(str_offset);
+	if(ctx->str_offset)
+		free(ctx->str_offset);
 } 
 
 /* ----
@@ -41,40 +36,40 @@ cleanup_path(void)
  * add a path to includes
  */
 int
-add_path(char* path, int l)
+add_path(struct t_context *ctx, char* path, int l)
 {
 	/* Expand str_offset array if needed */
-	if(incpathCount >= str_offsetCount)
+	if(ctx->incpathCount >= ctx->str_offsetCount)
 	{
-		str_offsetCount += INCREMENT_BASE;
-		str_offset = (int*)realloc(str_offset, str_offsetCount * sizeof(int));
-		if(str_offset == NULL)
+		ctx->str_offsetCount += INCREMENT_BASE;
+		ctx->str_offset = (int*)realloc(ctx->str_offset, ctx->str_offsetCount * sizeof(int));
+		if(ctx->str_offset == NULL)
 			return 0;
 	}
 
 	/* Initialize string offset */
-	str_offset[incpathCount] = incpathSize - remaining;
+	ctx->str_offset[ctx->incpathCount] = ctx->incpathSize - ctx->remaining;
 
 	/* Realloc string buffer if needed */
-	if(remaining < l)
+	if(ctx->remaining < l)
 	{
-		remaining  = incpathSize;
+		ctx->remaining  = ctx->incpathSize;
 		/* evil trick, get the greater multiple of INCREMENT_BASE closer 
 		   to (size + l). Note : this only works for INCREMENT_BASE = 2^n*/
-		incpathSize = ((incpathSize + l) + INCREMENT_BASE) & ~INCREMENT_BASE_MASK;
-		remaining  = incpathSize - remaining;
-		incpath = (char*)realloc(incpath, incpathSize);
-		if(incpath == NULL)
+		ctx->incpathSize = ((ctx->incpathSize + l) + INCREMENT_BASE) & ~INCREMENT_BASE_MASK;
+		ctx->remaining  = ctx->incpathSize - ctx->remaining;
+		ctx->incpath = (char*)realloc(ctx->incpath, ctx->incpathSize);
+		if(ctx->incpath == NULL)
 			return 0;
 	}
 		
-	remaining -= l;
+	ctx->remaining -= l;
 
 	/* Copy path */
-	strncpy(incpath + str_offset[incpathCount], path, l);
-	incpath[str_offset[incpathCount] + l - 1] = '\0';
+	strncpy(ctx->incpath + ctx->str_offset[ctx->incpathCount], path, l);
+	ctx->incpath[ctx->str_offset[ctx->incpathCount] + l - 1] = '\0';
 	
-	++incpathCount;
+	++ctx->incpathCount;
 	
 	return 1;
 }
@@ -92,13 +87,13 @@ add_path(char* path, int l)
  */
 
 int
-init_path(void)
+init_path(struct t_context *ctx)
 {
 	char *p,*pl;
 	int	ret, l;
 
 	/* Get env variable holding PCE path*/
-	p = getenv(machine->include_env);
+	p = getenv(ctx->machine->include_env);
 
 	if (p == NULL)
 		return 2;
@@ -125,7 +120,7 @@ init_path(void)
 		}
 
 		/* Add path */
-		ret = add_path(p, l);
+		ret = add_path(ctx, p, l);
 		if(!ret)
 			return 0;
 
@@ -146,152 +141,141 @@ init_path(void)
  */
 
 int
-readline(void)
+readline(struct t_context *ctx)
 {
+	struct t_source  *src;
+	struct t_srcline *line;
+	struct t_mslot *slot;
 	char *ptr, *arg, num[8];
 	int j, n;
 	int	i;		/* pointer into prlnbuf */
-	int	c;		/* current character		*/
 	int	temp;	/* temp used for line number conversion */
 
 start:
-	for (i = 0; i < LAST_CH_POS; i++)
-		prlnbuf[i] = ' ';
+	ctx->lexptr = NULL;
+	memset(ctx->prlnbuf, ' ', LAST_CH_POS);
 
 	/* if 'expand_macro' is set get a line from macro buffer instead */
-	if (expand_macro) {
-		if (mlptr == NULL) {
-			while (mlptr == NULL) {
-				midx--;
-				mlptr = mstack[midx];
-				mcounter = mcntstack[midx];
-				if (midx == 0) {
-					mlptr = NULL;
-					expand_macro = 0;
+	if (ctx->expand_macro) {
+		if (ctx->mlptr == NULL) {
+			while (ctx->mlptr == NULL) {
+				ctx->midx--;
+				ctx->mlptr = ctx->mstack[ctx->midx];
+				ctx->mcounter = ctx->mcntstack[ctx->midx];
+				if (ctx->midx == 0) {
+					ctx->mlptr = NULL;
+					ctx->expand_macro = 0;
 					break;
 				}
 			}
 		}
 
 		/* expand line */
-		if (mlptr) {
+		if (ctx->mlptr) {
 			i = SFIELD;
-			ptr = mlptr->data;
-			for (;;) {
-				c = *ptr++;
-				if (c == '\0')
+			ptr = ctx->mlptr->text;
+			for (slot = ctx->mlptr->slot;; slot++) {
+				/* copy the text, truncated if too long */
+				n = slot->len;
+				if ((i + n) >= LAST_CH_POS - 1)
+					n = LAST_CH_POS - 1 - i;
+				memcpy(&ctx->prlnbuf[i], ptr, n);
+				ptr += slot->len;
+				i += n;
+				ctx->prlnbuf[i] = '\0';
+
+				/* substitute the arg */
+				switch (slot->type) {
+				case MS_END:
 					break;
-				if (c != '\\')
-					prlnbuf[i++] = c;
-				else {
-					c = *ptr++;
-					prlnbuf[i] = '\0';
-
-					/* \@ */
-					if (c == '@') {
-						n = 5;
-						sprintf(num, "%05i", mcounter);
-						arg = num;
-					}
 
-					/* \# */
-					else if (c == '#') {
-						for (j = 9; j > 0; j--)
-							if (strlen(marg[midx][j - 1]))
-								break;
-						n = 1;
-						sprintf(num, "%i", j);
-						arg = num;
+				/* \@ */
+				case MS_COUNT:
+					if (ctx->mcntlast != ctx->mcounter) {
+						sprintf(ctx->mcntstr, "%05i", ctx->mcounter);
+						ctx->mcntlast = ctx->mcounter;
 					}
+					n = 5;
+					arg = ctx->mcntstr;
+					break;
 
-					/* \?1 - \?9 */
-					else if (c == '?') {
-						c = *ptr++;
-						if (c >= '1' && c <= '9') {
-							n = 1;
-							sprintf(num, "%i", macro_getargtype(marg[midx][c - '1']));
-							arg = num;
-						}
-						else {
-							error("Invalid macro argument index!");
-							return (-1);
-						}
-					}
+				/* \# */
+				case MS_NBARGS:
+					n = 1;
+					arg = &ctx->mnbargs[ctx->midx];
+					break;
 
-					/* \1 - \9 */
-					else if (c >= '1' && c <= '9') {
-						j   = c - '1';
-						n   = strlen(marg[midx][j]);
-						arg = marg[midx][j];
-					}
+				/* \?1 - \?9 */
+				case MS_TYPE:
+					j = ctx->margtype[ctx->midx][slot->arg];
+					if (j == ARG_SYMBOL)
+						j = macro_getargtype(ctx, ctx->marg[ctx->midx][slot->arg]);
+					num[0] = '0' + j;
+					n = 1;
+					arg = num;
+					break;
 
-					/* unknown macro special command */
-					else {
-						error("Invalid macro argument index!");
-						return (-1);
-					}
+				/* \1 - \9 */
+				case MS_ARG:
+					n   = ctx->marglen[ctx->midx][slot->arg];
+					arg = ctx->marg[ctx->midx][slot->arg];
+					break;
 
-					/* check for line overflow */
-					if ((i + n) >= LAST_CH_POS - 1) {
-						error("Invalid line length!");
-						return (-1);
-					}
+				/* unknown macro special command */
+				default:
+					error(ctx, "Invalid macro argument index!");
+					return (-1);
+				}
+				if (slot->type == MS_END)
+					break;
 
-					/* copy macro string */
-					strncpy(&prlnbuf[i], arg, n);
-					i += n;
+				/* check for line overflow */
+				if ((i + n) >= LAST_CH_POS - 1) {
+					error(ctx, "Invalid line length!");
+					return (-1);
 				}
-				if (i >= LAST_CH_POS - 1)
-					i  = LAST_CH_POS - 1;
+
+				/* copy macro string */
+				memcpy(&ctx->prlnbuf[i], arg, n);
+				i += n;
 			}
-			prlnbuf[i] = '\0';
-			mlptr = mlptr->next;
+			ctx->prlnbuf[i] = '\0';
+
+			/* the line analysis is shared by all the expansions */
+			ctx->lexptr = &ctx->mlptr->lex;
+			ctx->lexlimit = SFIELD + ctx->mlptr->subst;
+			ctx->mlptr = ctx->mlptr->next;
 			return (0);
 		}
 	}
 
-	/* put source line number into prlnbuf */
+	/* in a disabled block, skip the lines that can not
+	 * change the state of the conditional assembly
+	 */
+	if (ctx->skip_lines && !ctx->in_macro && ctx->infile_num)
+		skip_scan(ctx);
+
+	/* put source line number into prlnbuf,
+	 * only the last five digits fit
+	 */
 	i = 4;
-	temp = ++slnum;
-	while (temp != 0) {
-		prlnbuf[i--] = temp % 10 + '0';
+	temp = ++ctx->slnum;
+	while ((temp != 0) && (i >= 0)) {
+		ctx->prlnbuf[i--] = temp % 10 + '0';
 		temp /= 10;
 	}
 
 	/* get a line */
-	i = SFIELD;
-	c = getc(in_fp);
-	if (c == EOF) {
-		if (close_input())
+	src = ctx->input_file[ctx->infile_num].src;
+	if (ctx->slnum > src->nb_lines) {
+		if (close_input(ctx))
 			return (-1);
 		goto start;
 	}
-	for (;;) {
-		/* check for the end of line */
-		if (c == '\r') {
-			c = getc(in_fp);
-			if (c == '\n' || c == EOF)
-				break;
-			ungetc(c, in_fp);
-			break;
-		}
-		if (c == '\n' || c == EOF)
-			break;
-
-		/* store char in the line buffer */
-		prlnbuf[i] = c;
-		i += (i < LAST_CH_POS) ? 1 : 0;
-
-		/* expand tab char to space */
-		if (c == '\t') {
-			prlnbuf[--i] = ' ';
-			i += (8 - ((i - SFIELD) % 8));
-		}
-
-		/* get next char */
-		c = getc(in_fp);
-	}
-	prlnbuf[i] = '\0';
+	line = &src->line[ctx->slnum - 1];
+	memcpy(&ctx->prlnbuf[SFIELD], line->data, line->len + 1);
+	ctx->lexptr = &line->lex;
+	ctx->lexlimit = LAST_CH_POS;
 	return(0);
 }
 
@@ -302,66 +286,79 @@ start:
  */
 
 int
-open_input(char *name)
+open_input(struct t_context *ctx, char *name)
 {
-	FILE *fp;
-	char *p;
+	struct t_source *src;
 	char  temp[128];
 	int   i;
 
 	/* only 7 nested input files */
-	if (infile_num == 7) {
-		error("Too many include levels, max. 7!");
+	if (ctx->infile_num == 7) {
+		error(ctx, "Too many include levels, max. 7!");
 		return (1);
 	}
 
 	/* backup current input file infos */
-	if (infile_num) {
-		input_file[infile_num].lnum = slnum;
-		input_file[infile_num].fp = in_fp;
-	}				
+	if (ctx->infile_num)
+		ctx->input_file[ctx->infile_num].lnum = ctx->slnum;
 
 	/* get a copy of the file name */
 	strcpy(temp, name);
+	input_name(temp);
 
-	/* auto add the .asm file extension */
-	if ((p = strrchr(temp, '.')) != NULL) {
-		if (strchr(p, PATH_SEPARATOR))
-			strcat(temp, ".asm");
-	}
-	else {
-		strcat(temp, ".asm");
-	}
+	/* the files of the snapshot are already assembled */
+	if (ctx->infile_num && snap_skip(ctx, temp))
+		return (0);
 
 	/* check if this file is already opened */
-	if (infile_num) {
-		for (i = 1; i < infile_num; i++) {
-			if (!strcmp(input_file[i].name, temp)) {
-				error("Repeated include file!");
+	if (ctx->infile_num) {
+		for (i = 1; i < ctx->infile_num; i++) {
+			if (!strcmp(ctx->input_file[i].name, temp)) {
+				error(ctx, "Repeated include file!");
 				return (1);
 			}
 		}
 	}				
 
-	/* open the file */
-	if ((fp = open_file(temp, "r")) == NULL)
+	/* get the file lines */
+	if ((src = src_open(ctx, temp)) == NULL)
 		return (-1);
 
 	/* update input file infos */
-	in_fp = fp;
-	slnum = 0;
-	infile_num++;
-	input_file[infile_num].fp = fp;
-	input_file[infile_num].if_level = if_level;
-	strcpy(input_file[infile_num].name, temp);
-	if ((pass == LAST_PASS) && (xlist) && (list_level))
-		fprintf(lst_fp, "#[%i]   %s\n", infile_num, input_file[infile_num].name);
+	ctx->slnum = 0;
+	ctx->infile_num++;
+	ctx->input_file[ctx->infile_num].src = src;
+	ctx->input_file[ctx->infile_num].if_level = ctx->if_level;
+	strcpy(ctx->input_file[ctx->infile_num].name, temp);
+	if ((ctx->pass == LAST_PASS) && (ctx->xlist) && (ctx->list_level))
+		buf_printf(&ctx->lst_buf, "#[%i]   %s\n", ctx->infile_num, ctx->input_file[ctx->infile_num].name);
 
 	/* ok */
 	return (0);
 }
 
 
+/* ----
+ * input_name()
+ * ----
+ * auto add the .asm file extension
+ */
+
+void
+input_name(char *name)
+{
+	char *p;
+
+	if ((p = strrchr(name, '.')) != NULL) {
+		if (strchr(p, PATH_SEPARATOR))
+			strcat(name, ".asm");
+	}
+	else {
+		strcat(name, ".asm");
+	}
+}
+
+
 /* ----
  * close_input()
  * ----
@@ -369,30 +366,28 @@ open_input(char *name)
  */
 
 int
-close_input(void)
+close_input(struct t_context *ctx)
 {
-	if (proc_ptr) {
-		fatal_error("Incomplete PROC!");
+	if (ctx->proc_ptr) {
+		fatal_error(ctx, "Incomplete PROC!");
 		return (-1);
 	}
-	if (in_macro) {
-		fatal_error("Incomplete MACRO definition!");
+	if (ctx->in_macro) {
+		fatal_error(ctx, "Incomplete MACRO definition!");
 		return (-1);
 	}
-	if (input_file[infile_num].if_level != if_level) {
-		fatal_error("Incomplete IF/ENDIF statement!");
+	if (ctx->input_file[ctx->infile_num].if_level != ctx->if_level) {
+		fatal_error(ctx, "Incomplete IF/ENDIF statement!");
 		return (-1);
 	}
-	if (infile_num <= 1)
+	if (ctx->infile_num <= 1)
 		return (-1);
 
-	fclose(in_fp);
-	infile_num--;
-	infile_error = -1;
-	slnum = input_file[infile_num].lnum;
-	in_fp = input_file[infile_num].fp;
-	if ((pass == LAST_PASS) && (xlist) && (list_level))
-		fprintf(lst_fp, "#[%i]   %s\n", infile_num, input_file[infile_num].name);
+	ctx->infile_num--;
+	ctx->infile_error = -1;
+	ctx->slnum = ctx->input_file[ctx->infile_num].lnum;
+	if ((ctx->pass == LAST_PASS) && (ctx->xlist) && (ctx->list_level))
+		buf_printf(&ctx->lst_buf, "#[%i]   %s\n", ctx->infile_num, ctx->input_file[ctx->infile_num].name);
 
 	/* ok */
 	return (0);
@@ -402,30 +397,580 @@ close_input(void)
 /* ----
  * open_file()
  * ----
- * open a file - browse paths
+ * get the content of a file, the files given by the caller
+ * are searched first, then the caller reader and finally the
+ * include paths are used; a file is only loaded once
+ */
+
+struct t_file *
+open_file(struct t_context *ctx, char *name)
+{
+	struct t_file *file;
+	struct t_shfile *shared;
+	unsigned char *data;
+	FILE *fp;
+	char  path[256];
+	int   size;
+
+	/* search the file in the loaded files */
+	for (file = ctx->file_list; file; file = file->next) {
+		if (!strcmp(file->name, name))
+			return (file);
+	}
+
+	/* the regions of a parallel last pass share the list */
+	if (ctx->in_region) {
+		region_abort(ctx);
+		return (NULL);
+	}
+
+	/* ask the caller reader */
+	data = NULL;
+	size = 0;
+
+	if ((ctx->file_reader == NULL) ||
+		(!ctx->file_reader(ctx->file_user, name, &data, &size))) {
+		/* browse the include paths */
+		if ((fp = search_file(ctx, name, "rb", path)) == NULL)
+			return (NULL);
+
+		/* the files shared with other assemblies are read once */
+		if (ctx->shared) {
+			shared = shared_load(ctx->shared, path, fp);
+			fclose(fp);
+			if (shared == NULL)
+				return (NULL);
+
+			/* the build cache needs to know all the files used */
+			if (ctx->cache_dir[0])
+				cache_dep(ctx, name, path);
+
+			if ((file = add_file(ctx, name, shared->data, shared->size, shared)) != NULL)
+				strcpy(file->path, path);
+			return (file);
+		}
+
+		/* read the whole file */
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		if ((data = (void *)malloc(size + 1)) == NULL) {
+			fclose(fp);
+			return (NULL);
+		}
+		size = fread(data, 1, size, fp);
+		fclose(fp);
+
+		/* the build cache needs to know all the files used */
+		if (ctx->cache_dir[0])
+			cache_dep(ctx, name, path);
+
+		if ((file = add_file(ctx, name, data, size, NULL)) != NULL)
+			strcpy(file->path, path);
+		return (file);
+	}
+
+	return (add_file(ctx, name, data, size, NULL));
+}
+
+
+/* ----
+ * add_file()
+ * ----
+ * add a file to the loaded files, the file data must
+ * have been allocated with malloc() or belong to a shared file
+ */
+
+struct t_file *
+add_file(struct t_context *ctx, char *name, unsigned char *data, int size, struct t_shfile *shared)
+{
+	struct t_file *file;
+
+	if ((file = (void *)malloc(sizeof(struct t_file))) == NULL) {
+		if (shared == NULL)
+			free(data);
+		return (NULL);
+	}
+	strncpy(file->name, name, sizeof(file->name) - 1);
+	file->name[sizeof(file->name) - 1] = '\0';
+	file->path[0] = '\0';
+	file->shared = shared;
+	file->data = data;
+	file->size = size;
+	file->next = ctx->file_list;
+	ctx->file_list = file;
+
+	/* ok */
+	return (file);
+}
+
+
+/* ----
+ * search_file()
+ * ----
+ * open a file - browse paths, the name of the file
+ * found is copied in 'path'
  */
 
 FILE *
-open_file(char *name, char *mode)
+search_file(struct t_context *ctx, char *name, char *mode, char *path)
 {
 	FILE 	*fileptr;
 	char	testname[256];
 	int	i;
 
-	fileptr = fopen(name, mode);
-	if (fileptr != NULL) return(fileptr);
+	fileptr = NULL;
+	if (dir_check(ctx, name))
+		fileptr = fopen(name, mode);
+	if (fileptr != NULL) {
+		strcpy(path, name);
+		return(fileptr);
+	}
 
-	for (i = 0; i < incpathCount; ++i) {
-		if (strlen(incpath+str_offset[i])) {
-			strcpy(testname, incpath+str_offset[i]);
+	for (i = 0; i < ctx->incpathCount; ++i) {
+		if (strlen(ctx->incpath+ctx->str_offset[i])) {
+			strcpy(testname, ctx->incpath+ctx->str_offset[i]);
 			strcat(testname, PATH_SEPARATOR_STRING);
 			strcat(testname, name);
-		
+
+			/* don't try to open the files known to be missing */
+			if (!dir_check(ctx, testname))
+				continue;
+
 			fileptr = fopen(testname, mode);
-			if (fileptr != NULL) break;
+			if (fileptr != NULL) {
+				strcpy(path, testname);
+				break;
+			}
 		}
 	}
 
 	return (fileptr);
 }
 
+
+
+/* ----
+ * dir_cmp()
+ * ----
+ * compare two file names, for qsort() and bsearch()
+ */
+
+static int
+dir_cmp(const void *a, const void *b)
+{
+	return (strcmp(*(char **)a, *(char **)b));
+}
+
+
+/* ----
+ * dir_load()
+ * ----
+ * read the content of a directory, a directory that doesn't
+ * exist is empty; return NULL if it can not be read
+ */
+
+struct t_dir *
+dir_load(char *path)
+{
+#if defined(WIN32) || defined(__APPLE__)
+	/* file names are not case sensitive, let fopen() search them */
+	return (NULL);
+#else
+	struct t_dir *dir;
+	struct dirent *entry;
+	DIR  *dp;
+	char *text;
+	int   text_size, text_len;
+	int   max_names;
+	int   len, i;
+
+	if ((dir = (void *)calloc(1, sizeof(struct t_dir))) == NULL)
+		return (NULL);
+	strcpy(dir->path, path);
+
+	if ((dp = opendir(path)) == NULL) {
+		if ((errno == ENOENT) || (errno == ENOTDIR))
+			return (dir);
+		free(dir);
+		return (NULL);
+	}
+
+	/* get the names */
+	text_size = 0;
+	text_len = 0;
+	max_names = 0;
+
+	while ((entry = readdir(dp)) != NULL) {
+		len = strlen(entry->d_name) + 1;
+
+		/* grow buffers, the names are stored as offsets
+		 * until the text buffer is complete
+		 */
+		if (dir->nb_names == max_names) {
+			max_names = max_names ? (max_names * 2) : 64;
+			dir->names = (void *)realloc(dir->names, max_names * sizeof(char *));
+		}
+		if ((text_len + len) > text_size) {
+			text_size = text_size ? (text_size * 2) : 4096;
+			if (text_size < (text_len + len))
+				text_size = text_len + len;
+			dir->text = (void *)realloc(dir->text, text_size);
+		}
+		if ((dir->names == NULL) || (dir->text == NULL)) {
+			closedir(dp);
+			dir_free(dir);
+			return (NULL);
+		}
+		memcpy(&dir->text[text_len], entry->d_name, len);
+		dir->names[dir->nb_names++] = (char *)(size_t)text_len;
+		text_len += len;
+	}
+	closedir(dp);
+
+	/* sort them */
+	text = dir->text;
+	for (i = 0; i < dir->nb_names; i++)
+		dir->names[i] = text + (size_t)dir->names[i];
+	qsort(dir->names, dir->nb_names, sizeof(char *), dir_cmp);
+
+	/* ok */
+	return (dir);
+#endif
+}
+
+
+/* ----
+ * dir_free()
+ * ----
+ * free a list of directories
+ */
+
+void
+dir_free(struct t_dir *dir)
+{
+	struct t_dir *next;
+
+	for (; dir; dir = next) {
+		next = dir->next;
+		free(dir->names);
+		free(dir->text);
+		free(dir);
+	}
+}
+
+
+/* ----
+ * dir_check()
+ * ----
+ * check if a file may exist, each directory is read once
+ * so the include paths can be searched without trying to
+ * open the file in all of them; return 0 if the file is
+ * known to be missing
+ */
+
+int
+dir_check(struct t_context *ctx, char *name)
+{
+	struct t_dir *dir;
+	char  path[256];
+	char *base;
+	int   len;
+
+	/* split the directory and the file name */
+	if ((base = strrchr(name, PATH_SEPARATOR)) != NULL) {
+		len = base - name;
+		base++;
+		if (len == 0)
+			len = 1;
+		if (len >= (int)sizeof(path))
+			return (1);
+		memcpy(path, name, len);
+		path[len] = '\0';
+	}
+	else {
+		strcpy(path, ".");
+		base = name;
+	}
+	if (*base == '\0')
+		return (1);
+
+	/* get the directory content */
+	if (ctx->shared)
+		dir = shared_dir(ctx->shared, path);
+	else {
+		for (dir = ctx->dir_list; dir; dir = dir->next) {
+			if (!strcmp(dir->path, path))
+				break;
+		}
+		if ((dir == NULL) && ((dir = dir_load(path)) != NULL)) {
+			dir->next = ctx->dir_list;
+			ctx->dir_list = dir;
+		}
+	}
+	if (dir == NULL)
+		return (1);
+
+	/* search the file */
+	if (dir->nb_names == 0)
+		return (0);
+	return (bsearch(&base, dir->names, dir->nb_names, sizeof(char *), dir_cmp) != NULL);
+}
+
+
+/* ----
+ * src_open()
+ * ----
+ * get the formatted lines of a source file, the file is only
+ * read the first time it is opened, later passes and repeated
+ * includes use the lines kept in memory
+ */
+
+struct t_source *
+src_open(struct t_context *ctx, char *name)
+{
+	struct t_source *src;
+	struct t_file *file;
+
+	/* search the file in the loaded sources */
+	for (src = ctx->src_list; src; src = src->next) {
+		if (!strcmp(src->name, name))
+			return (src);
+	}
+	if (ctx->in_region) {
+		region_abort(ctx);
+		return (NULL);
+	}
+
+	/* load it, unless it was read ahead */
+	if ((src = prefetch_get(ctx, name)) == NULL) {
+		if ((file = open_file(ctx, name)) == NULL)
+			return (NULL);
+
+		if ((src = src_get(ctx, file->data, file->size, file->shared)) == NULL) {
+			fatal_error(ctx, "Out of memory!");
+			return (NULL);
+		}
+	}
+
+	/* add it to the list */
+	strcpy(src->name, name);
+	src->next = ctx->src_list;
+	ctx->src_list = src;
+
+	/* read ahead the files it includes */
+	if (ctx->prefetch)
+		prefetch_scan(ctx, src);
+
+	/* ok */
+	return (src);
+}
+
+
+/* ----
+ * src_load()
+ * ----
+ * split a source file into lines, tabs are expanded
+ * the same way readline() used to do it
+ */
+
+struct t_source *
+src_load(unsigned char *buf, int size)
+{
+	struct t_source *src;
+	struct t_srcline *line;
+	unsigned char *ptr, *end, *eol;
+	char  tmp[LAST_CH_POS + 4];
+	char *text;
+	int   text_size, text_len;
+	int   max_lines;
+	int   i, c, n, len;
+
+	if ((src = (void *)malloc(sizeof(struct t_source))) == NULL)
+		return (NULL);
+
+	/* count the lines to allocate the line index at once,
+	 * memchr() is much faster than a loop on each char
+	 */
+	ptr = buf;
+	end = buf + size;
+	max_lines = 1;
+
+	while ((ptr < end) && ((ptr = memchr(ptr, '\n', end - ptr)) != NULL)) {
+		ptr++;
+		max_lines++;
+	}
+
+	/* format lines */
+	ptr = buf;
+	text = NULL;
+	text_len = 0;
+	text_size = 0;
+	line = NULL;
+	n = 0;
+
+	if (size) {
+		line = (void *)malloc(max_lines * sizeof(struct t_srcline));
+		text_size = size + max_lines;
+		text = (void *)malloc(text_size);
+	}
+
+	while (ptr < end) {
+		/* search the end of the line, the lines without
+		 * tabs or control chars are copied as they are
+		 */
+		for (eol = ptr; (eol < end) && (*eol > '\r'); eol++)
+			;
+		if ((eol == end) || (*eol == '\n') || (*eol == '\r')) {
+			len = eol - ptr;
+			if (len > LAST_CH_POS - SFIELD)
+				len = LAST_CH_POS - SFIELD;
+			memcpy(&tmp[SFIELD], ptr, len);
+			i = SFIELD + len;
+
+			/* skip the end of line */
+			ptr = eol;
+			if (ptr < end) {
+				if ((*ptr++ == '\r') && (ptr < end) && (*ptr == '\n'))
+					ptr++;
+			}
+		}
+		else {
+			/* get a line */
+			memset(tmp, ' ', LAST_CH_POS);
+			i = SFIELD;
+
+			for (;;) {
+				if (ptr == end)
+					break;
+				c = *ptr++;
+
+				/* check for the end of line */
+				if (c == '\r') {
+					if ((ptr < end) && (*ptr == '\n'))
+						ptr++;
+					break;
+				}
+				if (c == '\n')
+					break;
+
+				/* store char in the line buffer */
+				tmp[i] = c;
+				i += (i < LAST_CH_POS) ? 1 : 0;
+
+				/* expand tab char to space */
+				if (c == '\t') {
+					tmp[--i] = ' ';
+					i += (8 - ((i - SFIELD) % 8));
+					if (i > LAST_CH_POS)
+						i = LAST_CH_POS;
+				}
+			}
+		}
+		tmp[i] = '\0';
+		len = strlen(&tmp[SFIELD]);
+
+		/* grow buffers, the line index can only be too small
+		 * if the file uses single '\r' as end of line and the
+		 * text buffer if tabs were expanded
+		 */
+		if (n == max_lines) {
+			max_lines *= 2;
+			line = (void *)realloc(line, max_lines * sizeof(struct t_srcline));
+		}
+		if ((text_len + len + 1) > text_size) {
+			text_size *= 2;
+			text = (void *)realloc(text, text_size);
+		}
+		if ((line == NULL) || (text == NULL)) {
+			free(line);
+			free(text);
+			free(src);
+			return (NULL);
+		}
+
+		/* store the line, text offsets are turned into
+		 * pointers once the text buffer is complete
+		 */
+		memcpy(&text[text_len], &tmp[SFIELD], len + 1);
+		memset(&line[n].lex, 0, sizeof(struct t_lexinfo));
+		line[n].skip_end = 0;
+		line[n].data = (char *)(size_t)text_len;
+		line[n].len = len;
+		text_len += len + 1;
+		n++;
+	}
+
+	for (i = 0; i < n; i++)
+		line[i].data = text + (size_t)line[i].data;
+
+	src->line = line;
+	src->text = text;
+	src->nb_lines = n;
+	src->shared = NULL;
+
+	/* ok */
+	return (src);
+}
+
+
+/* ----
+ * src_get()
+ * ----
+ * get the lines of a file, a file of the shared store is only
+ * split once; each assembly gets its own copy of the line index
+ * as it keeps the line analysis, the text stays shared
+ */
+
+struct t_source *
+src_get(struct t_context *ctx, unsigned char *buf, int size, struct t_shfile *shared)
+{
+	struct t_source *src, *model;
+
+	if (shared == NULL)
+		return (src_load(buf, size));
+
+	/* split it, unless it was done by a previous assembly */
+	if ((model = shared_source(ctx->shared, shared)) == NULL) {
+		if ((model = src_load(buf, size)) == NULL)
+			return (NULL);
+		model = shared_set_source(ctx->shared, shared, model);
+	}
+
+	/* copy the line index */
+	if ((src = (void *)malloc(sizeof(struct t_source))) == NULL)
+		return (NULL);
+
+	*src = *model;
+	src->shared = shared;
+	src->line = NULL;
+
+	if (model->nb_lines) {
+		if ((src->line = (void *)malloc(model->nb_lines * sizeof(struct t_srcline))) == NULL) {
+			free(src);
+			return (NULL);
+		}
+		memcpy(src->line, model->line, model->nb_lines * sizeof(struct t_srcline));
+	}
+	return (src);
+}
+
+
+/* ----
+ * src_free()
+ * ----
+ * free the lines of a source file
+ */
+
+void
+src_free(struct t_source *src)
+{
+	if (src == NULL)
+		return;
+
+	free(src->line);
+	if (src->shared == NULL)
+		free(src->text);
+	free(src);
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+/* character classes of the source lines, they replace the
+ * ctype functions (C locale) in the line analysis
+ */
+const unsigned char cc_class[256] = {
+	0x20, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x21, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x21, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x18, 0x00,
+	0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x02, 0x00, 0x20, 0x00, 0x10, 0x00, 0x00,
+	0x18, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+	0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x08,
+	0x00, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04,
+	0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+/* upper case of the characters */
+const unsigned char cc_upper[256] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F,
+	0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
+	0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F,
+	0x60, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+	0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x7B, 0x7C, 0x7D, 0x7E, 0x7F,
+	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F,
+	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F,
+	0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF,
+	0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
+	0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF,
+	0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF,
+	0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF,
+	0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF,
+};
+
+
+/* ----
+ * lexline()
+ * ----
+ * analyze the start of a line in a single scan, get the label
+ * and the name of the instruction or macro; the hashes needed
+ * to search them are computed on the way
+ */
+
+void
+lexline(struct t_context *ctx, struct t_lexline *lx)
+{
+	unsigned int hash;
+	unsigned char c;
+	int  local;
+	int  i, j;
+
+	/* search for a label, it must start the line
+	 * or be followed by a colon
+	 */
+	i = SFIELD;
+	while (cclass(ctx->prlnbuf[i]) & CC_SPACE)
+		i++;
+	local = (ctx->prlnbuf[i] == '.') || (ctx->prlnbuf[i] == '@');
+	hash = 0x811C9DC5;
+
+	for (j = 0;; j++) {
+		c = ctx->prlnbuf[i + j];
+		if ((cc_class[c] & CC_DIGIT) && (j == 0))
+			break;
+		if (!(cc_class[c] & (CC_ALNUM | CC_SYM))) {
+			if (!local || ((c != '-') && (c != '+')))
+				break;
+		}
+
+		/* the hash of the symbol, as st_hash() */
+		if (j < (SBOLSZ - 1)) {
+			hash ^= c;
+			hash *= 0x01000193;
+		}
+	}
+
+	if ((j == 0) || ((i != SFIELD) && (c != ':'))) {
+		lx->label_len = 0;
+		i = SFIELD;
+	}
+	else {
+		lx->label_pos  = i;
+		lx->label_len  = j;
+		lx->label_hash = hash;
+		i += j;
+		if (c == ':')
+			i++;
+	}
+
+	/* skip spaces */
+	while (cclass(ctx->prlnbuf[i]) & CC_SPACE)
+		i++;
+
+	/* instruction or macro */
+	lexname(ctx, i, lx);
+}
+
+
+/* ----
+ * lexname()
+ * ----
+ * get the name of an instruction or a macro at 'pos', the
+ * instruction name is in upper case and can have an extension
+ */
+
+void
+lexname(struct t_context *ctx, int pos, struct t_lexline *lx)
+{
+	unsigned int mhash, ohash;
+	unsigned char c, cls;
+	int  mlen, olen;
+	int  mok, oerr, ext;
+	int  i;
+
+	mhash = 0x811C9DC5;
+	ohash = ctx->machine->op_hash->seed;
+	mlen = 0;
+	olen = 0;
+	mok  = 1;
+	oerr = 0;
+	ext  = 0;
+	lx->opext  = 0;
+	lx->op_end = -1;
+
+	for (i = pos;; i++) {
+		c = ctx->prlnbuf[i];
+		cls = cc_class[c];
+		if (cls & CC_STOP)
+			break;
+
+		/* macro name */
+		if (mok) {
+			if (!(cls & CC_ALNUM) && (c != '_') && (c != '.'))
+				mok = 0;
+			else if ((mlen == 0) && (cls & CC_DIGIT))
+				mok = 0;
+			else if (mlen == 31)
+				mok = 0;
+			else {
+				lx->macro[++mlen] = c;
+				mhash ^= c;
+				mhash *= 0x01000193;
+			}
+		}
+
+		/* instruction name, the hash is the one used by opgen.c */
+		if (!oerr && (lx->op_end < 0)) {
+			c = cc_upper[c];
+			if (!(cls & (CC_ALNUM | CC_OPCH)))
+				oerr = 1;
+			else if (olen == 15)
+				oerr = 1;
+			else if ((c == '.') && olen) {
+				if (ext)
+					oerr = 1;
+				ext = 1;
+			}
+			else if (ext) {
+				if (lx->opext)
+					oerr = 1;
+				lx->opext = c;
+			}
+			else {
+				lx->op[olen++] = c;
+				ohash ^= c;
+				ohash *= 0x01000193;
+
+				/* '=' directive */
+				if (c == '=')
+					lx->op_end = i + 1;
+			}
+		}
+
+		/* nothing more to search */
+		if (!mok && (oerr || (lx->op_end >= 0)))
+			break;
+	}
+
+	/* macro */
+	lx->macro[0] = mok ? mlen : 0;
+	lx->macro[mlen + 1] = '\0';
+	lx->macro_hash = mhash;
+	lx->name_end = i;
+
+	/* instruction */
+	if (lx->op_end < 0)
+		lx->op_end = i;
+	lx->op[olen] = '\0';
+	lx->op_hash = ohash;
+
+	if (oerr)
+		lx->op_len = -1;
+	else if (ext && (lx->opext != 'L') && (lx->opext != 'H'))
+		lx->op_len = -1;
+	else if (olen == 0)
+		lx->op_len = -2;
+	else
+		lx->op_len = olen;
+}
@@ -6,119 +6,89 @@
 #include "externs.h"
 #include "protos.h"
 
-int  mopt;
-int  in_macro;
-int  expand_macro;
-char marg[8][10][80];
-int  midx;
-int  mcounter, mcntmax;
-int  mcntstack[8];
-struct t_line  *mstack[8];
-struct t_line  *mlptr;
-struct t_macro *macro_tbl[256];
-struct t_macro *mptr;
 
 /* .macro pseudo */
 
 void
-do_macro(int *ip)
+do_macro(struct t_context *ctx, int *ip)
 {
-	if (pass == LAST_PASS)
-		println();
+	if ((ctx->pass == LAST_PASS) && !ctx->single_pass)
+		println(ctx);
 	else {
 		/* error checking */
-		if (expand_macro) {
-			error("Can not nest macro definitions!");
+		if (ctx->expand_macro) {
+			error(ctx, "Can not nest macro definitions!");
 			return;
 		}
-		if (lablptr == NULL) {
+		if (ctx->lablptr == NULL) {
 			/* skip spaces */
-			while (isspace(prlnbuf[*ip]))
+			while (isspace(ctx->prlnbuf[*ip]))
 				(*ip)++;
 
 			/* search a label after the .macro */
-			if (colsym(ip) == 0) {
-				error("No name for this macro!");
+			if (colsym(ctx, ip) == 0) {
+				error(ctx, "No name for this macro!");
 				return;
 			}
 
 			/* put the macro name in the symbol table */
-			if ((lablptr = stlook(1)) == NULL)
+			if ((ctx->lablptr = stlook(ctx, 1)) == NULL)
 				return;
 		}
-		if (lablptr->refcnt) {
-			switch (lablptr->type) {
+		if (ctx->lablptr->refcnt) {
+			switch (ctx->lablptr->type) {
 			case MACRO:
-				fatal_error("Macro already defined!");
+				fatal_error(ctx, "Macro already defined!");
 				return;
 
 			case FUNC:
-				fatal_error("Symbol already used by a function!");
+				fatal_error(ctx, "Symbol already used by a function!");
 				return;
 
 			default:
-				fatal_error("Symbol already used by a label!");
+				fatal_error(ctx, "Symbol already used by a label!");
 				return;
 			}
 		}
-		if (!check_eol(ip))
+		if (!check_eol(ctx, ip))
 			return;
 
 		/* install this new macro in the hash table */
-		if (!macro_install())
+		if (!macro_install(ctx))
 			return;
 	}
-	in_macro = 1;
+	ctx->in_macro = 1;
 }
 
 /* .endm pseudo */
 
 void
-do_endm(int *ip)
+do_endm(struct t_context *ctx, int *ip)
 {
     (void)ip;
-	error("Unexpected ENDM!");
+	error(ctx, "Unexpected ENDM!");
 	return;
 }
 
-/* search a macro in the hash table */
+/* search a macro in the hash table, the name starts with its length */
 
-struct t_macro *macro_look(int *ip)
+struct t_macro *macro_find(struct t_context *ctx, char *name, unsigned int hash)
 {
 	struct t_macro *ptr;
-	char name[32];
-	char c;
-	int  hash;
-	int  l;
-
-	/* calculate the symbol hash value and check syntax */
-	l = 0;
-	hash = 0;
-	for (;;) {
-		c = prlnbuf[*ip];
-		if (c == '\0' || c == ' ' || c == '\t' || c == ';')
-			break;
+	char *str;
 
-		if (!isalnum(c) && c != '_')
-		{ if(c!=0x2e) {	return (NULL); }}
-		if (l == 0) {
-			if (isdigit(c))
-				return (NULL);
-		}
-		if (l == 31)
-			return (NULL);
-		name[l++] = c;
-		hash += c;
-		hash  = (hash << 3) + (hash >> 5) + c;
-		(*ip)++;
-	}
-	name[l] = '\0';
-	hash &= 0xFF;
+	/* the names are interned, a macro can't
+	 * exist if its name was never seen
+	 */
+	if (name[0] == 0)
+		return (NULL);
+	if ((str = name_look(&ctx->names, name, hash)) == NULL)
+		return (NULL);
 
 	/* browse the hash table */
-	ptr = macro_tbl[hash];
+	ptr = ctx->macro_tbl[hash & 0xFF];
 	while (ptr) {
-		if (!strcmp(name, ptr->name))
+		if (ptr->name == str)
 			break;
 		ptr = ptr->next;
 	}
@@ -130,42 +100,57 @@ struct t_macro *macro_look(int *ip)
 /* extract macro arguments */
 
 int
-macro_getargs(int ip)
+macro_getargs(struct t_context *ctx, int ip)
 {
-	char *ptr;
-	char  c, t;
-	int   i, j, f, arg;
-	int   level;
+	int i, ret;
 
 	/* can not nest too much macros */
-	if (midx == 7) {
-		error("Too many nested macro calls!");
+	if (ctx->midx == 7) {
+		error(ctx, "Too many nested macro calls!");
 		return (0);
 	}
 
 	/* initialize args */
-	mcntstack[midx] = mcounter;
-	mstack[midx++] = mlptr;
-	ptr = marg[midx][0];
-	arg = 0;
+	ctx->mcntstack[ctx->midx] = ctx->mcounter;
+	ctx->mstack[ctx->midx++] = ctx->mlptr;
 
 	for (i = 0; i < 9; i++)
-		marg[midx][i][0] = '\0';
+		ctx->marg[ctx->midx][i][0] = '\0';
+
+	/* extract args, the lines of the macro are expanded
+	 * with them even if an error is found
+	 */
+	ret = macro_splitargs(ctx, ip);
+	macro_setargs(ctx);
+	return (ret);
+}
+
+/* split the macro arguments */
+
+int
+macro_splitargs(struct t_context *ctx, int ip)
+{
+	char *ptr;
+	char  c, t;
+	int   i, j, f, arg;
+	int   level;
+
+	ptr = ctx->marg[ctx->midx][0];
+	arg = 0;
 
-	/* extract args */
 	for (;;) {
 		/* skip spaces */
-		while (isspace(prlnbuf[ip]))
+		while (isspace(ctx->prlnbuf[ip]))
 			ip++;
 
-		c = prlnbuf[ip++];
+		c = ctx->prlnbuf[ip++];
 		switch (c) {
 		/* no arg */
 		case ',':
 			arg++;
-			ptr = marg[midx][arg];
+			ptr = ctx->marg[ctx->midx][arg];
 			if (arg == 9) {
-				error("Too many arguments for a macro!");
+				error(ctx, "Too many arguments for a macro!");
 				return (0);
 			}
 			break;
@@ -178,13 +163,13 @@ macro_getargs(int ip)
 			if (c == '\"')
 				ptr[i++] = c;
 			for (;;) {
-				t = prlnbuf[ip++];
+				t = ctx->prlnbuf[ip++];
 				if (t == '\0') {
-					error("Unterminated string!");
+					error(ctx, "Unterminated string!");
 					return (0);
 				}
 				if (i == 80) {
-					error("String too long, max. 80 characters!");
+					error(ctx, "String too long, max. 80 characters!");
 					return (0);
 				}
 				if (t == c)
@@ -195,18 +180,18 @@ macro_getargs(int ip)
 				ptr[i++] = t;
 
 			/* skip spaces */
-			while (isspace(prlnbuf[ip]))
+			while (isspace(ctx->prlnbuf[ip]))
 				ip++;
 
 			/* check end of arg */
-			switch (prlnbuf[ip]) {
+			switch (ctx->prlnbuf[ip]) {
 			case '\0':
 			case ',':
 			case ';':
 				break;
 
 			default:
-				error("Syntax error!");
+				error(ctx, "Syntax error!");
 				return (0);
 			}
 
@@ -223,19 +208,19 @@ macro_getargs(int ip)
 		case '\\':
 			/* skip spaces */
 			i = ip;
-			while (isspace(prlnbuf[i]))
+			while (isspace(ctx->prlnbuf[i]))
 				i++;
 
 			/* check */
-			if (prlnbuf[i] == ';' || prlnbuf[i] == '\0') {
+			if (ctx->prlnbuf[i] == ';' || ctx->prlnbuf[i] == '\0') {
 				/* output line */
-				if (pass == LAST_PASS) {
-					println();
-					clearln();
+				if (ctx->pass == LAST_PASS) {
+					println(ctx);
+					clearln(ctx);
 				}
 
 				/* read a new line */
-				if (readline() == -1)
+				if (readline(ctx) == -1)
 					return (0);
 
 				/* rewind line pointer and continue */
@@ -279,11 +264,11 @@ macro_getargs(int ip)
 					ptr[i++] = c;
 				}
 				if (i == 80) {
-					error("Macro argument string too long, max. 80 characters!");
+					error(ctx, "Macro argument string too long, max. 80 characters!");
 					return (0);
 				}
 				j++;
-				c = prlnbuf[ip++];
+				c = ctx->prlnbuf[ip++];
 			}
 			ptr[i] = '\0';
 			ip--;
@@ -298,18 +283,18 @@ macro_getargs(int ip)
 						(strlen(ptr) == 1))
 					{
 						arg--;
-						ptr = marg[midx][arg];
+						ptr = ctx->marg[ctx->midx][arg];
 
 						/* check string length */
 						if (strlen(ptr) > 75) {
-							error("Macro argument string too long, max. 80 characters!");
+							error(ctx, "Macro argument string too long, max. 80 characters!");
 							return (0);
 						}
 
 						/* attach current arg to the previous one */
 						strcat(ptr, ",");
-						strcat(ptr, marg[midx][arg + 1]);
-						ptr = marg[midx][arg + 1];
+						strcat(ptr, ctx->marg[ctx->midx][arg + 1]);
+						ptr = ctx->marg[ctx->midx][arg + 1];
 						ptr[0] = '\0';
 					}
 			 	}
@@ -319,17 +304,41 @@ macro_getargs(int ip)
 	}
 }
 
+/* ----
+ * macro_setargs()
+ * ----
+ * get what the expansion of the macro lines needs to know about
+ * the args of a call: their length, their number and their type;
+ * the type of a symbol can change during the call, it is only
+ * checked when used
+ */
+
+void
+macro_setargs(struct t_context *ctx)
+{
+	char *arg;
+	int   i, n;
+
+	n = 0;
+	for (i = 0; i < 9; i++) {
+		arg = ctx->marg[ctx->midx][i];
+		ctx->marglen[ctx->midx][i] = strlen(arg);
+		ctx->margtype[ctx->midx][i] = macro_argclass(arg);
+		if (arg[0])
+			n = i + 1;
+	}
+	ctx->mnbargs[ctx->midx] = '0' + n;
+}
+
 /* install a macro in the hash table */
 
 int
-macro_install(void)
+macro_install(struct t_context *ctx)
 {
-	char c;
-	int hash = 0;
-	int i;
+	unsigned int hash;
 
 	/* mark the macro name as reserved */
-	lablptr->type = MACRO;
+	ctx->lablptr->type = MACRO;
 
 	/* check macro name syntax */
 	/*
@@ -340,37 +349,131 @@ macro_install(void)
 	*/
 
 	/* calculate symbol hash value */
-	for (i = 1; i <= symbol[0]; i++) {
-		c = symbol[i];
-		hash += c;
-		hash  = (hash << 3) + (hash >> 5) + c;
-	}
-	hash &= 0xFF;
+	hash = st_hash(ctx->symbol);
 
 	/* allocate a macro struct */
-	mptr = (void *)malloc(sizeof(struct t_macro));
-	if (mptr == NULL) {
-		error("Out of memory!");
+	ctx->mptr = arena_alloc(&ctx->macro_arena, sizeof(struct t_macro));
+	if (ctx->mptr == NULL) {
+		error(ctx, "Out of memory!");
 		return (0);
 	}
 
 	/* initialize it */
-	strcpy(mptr->name, &symbol[1]);
-	mptr->line = NULL;
-	mptr->next = macro_tbl[hash];
-	macro_tbl[hash] = mptr;
-	mlptr = NULL;
+	if ((ctx->mptr->name = name_intern(&ctx->names, ctx->symbol, hash)) == NULL) {
+		error(ctx, "Out of memory!");
+		return (0);
+	}
+	ctx->mptr->line = NULL;
+	ctx->mptr->next = ctx->macro_tbl[hash & 0xFF];
+	ctx->macro_tbl[hash & 0xFF] = ctx->mptr;
+	ctx->mlptr = NULL;
 
 	/* ok */
 	return (1);
 }
 
-/* send back the addressing mode of a macro arg */
+/* ----
+ * macro_parseline()
+ * ----
+ * split a macro line in literal text and argument references,
+ * done once when the macro is defined so the expansions only
+ * have to copy the text and the args
+ */
 
 int
-macro_getargtype(char *arg)
+macro_parseline(struct t_context *ctx, struct t_line *line)
+{
+	struct t_mslot slot[LAST_CH_POS];
+	char  text[LAST_CH_POS + 4];
+	char *ptr;
+	int   nb, len, last;
+	char  c;
+
+	ptr = line->data;
+	nb = 0;
+	len = 0;
+	last = 0;
+
+	for (;;) {
+		c = *ptr++;
+		if (c == '\0')
+			break;
+		if (c != '\\') {
+			text[len++] = c;
+			continue;
+		}
+
+		/* argument reference */
+		c = *ptr++;
+		slot[nb].arg = 0;
+		if (c == '@')
+			slot[nb].type = MS_COUNT;
+		else if (c == '#')
+			slot[nb].type = MS_NBARGS;
+		else if (c == '?') {
+			c = *ptr++;
+			if (c >= '1' && c <= '9') {
+				slot[nb].type = MS_TYPE;
+				slot[nb].arg = c - '1';
+			}
+			else
+				slot[nb].type = MS_ERROR;
+		}
+		else if (c >= '1' && c <= '9') {
+			slot[nb].type = MS_ARG;
+			slot[nb].arg = c - '1';
+		}
+		else
+			slot[nb].type = MS_ERROR;
+
+		slot[nb].len = len - last;
+		last = len;
+		nb++;
+
+		/* the rest of the line is never expanded */
+		if (slot[nb - 1].type == MS_ERROR)
+			break;
+	}
+	slot[nb].type = MS_END;
+	slot[nb].arg = 0;
+	slot[nb].len = len - last;
+	nb++;
+
+	/* the line analysis can be reused by all the expansions
+	 * as long as no argument is found before the operand field
+	 */
+	line->subst = (nb > 1) ? slot[0].len : LAST_CH_POS;
+
+	/* store the slots, the text is shared with the line
+	 * when there is no argument reference
+	 */
+	line->slot = arena_alloc(&ctx->macro_arena, nb * sizeof(struct t_mslot));
+	if (line->slot == NULL)
+		return (0);
+	memcpy(line->slot, slot, nb * sizeof(struct t_mslot));
+
+	if (nb == 1)
+		line->text = line->data;
+	else {
+		if ((line->text = arena_alloc(&ctx->macro_arena, len + 1)) == NULL)
+			return (0);
+		memcpy(line->text, text, len);
+		line->text[len] = '\0';
+	}
+	return (1);
+}
+
+
+/* ----
+ * macro_argclass()
+ * ----
+ * get the addressing mode of a macro arg from its syntax,
+ * ARG_SYMBOL if it depends on a symbol
+ */
+
+int
+macro_argclass(char *arg)
 {
-	struct t_symbol *sym;
 	char c;
 	int  i;
 
@@ -397,40 +500,64 @@ macro_getargtype(char *arg)
 	case 'Y':
 		if (*arg == '\0')
 			return (ARG_REG);
+		break;
 
 	default:
-		/* symbol */
-		c = arg[0];
-		for(i = 0; i < SBOLSZ; i++) {
-			c = arg[i];
-			if (isdigit(c) && (i == 0))
-				break;
-			if ((!isalnum(c)) && (c != '_') && (c != '.') && (c != '@'))
-				break;
-		}
+		break;
+	}
 
-		if (i == 0)
-			return (ARG_ABS);
-		else {
-			if (c != '\0')
-				return (ARG_ABS);
-			else {
-				strncpy(&symbol[1], arg, i);
-				symbol[0] = i;
-				symbol[i+1] = '\0';
-
-				if ((sym = stlook(0)) == NULL)
-					return (ARG_LABEL);
-				else {
-					if((sym->type == UNDEF) || (sym->type == IFUNDEF))
-						return (ARG_LABEL);
-					if (sym->bank == RESERVED_BANK)
-						return (ARG_ABS);
-					else
-						return (ARG_LABEL);
-				}
-			}
-		}
+	/* symbol */
+	c = arg[0];
+	for(i = 0; i < SBOLSZ; i++) {
+		c = arg[i];
+		if (isdigit(c) && (i == 0))
+			break;
+		if ((!isalnum(c)) && (c != '_') && (c != '.') && (c != '@'))
+			break;
 	}
+
+	if (i == 0)
+		return (ARG_ABS);
+	if (c != '\0')
+		return (ARG_ABS);
+	return (ARG_SYMBOL);
 }
 
+/* send back the addressing mode of a macro arg */
+
+int
+macro_getargtype(struct t_context *ctx, char *arg)
+{
+	struct t_symbol *sym;
+	int  type, i;
+
+	if ((type = macro_argclass(arg)) != ARG_SYMBOL)
+		return (type);
+
+	/* the symbol name starts after the first char */
+	while (isspace(*arg))
+		arg++;
+	arg++;
+	i = strlen(arg);
+
+	strncpy(&ctx->symbol[1], arg, i);
+	ctx->symbol[0] = i;
+	ctx->symbol[i+1] = '\0';
+
+	if ((sym = stlook(ctx, 0)) == NULL) {
+		if (ctx->single_pass)
+			fixup_probe(ctx, FIX_ARGTYPE, ctx->symbol, st_hash(ctx->symbol));
+		return (ARG_LABEL);
+	}
+	else {
+		if((sym->type == UNDEF) || (sym->type == IFUNDEF)) {
+			if (ctx->single_pass)
+				fixup_probe(ctx, FIX_ARGTYPE, sym->name, sym->hash);
+			return (ARG_LABEL);
+		}
+		if (sym->bank == RESERVED_BANK)
+			return (ARG_ABS);
+		else
+			return (ARG_LABEL);
+	}
+}
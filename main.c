@@ -29,154 +29,211 @@
 #include "defs.h"
 #include "externs.h"
 #include "protos.h"
-#include "vars.h"
-#include "inst.h"
-#include "overlay.h"
-
-/* defines */
-#define STANDARD_CD	1
-#define SUPER_CD	2
+#include "pceas.h"
 
 /* variables */
-unsigned char ipl_buffer[4096];
-char   in_fname[256];	/* file names, input */
-char  out_fname[256];	/* output */
-char  bin_fname[256];	/* binary */
-char  lst_fname[256];	/* listing */
-char  sym_fname[256];	/* symbol table */
-char  zeroes[2048];	/* CDROM sector full of zeores */
 char *prg_name;	/* program name */
-FILE *in_fp;	/* file pointers, input */
-FILE *lst_fp;	/* listing */
 char  section_name[4][8] = { "  ZP", " BSS", "CODE", "DATA" };
-int   dump_seg;
-int   overlayflag;
-int   develo_opt;
-int   header_opt;
-int   srec_opt;
-int   run_opt;
-int   scd_opt;
-int   cd_opt;
-int   mx_opt;
-int   mlist_opt;	/* macro listing main flag */
-int   xlist;		/* listing file main flag */
-int   list_level;	/* output level */
-int   asm_opt[8];	/* assembler options */
-int   zero_need;	/* counter for trailing empty sectors on CDROM */
+char *batch_name;	/* batch file name */
+int   batch_jobs;	/* number of batch threads */
+int   watch_mode;	/* rebuild when a file changes */
 
 /* ----
- * atexit callback
+ * main()
  * ----
  */
-void
-cleanup(void)
+
+int
+main(int argc, char **argv)
 {
-	cleanup_path();
+	struct t_context *ctx;
+	char *p;
+	int ret;
+
+	/* get program name */
+	if ((prg_name = strrchr(argv[0], '/')) != NULL)
+		 prg_name++;
+	else {
+		if ((prg_name = strrchr(argv[0], '\\')) == NULL)
+			 prg_name = argv[0];
+		else
+			 prg_name++;
+	}
+
+	/* remove extension */
+	if ((p = strrchr(prg_name, '.')) != NULL)
+		*p = '\0';
+
+	/* create the assembler context */
+	if ((ctx = new_context()) == NULL) {
+		printf("Not enough memory!\n");
+		return (1);
+	}
+
+	/* display assembler version message */
+	printf("%s\n\n", ctx->machine->asm_title);
+
+	/* get the options */
+	if ((ret = get_options(ctx, argc, argv)) >= 0)
+		return (ret);
+
+	/* batch mode, the options are shared by all the targets */
+	if (batch_name) {
+		ret = batch_run(argc, argv);
+		pceas_delete(ctx);
+		return (ret);
+	}
+
+	/* resident mode, each build uses a new context */
+	if (watch_mode) {
+		pceas_delete(ctx);
+		return (watch_run(argc, argv));
+	}
+
+	/* init include path */
+	init_path(ctx);
+
+	/* assemble and save the outputs */
+	if (assemble_target(ctx, argc, argv))
+		exit(1);
+
+	/* free the assembler context */
+	pceas_delete(ctx);
+
+	/* ok */
+	return(0);
 }
 
+
 /* ----
- * main()
+ * new_context()
  * ----
+ * create an assembler context for the machine matching
+ * the program name
+ */
+
+struct t_context *
+new_context(void)
+{
+	struct t_context *ctx;
+
+	/* machine detection */
+	if (!strncasecmp(prg_name, "PCE", 3))
+		ctx = pceas_new(PCEAS_PCE);     //change this to PCEAS_NES to build NESASM
+	else
+		ctx = pceas_new(PCEAS_NES);
+
+	/* messages are displayed */
+	if (ctx)
+		pceas_set_messages(ctx, stdout);
+
+	return (ctx);
+}
+
+
+/* ----
+ * get_options()
+ * ----
+ * parse the command line, return -1 if there is something to
+ * assemble or the program exit code
  */
 
 int
-main(int argc, char **argv)
+get_options(struct t_context *ctx, int argc, char **argv)
 {
-	FILE *fp, *ipl;
 	char *p;
-	char  cmd[80];
-	int i, j, opt;
+	int i, opt;
 	int file;
-	int ram_bank;
 	int cd_type;
-	const char *cmd_line_options = "sSl:mhI:o:";
+	int raw_opt, overlay_opt, develo_opt, mx_opt, srec_opt;
+	int dep_opt, single_opt, obj_opt, link_opt, prefetch_opt;
+	int pass_jobs;
+	char *snap_out;
+	const char *cmd_line_options = "sSl:mhI:o:j:";
 	const struct option cmd_line_long_options[] = {
 		{"segment",     0, 0,		's'},
 		{"fullsegment", 0, 0,		'S'},
 		{"listing",	1, 0,		'l'},
 		{"macro",       0, 0, 		'm'},
-		{"raw",		0, &header_opt,  0 },
+		{"raw",		0, &raw_opt,	 1 },
 		{"cd",		0, &cd_type,	 1 },
 		{"scd",		0, &cd_type,	 2 },
-		{"over",	0, &overlayflag, 1 },
-		{"overlay",	0, &overlayflag, 1 },
+		{"over",	0, &overlay_opt, 1 },
+		{"overlay",	0, &overlay_opt, 1 },
 		{"dev",		0, &develo_opt,  1 },
 		{"develo",	0, &develo_opt,  1 },			
 		{"mx",		0, &mx_opt, 	 1 },
 		{"srec",	0, &srec_opt, 	 1 },
+		{"single",	0, &single_opt,  1 },
+		{"object",	0, &obj_opt,	 1 },
+		{"link",	0, &link_opt,	 1 },
+		{"prefetch",	0, &prefetch_opt, 1 },
+		{"cache",	1, 0,		'c'},
+		{"batch",	1, 0,		'b'},
+		{"jobs",	1, 0,		'j'},
+		{"pass-jobs",	1, 0,		'p'},
+		{"watch",	0, 0,		'w'},
+		{"MD",		0, 0,		'D'},
+		{"MF",		1, 0,		'F'},
+		{"snapshot",	1, 0,		'n'},
+		{"mksnapshot",	1, 0,		'N'},
 		{"help",	0, 0,		'h'},
 		{0,		0, 0,		 0 }
 	};
 
-	/* register atexit callback */
-	atexit(cleanup);
-	
-	/* get program name */
-	if ((prg_name = strrchr(argv[0], '/')) != NULL)
-		 prg_name++;
-	else {
-		if ((prg_name = strrchr(argv[0], '\\')) == NULL)
-			 prg_name = argv[0];
-		else
-			 prg_name++;
-	}
-
-	/* remove extension */
-	if ((p = strrchr(prg_name, '.')) != NULL)
-		*p = '\0';
-
-	/* machine detection */
-	if (!strncasecmp(prg_name, "PCE", 3))
-		machine = &pce;     //change this to &nes to build NESASM
-	else
-		machine = &nes;
-
 	/* init assembler options */
-	list_level = 2;
-	header_opt = 1;
-	overlayflag = 0;
+	raw_opt = 0;
+	overlay_opt = 0;
 	develo_opt = 0;
-	mlist_opt = 0;
-	srec_opt = 0;
-	run_opt = 0;
-	scd_opt = 0;
-	cd_opt = 0;
 	mx_opt = 0;
+	srec_opt = 0;
 	file = 0;
 	cd_type = 0;
+	dep_opt = 0;
+	single_opt = 0;
+	obj_opt = 0;
+	link_opt = 0;
+	prefetch_opt = 0;
+	pass_jobs = 1;
+	snap_out = NULL;
 	
-    memset(out_fname, 0, 256);
+    memset(ctx->out_fname, 0, 256);
+    memset(ctx->cache_dir, 0, 256);
+    memset(ctx->dep_fname, 0, 256);
+    memset(ctx->snap_fname, 0, 256);
 
-	/* display assembler version message */
-	printf("%s\n\n", machine->asm_title);
-	
-	while ((opt = getopt_long_only (argc, argv, cmd_line_options, cmd_line_long_options, &i)) > 0)
+	/* restart the scan, the command line of each batch target
+	 * is parsed too
+	 */
+	optind = 0;
+
+	while ((opt = getopt_long_only (argc, argv, cmd_line_options, cmd_line_long_options, &i)) != -1)
 	{
 		switch(opt)
 		{	
+			case 0:
+				/* flag set by a long option */
+				break;
+
 			case 's':
-				dump_seg = 1;
+				ctx->dump_seg = 1;
 				break;
 				
 			case 'S':
-				dump_seg = 2;
+				ctx->dump_seg = 2;
 				break;
 			
 			case 'l':
 				/* get level */
-				list_level = atol(optarg);
-				
-				/* check range */
-				if (list_level < 0 || list_level > 3)
-					list_level = 2;
+				pceas_set_option(ctx, PCEAS_OPT_LIST, atol(optarg));
 				break;
 			
 			case 'm':
-				mlist_opt = 1;
+				pceas_set_option(ctx, PCEAS_OPT_MACRO, 1);
 				break;
 				
 			case 'I':
-				if(!add_path(optarg, strlen(optarg)+1))
+				if(!add_path(ctx, optarg, strlen(optarg)+1))
 				{
 					printf("Error while adding include path\n");
 					return 0;
@@ -184,11 +241,47 @@ main(int argc, char **argv)
 				break;
 			
             case 'o':
-                strcpy(out_fname, optarg);
+                strcpy(ctx->out_fname, optarg);
                 break;
 
+			case 'c':
+				strncpy(ctx->cache_dir, optarg, 255);
+				break;
+
+			case 'b':
+				batch_name = optarg;
+				break;
+
+			case 'j':
+				batch_jobs = atol(optarg);
+				break;
+
+			case 'p':
+				pass_jobs = atol(optarg);
+				break;
+
+			case 'w':
+				watch_mode = 1;
+				break;
+
+			case 'D':
+				dep_opt = 1;
+				break;
+
+			case 'F':
+				strncpy(ctx->dep_fname, optarg, 255);
+				break;
+
+			case 'n':
+				pceas_use_snapshot(ctx, optarg);
+				break;
+
+			case 'N':
+				snap_out = optarg;
+				break;
+
 			case 'h':
-				help();
+				help(ctx);
 				return 0;
 				
 			default:
@@ -196,48 +289,70 @@ main(int argc, char **argv)
 		}		
 	}
 
-	/* check for missing asm file */
+	/* check for missing asm file, the targets
+	 * of a batch are in the batch file
+	 */
 	if(optind == argc)
 	{
+		if (batch_name && !ctx->in_fname[0])
+			return (-1);
 		fprintf(stderr, "Missing input file\n");
 		return 0;
 	}
 	
-	/* get file names */
+	/* get file names, the outputs of a link are named
+	 * after its first object file
+	 */
+	if (link_opt) {
+		ctx->link_name = &argv[optind];
+		ctx->link_nb = argc - optind;
+		strcpy(ctx->in_fname, argv[optind]);
+		file = ctx->link_nb;
+		optind = argc;
+	}
 	for ( ; optind < argc; ++optind, ++file) {
-		strcpy(in_fname, argv[optind]);
+		strcpy(ctx->in_fname, argv[optind]);
 	}
 
+	/* set assembler options */
+	pceas_set_option(ctx, PCEAS_OPT_HEADER, !raw_opt);
+	pceas_set_option(ctx, PCEAS_OPT_OVERLAY, overlay_opt);
+	pceas_set_option(ctx, PCEAS_OPT_DEVELO, develo_opt);
+	pceas_set_option(ctx, PCEAS_OPT_MX, mx_opt);
+	pceas_set_option(ctx, PCEAS_OPT_SREC, srec_opt);
+	pceas_set_option(ctx, PCEAS_OPT_SINGLE, single_opt);
+	pceas_set_option(ctx, PCEAS_OPT_OBJECT, obj_opt && !link_opt);
+	pceas_set_option(ctx, PCEAS_OPT_PREFETCH, prefetch_opt);
+	pceas_set_option(ctx, PCEAS_OPT_JOBS, pass_jobs);
+
 	/* Adjust cdrom type values ... */
 	switch(cd_type) {
 		case 1:
 			/* cdrom */	
-			cd_opt  = STANDARD_CD;
-			scd_opt = 0;
+			pceas_set_option(ctx, PCEAS_OPT_CD, 1);
 			break;
 			
 		case 2:
 			/* super cdrom */
-			scd_opt = SUPER_CD;
-			cd_opt  = 0;
+			pceas_set_option(ctx, PCEAS_OPT_SCD, 1);
 			break;
 	}
 
-	if ( (overlayflag == 1) &&
-	     ((scd_opt == 0) && (cd_opt == 0)) )
+	if ( (ctx->overlayflag == 1) &&
+	     ((ctx->scd_opt == 0) && (ctx->cd_opt == 0)) )
 	{
 		printf("Overlay option only valid for CD or SCD programs\n\n");
-		help();
+		help(ctx);
 		return (0);
 	}
 
 	if (!file) {
-		help();
+		help(ctx);
 		return (0);
 	}
 
 	/* search file extension */
-	if ((p = strrchr(in_fname, '.')) != NULL) {
+	if ((p = strrchr(ctx->in_fname, '.')) != NULL) {
 		if (!strchr(p, PATH_SEPARATOR))
 		   *p = '\0';
 		else
@@ -245,380 +360,308 @@ main(int argc, char **argv)
 	}
 
 	/* auto-add file extensions */
-	strcpy(bin_fname, in_fname);
-	strcpy(lst_fname, in_fname);
-	strcpy(sym_fname, in_fname);
-	strcat(lst_fname, ".lst");  // [todo]
-	strcat(sym_fname, ".sym");  // [todo]
-
-    if(out_fname[0]) {
-        strcpy(bin_fname, out_fname);
+	strcpy(ctx->bin_fname, ctx->in_fname);
+	strcpy(ctx->lst_fname, ctx->in_fname);
+	strcpy(ctx->sym_fname, ctx->in_fname);
+	strcat(ctx->lst_fname, ".lst");  // [todo]
+	strcat(ctx->sym_fname, ".sym");  // [todo]
+
+	if (dep_opt && !ctx->dep_fname[0]) {
+		strcpy(ctx->dep_fname, ctx->in_fname);
+		strcat(ctx->dep_fname, ".d");
+	}
+
+    if(ctx->out_fname[0]) {
+        strcpy(ctx->bin_fname, ctx->out_fname);
     }
     else {
-        strcpy(bin_fname, in_fname);
-        if (overlayflag == 1)
-            strcat(bin_fname, ".ovl");
-        else if (cd_opt || scd_opt)
-            strcat(bin_fname, ".iso");
+        strcpy(ctx->bin_fname, ctx->in_fname);
+        if (ctx->overlayflag == 1)
+            strcat(ctx->bin_fname, ".ovl");
+        else if (ctx->cd_opt || ctx->scd_opt)
+            strcat(ctx->bin_fname, ".iso");
         else
-            strcat(bin_fname, machine->rom_ext);
+            strcat(ctx->bin_fname, ctx->machine->rom_ext);
     }
 
+	/* the snapshot or the object file replaces the rom */
+	if (snap_out) {
+		strncpy(ctx->bin_fname, snap_out, 255);
+		pceas_set_option(ctx, PCEAS_OPT_SNAPSHOT, 1);
+	}
+	else if (ctx->obj_opt && !ctx->out_fname[0]) {
+		strcpy(ctx->bin_fname, ctx->in_fname);
+		strcat(ctx->bin_fname, ".o");
+	}
+
 	if (p)
 	   *p = '.';
-	else
-		strcat(in_fname, ".asm");
+	else if (!ctx->link_nb)
+		strcat(ctx->in_fname, ".asm");
 
-	/* init include path */
-	init_path();
+	/* ok */
+	return (-1);
+}
 
-	/* init crc functions */
-	crc_init();
 
-	/* open the input file */
-	if (open_input(in_fname)) {
-		printf("Can not open input file '%s'!\n", in_fname);
-		exit(1);
+/* ----
+ * assemble_target()
+ * ----
+ * assemble the input file and save the outputs, the build
+ * cache is used when enabled; return 1 on error
+ */
+
+int
+assemble_target(struct t_context *ctx, int argc, char **argv)
+{
+	const unsigned char *data;
+	char  cmd[80];
+	char  fname[260];
+	char *target;
+	int   size;
+	int   ret;
+
+	/* search the build cache, the develo run and the
+	 * segment usage can't be restored from it; a link
+	 * is fast enough without it
+	 */
+	if (ctx->develo_opt || ctx->dump_seg || ctx->link_nb)
+		ctx->cache_dir[0] = '\0';
+	if (ctx->cache_dir[0]) {
+		if (cache_lookup(ctx, argc, argv))
+			return (0);
 	}
 
-	/* clear the ROM array */
-	memset(rom, 0xFF, 8192 * 128);
-	memset(map, 0xFF, 8192 * 128);
+	/* assemble, or link the object files */
+	if (ctx->link_nb)
+		ret = pceas_link(ctx, (const char **)ctx->link_name, ctx->link_nb);
+	else
+		ret = pceas_assemble(ctx, ctx->in_fname);
 
-	/* clear symbol hash tables */
-	for (i = 0; i < 256; i++) {
-		hash_tbl[i]  = NULL;
-		macro_tbl[i] = NULL;
-		func_tbl[i]  = NULL;
-		inst_tbl[i]  = NULL;
+	if (ret) {
+		/* the listing is kept up to the error */
+		if ((data = pceas_output(ctx, PCEAS_OUT_LST, &size)) != NULL)
+			write_file(ctx->lst_fname, "w", data, size);
+		return (1);
 	}
 
-	/* fill the instruction hash table */
-	addinst(base_inst);
-	addinst(base_pseudo);
-
-	/* add machine specific instructions and pseudos */
-	addinst(machine->inst);
-	addinst(machine->pseudo_inst);
-
-	/* predefined symbols */
-	lablset("MAGICKIT", 1);
-	lablset("DEVELO", develo_opt | mx_opt);
-	lablset("CDROM", cd_opt | scd_opt);
-	lablset("_bss_end", 0);
-	lablset("_bank_base", 0);
-	lablset("_nb_bank", 1);
-	lablset("_call_bank", 0);
-
-	/* init global variables */
-	max_zp = 0x01;
-	max_bss = 0x0201;
-	max_bank = 0;
-	rom_limit = 0x100000;		/* 1MB */
-	bank_limit = 0x7F;
-	bank_base = 0;
-	errcnt = 0;
-
-	if (cd_opt) {
-		rom_limit  = 0x10000;	/* 64KB */
-		bank_limit = 0x07;
-	}
-	else if (scd_opt) {
-		rom_limit  = 0x40000;	/* 256KB */
-		bank_limit = 0x1F;
-	}
-	else if (develo_opt || mx_opt) {
-		rom_limit  = 0x30000;	/* 192KB */
-		bank_limit = 0x17;
+	/* rom */
+	data = pceas_output(ctx, PCEAS_OUT_ROM, &size);
+
+	/* snapshot */
+	if (ctx->snap_opt) {
+		target = ctx->bin_fname;
+		data = pceas_output(ctx, PCEAS_OUT_SNAPSHOT, &size);
+		if (!write_file(ctx->bin_fname, "wb", data, size)) {
+			msg_printf(ctx, "Can not write snapshot file '%s'!\n", ctx->bin_fname);
+			return (1);
+		}
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->bin_fname);
 	}
 
-	/* assemble */
-	for (pass = FIRST_PASS; pass <= LAST_PASS; pass++) {
-		infile_error = -1;
-		page = 7;
-		bank = 0;
-		loccnt = 0;
-		slnum = 0;
-		mcounter = 0;
-		mcntmax = 0;
-		xlist = 0;
-		glablptr = NULL;
-		skip_lines = 0;
-		rsbase = 0;
-		proc_nb = 0;
-
-		/* reset assembler options */
-		asm_opt[OPT_LIST] = 0;
-		asm_opt[OPT_MACRO] = mlist_opt;
-		asm_opt[OPT_WARNING] = 0;
-		asm_opt[OPT_OPTIMIZE] = 0;
-
-		/* reset bank arrays */
-		for (i = 0; i < 4; i++) {
-			for (j = 0; j < 256; j++) {
-				bank_loccnt[i][j] = 0;
-				bank_glabl[i][j]  = NULL;
-				bank_page[i][j]   = 0;
-			}
+	/* object file */
+	else if (ctx->obj_opt) {
+		target = ctx->bin_fname;
+		data = pceas_output(ctx, PCEAS_OUT_OBJECT, &size);
+		if (!write_file(ctx->bin_fname, "wb", data, size)) {
+			msg_printf(ctx, "Can not write object file '%s'!\n", ctx->bin_fname);
+			return (1);
 		}
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->bin_fname);
+	}
 
-		/* reset sections */
-		ram_bank = machine->ram_bank;
-		section  = S_CODE;
-
-		/* .zp */
-		section_bank[S_ZP]           = ram_bank;
-		bank_page[S_ZP][ram_bank]    = machine->ram_page;
-		bank_loccnt[S_ZP][ram_bank]  = 0x0000;
-
-		/* .bss */
-		section_bank[S_BSS]          = ram_bank;
-		bank_page[S_BSS][ram_bank]   = machine->ram_page;
-		bank_loccnt[S_BSS][ram_bank] = 0x0200;
-
-		/* .code */
-		section_bank[S_CODE]         = 0x00;
-		bank_page[S_CODE][0x00]      = 0x07;
-		bank_loccnt[S_CODE][0x00]    = 0x0000;
-
-		/* .data */
-		section_bank[S_DATA]         = 0x00;
-		bank_page[S_DATA][0x00]      = 0x07;
-		bank_loccnt[S_DATA][0x00]    = 0x0000;
-
-		/* pass message */
-		printf("pass %i\n", pass + 1);
-
-		/* assemble */
-		while (readline() != -1) {
-			assemble();
-			if (loccnt > 0x2000) {
-				loccnt&=0x1fff;
-				page++;
-				bank++;
-				if(pass==FIRST_PASS)
-				printf("   (Warning. Opcode crossing page boundary $%04X, bank $%02X)\n",(page*0x2000),bank);
-			}
-			if (stop_pass)
-				break;
+	/* develo box or s-record file */
+	else if (!(ctx->cd_opt || ctx->scd_opt) && (ctx->develo_opt || ctx->mx_opt || ctx->srec_opt)) {
+		if (ctx->develo_opt || ctx->mx_opt) {
+			msg_printf(ctx, "writing mx file... ");
+			sprintf(fname, "%s.mx", ctx->out_fname);
 		}
-
-		/* relocate procs */
-		if (pass == FIRST_PASS)
-			proc_reloc();
-
-		/* abord pass on errors */
-		if (errcnt) {
-			printf("# %d error(s)\n", errcnt);
-			exit(1);
-			//break;
+		else {
+			msg_printf(ctx, "writing s-record file... ");
+			sprintf(fname, "%s.s28", ctx->out_fname);
 		}
+		target = fname;
 
-		/* adjust bank base */
-		if (pass == FIRST_PASS)
-			bank_base = calc_bank_base();
+		/* flush output */
+		if (ctx->msg_fp)
+			fflush(ctx->msg_fp);
 
-		/* update predefined symbols */
-		if (pass == FIRST_PASS) {
-			lablset("_bss_end", machine->ram_base + max_bss);
-			lablset("_bank_base", bank_base);
-			lablset("_call_bank", bank_base + max_bank + 1);
-			lablset("_nb_bank", max_bank + 2);
+		if (!write_file(fname, "w", data, size)) {
+			msg_printf(ctx, "can not write file '%s'!\n", fname);
+			ctx->cache_rec = 0;
 		}
-
-		/* adjust the symbol table for the develo or for cd-roms */
-		if (pass == FIRST_PASS) {
-			if (develo_opt || mx_opt || cd_opt || scd_opt)
-				lablremap();
+		else {
+			if (ctx->cache_dir[0])
+				cache_out(ctx, fname);
+			msg_printf(ctx, "OK\n");
 		}
 
-		/* rewind input file */
-		rewind(in_fp);
-
-		/* open the listing file */
-		if (pass == FIRST_PASS) {
-			if (xlist && list_level) {
-				if ((lst_fp = fopen(lst_fname, "w")) == NULL) {
-					printf("Can not open listing file '%s'!\n", lst_fname);
-					exit(1);
-				}
-				fprintf(lst_fp, "#[1]   %s\n", input_file[1].name);
-			}
+		/* execute */
+		if (ctx->develo_opt) {
+			sprintf(cmd, "perun %s", ctx->out_fname);
+			system(cmd);
 		}
 	}
 
-	/* rom */
-	if (errcnt == 0) {
-		/* cd-rom */
-		if (cd_opt || scd_opt) {
-			/* open output file */
-			if ((fp = fopen(bin_fname, "wb")) == NULL) {
-				printf("Can not open output file '%s'!\n", bin_fname);
-				exit(1);
-			}
-
-			/* boot code */
-			if ((header_opt) && (overlayflag == 0)) {
-				/* open ipl binary file */
-				if ((ipl = open_file("ipl.bin", "rb")) == NULL) {
-					printf("Can not find CD boot file 'ipl.bin'!\n");
-					exit(1);
-				}
-
-				/* load ipl */
-				fread(ipl_buffer, 1, 4096, ipl);
-				fclose(ipl);
-
-				memset(&ipl_buffer[0x800], 0, 32);
-				/* prg sector base */
-				ipl_buffer[0x802] = 2;
-				/* nb sectors */
-				ipl_buffer[0x803] = 16;
-				/* loading address */
-				ipl_buffer[0x804] = 0x00;
-				ipl_buffer[0x805] = 0x40;
-				/* starting address */
-				ipl_buffer[0x806] = BOOT_ENTRY_POINT & 0xFF;
-				ipl_buffer[0x807] = (BOOT_ENTRY_POINT >> 8) & 0xFF;
-				/* mpr registers */
-				ipl_buffer[0x808] = 0x00;
-				ipl_buffer[0x809] = 0x01;
-				ipl_buffer[0x80A] = 0x02;
-				ipl_buffer[0x80B] = 0x03;
-				ipl_buffer[0x80C] = 0x00;	/* boot loader @ $C000 */
-				/* load mode */
-				ipl_buffer[0x80D] = 0x60;
-
-				/* write boot code */
-				fwrite(ipl_buffer, 1, 4096, fp);
-			}
-
-			/* write rom */
-			fwrite(rom, 8192, (max_bank + 1), fp);
-
-			/* write trailing zeroes to fill */
-			/* at least 4 seconds of CDROM */
-			if (overlayflag == 0)
-			{
-				memset(zeroes, 0, 2048);
-
-				/* calculate number of trailing zero sectors      */
-				/* rule 1: track must be at least 6 seconds total */
-				zero_need = (6*75) - 2 - (4 * (max_bank + 1));
-
-				/* rule 2: track should have at least 2 seconds     */
-				/*         of trailing zeroes before an audio track */
-				if (zero_need < (2*75))
-					zero_need = (2*75);
-
-				while (zero_need > 0) {
-					fwrite(zeroes, 1, 2048, fp);
-					zero_need--;
-				}
-			}
-
-			fclose(fp);
-		}
-
-		/* develo box */
-		else if (develo_opt || mx_opt) {
-			page = (map[0][0] >> 5);
-
-			/* save mx file */
-			if ((page + max_bank) < 7)
-				/* old format */
-				write_srec(out_fname, "mx", page << 13);
+	/* binary file or cd-rom */
+	else {
+		target = ctx->bin_fname;
+		if (!write_file(ctx->bin_fname, "wb", data, size)) {
+			if (ctx->cd_opt || ctx->scd_opt)
+				msg_printf(ctx, "Can not write output file '%s'!\n", ctx->bin_fname);
 			else
-				/* new format */
-				write_srec(out_fname, "mx", 0xD0000);
-
-			/* execute */
-			if (develo_opt) {
-				sprintf(cmd, "perun %s", out_fname);
-				system(cmd);
-			}
+				msg_printf(ctx, "Can not write binary file '%s'!\n", ctx->bin_fname);
+			return (1);
 		}
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->bin_fname);
+	}
 
-		/* save */
-		else {
-			/* s-record file */
-			if (srec_opt)
-				write_srec(out_fname, "s28", 0);
-
-			/* binary file */
-			else {
-				/* open file */
-				if ((fp = fopen(bin_fname, "wb")) == NULL) {
-					printf("Can not open binary file '%s'!\n", bin_fname);
-					exit(1);
-				}
-
-				/* write header */
-				if (header_opt)
-					machine->write_header(fp, max_bank + 1);
-
-				/* write rom */
-				fwrite(rom, 8192, (max_bank + 1), fp);
-				fclose(fp);
-			}
+	/* listing file */
+	if ((data = pceas_output(ctx, PCEAS_OUT_LST, &size)) != NULL) {
+		if (!write_file(ctx->lst_fname, "w", data, size)) {
+			msg_printf(ctx, "Can not write listing file '%s'!\n", ctx->lst_fname);
+			return (1);
 		}
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->lst_fname);
 	}
 
-	/* close listing file */
-	if (xlist && list_level)
-		fclose(lst_fp);
-
-	/* close input file */
-	fclose(in_fp);
-
 	/* dump the symbol table */
-	if ((fp = fopen(sym_fname, "w")) != NULL) {
-		labldump(fp);
-		fclose(fp);
+	data = pceas_output(ctx, PCEAS_OUT_SYM, &size);
+	if (write_file(ctx->sym_fname, "w", data, size)) {
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->sym_fname);
+	}
+	else
+		ctx->cache_rec = 0;
+
+	/* dependency file */
+	if (ctx->dep_fname[0]) {
+		if (!write_deps(ctx, target)) {
+			msg_printf(ctx, "Can not open dependency file '%s'!\n", ctx->dep_fname);
+			return (1);
+		}
+		if (ctx->cache_dir[0])
+			cache_out(ctx, ctx->dep_fname);
 	}
 
+	/* save the outputs in the build cache */
+	if (ctx->cache_dir[0])
+		cache_store(ctx);
+
 	/* dump the bank table */
-	if (dump_seg)
-		show_seg_usage();
+	if (ctx->dump_seg)
+		show_seg_usage(ctx);
 
 	/* ok */
-	return(0);
+	return (0);
 }
 
 
 /* ----
- * calc_bank_base()
+ * write_file()
  * ----
- * calculate rom bank base
+ * write an output file, return 0 if the file can not be opened
+ * or written completely; a truncated file is removed
  */
 
 int
-calc_bank_base(void)
+write_file(char *name, char *mode, const unsigned char *data, int size)
 {
-	int base;
+	FILE *fp;
+	int   err;
 
-	/* cd */
-	if (cd_opt)
-		base = 0x80;
+	if ((fp = fopen(name, mode)) == NULL)
+		return (0);
 
-	/* super cd */
-	else if (scd_opt)
-		base = 0x68;
+	err = 0;
+	if (size && (fwrite(data, 1, size, fp) != (size_t)size))
+		err = 1;
+	if (fclose(fp))
+		err = 1;
 
-	/* develo */
-	else if (develo_opt || mx_opt) {
-		if (max_bank < 4)
-			base = 0x84;
-		else
-			base = 0x68;
+	/* don't leave a truncated file */
+	if (err)
+		remove(name);
+	return (!err);
+}
+
+
+/* ----
+ * write_deps()
+ * ----
+ * write a makefile rule listing the files used by the assembly,
+ * return 0 if the file can not be opened
+ */
+
+int
+write_deps(struct t_context *ctx, char *target)
+{
+	struct t_file *file, **list;
+	FILE *fp;
+	int   nb, i, j;
+
+	if ((fp = fopen(ctx->dep_fname, "w")) == NULL)
+		return (0);
+
+	/* the files are listed in reverse order */
+	nb = 0;
+	for (file = ctx->file_list; file; file = file->next)
+		nb++;
+	if ((list = (void *)malloc((nb + 1) * sizeof(struct t_file *))) == NULL) {
+		fclose(fp);
+		return (0);
 	}
+	for (i = nb, file = ctx->file_list; file; file = file->next)
+		list[--i] = file;
+
+	/* the files given by a library user are not on the disk */
+	write_deps_name(fp, target);
+	fputc(':', fp);
+	for (i = 0; i < nb; i++) {
+		if (list[i]->path[0] == '\0')
+			continue;
 
-	/* default */
-	else {
-		base = 0;
+		/* a file can be used with different names */
+		for (j = 0; j < i; j++) {
+			if (!strcmp(list[j]->path, list[i]->path))
+				break;
+		}
+		if (j < i)
+			continue;
+
+		fputs(" \\\n  ", fp);
+		write_deps_name(fp, list[i]->path);
 	}
+	fputc('\n', fp);
+	free(list);
+
+	return (fclose(fp) == 0);
+}
 
-	return (base);
+
+/* ----
+ * write_deps_name()
+ * ----
+ * write a file name, escaping the chars that are special in
+ * makefiles
+ */
+
+void
+write_deps_name(FILE *fp, char *name)
+{
+	int c;
+
+	while ((c = *name++) != '\0') {
+		if ((c == ' ') || (c == '#'))
+			fputc('\\', fp);
+		else if (c == '$')
+			fputc('$', fp);
+		fputc(c, fp);
+	}
 }
 
 
@@ -629,11 +672,11 @@ calc_bank_base(void)
  */
 
 void
-help(void)
+help(struct t_context *ctx)
 {
 	/* check program name */
 	if (strlen(prg_name) == 0)
-		prg_name = machine->asm_name;
+		prg_name = ctx->machine->asm_name;
 
 	/* display help */
 	printf("%s [-options] [-h (for help)] infile\n\n", prg_name);
@@ -644,8 +687,22 @@ help(void)
 		   "-m          : force macro expansion in listing\n"
 		   "--macro\n"
 		   "--raw       : prevent adding a ROM header\n"
-		   "-I          : add include path\n");
-	if (machine->type == MACHINE_PCE) {
+		   "-I          : add include path\n"
+		   "--cache dir : reuse the outputs of an identical previous build\n"
+		   "--batch file: assemble the targets listed in a file\n"
+		   "-j #        : number of batch threads\n"
+		   "--jobs #\n"
+		   "--pass-jobs #: number of threads of the last pass\n"
+		   "--watch     : assemble again when a source file changes\n"
+		   "--single    : assemble in a single pass when possible\n"
+		   "--object    : create an object file instead of a rom\n"
+		   "--link      : link object files into a rom\n"
+		   "--prefetch  : read the include files ahead in threads\n"
+		   "-MD         : write the files used in a dependency file\n"
+		   "-MF file    : name of the dependency file\n"
+		   "--mksnapshot file: save the declarations instead of a rom\n"
+		   "--snapshot file  : use the declarations of a snapshot\n");
+	if (ctx->machine->type == MACHINE_PCE) {
 		printf("--cd        : create a CD-ROM track image\n"
 			   "--scd       : create a Super CD-ROM track image\n"
 			   "--over(lay) : create an executable 'overlay' program segment\n"
@@ -656,7 +713,7 @@ help(void)
 		   "-h          : help. Displays this message\n"
 		   "--help\n");
 	
-	printf("infile      : file to be assembled\n\n");
+	printf("infile      : file to be assembled, or object files to link\n\n");
 }
 
 
@@ -666,36 +723,36 @@ help(void)
  */
 
 void
-show_seg_usage(void)
+show_seg_usage(struct t_context *ctx)
 {
 	int i, j;
 	int addr, start, stop, nb;
 	int rom_used;
 	int rom_free;
-	int ram_base = machine->ram_base;
+	int ram_base = ctx->machine->ram_base;
 
-	printf("segment usage:\n");
-	printf("\n");
+	msg_printf(ctx, "segment usage:\n");
+	msg_printf(ctx, "\n");
 
-	if (max_bank)
-		printf("\t\t\t\t    USED/FREE\n");
+	if (ctx->max_bank)
+		msg_printf(ctx, "\t\t\t\t    USED/FREE\n");
 
 	/* zp usage */
-	if (max_zp <= 1)
-		printf("      ZP    -\n");
+	if (ctx->max_zp <= 1)
+		msg_printf(ctx, "      ZP    -\n");
 	else {
 		start = ram_base;
-		stop  = ram_base + (max_zp - 1);
-		printf("      ZP    $%04X-$%04X  [%4i]     %4i/%4i\n", start, stop, stop - start + 1, stop-start+1, 256-(stop-start+1));
+		stop  = ram_base + (ctx->max_zp - 1);
+		msg_printf(ctx, "      ZP    $%04X-$%04X  [%4i]     %4i/%4i\n", start, stop, stop - start + 1, stop-start+1, 256-(stop-start+1));
 	}
 
 	/* bss usage */
-	if (max_bss <= 0x201)
-		printf("     BSS    -\n");
+	if (ctx->max_bss <= 0x201)
+		msg_printf(ctx, "     BSS    -\n");
 	else {
 		start = ram_base + 0x200;
-		stop  = ram_base + (max_bss - 1);
-		printf("     BSS    $%04X-$%04X  [%4i]     %4i/%4i\n\n", start, stop, stop - start + 1, stop-start+1, 8192-(stop-start+1));
+		stop  = ram_base + (ctx->max_bss - 1);
+		msg_printf(ctx, "     BSS    $%04X-$%04X  [%4i]     %4i/%4i\n\n", start, stop, stop - start + 1, stop-start+1, 8192-(stop-start+1));
 	}
 
 	/* bank usage */
@@ -703,14 +760,14 @@ show_seg_usage(void)
 	rom_free = 0;
 
 	/* scan banks */
-	for (i = 0; i <= max_bank; i++) {
+	for (i = 0; i <= ctx->max_bank; i++) {
 		start = 0;
 		addr = 0;
 		nb = 0;
 
 		/* count used and free bytes */
 		for (j = 0; j < 8192; j++)
-			if (map[i][j] != 0xFF)
+			if (ctx->map[i][j] != 0xFF)
 				nb++;
 
 		/* update used/free counters */
@@ -719,21 +776,21 @@ show_seg_usage(void)
 
 		/* display bank infos */
 		if (nb)
-			printf("BANK %2X  %-23s    %4i/%4i\n",
-					i, bank_name[i], nb, 8192 - nb);
+			msg_printf(ctx, "BANK %2X  %-23s    %4i/%4i\n",
+					i, ctx->bank_name[i], nb, 8192 - nb);
 		else {
-			printf("BANK %2X  %-23s       0/8192\n", i, bank_name[i]);
+			msg_printf(ctx, "BANK %2X  %-23s       0/8192\n", i, ctx->bank_name[i]);
 			continue;
 		}
 
 		/* scan */
-		if (dump_seg == 1)
+		if (ctx->dump_seg == 1)
 			continue;
 
 		for (;;) {
 			/* search section start */
 			for (; addr < 8192; addr++)
-				if (map[i][addr] != 0xFF)
+				if (ctx->map[i][addr] != 0xFF)
 					break;
 
 			/* check for end of bank */
@@ -741,20 +798,20 @@ show_seg_usage(void)
 				break;
 
 			/* get section type */
-			section = map[i][addr] & 0x0F;
-			page = (map[i][addr] & 0xE0) << 8;
+			ctx->section = ctx->map[i][addr] & 0x0F;
+			ctx->page = (ctx->map[i][addr] & 0xE0) << 8;
 			start = addr;
 
 			/* search section end */
 			for (; addr < 8192; addr++)
-				if ((map[i][addr] & 0x0F) != section)
+				if ((ctx->map[i][addr] & 0x0F) != ctx->section)
 					break;
 
 			/* display section infos */
-			printf("    %s    $%04X-$%04X  [%4i]\n",
-					section_name[section],	/* section name */
-				    start + page,			/* starting address */
-					addr  + page - 1,		/* end address */
+			msg_printf(ctx, "    %s    $%04X-$%04X  [%4i]\n",
+					section_name[ctx->section],	/* section name */
+				    start + ctx->page,			/* starting address */
+					addr  + ctx->page - 1,		/* end address */
 					addr  - start);			/* size */
 		}
 	}
@@ -762,8 +819,8 @@ show_seg_usage(void)
 	/* total */
 	rom_used = (rom_used + 1023) >> 10;
 	rom_free = (rom_free) >> 10;
-	printf("\t\t\t\t    ---- ----\n");
-	printf("\t\t\t\t    %4iK%4iK\n", rom_used, rom_free);
-	printf("\n\t\t\tTOTAL SIZE =     %4iK\n", (rom_used + rom_free));
+	msg_printf(ctx, "\t\t\t\t    ---- ----\n");
+	msg_printf(ctx, "\t\t\t\t    %4iK%4iK\n", rom_used, rom_free);
+	msg_printf(ctx, "\n\t\t\tTOTAL SIZE =     %4iK\n", (rom_used + rom_free));
 }
 
@@ -5,9 +5,6 @@
 #include "externs.h"
 #include "protos.h"
 
-/* locals */
-static unsigned char buffer[512];
-
 
 /* ----
  * pce_load_map()
@@ -15,10 +12,11 @@ static unsigned char buffer[512];
  */
 
 int
-pce_load_map(char *fname, int mode)
+pce_load_map(struct t_context *ctx, char *fname, int mode)
 {
-	FILE *fp;
-	unsigned char header[16];
+	struct t_file *file;
+	unsigned char *ptr;
+	unsigned char buffer[512];
 	int fsize;
 	int size;
 	int nb;
@@ -29,56 +27,64 @@ pce_load_map(char *fname, int mode)
 	cnt = 0;
 
 	/* open the file */
-	if ((fp = open_file(fname, "rb")) == NULL) {
-		fatal_error("Can not open file!");
+	if ((file = open_file(ctx, fname)) == NULL) {
+		fatal_error(ctx, "Can not open file!");
 		return (1);
 	}
 
 	/* check FMP header */
-	fread(header, 1, 12, fp);
-	fsize = (header[4] << 24) +
-			(header[5] << 16) +
-			(header[6] <<  8) +
-			 header[7] - 4;
+	ptr = file->data;
 
-	if (memcmp(header, "FORM", 4) || memcmp(&header[8], "FMAP", 4)) {
+	if ((file->size < 12) || memcmp(ptr, "FORM", 4) || memcmp(&ptr[8], "FMAP", 4)) {
 		/* incorrect header */
 		if (mode)
-			fatal_error("Invalid FMP format!");
-		fclose(fp);
+			fatal_error(ctx, "Invalid FMP format!");
 		return(mode);
 	}
+	fsize = (ptr[4] << 24) +
+			(ptr[5] << 16) +
+			(ptr[6] <<  8) +
+			 ptr[7] - 4;
+	ptr += 12;
+
+	/* the chunks must fit in the file */
+	if (fsize > (file->size - 12))
+		fsize = (file->size - 12);
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* browse chunks */
 	while (fsize > 0) {
-		fread(header, 1, 8, fp);
-		size = (header[4] << 24) +
-			   (header[5] << 16) +
-			   (header[6] <<  8) +
-			    header[7];
+		if (fsize < 8)
+			break;
+		size = (ptr[4] << 24) +
+			   (ptr[5] << 16) +
+			   (ptr[6] <<  8) +
+			    ptr[7];
 		fsize -= 8;
 		fsize -= size;
-		if (fsize < 0)
+		if ((size < 0) || (fsize < 0))
 			break;
 
 		/* BODY chunk */
-		if (memcmp(header, "BODY", 4) == 0) {
+		if (memcmp(ptr, "BODY", 4) == 0) {
+			ptr += 8;
+
 			/* add size */
 			cnt += (size >> 1);
 
-			if (pass == LAST_PASS) {
+			if (ctx->pass == LAST_PASS) {
 				/* read chunk */
 				while (size) {
 					/* read a block */
 					nb = (size > 512) ? 512 : size;
-					fread(buffer, 1, nb, fp);
+					memcpy(buffer, ptr, nb);
+					ptr  += nb;
 					size -= nb;
 					nb >>= 1;
 
@@ -87,39 +93,27 @@ pce_load_map(char *fname, int mode)
 						buffer[i] = ((buffer[j] + (buffer[j+1] << 8)) >> 5) - 1;
 
 					/* output buffer */
-					putbuffer(buffer, nb);
+					putbuffer(ctx, buffer, nb);
 				}
 			}
 			else
-				putbuffer(NULL, size >> 1);
+				putbuffer(ctx, NULL, size >> 1);
 
 			/* ok */
 			break;
 		}
 		else {
 			/* unsupported chunk */
-			fseek(fp, size, SEEK_CUR);
+			ptr += 8 + size;
 		}
 	}
 
-	/* close file */
-	fclose(fp);
-
 	/* size */
-	if (lablptr) {
-		lablptr->data_type = P_INCBIN;
-		lablptr->data_size = cnt;
-	}
-	else {
-		if (lastlabl) {
-			if (lastlabl->data_type == P_INCBIN)
-				lastlabl->data_size += cnt;
-		}
-	}
+	lablsize(ctx, P_INCBIN, cnt);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 
 	/* ok */
 	return (1);
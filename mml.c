@@ -21,15 +21,6 @@
 #define SND_WAVE_DATA	30	/* init to inline wave data */
 
 /* locals */
-static unsigned int snd_wave;
-static unsigned int snd_octave;
-static unsigned int snd_volume;
-static unsigned int snd_length;
-static unsigned int snd_tempo;
-static unsigned int snd_timebase;
-static unsigned int snd_ticks_h, snd_ticks_l;
-static int snd_wave_flag;
-static int snd_off;
 static int tone_table[7]  = { 10, 12, 1, 3, 5, 6, 8 };
 static int freq_table[14] = {
 	0x001EDD,
@@ -46,7 +37,7 @@ static int freq_table[14] = {
 /* protos */
 int mml_get_value(char **ptr);
 int mml_get_length(char **ptr);
-int mml_calc_duration(unsigned int len);
+int mml_calc_duration(struct t_context *ctx, unsigned int len);
 
 
 /* ----
@@ -55,19 +46,19 @@ int mml_calc_duration(unsigned int len);
  */
 
 int
-mml_start(unsigned char *buffer)
+mml_start(struct t_context *ctx, unsigned char *buffer)
 {
 	*buffer = SND_OFF;
 
-	snd_off = 1;
-	snd_wave_flag = 0;
-	snd_octave = 4;
-	snd_volume = 15;
-	snd_length = 4;
-	snd_tempo = 128;
-	snd_timebase = 60;
-	snd_ticks_h = 0;
-	snd_ticks_l = 0;
+	ctx->snd_off = 1;
+	ctx->snd_wave_flag = 0;
+	ctx->snd_octave = 4;
+	ctx->snd_volume = 15;
+	ctx->snd_length = 4;
+	ctx->snd_tempo = 128;
+	ctx->snd_timebase = 60;
+	ctx->snd_ticks_h = 0;
+	ctx->snd_ticks_l = 0;
 
 	/* ok */
 	return (1);
@@ -94,7 +85,7 @@ mml_stop(unsigned char *buffer)
  */
 
 int
-mml_parse(unsigned char *buffer, int bufsize, char *ptr)
+mml_parse(struct t_context *ctx, unsigned char *buffer, int bufsize, char *ptr)
 {
 	unsigned int tone, freq, value, len;
 	int size = 0;
@@ -104,52 +95,52 @@ mml_parse(unsigned char *buffer, int bufsize, char *ptr)
 	while ((c = *ptr++) != '\0') {
 		/* check buffer size */
 		if (bufsize < 7) {
-			fatal_error("Internal error: MML buffer too small!");
+			fatal_error(ctx, "Internal error: MML buffer too small!");
 			return (-1);
 		}
 
 		switch (c) {
 		/* octave */
 		case 'O':
-			snd_octave = mml_get_value(&ptr);
+			ctx->snd_octave = mml_get_value(&ptr);
 	
-			if ((snd_octave < 1) || (snd_octave > 7)) {
-				error("Incorrect octave!");
+			if ((ctx->snd_octave < 1) || (ctx->snd_octave > 7)) {
+				error(ctx, "Incorrect octave!");
 				return (-1);
 			}
 			break;
 	
 		/* volume */
 		case 'V':
-			snd_volume = mml_get_value(&ptr);
+			ctx->snd_volume = mml_get_value(&ptr);
 	
-			if (snd_volume > 15) {
-				error("Incorrect volume!");
+			if (ctx->snd_volume > 15) {
+				error(ctx, "Incorrect volume!");
 				return (-1);
 			}
 	
 			/* gen code */
 			*buffer++ = SND_VOLUME;
-			*buffer++ = (snd_volume << 4) + snd_volume;
+			*buffer++ = (ctx->snd_volume << 4) + ctx->snd_volume;
 			size += 2;
 			break;
 
 		/* tempo */
 		case 'T':
-			snd_tempo = mml_get_value(&ptr);
+			ctx->snd_tempo = mml_get_value(&ptr);
 	
-			if ((snd_tempo < 32) || (snd_tempo > 256)) {
-				error("Incorrect tempo!");
+			if ((ctx->snd_tempo < 32) || (ctx->snd_tempo > 256)) {
+				error(ctx, "Incorrect tempo!");
 				return (-1);
 			}
 			break;
 	
 		/* length */
 		case 'L':
-			snd_length = mml_get_length(&ptr);
+			ctx->snd_length = mml_get_length(&ptr);
 	
-			if (!snd_length) {
-				error("Incorrect note length!");
+			if (!ctx->snd_length) {
+				error(ctx, "Incorrect note length!");
 				return (-1);
 			}
 			break;
@@ -177,7 +168,7 @@ mml_parse(unsigned char *buffer, int bufsize, char *ptr)
 			if (isdigit(*ptr))
 				len = (mml_get_length(&ptr) << 8);
 			else {
-				len = (snd_length << 8);
+				len = (ctx->snd_length << 8);
 			}
 			if (*ptr == '.') {
 				len = (len * 0xC0) >> 8;
@@ -186,12 +177,12 @@ mml_parse(unsigned char *buffer, int bufsize, char *ptr)
 
 			/* check length */
 			if (!len) {
-				error("Incorrect note length!");
+				error(ctx, "Incorrect note length!");
 				return (-1);
 			}
 
 			/* calculate frequency */
-			freq  = (freq_table[tone] << (snd_octave - 1));
+			freq  = (freq_table[tone] << (ctx->snd_octave - 1));
 			value = (((3580000 * 16) / freq) + 1) >> 1;
 
 			/* gen code */
@@ -199,24 +190,24 @@ mml_parse(unsigned char *buffer, int bufsize, char *ptr)
 			*buffer++ = (value)  & 0xFF;
 			*buffer++ = (value >> 8) & 0xFF;
 
-			if (snd_wave_flag) {
+			if (ctx->snd_wave_flag) {
 				/* new waveform */
-				snd_wave_flag = 0;
-				snd_off = 0;
-			   *buffer++ = SND_WAVE_SINE + (snd_wave - 1);
+				ctx->snd_wave_flag = 0;
+				ctx->snd_off = 0;
+			   *buffer++ = SND_WAVE_SINE + (ctx->snd_wave - 1);
 				size += 1;
 			}
 			else {
-				if (snd_off) {
+				if (ctx->snd_off) {
 					/* sound on */
-					snd_off = 0;
+					ctx->snd_off = 0;
 				   *buffer++ = SND_ON;
 					size += 1;
 				}
 			}
 
 			*buffer++ = SND_DURATION;
-			*buffer++ = mml_calc_duration(len);
+			*buffer++ = mml_calc_duration(ctx, len);
 			size += 5;
 			break;
 	
@@ -235,32 +226,32 @@ mml_parse(unsigned char *buffer, int bufsize, char *ptr)
 
 			/* check length */
 			if (!len) {
-				error("Incorrect note length!");
+				error(ctx, "Incorrect note length!");
 				return (-1);
 			}
 
 			/* gen code */
 			*buffer++ = SND_OFF;
 			*buffer++ = SND_DURATION;
-			*buffer++ = mml_calc_duration(len);
-			snd_off = 1;
+			*buffer++ = mml_calc_duration(ctx, len);
+			ctx->snd_off = 1;
 			size += 3;
 			break;
 
 		/* waveform */
 		case 'W':
-			snd_wave = mml_get_value(&ptr);
-			snd_wave_flag = 1;
+			ctx->snd_wave = mml_get_value(&ptr);
+			ctx->snd_wave_flag = 1;
 	
-			if ((snd_wave < 1) || (snd_wave > 3)) {
-				error("Incorrect waveform!");
+			if ((ctx->snd_wave < 1) || (ctx->snd_wave > 3)) {
+				error(ctx, "Incorrect waveform!");
 				return (-1);
 			}
 			break;
 	
 		/* other */
 		default:
-			error("Syntax error!");
+			error(ctx, "Syntax error!");
 			return (-1);
 		}
 
@@ -344,7 +335,7 @@ mml_get_length(char **ptr)
  */
 
 int
-mml_calc_duration(unsigned int len)
+mml_calc_duration(struct t_context *ctx, unsigned int len)
 {
 	unsigned int ticks, mask, tmp;
 
@@ -352,29 +343,29 @@ mml_calc_duration(unsigned int len)
 	ticks = 0xC00000 / len;
 
 	/* base */
-	if (snd_timebase == 0) {
+	if (ctx->snd_timebase == 0) {
 		/* timer */
 		mask = 0xFF;
-		snd_ticks_h = (ticks >> 8);
-		snd_ticks_l = (ticks & 0xFF) + snd_ticks_l;
+		ctx->snd_ticks_h = (ticks >> 8);
+		ctx->snd_ticks_l = (ticks & 0xFF) + ctx->snd_ticks_l;
 	}
 	else {
 		/* fixed frequency (ie. vsync) */
 		mask = 0xFFFFFF;
-		tmp  = (256 - snd_tempo) * snd_timebase * ticks * 8;
-		snd_ticks_h = (tmp >> 24);
-		snd_ticks_l = (tmp & 0xFFFFFF) + snd_ticks_l;
+		tmp  = (256 - ctx->snd_tempo) * ctx->snd_timebase * ticks * 8;
+		ctx->snd_ticks_h = (tmp >> 24);
+		ctx->snd_ticks_l = (tmp & 0xFFFFFF) + ctx->snd_ticks_l;
 	}
 
 	/* adjust timings */
-	if (snd_ticks_l  > mask) {
-		snd_ticks_l &= mask;
-		snd_ticks_h++;
+	if (ctx->snd_ticks_l  > mask) {
+		ctx->snd_ticks_l &= mask;
+		ctx->snd_ticks_h++;
 	}
-	if (snd_ticks_h == 0)
-		snd_ticks_h = 1;
+	if (ctx->snd_ticks_h == 0)
+		ctx->snd_ticks_h = 1;
 
 	/* result */
-	return (snd_ticks_h - 1);
+	return (ctx->snd_ticks_h - 1);
 }
 
@@ -5,18 +5,6 @@
 #include "protos.h"
 #include "nes.h"
 
-/* locals */
-static int ines_prg;		/* number of prg banks */
-static int ines_chr;		/* number of character banks */
-static int ines_mapper[2];	/* rom mapper type */
-static struct INES {		/* INES rom header */
-	unsigned char id[4];
-	unsigned char prg;
-	unsigned char chr;
-	unsigned char mapper[2];
-	unsigned char unused[8];
-} header;
-
 
 /* ----
  * write_header()
@@ -25,22 +13,22 @@ static struct INES {		/* INES rom header */
  */
 
 void
-nes_write_header(FILE *f, int banks)
+nes_write_header(struct t_context *ctx, struct t_buffer *buf, int banks)
 {
     (void)banks;
 	/* setup INES header */
-	memset(&header, 0, sizeof(header));
-	header.id[0] = 'N';
-	header.id[1] = 'E';
-	header.id[2] = 'S';
-	header.id[3] = 26;
-	header.prg = ines_prg;
-	header.chr = ines_chr;
-	header.mapper[0] = ines_mapper[0];
-	header.mapper[1] = ines_mapper[1];
+	memset(&ctx->ines, 0, sizeof(ctx->ines));
+	ctx->ines.id[0] = 'N';
+	ctx->ines.id[1] = 'E';
+	ctx->ines.id[2] = 'S';
+	ctx->ines.id[3] = 26;
+	ctx->ines.prg = ctx->ines_prg;
+	ctx->ines.chr = ctx->ines_chr;
+	ctx->ines.mapper[0] = ctx->ines_mapper[0];
+	ctx->ines.mapper[1] = ctx->ines_mapper[1];
 
 	/* write */
-	fwrite(&header, sizeof(header), 1, f);
+	buf_write(buf, &ctx->ines, sizeof(ctx->ines));
 }
 
 
@@ -51,7 +39,7 @@ nes_write_header(FILE *f, int banks)
  */
 
 int
-nes_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format)
+nes_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format)
 {
 	int i, j;
 	int cnt, err;
@@ -60,7 +48,7 @@ nes_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
 	unsigned int  *packed;
 
 	/* pack the tile only in the last pass */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (16);
 
 	/* clear buffer */
@@ -108,12 +96,12 @@ nes_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
 
 		/* error message */
 		if (err)
-			error("Incorrect pixel color index!");
+			error(ctx, "Incorrect pixel color index!");
 		break;
 
 	default:
 		/* other formats not supported */
-		error("Internal error: unsupported format passed to 'pack_8x8_tile'!");
+		error(ctx, "Internal error: unsupported format passed to 'pack_8x8_tile'!");
 		break;
 	}
 
@@ -129,7 +117,7 @@ nes_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
  */
 
 void
-nes_defchr(int *ip)
+nes_defchr(struct t_context *ctx, int *ip)
 {
 	unsigned char buffer[16];
 	unsigned int data[8];
@@ -137,32 +125,32 @@ nes_defchr(int *ip)
 	int i;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 3;
-	data_level  = 3;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 3;
+	ctx->data_level  = 3;
 
 	/* get tile data */
 	for (i = 0; i < 8; i++) {
 		/* get value */
-		if (!evaluate(ip, (i < 7) ? ',' : ';'))
+		if (!evaluate(ctx, ip, (i < 7) ? ',' : ';'))
 			return;
 
 		/* store value */
-		data[i] = value;
+		data[i] = ctx->value;
 	}
 
 	/* encode tile */
-	size = nes_pack_8x8_tile(buffer, data, 0, PACKED_TILE);
+	size = nes_pack_8x8_tile(ctx, buffer, data, 0, PACKED_TILE);
 
 	/* store tile */
-	putbuffer(buffer, size);
+	putbuffer(ctx, buffer, size);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -173,23 +161,23 @@ nes_defchr(int *ip)
  */
 
 void
-nes_inesprg(int *ip)
+nes_inesprg(struct t_context *ctx, int *ip)
 {
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
-    int svalue = (int)value;
+    int svalue = (int)ctx->value;
 	if ((svalue < 0) || (svalue > 64)) 
 	{
-		error("Prg bank value out of range!");
+		error(ctx, "Prg bank value out of range!");
 	
 		return;
 	}
 	
-	ines_prg = value;
+	ctx->ines_prg = ctx->value;
 
-	if (pass == LAST_PASS) 
+	if (ctx->pass == LAST_PASS) 
 	{
-		println();
+		println(ctx);
 	}
 }
 
@@ -201,24 +189,24 @@ nes_inesprg(int *ip)
  */
 
 void
-nes_ineschr(int *ip)
+nes_ineschr(struct t_context *ctx, int *ip)
 {
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
-    int svalue = (int)value;
+    int svalue = (int)ctx->value;
 	if ((svalue < 0) || (svalue > 64)) 
 	{
-		error("Prg bank value out of range!");
+		error(ctx, "Prg bank value out of range!");
 	
 		return;
 	}
 	
-	ines_chr = value;
+	ctx->ines_chr = ctx->value;
 
-	if (pass == LAST_PASS) 
+	if (ctx->pass == LAST_PASS) 
 	{
-		println();
+		println(ctx);
 	}
 }
 
@@ -230,26 +218,26 @@ nes_ineschr(int *ip)
  */
 
 void
-nes_inesmap(int *ip)
+nes_inesmap(struct t_context *ctx, int *ip)
 {
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
-    int svalue = (int)value;
+    int svalue = (int)ctx->value;
 	if ((svalue < 0) || (svalue > 255)) 
 	{
-		error("Mapper value out of range!");
+		error(ctx, "Mapper value out of range!");
 	
 		return;
 	}
 	
-	ines_mapper[0] &= 0x0F;
-	ines_mapper[0] |= (value & 0x0F) << 4;
-	ines_mapper[1]  = (value & 0xF0);
+	ctx->ines_mapper[0] &= 0x0F;
+	ctx->ines_mapper[0] |= (ctx->value & 0x0F) << 4;
+	ctx->ines_mapper[1]  = (ctx->value & 0xF0);
 
-	if (pass == LAST_PASS) 
+	if (ctx->pass == LAST_PASS) 
 	{
-		println();
+		println(ctx);
 	}
 }
 
@@ -261,25 +249,25 @@ nes_inesmap(int *ip)
  */
 
 void
-nes_inesmir(int *ip)
+nes_inesmir(struct t_context *ctx, int *ip)
 {
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
 
-    int svalue = (int)value;
+    int svalue = (int)ctx->value;
 	if ((svalue < 0) || (svalue > 15)) 
 	{
-		error("Mirror value out of range!");
+		error(ctx, "Mirror value out of range!");
 	
 		return;
 	}
 	
-	ines_mapper[0] &= 0xF0;
-	ines_mapper[0] |= (value  & 0x0F);
+	ctx->ines_mapper[0] &= 0xF0;
+	ctx->ines_mapper[0] |= (ctx->value  & 0x0F);
 
-	if (pass == LAST_PASS) 
+	if (ctx->pass == LAST_PASS) 
 	{
-		println();
+		println(ctx);
 	}
 }
 
@@ -1,12 +1,12 @@
 
 /* NES.C */
-void nes_write_header(FILE *f, int banks);
-int  nes_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format);
-void nes_defchr(int *ip);
-void nes_inesprg(int *ip);
-void nes_ineschr(int *ip);
-void nes_inesmap(int *ip);
-void nes_inesmir(int *ip);
+void nes_write_header(struct t_context *ctx, struct t_buffer *buf, int banks);
+int  nes_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format);
+void nes_defchr(struct t_context *ctx, int *ip);
+void nes_inesprg(struct t_context *ctx, int *ip);
+void nes_ineschr(struct t_context *ctx, int *ip);
+void nes_inesmap(struct t_context *ctx, int *ip);
+void nes_inesmir(struct t_context *ctx, int *ip);
 
 /* NES specific pseudos */
 struct t_opcode nes_pseudo[11] = {
@@ -41,6 +41,9 @@ struct t_machine nes = {
 	nes_pack_8x8_tile, /* pack_8x8_tile */
 	NULL,              /* pack_16x16_tile */
 	NULL,              /* pack_16x16_sprite */
-	nes_write_header   /* write_header */
+	nes_write_header,  /* write_header */
+	NULL,       /* op_hash, set by opinit() */
+	NULL,       /* op_tbl */
+	0           /* inst_init */
 };
 
@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+#include "expr.h"
+
+#define OBJ_MAGIC "pceas-object 1"
+
+
+/* ----
+ * obj_save()
+ * ----
+ * save the code and data of the file just assembled, the
+ * symbols it exports and the fixups of the values using the
+ * symbols it imports; the sections are placed by the source,
+ * the linker doesn't move them
+ */
+
+int
+obj_save(struct t_context *ctx, struct t_buffer *buf)
+{
+	struct t_symbol *sym, *local;
+	struct t_symbol **refs;
+	struct t_exprop *code;
+	struct t_fixup *fix;
+	int nb, nb_refs, i, j, k;
+
+	/* the develo and the procs need the whole program */
+	if (ctx->develo_opt || ctx->mx_opt) {
+		msg_printf(ctx, "An object file can not be made for the Develo!\n");
+		return (1);
+	}
+	for (i = 0; i < 256; i++) {
+		if (ctx->proc_tbl[i]) {
+			msg_printf(ctx, "An object file can not contain procs!\n");
+			return (1);
+		}
+	}
+
+	/* symbols used by the fixups */
+	refs = NULL;
+	nb_refs = 0;
+
+	for (fix = ctx->fix_list; fix; fix = fix->next) {
+		for (i = 0, code = fix->code; i < fix->nb; i++, code++) {
+			if ((code->op == EX_SYMBOL) && (obj_ref(&refs, &nb_refs, code->sym) < 0)) {
+				free(refs);
+				msg_printf(ctx, "Not enough memory!\n");
+				return (1);
+			}
+		}
+	}
+
+	/* header, the objects linked must use the same options */
+	buf->size = 0;
+	buf_write(buf, OBJ_MAGIC, strlen(OBJ_MAGIC) + 1);
+	snap_put_int(buf, ctx->machine->type);
+	snap_put_int(buf, ctx->develo_opt | ctx->mx_opt);
+	snap_put_int(buf, ctx->cd_opt | (ctx->scd_opt << 1));
+
+	/* bank requirements */
+	snap_put_int(buf, ctx->max_bank);
+	snap_put_int(buf, ctx->max_zp);
+	snap_put_int(buf, ctx->max_bss);
+	snap_put_int(buf, ctx->ines_prg);
+	snap_put_int(buf, ctx->ines_chr);
+	snap_put_int(buf, ctx->ines_mapper[0]);
+	snap_put_int(buf, ctx->ines_mapper[1]);
+
+	/* exported symbols */
+	for (nb = 0, i = 0; i < ctx->sym_tbl.nb; i++)
+		nb += obj_export(ctx->sym_tbl.list[i]);
+	snap_put_int(buf, nb);
+
+	for (i = 0; i < ctx->sym_tbl.nb; i++) {
+		sym = ctx->sym_tbl.list[i];
+		if (!obj_export(sym))
+			continue;
+		snap_put_sym(buf, sym);
+
+		for (nb = 0, local = sym->local; local; local = local->next)
+			nb += obj_export(local);
+		snap_put_int(buf, nb);
+
+		for (local = sym->local; local; local = local->next) {
+			if (obj_export(local))
+				snap_put_sym(buf, local);
+		}
+	}
+
+	/* symbols used by the fixups, the ones defined by this
+	 * file are kept with their values
+	 */
+	snap_put_int(buf, nb_refs);
+
+	for (i = 0; i < nb_refs; i++)
+		snap_put_sym(buf, refs[i]);
+
+	/* code and data, by runs of bytes */
+	for (nb = 0, i = 0; i < 128; i++) {
+		for (j = 0; j < 8192; j = k) {
+			for (k = j; (k < 8192) && (ctx->map[i][k] != 0xFF); k++)
+				;
+			if (k == j)
+				k++;
+			else
+				nb++;
+		}
+	}
+	snap_put_int(buf, nb);
+
+	for (i = 0; i < 128; i++) {
+		for (j = 0; j < 8192; j = k) {
+			for (k = j; (k < 8192) && (ctx->map[i][k] != 0xFF); k++)
+				;
+			if (k == j) {
+				k++;
+				continue;
+			}
+			snap_put_int(buf, i);
+			snap_put_int(buf, j);
+			snap_put_int(buf, k - j);
+			buf_write(buf, &ctx->rom[i][j], k - j);
+			buf_write(buf, &ctx->map[i][j], k - j);
+		}
+	}
+
+	/* fixups */
+	for (nb = 0, fix = ctx->fix_list; fix; fix = fix->next)
+		nb++;
+	snap_put_int(buf, nb);
+
+	for (fix = ctx->fix_list; fix; fix = fix->next) {
+		snap_put_int(buf, fix->type);
+		snap_put_int(buf, fix->bank);
+		snap_put_int(buf, fix->offset);
+		snap_put_int(buf, fix->adjust);
+		snap_put_int(buf, fix->nb);
+
+		for (i = 0, code = fix->code; i < fix->nb; i++, code++) {
+			snap_put_int(buf, code->op);
+			snap_put_int(buf, code->value);
+			snap_put_int(buf, (code->op == EX_SYMBOL) ? obj_ref(&refs, &nb_refs, code->sym) : -1);
+		}
+	}
+
+	/* ok */
+	free(refs);
+	return (0);
+}
+
+
+/* ----
+ * obj_link()
+ * ----
+ * link object files, the symbols exported by all of them are
+ * loaded first then their code and data are patched; return 1
+ * on error
+ */
+
+int
+obj_link(struct t_context *ctx, char **names, int nb)
+{
+	struct t_stream *st;
+	int i;
+
+	if ((st = (void *)malloc(nb * sizeof(struct t_stream))) == NULL) {
+		msg_printf(ctx, "Not enough memory!\n");
+		ctx->errcnt++;
+		return (1);
+	}
+
+	/* the symbols set after the first pass */
+	lablset(ctx, "_bss_end", 0);
+	lablset(ctx, "_bank_base", 0);
+	lablset(ctx, "_nb_bank", 1);
+	lablset(ctx, "_call_bank", 0);
+
+	/* exported symbols */
+	for (i = 0; i < nb; i++) {
+		if (obj_load(ctx, names[i], &st[i]))
+			break;
+	}
+	if (ctx->errcnt) {
+		free(st);
+		return (1);
+	}
+
+	/* update predefined symbols */
+	ctx->bank_base = calc_bank_base(ctx);
+	lablset(ctx, "_bss_end", ctx->machine->ram_base + ctx->max_bss);
+	lablset(ctx, "_bank_base", ctx->bank_base);
+	lablset(ctx, "_call_bank", ctx->bank_base + ctx->max_bank + 1);
+	lablset(ctx, "_nb_bank", ctx->max_bank + 2);
+
+	/* code and data */
+	for (i = 0; i < nb; i++) {
+		if (obj_patch(ctx, names[i], &st[i]))
+			break;
+	}
+	free(st);
+
+	return (ctx->errcnt ? 1 : 0);
+}
+
+
+/* ----
+ * obj_load()
+ * ----
+ * load the header and the exported symbols of an object file,
+ * the stream is left at the beginning of its code; return 1 on
+ * error
+ */
+
+int
+obj_load(struct t_context *ctx, char *name, struct t_stream *st)
+{
+	struct t_symbol *sym, *local, *found;
+	struct t_symbol **last_local;
+	struct t_file *file;
+	int nb, val, i, k;
+
+	if ((file = open_file(ctx, name)) == NULL) {
+		msg_printf(ctx, "Can not open object file '%s'!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+
+	st->ptr = file->data;
+	st->end = file->data + file->size;
+	st->error = 0;
+
+	/* header */
+	if ((file->size < (int)sizeof(OBJ_MAGIC)) || memcmp(file->data, OBJ_MAGIC, sizeof(OBJ_MAGIC))) {
+		msg_printf(ctx, "'%s' is not an object file!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+	st->ptr += sizeof(OBJ_MAGIC);
+
+	if ((snap_get_int(st) != ctx->machine->type) ||
+		(snap_get_int(st) != (ctx->develo_opt | ctx->mx_opt)) ||
+		(snap_get_int(st) != (ctx->cd_opt | (ctx->scd_opt << 1)))) {
+		msg_printf(ctx, "Object file '%s' was made for other options!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+
+	/* bank requirements, the rom holds all the objects */
+	if ((val = snap_get_int(st)) > ctx->max_bank)
+		ctx->max_bank = val;
+	if ((val = snap_get_int(st)) > ctx->max_zp)
+		ctx->max_zp = val;
+	if ((val = snap_get_int(st)) > ctx->max_bss)
+		ctx->max_bss = val;
+	if ((val = snap_get_int(st)) > ctx->ines_prg)
+		ctx->ines_prg = val;
+	if ((val = snap_get_int(st)) > ctx->ines_chr)
+		ctx->ines_chr = val;
+	ctx->ines_mapper[0] |= snap_get_int(st);
+	ctx->ines_mapper[1] |= snap_get_int(st);
+
+	if ((ctx->max_bank < 0) || (ctx->max_bank > 0x7F))
+		st->error = 1;
+
+	/* exported symbols, a symbol can only be exported
+	 * twice with the same value
+	 */
+	nb = snap_get_int(st);
+
+	for (i = 0; (i < nb) && !st->error; i++) {
+		if ((sym = snap_get_sym(ctx, st)) == NULL)
+			break;
+
+		if ((found = st_search(&ctx->sym_tbl.idx, sym->name, sym->hash)) != NULL) {
+			if ((found->type != sym->type) ||
+				(found->value != sym->value) ||
+				(found->bank != sym->bank)) {
+				msg_printf(ctx, "Symbol '%s' of '%s' is already defined!\n", &sym->name[1], name);
+				ctx->errcnt++;
+			}
+			found->refcnt += sym->refcnt;
+		}
+		else if (!st_add(&ctx->sym_tbl, sym))
+			break;
+
+		/* locals, the ones of a symbol exported twice
+		 * are dropped
+		 */
+		last_local = &sym->local;
+		k = snap_get_int(st);
+
+		for (; (k > 0) && !st->error; k--) {
+			if ((local = snap_get_sym(ctx, st)) == NULL)
+				break;
+			if (found)
+				continue;
+			if (!st_index(&sym->ext->local_idx, local, 16))
+				break;
+			*last_local = local;
+			last_local = &local->next;
+		}
+		*last_local = NULL;
+		if (k > 0)
+			break;
+	}
+	if (i < nb)
+		st->error = 1;
+
+	if (st->error) {
+		msg_printf(ctx, "Object file '%s' is corrupted!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * obj_patch()
+ * ----
+ * copy the code and data of an object file in the rom, and
+ * patch the values using the symbols it imports; return 1 if
+ * the object file is corrupted
+ */
+
+int
+obj_patch(struct t_context *ctx, char *name, struct t_stream *st)
+{
+	struct t_symbol **refs;
+	struct t_symbol *sym, *found;
+	struct t_exprop *code;
+	struct t_fixup *fix;
+	unsigned char *map;
+	int nb, nb_refs, bank, offset, size, undef;
+	int i, j, k;
+
+	/* symbols used by the fixups, the imported ones are
+	 * searched in the symbols exported by the objects
+	 */
+	nb_refs = snap_get_int(st);
+	if ((nb_refs < 0) || (nb_refs > (st->end - st->ptr))) {
+		msg_printf(ctx, "Object file '%s' is corrupted!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+	refs = (void *)malloc((nb_refs + 1) * sizeof(struct t_symbol *));
+	fix  = (void *)malloc(sizeof(struct t_fixup) + (EXPR_CODE_MAX - 1) * sizeof(struct t_exprop));
+	if ((refs == NULL) || (fix == NULL)) {
+		free(refs);
+		free(fix);
+		msg_printf(ctx, "Not enough memory!\n");
+		ctx->errcnt++;
+		return (1);
+	}
+
+	for (i = 0; (i < nb_refs) && !st->error; i++) {
+		if ((sym = snap_get_sym(ctx, st)) == NULL)
+			break;
+
+		if ((sym->type == UNDEF) || (sym->type == IFUNDEF)) {
+			found = st_search(&ctx->sym_tbl.idx, sym->name, sym->hash);
+			if (found == NULL) {
+				msg_printf(ctx, "Undefined symbol '%s' in '%s'!\n", &sym->name[1], name);
+				ctx->errcnt++;
+			}
+			else
+				sym = found;
+		}
+		refs[i] = sym;
+	}
+	if (i < nb_refs)
+		st->error = 1;
+
+	/* code and data, the objects can't overlap */
+	nb = snap_get_int(st);
+
+	for (i = 0; (i < nb) && !st->error; i++) {
+		bank = snap_get_int(st);
+		offset = snap_get_int(st);
+		size = snap_get_int(st);
+
+		if ((bank < 0) || (bank > 0x7F) || (offset < 0) || (size <= 0) ||
+			(offset + size > 8192) || ((st->end - st->ptr) < (2 * size))) {
+			st->error = 1;
+			break;
+		}
+
+		map = &ctx->map[bank][offset];
+		for (j = 0; j < size; j++) {
+			if (map[j] != 0xFF) {
+				msg_printf(ctx, "Object file '%s' overlaps another one in bank $%02X at $%04X!\n",
+						   name, bank, offset + j);
+				ctx->errcnt++;
+				break;
+			}
+		}
+		memcpy(&ctx->rom[bank][offset], st->ptr, size);
+		st->ptr += size;
+		memcpy(map, st->ptr, size);
+		st->ptr += size;
+	}
+
+	/* fixups, patched one by one */
+	nb = snap_get_int(st);
+	fix->next = NULL;
+
+	for (i = 0; (i < nb) && !st->error; i++) {
+		fix->type = snap_get_int(st);
+		fix->bank = snap_get_int(st);
+		fix->offset = snap_get_int(st);
+		fix->adjust = snap_get_int(st);
+		fix->nb = snap_get_int(st);
+
+		if ((fix->type < FIX_BYTE) || (fix->type > FIX_REL) || (fix->type == FIX_OPERAND) ||
+			(fix->bank < 0) || (fix->bank > 0x7F) || (fix->offset < 0) ||
+			(fix->nb <= 0) || (fix->nb > EXPR_CODE_MAX)) {
+			st->error = 1;
+			break;
+		}
+
+		undef = 0;
+		for (j = 0, code = fix->code; j < fix->nb; j++, code++) {
+			code->op = snap_get_int(st);
+			code->value = snap_get_int(st);
+			code->sym = NULL;
+			code->scope = NULL;
+
+			k = snap_get_int(st);
+			if (code->op == EX_SYMBOL) {
+				if ((k < 0) || (k >= nb_refs)) {
+					st->error = 1;
+					break;
+				}
+				code->sym = refs[k];
+				if ((code->sym->type == UNDEF) || (code->sym->type == IFUNDEF))
+					undef = 1;
+			}
+			else if ((code->op < 0) || ((code->op > EX_CONST) && (code->op != EX_FUNC))) {
+				st->error = 1;
+				break;
+			}
+		}
+		if (st->error)
+			break;
+
+		/* the undefined symbols are already reported */
+		if (undef)
+			continue;
+
+		ctx->expr_nb = -1;
+		ctx->func_nb = -1;
+		if (!fixup_patch(ctx, fix)) {
+			msg_printf(ctx, "Value out of range in '%s', bank $%02X at $%04X!\n",
+					   name, fix->bank, fix->offset);
+			ctx->errcnt++;
+		}
+	}
+	free(refs);
+	free(fix);
+
+	if (st->error) {
+		msg_printf(ctx, "Object file '%s' is corrupted!\n", name);
+		ctx->errcnt++;
+		return (1);
+	}
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * obj_export()
+ * ----
+ * check if a symbol is exported by an object file, the
+ * predefined symbols are set by the linker
+ */
+
+int
+obj_export(struct t_symbol *sym)
+{
+	if ((sym->type == UNDEF) || (sym->type == IFUNDEF) ||
+		(sym->type == MACRO) || (sym->type == FUNC))
+		return (0);
+	if (sym->ext->reserved)
+		return (0);
+	return (1);
+}
+
+
+/* ----
+ * obj_ref()
+ * ----
+ * get the index of a symbol used by the fixups, it's added
+ * to the list if not found; return -1 on error
+ */
+
+int
+obj_ref(struct t_symbol ***refs, int *nb, struct t_symbol *sym)
+{
+	struct t_symbol **list;
+	int i;
+
+	for (i = 0; i < *nb; i++) {
+		if ((*refs)[i] == sym)
+			return (i);
+	}
+
+	/* grow the list by 64 symbols */
+	if ((*nb & 63) == 0) {
+		list = (void *)realloc(*refs, (*nb + 64) * sizeof(struct t_symbol *));
+		if (list == NULL)
+			return (-1);
+		*refs = list;
+	}
+	(*refs)[*nb] = sym;
+	return ((*nb)++);
+}
@@ -0,0 +1,421 @@
+/*
+ *  opgen
+ *  ----
+ *  Build tool, generates a perfect hash of the instructions and
+ *  pseudos of each machine. The names are read from the instruction
+ *  tables in the headers, the output is included by pceas.c.
+ *
+ *  usage: opgen output machine table table table table [machine ...]
+ *
+ *  The four tables of a machine are its base instructions, base
+ *  pseudos, machine instructions and machine pseudos, written as
+ *  file:array or '-' when the machine has none; the machines must
+ *  be given in the order of their type.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_NAMES	1024
+#define MAX_MACHINES	4
+
+typedef struct t_opname {
+	char name[16];
+	int  len;
+	int  id;		/* table << 8 | index */
+	unsigned int hash;
+} t_opname;
+
+typedef struct t_opmach {
+	char *name;
+	struct t_opname op[MAX_NAMES];
+	int  nb;
+	unsigned int seed;
+	int  nb_disp;
+	int  size;
+	unsigned short *disp;
+	short *slot;
+} t_opmach;
+
+int  read_table(struct t_opmach *mach, char *arg, int table);
+int  add_name(struct t_opmach *mach, char *name, int id);
+int  build_hash(struct t_opmach *mach);
+int  try_seed(struct t_opmach *mach, unsigned int seed);
+unsigned int op_hash(unsigned int seed, char *name);
+void write_hash(FILE *fp, struct t_opmach *mach);
+
+struct t_opmach machines[MAX_MACHINES];
+
+
+/* ----
+ * main()
+ * ----
+ */
+
+int
+main(int argc, char **argv)
+{
+	struct t_opmach *mach;
+	FILE *fp;
+	int nb, i, j;
+
+	if ((argc < 7) || ((argc - 2) % 5)) {
+		fprintf(stderr, "usage: opgen output machine table table table table [machine ...]\n");
+		return (1);
+	}
+
+	/* read the names */
+	nb = (argc - 2) / 5;
+	if (nb > MAX_MACHINES) {
+		fprintf(stderr, "opgen: too many machines!\n");
+		return (1);
+	}
+	for (i = 0; i < nb; i++) {
+		mach = &machines[i];
+		mach->name = argv[2 + i * 5];
+		for (j = 0; j < 4; j++) {
+			if (!read_table(mach, argv[3 + i * 5 + j], j))
+				return (1);
+		}
+		if (!build_hash(mach))
+			return (1);
+	}
+
+	/* write the tables */
+	if ((fp = fopen(argv[1], "w")) == NULL) {
+		fprintf(stderr, "opgen: can not write '%s'!\n", argv[1]);
+		return (1);
+	}
+	fprintf(fp, "/* generated by opgen from the instruction tables, do not edit */\n\n");
+	for (i = 0; i < nb; i++)
+		write_hash(fp, &machines[i]);
+
+	fprintf(fp, "static const struct t_ophash op_hash[%i] = {\n", nb);
+	for (i = 0; i < nb; i++) {
+		mach = &machines[i];
+		fprintf(fp, "\t{0x%08X, %i, %i, %s_op_disp, %s_op_slot, %s_op_len, %s_op_name}%s\n",
+				mach->seed, mach->nb_disp, mach->size,
+				mach->name, mach->name, mach->name, mach->name,
+				(i < nb - 1) ? "," : "");
+	}
+	fprintf(fp, "};\n");
+
+	if (fclose(fp)) {
+		fprintf(stderr, "opgen: can not write '%s'!\n", argv[1]);
+		return (1);
+	}
+	return (0);
+}
+
+
+/* ----
+ * read_table()
+ * ----
+ * read the names of an instruction table, 'arg' is the header
+ * and the array name separated by a colon
+ */
+
+int
+read_table(struct t_opmach *mach, char *arg, int table)
+{
+	char  path[512];
+	char  name[64];
+	char  line[512];
+	char *array, *ptr, *end;
+	FILE *fp;
+	int   found, idx;
+
+	if (!strcmp(arg, "-"))
+		return (1);
+
+	/* split the argument */
+	strncpy(path, arg, sizeof(path) - 1);
+	path[sizeof(path) - 1] = '\0';
+	if ((array = strrchr(path, ':')) == NULL) {
+		fprintf(stderr, "opgen: invalid table '%s'!\n", arg);
+		return (0);
+	}
+	*array++ = '\0';
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "opgen: can not open '%s'!\n", path);
+		return (0);
+	}
+
+	/* search the array, then get the names of its entries;
+	 * they are all written on one line as {NULL, "NAME", ...}
+	 */
+	sprintf(name, "struct t_opcode %s[", array);
+	found = 0;
+	idx = 0;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		if (!found) {
+			if (strstr(line, name))
+				found = 1;
+			continue;
+		}
+		if (strstr(line, "};"))
+			break;
+		if ((ptr = strchr(line, '{')) == NULL)
+			continue;
+
+		/* skip the 'next' field, an entry that isn't written
+		 * this way would shift the indexes of the next ones
+		 */
+		for (ptr++; (*ptr == ' ') || (*ptr == '\t'); ptr++)
+			;
+		if (strncmp(ptr, "NULL", 4)) {
+			fprintf(stderr, "opgen: invalid entry %i in '%s'!\n", idx, array);
+			fclose(fp);
+			return (0);
+		}
+		for (ptr += 4; (*ptr == ' ') || (*ptr == '\t'); ptr++)
+			;
+		if (*ptr++ != ',') {
+			fprintf(stderr, "opgen: invalid entry %i in '%s'!\n", idx, array);
+			fclose(fp);
+			return (0);
+		}
+		while ((*ptr == ' ') || (*ptr == '\t'))
+			ptr++;
+
+		/* end of the table */
+		if (!strncmp(ptr, "NULL", 4))
+			break;
+		if ((*ptr++ != '"') || ((end = strchr(ptr, '"')) == NULL) || ((end - ptr) > 15) || (end == ptr)) {
+			fprintf(stderr, "opgen: invalid name in entry %i of '%s'!\n", idx, array);
+			fclose(fp);
+			return (0);
+		}
+		*end = '\0';
+		if (!add_name(mach, ptr, (table << 8) | idx)) {
+			fclose(fp);
+			return (0);
+		}
+		idx++;
+	}
+	fclose(fp);
+
+	if (!found) {
+		fprintf(stderr, "opgen: array '%s' not found in '%s'!\n", array, path);
+		return (0);
+	}
+	if (idx > 255) {
+		fprintf(stderr, "opgen: too many names in '%s'!\n", array);
+		return (0);
+	}
+	return (1);
+}
+
+
+/* ----
+ * add_name()
+ * ----
+ * add a name to a machine, the tables added last replace the
+ * names of the previous ones like they did in the old chained
+ * hash table
+ */
+
+int
+add_name(struct t_opmach *mach, char *name, int id)
+{
+	int i;
+
+	for (i = 0; i < mach->nb; i++) {
+		if (!strcmp(mach->op[i].name, name)) {
+			mach->op[i].id = id;
+			return (1);
+		}
+	}
+	if (mach->nb == MAX_NAMES) {
+		fprintf(stderr, "opgen: too many names!\n");
+		return (0);
+	}
+	strcpy(mach->op[mach->nb].name, name);
+	mach->op[mach->nb].len = strlen(name);
+	mach->op[mach->nb].id = id;
+	mach->nb++;
+	return (1);
+}
+
+
+/* ----
+ * build_hash()
+ * ----
+ * find a seed for which each bucket of names can be moved to
+ * free slots with a single displacement value
+ */
+
+int
+build_hash(struct t_opmach *mach)
+{
+	unsigned int seed;
+	int n;
+
+	/* about two names per bucket, and a half empty table */
+	for (n = 1; n < mach->nb; n *= 2)
+		;
+	mach->size = n * 2;
+	mach->nb_disp = (n / 2) ? (n / 2) : 1;
+
+	mach->disp = (void *)malloc(mach->nb_disp * sizeof(unsigned short));
+	mach->slot = (void *)malloc(mach->size * sizeof(short));
+	if ((mach->disp == NULL) || (mach->slot == NULL)) {
+		fprintf(stderr, "opgen: not enough memory!\n");
+		return (0);
+	}
+
+	for (seed = 0x811C9DC5; seed != 0x811C9DC5 + 100000; seed++) {
+		if (try_seed(mach, seed)) {
+			mach->seed = seed;
+			return (1);
+		}
+	}
+	fprintf(stderr, "opgen: no perfect hash found for '%s'!\n", mach->name);
+	return (0);
+}
+
+
+/* ----
+ * try_seed()
+ * ----
+ * place the names with a seed, the biggest buckets first
+ */
+
+int
+try_seed(struct t_opmach *mach, unsigned int seed)
+{
+	int  count[MAX_NAMES];
+	int  order[MAX_NAMES];
+	int  member[16];
+	int  i, j, k, b, nb, tmp;
+	unsigned int d, s;
+
+	for (i = 0; i < mach->nb; i++)
+		mach->op[i].hash = op_hash(seed, mach->op[i].name);
+	for (i = 0; i < mach->size; i++)
+		mach->slot[i] = -1;
+
+	/* bucket sizes */
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < mach->nb; i++)
+		count[mach->op[i].hash & (mach->nb_disp - 1)]++;
+
+	/* sort the buckets */
+	for (i = 0; i < mach->nb_disp; i++)
+		order[i] = i;
+	for (i = 1; i < mach->nb_disp; i++) {
+		for (j = i; (j > 0) && (count[order[j]] > count[order[j - 1]]); j--) {
+			tmp = order[j];
+			order[j] = order[j - 1];
+			order[j - 1] = tmp;
+		}
+	}
+
+	/* place them */
+	for (i = 0; i < mach->nb_disp; i++) {
+		b = order[i];
+		mach->disp[b] = 0;
+		if (count[b] == 0)
+			continue;
+		if (count[b] > 16)
+			return (0);
+
+		for (nb = 0, j = 0; j < mach->nb; j++) {
+			if ((int)(mach->op[j].hash & (mach->nb_disp - 1)) == b)
+				member[nb++] = j;
+		}
+
+		for (d = 0; d < (unsigned int)mach->size; d++) {
+			for (j = 0; j < nb; j++) {
+				s = ((mach->op[member[j]].hash >> 16) ^ d) & (mach->size - 1);
+				if (mach->slot[s] >= 0)
+					break;
+				for (k = 0; k < j; k++) {
+					if ((((mach->op[member[k]].hash >> 16) ^ d) & (mach->size - 1)) == s)
+						break;
+				}
+				if (k < j)
+					break;
+			}
+			if (j == nb)
+				break;
+		}
+		if (d == (unsigned int)mach->size)
+			return (0);
+
+		mach->disp[b] = d;
+		for (j = 0; j < nb; j++) {
+			s = ((mach->op[member[j]].hash >> 16) ^ d) & (mach->size - 1);
+			mach->slot[s] = member[j];
+		}
+	}
+
+	return (1);
+}
+
+
+/* ----
+ * op_hash()
+ * ----
+ * hash of an instruction name, it must be the same as
+ * the one computed by oplook()
+ */
+
+unsigned int
+op_hash(unsigned int seed, char *name)
+{
+	unsigned int hash = seed;
+
+	while (*name) {
+		hash ^= (unsigned char)*name++;
+		hash *= 0x01000193;
+	}
+	return (hash);
+}
+
+
+/* ----
+ * write_hash()
+ * ----
+ * write the tables of a machine
+ */
+
+void
+write_hash(FILE *fp, struct t_opmach *mach)
+{
+	int i, op;
+
+	fprintf(fp, "static const unsigned short %s_op_disp[%i] = {", mach->name, mach->nb_disp);
+	for (i = 0; i < mach->nb_disp; i++)
+		fprintf(fp, "%s%i,", (i % 16) ? " " : "\n\t", mach->disp[i]);
+	fprintf(fp, "\n};\n\n");
+
+	/* the slots hold the table and the index of the instruction */
+	fprintf(fp, "static const short %s_op_slot[%i] = {", mach->name, mach->size);
+	for (i = 0; i < mach->size; i++) {
+		op = mach->slot[i];
+		fprintf(fp, "%s%i,", (i % 16) ? " " : "\n\t", (op < 0) ? -1 : mach->op[op].id);
+	}
+	fprintf(fp, "\n};\n\n");
+
+	fprintf(fp, "static const unsigned char %s_op_len[%i] = {", mach->name, mach->size);
+	for (i = 0; i < mach->size; i++) {
+		op = mach->slot[i];
+		fprintf(fp, "%s%i,", (i % 16) ? " " : "\n\t", (op < 0) ? 0 : mach->op[op].len);
+	}
+	fprintf(fp, "\n};\n\n");
+
+	/* the names, to check the tables they were read from */
+	fprintf(fp, "static const char *const %s_op_name[%i] = {", mach->name, mach->size);
+	for (i = 0; i < mach->size; i++) {
+		op = mach->slot[i];
+		if (op < 0)
+			fprintf(fp, "%sNULL,", (i % 8) ? " " : "\n\t");
+		else
+			fprintf(fp, "%s\"%s\",", (i % 8) ? " " : "\n\t", mach->op[op].name);
+	}
+	fprintf(fp, "\n};\n\n");
+}
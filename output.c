@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "defs.h"
 #include "externs.h"
@@ -12,58 +13,58 @@
  */
 
 void
-println(void)
+println(struct t_context *ctx)
 {
 	int nb, cnt;
 	int i;
 
 	/* check if output possible */
-	if (list_level == 0)
+	if (ctx->list_level == 0)
 		return;
-	if (!xlist || !asm_opt[OPT_LIST] || (expand_macro && !asm_opt[OPT_MACRO]))
+	if (!ctx->xlist || !ctx->asm_opt[OPT_LIST] || (ctx->expand_macro && !ctx->asm_opt[OPT_MACRO]))
 		return;
 
 	/* update line buffer if necessary */
-	if (continued_line)
-		strcpy(prlnbuf, tmplnbuf);
+	if (ctx->continued_line)
+		strcpy(ctx->prlnbuf, ctx->tmplnbuf);
 
 	/* output */
-	if (data_loccnt == -1)
+	if (ctx->data_loccnt == -1)
 		/* line buffer */
-		fprintf(lst_fp, "%s\n", prlnbuf);
+		buf_printf(&ctx->lst_buf, "%s\n", ctx->prlnbuf);
 	else {
 		/* line buffer + data bytes */
-		loadlc(data_loccnt, 0);
+		loadlc(ctx, ctx->data_loccnt, 0);
 
 		/* number of bytes */
-		nb = loccnt - data_loccnt;
+		nb = ctx->loccnt - ctx->data_loccnt;
 
 		/* check level */
-		if ((data_level > list_level) && (nb > 3))
+		if ((ctx->data_level > ctx->list_level) && (nb > 3))
 			/* doesn't match */
-			fprintf(lst_fp, "%s\n", prlnbuf);
+			buf_printf(&ctx->lst_buf, "%s\n", ctx->prlnbuf);
 		else {
 			/* ok */
 			cnt = 0;
 			for (i = 0; i < nb; i++) {
-				if (bank >= RESERVED_BANK) {
-					prlnbuf[16 + (3*cnt)] = '-';
-					prlnbuf[17 + (3*cnt)] = '-';
+				if (ctx->bank >= RESERVED_BANK) {
+					ctx->prlnbuf[16 + (3*cnt)] = '-';
+					ctx->prlnbuf[17 + (3*cnt)] = '-';
 				}
 				else {
-					hexcon(2, rom[bank][data_loccnt], &prlnbuf[16 + (3*cnt)]);
+					hexcon(2, ctx->rom[ctx->bank][ctx->data_loccnt], &ctx->prlnbuf[16 + (3*cnt)]);
 				}
-				data_loccnt++;
+				ctx->data_loccnt++;
 				cnt++;
-				if (cnt == data_size) {
+				if (cnt == ctx->data_size) {
 					cnt = 0;
-					fprintf(lst_fp, "%s\n", prlnbuf);
-					clearln();
-					loadlc(data_loccnt, 0);
+					buf_printf(&ctx->lst_buf, "%s\n", ctx->prlnbuf);
+					clearln(ctx);
+					loadlc(ctx, ctx->data_loccnt, 0);
 				}
 			}
 			if (cnt)
-				fprintf(lst_fp, "%s\n", prlnbuf);
+				buf_printf(&ctx->lst_buf, "%s\n", ctx->prlnbuf);
 		}
 	}
 }
@@ -76,10 +77,10 @@ println(void)
  */
 
 void
-clearln(void)
+clearln(struct t_context *ctx)
 {
-	memset(prlnbuf, ' ', SFIELD);
-	prlnbuf[SFIELD+1] = 0;
+	memset(ctx->prlnbuf, ' ', SFIELD);
+	ctx->prlnbuf[SFIELD+1] = 0;
 }
 
 
@@ -90,7 +91,7 @@ clearln(void)
  */
 
 void
-loadlc(int offset, int pos)
+loadlc(struct t_context *ctx, int offset, int pos)
 {
 	int	i;
 
@@ -100,17 +101,17 @@ loadlc(int offset, int pos)
 		i = 7;
 
 	if (pos == 0) {
-		if (bank >= RESERVED_BANK) {
-			prlnbuf[i++] = '-';
-			prlnbuf[i++] = '-';
+		if (ctx->bank >= RESERVED_BANK) {
+			ctx->prlnbuf[i++] = '-';
+			ctx->prlnbuf[i++] = '-';
 		}
 		else {
-			hexcon(2, bank, &prlnbuf[i]);
+			hexcon(2, ctx->bank, &ctx->prlnbuf[i]);
 		}
-		prlnbuf[i++] = ':';
-		offset += page << 13;
+		ctx->prlnbuf[i++] = ':';
+		offset += ctx->page << 13;
 	}
-	hexcon(4, offset, &prlnbuf[i]);
+	hexcon(4, offset, &ctx->prlnbuf[i]);
 }
 
 
@@ -138,17 +139,21 @@ hexcon(int digit, int num, char *out)
  */
 
 void
-putbyte(int offset, int data)
+putbyte(struct t_context *ctx, int offset, int data)
 {
-	if (bank >= RESERVED_BANK)
+	if (ctx->bank >= RESERVED_BANK)
 		return;
 	if (offset < 0x2000) {
-		rom[bank][offset] = (data) & 0xFF;
-		map[bank][offset] = section + (page << 5);
+		ctx->rom[ctx->bank][offset] = (data) & 0xFF;
+		ctx->map[ctx->bank][offset] = ctx->section + (ctx->page << 5);
 
-		/* update rom size */
-		if (bank > max_bank)
-			max_bank = bank;
+		/* update rom size, kept apart by the single pass */
+		if (ctx->single_pass) {
+			if (ctx->bank > ctx->fix_bank)
+				ctx->fix_bank = ctx->bank;
+		}
+		else if (ctx->bank > ctx->max_bank)
+			ctx->max_bank = ctx->bank;
 	}
 }
 
@@ -160,26 +165,125 @@ putbyte(int offset, int data)
  */
 
 void
-putword(int offset, int data)
+putword(struct t_context *ctx, int offset, int data)
 {
-	if (bank >= RESERVED_BANK)
+	if (ctx->bank >= RESERVED_BANK)
 		return;
 	if (offset < 0x1FFF) {
 		/* low byte */
-		rom[bank][offset] = (data) & 0xFF;
-		map[bank][offset] = section + (page << 5);
+		ctx->rom[ctx->bank][offset] = (data) & 0xFF;
+		ctx->map[ctx->bank][offset] = ctx->section + (ctx->page << 5);
 
 		/* high byte */
-		rom[bank][offset+1] = (data >> 8) & 0xFF;
-		map[bank][offset+1] = section + (page << 5);
+		ctx->rom[ctx->bank][offset+1] = (data >> 8) & 0xFF;
+		ctx->map[ctx->bank][offset+1] = ctx->section + (ctx->page << 5);
 
-		/* update rom size */
-		if (bank > max_bank)
-			max_bank = bank;
+		/* update rom size, kept apart by the single pass */
+		if (ctx->single_pass) {
+			if (ctx->bank > ctx->fix_bank)
+				ctx->fix_bank = ctx->bank;
+		}
+		else if (ctx->bank > ctx->max_bank)
+			ctx->max_bank = ctx->bank;
 	}
 }
 
 
+/* ----
+ * putbytes()
+ * ----
+ * store a run of bytes in the rom, the bytes past the end
+ * of the bank are dropped as putbyte() does
+ */
+
+void
+putbytes(struct t_context *ctx, int offset, unsigned char *data, int size)
+{
+	if (ctx->bank >= RESERVED_BANK)
+		return;
+	if (offset + size > 0x2000)
+		size = 0x2000 - offset;
+	if (size > 0) {
+		memcpy(&ctx->rom[ctx->bank][offset], data, size);
+		memset(&ctx->map[ctx->bank][offset], ctx->section + (ctx->page << 5), size);
+
+		/* update rom size, kept apart by the single pass */
+		if (ctx->single_pass) {
+			if (ctx->bank > ctx->fix_bank)
+				ctx->fix_bank = ctx->bank;
+		}
+		else if (ctx->bank > ctx->max_bank)
+			ctx->max_bank = ctx->bank;
+	}
+}
+
+
+/* ----
+ * putwords()
+ * ----
+ * store a run of words, only the words that entirely fit
+ * in the bank are kept as with putword()
+ */
+
+void
+putwords(struct t_context *ctx, int offset, unsigned char *data, int size)
+{
+	if (offset + size > 0x2000)
+		size = ((0x2000 - offset) / 2) * 2;
+	putbytes(ctx, offset, data, size);
+}
+
+
+/* ----
+ * putbuf_start()
+ * ----
+ * start a run of data at 'offset', stored by bytes or by words
+ */
+
+void
+putbuf_start(struct t_putbuf *buf, int offset, int word)
+{
+	buf->offset = offset;
+	buf->size = 0;
+	buf->word = word;
+}
+
+
+/* ----
+ * putbuf_byte()
+ * ----
+ * add a byte to a run, it is stored when the run is full
+ */
+
+void
+putbuf_byte(struct t_context *ctx, struct t_putbuf *buf, int data)
+{
+	if (buf->size == sizeof(buf->data))
+		putbuf_flush(ctx, buf);
+	buf->data[buf->size++] = data & 0xFF;
+}
+
+
+/* ----
+ * putbuf_flush()
+ * ----
+ * store the bytes of a run, the next ones follow them
+ */
+
+void
+putbuf_flush(struct t_context *ctx, struct t_putbuf *buf)
+{
+	if (buf->size == 0)
+		return;
+	if (buf->word)
+		putwords(ctx, buf->offset, buf->data, buf->size);
+	else
+		putbytes(ctx, buf->offset, buf->data, buf->size);
+	buf->offset += buf->size;
+	buf->size = 0;
+}
+
+
 /* ----
  * putbuffer()
  * ----
@@ -187,7 +291,7 @@ putword(int offset, int data)
  */
 
 void
-putbuffer(void *data, int size)
+putbuffer(struct t_context *ctx, void *data, int size)
 {
 	int addr;
 
@@ -196,46 +300,46 @@ putbuffer(void *data, int size)
 		return;
 
 	/* check if the buffer will fit in the rom */
-	if (bank >= RESERVED_BANK) {
-		addr  = loccnt + size;
+	if (ctx->bank >= RESERVED_BANK) {
+		addr  = ctx->loccnt + size;
 
 		if (addr > 0x1FFF) {
-			fatal_error("PROC overflow!");
+			fatal_error(ctx, "PROC overflow!");
 			return;
 		}
 	}
 	else {
-		addr  = loccnt + size + (bank << 13);
+		addr  = ctx->loccnt + size + (ctx->bank << 13);
 
-		if (addr > rom_limit) {
-			fatal_error("ROM overflow!");
+		if (addr > ctx->rom_limit) {
+			fatal_error(ctx, "ROM overflow!");
 			return;
 		}
 
 		/* copy the buffer */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			if (data) {
-				memcpy(&rom[bank][loccnt], data, size);
-				memset(&map[bank][loccnt], section + (page << 5), size);
+				memcpy(&ctx->rom[ctx->bank][ctx->loccnt], data, size);
+				memset(&ctx->map[ctx->bank][ctx->loccnt], ctx->section + (ctx->page << 5), size);
 			}
 			else {
-				memset(&rom[bank][loccnt], 0, size);
-				memset(&map[bank][loccnt], section + (page << 5), size);
+				memset(&ctx->rom[ctx->bank][ctx->loccnt], 0, size);
+				memset(&ctx->map[ctx->bank][ctx->loccnt], ctx->section + (ctx->page << 5), size);
 			}
 		}
 	}
 
 	/* update the location counter */
-	bank  += (loccnt + size) >> 13;
-	loccnt = (loccnt + size) & 0x1FFF;
+	ctx->bank  += (ctx->loccnt + size) >> 13;
+	ctx->loccnt = (ctx->loccnt + size) & 0x1FFF;
 
 	/* update rom size */
-	if (bank < RESERVED_BANK) {
-		if (bank > max_bank) {
-			if (loccnt)
-				max_bank = bank;
+	if (ctx->bank < RESERVED_BANK) {
+		if (ctx->bank > ctx->max_bank) {
+			if (ctx->loccnt)
+				ctx->max_bank = ctx->bank;
 			else
-				max_bank = bank - 1;
+				ctx->max_bank = ctx->bank - 1;
 		}
 	}
 }
@@ -244,44 +348,23 @@ putbuffer(void *data, int size)
 /* ----
  * write_srec()
  * ----
+ * convert the rom to a s-record file
  */
 
-void
-write_srec(char *file, char *ext, int base)
+int
+write_srec(struct t_context *ctx, struct t_buffer *buf, int base)
 {
 	unsigned char data, chksum;
-	char  fname[128];
 	int   addr, dump, cnt, pos, i, j;
-	FILE *fp;
-
-	/* status message */
-	if (!strcmp(ext, "mx"))
-		printf("writing mx file... ");
-	else
-		printf("writing s-record file... ");
-
-	/* flush output */
-	fflush(stdout);
-
-	/* add the file extension */
-	strcpy(fname, file);
-	strcat(fname, ".");
-	strcat(fname, ext);
-
-	/* open the file */
-	if ((fp = fopen(fname, "w")) == NULL) {
-		printf("can not open file '%s'!\n", fname);
-		return;
-	}
 
 	/* dump the rom */
 	dump = 0;
 	cnt  = 0;
 	pos  = 0;
 
-	for (i = 0; i <= max_bank; i++) {
+	for (i = 0; i <= ctx->max_bank; i++) {
 		for (j = 0; j < 8192; j++) {
-			if (map[i][j] != 0xFF) {
+			if (ctx->map[i][j] != 0xFF) {
 				/* data byte */
 				if (cnt == 0)
 					pos = j;
@@ -308,30 +391,26 @@ write_srec(char *file, char *ext, int base)
 							   4;
 
 				/* number, address */
-				fprintf(fp, "S2%02X%06X", cnt + 4, addr);
+				buf_printf(buf, "S2%02X%06X", cnt + 4, addr);
 
 				/* code */
 				while (cnt) {
-					data = rom[i][pos++];
+					data = ctx->rom[i][pos++];
 					chksum += data;
-					fprintf(fp, "%02X", data);
+					buf_printf(buf, "%02X", data);
 					cnt--;
 				}
 
 				/* chksum */
-				fprintf(fp, "%02X\n", (~chksum) & 0xFF);
+				buf_printf(buf, "%02X\n", (~chksum) & 0xFF);
 			}
 		}
 	}
 
 	/* starting address */
-	addr   = ((map[0][0] >> 5) << 13);
+	addr   = ((ctx->map[0][0] >> 5) << 13);
 	chksum = ((addr >> 8) & 0xFF) + (addr & 0xFF) + 4;
-	fprintf(fp, "S804%06X%02X", addr, (~chksum) & 0xFF);
-
-	/* ok */
-	fclose(fp);
-	printf("OK\n");
+	return (buf_printf(buf, "S804%06X%02X", addr, (~chksum) & 0xFF));
 }
 
 
@@ -342,10 +421,10 @@ write_srec(char *file, char *ext, int base)
  */
 
 void
-fatal_error(char *stptr)
+fatal_error(struct t_context *ctx, char *stptr)
 {
-	error(stptr);
-	stop_pass = 1;
+	error(ctx, stptr);
+	ctx->stop_pass = 1;
 }
 
 
@@ -356,10 +435,10 @@ fatal_error(char *stptr)
  */
 
 void
-error(char *stptr)
+error(struct t_context *ctx, char *stptr)
 {
-	warning(stptr);
-	errcnt++;
+	warning(ctx, stptr);
+	ctx->errcnt++;
 }
 
 
@@ -370,27 +449,161 @@ error(char *stptr)
  */
 
 void
-warning(char *stptr)
+warning(struct t_context *ctx, char *stptr)
 {
 	int i, temp;
 
+	/* a region of a parallel last pass is assembled again,
+	 * the message is given then
+	 */
+	if (ctx->in_region) {
+		region_abort(ctx);
+		return;
+	}
+
 	/* put the source line number into prlnbuf */
 	i = 4;
-	temp = slnum;
+	temp = ctx->slnum;
 	while (temp != 0) {
-		prlnbuf[i--] = temp % 10 + '0';
+		ctx->prlnbuf[i--] = temp % 10 + '0';
 		temp /= 10;
 	}
 
 	/* update the current file name */
-	if (infile_error != infile_num) {
-		infile_error  = infile_num;
-		printf("#[%i]   %s\n", infile_num, input_file[infile_num].name);
+	if (ctx->infile_error != ctx->infile_num) {
+		ctx->infile_error  = ctx->infile_num;
+		msg_printf(ctx, "#[%i]   %s\n", ctx->infile_num, ctx->input_file[ctx->infile_num].name);
 	}
 
 	/* output the line and the error message */
-	loadlc(loccnt, 0);
-	printf("%s\n", prlnbuf);
-	printf("       %s\n", stptr);
+	loadlc(ctx, ctx->loccnt, 0);
+	msg_printf(ctx, "%s\n", ctx->prlnbuf);
+	msg_printf(ctx, "       %s\n", stptr);
+}
+
+
+/* ----
+ * msg_printf()
+ * ----
+ * print an assembler message
+ */
+
+void
+msg_printf(struct t_context *ctx, const char *format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	if (ctx->msg_fp)
+		vfprintf(ctx->msg_fp, format, args);
+	else
+		buf_vprintf(&ctx->msg_buf, format, args);
+	va_end(args);
+}
+
+
+/* ----
+ * buf_grow()
+ * ----
+ * make room for 'size' more bytes in a memory buffer,
+ * plus the terminating null char
+ */
+
+int
+buf_grow(struct t_buffer *buf, int size)
+{
+	char *ptr;
+	int   max;
+
+	if ((buf->size + size + 1) <= buf->max)
+		return (1);
+
+	max = buf->max ? buf->max : 4096;
+	while ((buf->size + size + 1) > max)
+		max *= 2;
+	if ((ptr = (void *)realloc(buf->data, max)) == NULL)
+		return (0);
+	buf->data = ptr;
+	buf->max  = max;
+	return (1);
+}
+
+
+/* ----
+ * buf_write()
+ * ----
+ * append data to a memory buffer, the buffer is always
+ * kept null-terminated
+ */
+
+int
+buf_write(struct t_buffer *buf, const void *data, int size)
+{
+	if (!buf_grow(buf, size))
+		return (0);
+	memcpy(&buf->data[buf->size], data, size);
+	buf->size += size;
+	buf->data[buf->size] = '\0';
+	return (1);
 }
 
+
+/* ----
+ * buf_printf()
+ * ----
+ * formatted output to a memory buffer
+ */
+
+int
+buf_printf(struct t_buffer *buf, const char *format, ...)
+{
+	va_list args;
+	int ret;
+
+	va_start(args, format);
+	ret = buf_vprintf(buf, format, args);
+	va_end(args);
+	return (ret);
+}
+
+
+/* ----
+ * buf_vprintf()
+ * ----
+ */
+
+int
+buf_vprintf(struct t_buffer *buf, const char *format, va_list args)
+{
+	va_list copy;
+	int len;
+
+	/* get the output size */
+	va_copy(copy, args);
+	len = vsnprintf(NULL, 0, format, copy);
+	va_end(copy);
+	if (len < 0)
+		return (0);
+
+	/* make room and print */
+	if (!buf_grow(buf, len))
+		return (0);
+	vsnprintf(&buf->data[buf->size], len + 1, format, args);
+	buf->size += len;
+	return (1);
+}
+
+
+/* ----
+ * buf_free()
+ * ----
+ */
+
+void
+buf_free(struct t_buffer *buf)
+{
+	free(buf->data);
+	buf->data = NULL;
+	buf->size = 0;
+	buf->max  = 0;
+}
@@ -6,10 +6,6 @@
 #include "protos.h"
 #include "pce.h"
 
-/* locals */
-static unsigned char buffer[16384];	/* buffer for .inc and .def directives */
-static unsigned char header[512];	/* rom header */
-
 
 /* ----
  * write_header()
@@ -18,14 +14,14 @@ static unsigned char header[512];	/* rom header */
  */
 
 void
-pce_write_header(FILE *f, int banks)
+pce_write_header(struct t_context *ctx, struct t_buffer *buf, int banks)
 {
 	/* setup header */
-	memset(header, 0, 512);
-	header[0] = banks;
+	memset(ctx->header, 0, 512);
+	ctx->header[0] = banks;
 
 	/* write */
-	fwrite(header, 512, 1, f);
+	buf_write(buf, ctx->header, 512);
 }
 
 
@@ -36,7 +32,7 @@ pce_write_header(FILE *f, int banks)
  */
 
 int
-pce_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format)
+pce_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format)
 {
 	int i, j;
 	int cnt;
@@ -45,7 +41,7 @@ pce_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
 	unsigned int  *packed;
 
 	/* pack the tile only in the last pass */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (32);
 
 	/* clear buffer */
@@ -94,7 +90,7 @@ pce_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
 
 	default:
 		/* other formats not supported */
-		error("Internal error: unsupported format passed to 'pack_8x8_tile'!");
+		error(ctx, "Internal error: unsupported format passed to 'pack_8x8_tile'!");
 		break;
 	}
 
@@ -110,7 +106,7 @@ pce_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format
  */
 
 int
-pce_pack_16x16_tile(unsigned char *buffer, void *data, int line_offset, int format)
+pce_pack_16x16_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format)
 {
 	int i, j;
 	int cnt;
@@ -118,7 +114,7 @@ pce_pack_16x16_tile(unsigned char *buffer, void *data, int line_offset, int form
 	unsigned char *ptr;
 
 	/* pack the tile only in the last pass */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (128);
 
 	/* clear buffer */
@@ -155,7 +151,7 @@ pce_pack_16x16_tile(unsigned char *buffer, void *data, int line_offset, int form
 
 	default:
 		/* other formats not supported */
-		error("Internal error: unsupported format passed to 'pack_16x16_tile'!");
+		error(ctx, "Internal error: unsupported format passed to 'pack_16x16_tile'!");
 		break;
 	}
 
@@ -171,7 +167,7 @@ pce_pack_16x16_tile(unsigned char *buffer, void *data, int line_offset, int form
  */
 
 int
-pce_pack_16x16_sprite(unsigned char *buffer, void *data, int line_offset, int format)
+pce_pack_16x16_sprite(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format)
 {
 	int i, j;
 	int cnt;
@@ -180,7 +176,7 @@ pce_pack_16x16_sprite(unsigned char *buffer, void *data, int line_offset, int fo
 	unsigned int  *packed;
 
 	/* pack the sprite only in the last pass */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (128);
 
 	/* clear buffer */
@@ -253,7 +249,7 @@ pce_pack_16x16_sprite(unsigned char *buffer, void *data, int line_offset, int fo
 
 	default:
 		/* other formats not supported */
-		error("Internal error: unsupported format passed to 'pack_16x16_sprite'!");
+		error(ctx, "Internal error: unsupported format passed to 'pack_16x16_sprite'!");
 		break;
 	}
 
@@ -269,30 +265,30 @@ pce_pack_16x16_sprite(unsigned char *buffer, void *data, int line_offset, int fo
  */
 
 void
-pce_vram(int *ip)
+pce_vram(struct t_context *ctx, int *ip)
 {
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* check if there's a label */
-	if (lastlabl == NULL) {
-		error("No label!");
+	if (ctx->lastlabl == NULL) {
+		error(ctx, "No label!");
 		return;
 	}
 
 	/* get the VRAM address */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
-	if (value >= 0x7F00) {
-		error("Incorrect VRAM address!");
+	if (ctx->value >= 0x7F00) {
+		error(ctx, "Incorrect VRAM address!");
 		return;
 	}
-	lastlabl->vram = value;
+	region_check(ctx, &ctx->lastlabl->ext->vram, ctx->value);
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(value, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value, 1);
+		println(ctx);
 	}
 }
 
@@ -304,30 +300,30 @@ pce_vram(int *ip)
  */
 
 void
-pce_pal(int *ip)
+pce_pal(struct t_context *ctx, int *ip)
 {
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* check if there's a label */
-	if (lastlabl == NULL) {
-		error("No label!");
+	if (ctx->lastlabl == NULL) {
+		error(ctx, "No label!");
 		return;
 	}
 
 	/* get the palette index */
-	if (!evaluate(ip, ';'))
+	if (!evaluate(ctx, ip, ';'))
 		return;
-	if (value > 15) {
-		error("Incorrect palette index!");
+	if (ctx->value > 15) {
+		error(ctx, "Incorrect palette index!");
 		return;
 	}
-	lastlabl->pal = value;
+	region_check(ctx, &ctx->lastlabl->ext->pal, ctx->value);
 
 	/* output line */
-	if (pass == LAST_PASS) {
-		loadlc(value, 1);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, ctx->value, 1);
+		println(ctx);
 	}
 }
 
@@ -339,60 +335,60 @@ pce_pal(int *ip)
  */
 
 void
-pce_defchr(int *ip)
+pce_defchr(struct t_context *ctx, int *ip)
 {
 	unsigned int data[8];
 	int size;
 	int i;
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 3;
-	data_level  = 3;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 3;
+	ctx->data_level  = 3;
 
 	/* check if there's a label */
-	if (lablptr) {
+	if (ctx->lablptr) {
 		/* define label */
-		labldef(loccnt, 1);
+		labldef(ctx, ctx->loccnt, 1);
 
 		/* get the VRAM address */
-		if (!evaluate(ip, ','))
+		if (!evaluate(ctx, ip, ','))
 			return;
-		if (value >= 0x7F00) {
-			error("Incorrect VRAM address!");
+		if (ctx->value >= 0x7F00) {
+			error(ctx, "Incorrect VRAM address!");
 			return;
 		}
-		lablptr->vram = value;
+		region_check(ctx, &ctx->lablptr->ext->vram, ctx->value);
 	
 		/* get the default palette */
-		if (!evaluate(ip, ','))
+		if (!evaluate(ctx, ip, ','))
 			return;
-		if (value > 0x0F) {
-			error("Incorrect palette index!");
+		if (ctx->value > 0x0F) {
+			error(ctx, "Incorrect palette index!");
 			return;
 		}
-		lablptr->pal = value;
+		region_check(ctx, &ctx->lablptr->ext->pal, ctx->value);
 	}
 
 	/* get tile data */
 	for (i = 0; i < 8; i++) {
 		/* get value */
-		if (!evaluate(ip, (i < 7) ? ',' : ';'))
+		if (!evaluate(ctx, ip, (i < 7) ? ',' : ';'))
 			return;
 
 		/* store value */
-		data[i] = value;
+		data[i] = ctx->value;
 	}
 
 	/* encode tile */
-	size = pce_pack_8x8_tile(buffer, data, 0, PACKED_TILE);
+	size = pce_pack_8x8_tile(ctx, ctx->buffer, data, 0, PACKED_TILE);
 
 	/* store tile */
-	putbuffer(buffer, size);
+	putbuffer(ctx, ctx->buffer, size);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -403,55 +399,55 @@ pce_defchr(int *ip)
  */
 
 void
-pce_defpal(int *ip)
+pce_defpal(struct t_context *ctx, int *ip)
 {
 	unsigned int color;
 	unsigned int r, g, b;
 	char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 2;
-	data_level  = 3;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 2;
+	ctx->data_level  = 3;
 
 	/* get data */
 	for (;;) {
 		/* get color */
-		if (!evaluate(ip, 0))
+		if (!evaluate(ctx, ip, 0))
 			return;
 
 		/* store data on last pass */
-		if (pass == LAST_PASS) {
+		if (ctx->pass == LAST_PASS) {
 			/* convert color */
-			r = (value >> 8) & 0x7;
-			g = (value >> 4) & 0x7;
-			b = (value) & 0x7;
+			r = (ctx->value >> 8) & 0x7;
+			g = (ctx->value >> 4) & 0x7;
+			b = (ctx->value) & 0x7;
 			color = (g << 6) + (r << 3) + (b);
 
 			/* store color */
-			putword(loccnt, color);
+			putword(ctx, ctx->loccnt, color);
 		}
 
 		/* update location counter */
-		loccnt += 2;
+		ctx->loccnt += 2;
 
 		/* check if there's another color */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if (c != ',')
 			break;
 	}
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 
 	/* check errors */
 	if (c != ';' && c != '\0')
-		error("Syntax error!");
+		error(ctx, "Syntax error!");
 }
 
 
@@ -462,60 +458,60 @@ pce_defpal(int *ip)
  */
 
 void
-pce_defspr(int *ip)
+pce_defspr(struct t_context *ctx, int *ip)
 {
 	unsigned int data[32];
 	int size;
 	int i;
 
 	/* output infos */
-	data_loccnt = loccnt;
-	data_size   = 3;
-	data_level  = 3;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->data_size   = 3;
+	ctx->data_level  = 3;
 
 	/* check if there's a label */
-	if (lablptr) {
+	if (ctx->lablptr) {
 		/* define label */
-		labldef(loccnt, 1);
+		labldef(ctx, ctx->loccnt, 1);
 	
 		/* get the VRAM address */
-		if (!evaluate(ip, ','))
+		if (!evaluate(ctx, ip, ','))
 			return;
-		if (value >= 0x7F00) {
-			error("Incorrect VRAM address!");
+		if (ctx->value >= 0x7F00) {
+			error(ctx, "Incorrect VRAM address!");
 			return;
 		}
-		lablptr->vram = value;
+		region_check(ctx, &ctx->lablptr->ext->vram, ctx->value);
 	
 		/* get the default palette */
-		if (!evaluate(ip, ','))
+		if (!evaluate(ctx, ip, ','))
 			return;
-		if (value > 0x0F) {
-			error("Incorrect palette index!");
+		if (ctx->value > 0x0F) {
+			error(ctx, "Incorrect palette index!");
 			return;
 		}
-		lablptr->pal = value;
+		region_check(ctx, &ctx->lablptr->ext->pal, ctx->value);
 	}
 
 	/* get sprite data */
 	for (i = 0; i < 32; i++) {
 		/* get value */
-		if (!evaluate(ip, (i < 31) ? ',' : ';'))
+		if (!evaluate(ctx, ip, (i < 31) ? ',' : ';'))
 			return;
 
 		/* store value */
-		data[i] = value;
+		data[i] = ctx->value;
 	}
 
 	/* encode sprite */
-	size = pce_pack_16x16_sprite(buffer, data, 0, PACKED_TILE);
+	size = pce_pack_16x16_sprite(ctx, ctx->buffer, data, 0, PACKED_TILE);
 
 	/* store sprite */
-	putbuffer(buffer, size);
+	putbuffer(ctx, ctx->buffer, size);
 
 	/* output line */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -526,7 +522,7 @@ pce_defspr(int *ip)
  */
 
 void
-pce_incbat(int *ip)
+pce_incbat(struct t_context *ctx, int *ip)
 {
 	unsigned char *ptr, ref;
 	int i, j, k, l, x, y, w, h;
@@ -534,27 +530,27 @@ pce_incbat(int *ip)
 	unsigned int temp;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
-	if (!pcx_parse_args(1, pcx_nb_args - 1, &x, &y, &w, &h, 8))
+	if (!pcx_parse_args(ctx, 1, ctx->pcx_nb_args - 1, &x, &y, &w, &h, 8))
 		return;
 
 	/* build the BAT */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		index = 0;
 		flag  = 0;
-		base  = (pcx_arg[0] >> 4);
+		base  = (ctx->pcx_arg[0] >> 4);
 
 		for (i = 0; i < h; i++) {
 			for (j = 0; j < w; j++) {
-				ptr = pcx_buf + (x + (j * 8)) + ((y + (i * 8)) * pcx_w);
+				ptr = ctx->pcx_buf + (x + (j * 8)) + ((y + (i * 8)) * ctx->pcx_w);
 				ref = ptr[0] & 0xF0;
 
 				/* check colors */
@@ -563,11 +559,11 @@ pce_incbat(int *ip)
 						if ((ptr[l] & 0xF0) != ref)
 							flag = 1;
 					}				
-					ptr += pcx_w;
+					ptr += ctx->pcx_w;
 				}
 				temp = (base & 0xFFF) | ((ref & 0xF0) << 8);
-				buffer[2*index]   = temp & 0xff;
-				buffer[2*index+1] = temp >> 8;
+				ctx->buffer[2*index]   = temp & 0xff;
+				ctx->buffer[2*index+1] = temp >> 8;
 
 				index++;
 				base++;
@@ -576,15 +572,15 @@ pce_incbat(int *ip)
 
 		/* errors */
 		if (flag)
-			error("Invalid color index found!");
+			fixup_error(ctx, "Invalid color index found!");
 	}
 
 	/* store data */
-	putbuffer(buffer, 2 * w * h);
+	putbuffer(ctx, ctx->buffer, 2 * w * h);
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -595,60 +591,60 @@ pce_incbat(int *ip)
  */
 
 void
-pce_incpal(int *ip)
+pce_incpal(struct t_context *ctx, int *ip)
 {
 	unsigned int temp;
 	int i, start, nb;
 	int r, g, b;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
 
 	start = 0;
-	nb = pcx_nb_colors;
+	nb = ctx->pcx_nb_colors;
 
-	if (pcx_nb_args) {
-		start = pcx_arg[0] << 4;
+	if (ctx->pcx_nb_args) {
+		start = ctx->pcx_arg[0] << 4;
 
-		if (pcx_nb_args == 1)
+		if (ctx->pcx_nb_args == 1)
 			nb = 16;
 		else {
-			nb = pcx_arg[1] << 4;
+			nb = ctx->pcx_arg[1] << 4;
 		}
 	}
 
 	/* check args */
 	if (((start + nb) > 256) || (nb == 0)) {
-		error("Palette index out of range!");
+		error(ctx, "Palette index out of range!");
 		return;
 	}
 
 	/* make data */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		for (i = 0; i < nb; i++) {
-			r = pcx_pal[start + i][0];
-			g = pcx_pal[start + i][1];
-			b = pcx_pal[start + i][2];
+			r = ctx->pcx_pal[start + i][0];
+			g = ctx->pcx_pal[start + i][1];
+			b = ctx->pcx_pal[start + i][2];
 			temp = ((r & 0xE0) >> 2) | ((g & 0xE0) << 1) | ((b & 0xE0) >> 5);
-			buffer[2*i]   = temp & 0xff;
-			buffer[2*i+1] = temp >> 8;
+			ctx->buffer[2*i]   = temp & 0xff;
+			ctx->buffer[2*i+1] = temp >> 8;
 		}
 	}
 
 	/* store data */
-	putbuffer(buffer, nb << 1);
+	putbuffer(ctx, ctx->buffer, nb << 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -659,7 +655,7 @@ pce_incpal(int *ip)
  */
 
 void
-pce_incspr(int *ip)
+pce_incspr(struct t_context *ctx, int *ip)
 {
 	int i, j;
 	int x, y, w, h;
@@ -667,16 +663,16 @@ pce_incspr(int *ip)
 	int size;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
-	if (!pcx_parse_args(0, pcx_nb_args, &x, &y, &w, &h, 16))
+	if (!pcx_parse_args(ctx, 0, ctx->pcx_nb_args, &x, &y, &w, &h, 16))
 		return;
 
 	/* pack sprites */
@@ -687,16 +683,16 @@ pce_incspr(int *ip)
 			sy = y + (i << 4);
 
 			/* encode sprite */
-			size = pcx_pack_16x16_sprite(buffer, sx, sy);
+			size = pcx_pack_16x16_sprite(ctx, ctx->buffer, sx, sy);
 
 			/* store sprite */
-			putbuffer(buffer, size);
+			putbuffer(ctx, ctx->buffer, size);
 		}
 	}
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -707,7 +703,7 @@ pce_incspr(int *ip)
  */
 
 void
-pce_inctile(int *ip)
+pce_inctile(struct t_context *ctx, int *ip)
 {
 	int i, j;
     int x, y, w, h;
@@ -716,16 +712,16 @@ pce_inctile(int *ip)
 	int size = 0;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
-	if (!pcx_parse_args(0, pcx_nb_args, &x, &y, &w, &h, 16))
+	if (!pcx_parse_args(ctx, 0, ctx->pcx_nb_args, &x, &y, &w, &h, 16))
 		return;
 
 	/* pack tiles */
@@ -736,26 +732,26 @@ pce_inctile(int *ip)
 			ty = y + (i << 4);
 
 			/* get tile */
-			size = pcx_pack_16x16_tile(buffer, tx, ty);
+			size = pcx_pack_16x16_tile(ctx, ctx->buffer, tx, ty);
 
 			/* store tile */
-			putbuffer(buffer, size);
+			putbuffer(ctx, ctx->buffer, size);
 			nb_tile++;
 		}
 	}
 
 	/* attach the number of loaded tiles to the label */
-	if (lastlabl) {
+	if (ctx->lastlabl) {
 		if (nb_tile) {
-			lastlabl->nb = nb_tile;
-			if (pass == LAST_PASS)
-				lastlabl->size = size;
+			region_check(ctx, &ctx->lastlabl->nb, nb_tile);
+			if (ctx->pass == LAST_PASS)
+				region_set(ctx, &ctx->lastlabl->size, size);
 		}
 	}
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -766,7 +762,7 @@ pce_inctile(int *ip)
  */
 
 void
-pce_incmap(int *ip)
+pce_incmap(struct t_context *ctx, int *ip)
 {
 	int i, j;
 	int x, y, w, h;
@@ -775,16 +771,16 @@ pce_incmap(int *ip)
 	int err = 0;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* get args */
-	if (!pcx_get_args(ip))
+	if (!pcx_get_args(ctx, ip))
 		return;
-	if (!pcx_parse_args(0, pcx_nb_args - 1, &x, &y, &w, &h, 16))
+	if (!pcx_parse_args(ctx, 0, ctx->pcx_nb_args - 1, &x, &y, &w, &h, 16))
 		return;
 
 	/* pack map */
@@ -795,10 +791,10 @@ pce_incmap(int *ip)
 			ty = y + (i << 4);
 
 			/* get tile */
-			size = pcx_pack_16x16_tile(buffer, tx, ty);
+			size = pcx_pack_16x16_tile(ctx, ctx->buffer, tx, ty);
 
 			/* search tile */
-			tile = pcx_search_tile(buffer, size);
+			tile = pcx_search_tile(ctx, ctx->buffer, size);
 
 			if (tile == -1) {
 				/* didn't find the tile */
@@ -807,21 +803,21 @@ pce_incmap(int *ip)
 			}
 
 			/* store tile index */
-			if (pass == LAST_PASS)
-				putbyte(loccnt, tile & 0xFF);
+			if (ctx->pass == LAST_PASS)
+				putbyte(ctx, ctx->loccnt, tile & 0xFF);
 
 			/* update location counter */
-			loccnt++;
+			ctx->loccnt++;
 		}
 	}
 
 	/* error */
 	if (err)
-		error("One or more tiles didn't match!");
+		fixup_error(ctx, "One or more tiles didn't match!");
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -832,32 +828,32 @@ pce_incmap(int *ip)
  */
 
 void
-pce_mml(int *ip)
+pce_mml(struct t_context *ctx, int *ip)
 {
 	int offset, bufsize, size;
 	char mml[128];
 	char c;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS)
-		loadlc(loccnt, 0);
+	if (ctx->pass == LAST_PASS)
+		loadlc(ctx, ctx->loccnt, 0);
 
 	/* start */
 	bufsize = 8192;
-	offset = mml_start(buffer);
+	offset = mml_start(ctx, ctx->buffer);
 	bufsize -= offset;
 
 	/* extract and parse mml string(s) */
 	for (;;) {
 		/* get string */
-		if (!getstring(ip, mml, 127))
+		if (!getstring(ctx, ip, mml, 127))
 			return;
 
 		/* parse string */
-		size = mml_parse(buffer + offset, bufsize, mml);
+		size = mml_parse(ctx, ctx->buffer + offset, bufsize, mml);
 
 		if (size == -1)
 			return;
@@ -867,57 +863,57 @@ pce_mml(int *ip)
 		bufsize -= size;
 
 		/* next string */
-		c = prlnbuf[(*ip)++];
+		c = ctx->prlnbuf[(*ip)++];
 
 		if ((c != ',') && (c != ';') && (c != '\0')) {
-			error("Syntax error!");
+			error(ctx, "Syntax error!");
 			return;
 		}
 		if (c != ',')
 			break;
 
 		/* skip spaces */
-		while (isspace(prlnbuf[*ip]))
+		while (isspace(ctx->prlnbuf[*ip]))
 			(*ip)++;
 
 		/* continuation char */
-		if (prlnbuf[*ip] == '\\') {
+		if (ctx->prlnbuf[*ip] == '\\') {
 			(*ip)++;
 
 			/* skip spaces */
-			while (isspace(prlnbuf[*ip]))
+			while (isspace(ctx->prlnbuf[*ip]))
 				(*ip)++;
 
 			/* check */
-			if (prlnbuf[*ip] == ';' || prlnbuf[*ip] == '\0') {
+			if (ctx->prlnbuf[*ip] == ';' || ctx->prlnbuf[*ip] == '\0') {
 				/* output line */
-				if (pass == LAST_PASS) {
-					println();
-					clearln();
+				if (ctx->pass == LAST_PASS) {
+					println(ctx);
+					clearln(ctx);
 				}
 
 				/* read a new line */
-				if (readline() == -1)
+				if (readline(ctx) == -1)
 					return;
 				
 				/* rewind line pointer and continue */
 				*ip = SFIELD;
 			}
 			else {
-				error("Syntax error!");
+				error(ctx, "Syntax error!");
 				return;
 			}
 		}
 	}			
 
 	/* stop */
-	offset += mml_stop(buffer + offset);
+	offset += mml_stop(ctx->buffer + offset);
 
 	/* store data */
-	putbuffer(buffer, offset);
+	putbuffer(ctx, ctx->buffer, offset);
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
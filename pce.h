@@ -1,26 +1,26 @@
 
 /* PCE.C */
-void pce_write_header(FILE *f, int banks);
-int  pce_pack_8x8_tile(unsigned char *buffer, void *data, int line_offset, int format);
-int  pce_pack_16x16_tile(unsigned char *buffer, void *data, int line_offset, int format);
-int  pce_pack_16x16_sprite(unsigned char *buffer, void *data, int line_offset, int format);
-void pce_defchr(int *ip);
-void pce_defpal(int *ip);
-void pce_defspr(int *ip);
-void pce_incbat(int *ip);
-void pce_incpal(int *ip);
-void pce_incspr(int *ip);
-void pce_inctile(int *ip);
-void pce_incmap(int *ip);
-void pce_vram(int *ip);
-void pce_pal(int *ip);
+void pce_write_header(struct t_context *ctx, struct t_buffer *buf, int banks);
+int  pce_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format);
+int  pce_pack_16x16_tile(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format);
+int  pce_pack_16x16_sprite(struct t_context *ctx, unsigned char *buffer, void *data, int line_offset, int format);
+void pce_defchr(struct t_context *ctx, int *ip);
+void pce_defpal(struct t_context *ctx, int *ip);
+void pce_defspr(struct t_context *ctx, int *ip);
+void pce_incbat(struct t_context *ctx, int *ip);
+void pce_incpal(struct t_context *ctx, int *ip);
+void pce_incspr(struct t_context *ctx, int *ip);
+void pce_inctile(struct t_context *ctx, int *ip);
+void pce_incmap(struct t_context *ctx, int *ip);
+void pce_vram(struct t_context *ctx, int *ip);
+void pce_pal(struct t_context *ctx, int *ip);
 void pce_develo(int *ip);
-void pce_mml(int *ip);
+void pce_mml(struct t_context *ctx, int *ip);
 
 /* MML.C */
-int mml_start(unsigned char *buffer);
+int mml_start(struct t_context *ctx, unsigned char *buffer);
 int mml_stop(unsigned char *buffer);
-int mml_parse(unsigned char *buffer, int bufsize, char *ptr);
+int mml_parse(struct t_context *ctx, unsigned char *buffer, int bufsize, char *ptr);
 
 /* PCE specific instructions */
 struct t_opcode pce_inst[82] = {
@@ -153,6 +153,9 @@ struct t_machine pce = {
 	pce_pack_8x8_tile,     /* pack_8x8_tile */
 	pce_pack_16x16_tile,   /* pack_16x16_tile */
 	pce_pack_16x16_sprite, /* pack_16x16_sprite */
-	pce_write_header /* write_header */
+	pce_write_header, /* write_header */
+	NULL,    /* op_hash, set by opinit() */
+	NULL,    /* op_tbl */
+	0        /* inst_init */
 };
 
@@ -0,0 +1,889 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+#include "inst.h"
+#include "ophash.h"
+#include "overlay.h"
+#include "pceas.h"
+
+/* defines */
+#define STANDARD_CD	1
+#define SUPER_CD	2
+
+/* library init, contexts may be created by several threads */
+#ifndef WIN32
+static pthread_mutex_t init_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static int crc_ready;
+
+
+/* ----
+ * pceas_new()
+ * ----
+ * create an assembler context
+ */
+
+struct t_context *
+pceas_new(int machine)
+{
+	struct t_opcode *optbl[4];
+	struct t_context *ctx;
+
+	if ((ctx = (void *)calloc(1, sizeof(struct t_context))) == NULL)
+		return (NULL);
+
+	/* machine */
+	if (machine == PCEAS_NES)
+		ctx->machine = &nes;
+	else
+		ctx->machine = &pce;
+
+#ifndef WIN32
+	pthread_mutex_lock(&init_lock);
+#endif
+
+	/* fill the instruction table, it is built only once
+	 * for each machine from the perfect hash made by opgen
+	 */
+	if (!ctx->machine->inst_init) {
+		optbl[0] = base_inst;
+		optbl[1] = base_pseudo;
+
+		/* machine specific instructions and pseudos */
+		optbl[2] = ctx->machine->inst;
+		optbl[3] = ctx->machine->pseudo_inst;
+
+		if (!opinit(ctx->machine, &op_hash[ctx->machine->type], optbl)) {
+#ifndef WIN32
+			pthread_mutex_unlock(&init_lock);
+#endif
+			free(ctx);
+			return (NULL);
+		}
+		ctx->machine->inst_init = 1;
+	}
+
+	/* init crc functions */
+	if (!crc_ready) {
+		crc_init();
+		crc_ready = 1;
+	}
+
+#ifndef WIN32
+	pthread_mutex_unlock(&init_lock);
+#endif
+
+	/* default options */
+	ctx->list_level = 2;
+	ctx->header_opt = 1;
+
+	/* ok */
+	return (ctx);
+}
+
+
+/* ----
+ * pceas_delete()
+ * ----
+ * free an assembler context
+ */
+
+void
+pceas_delete(struct t_context *ctx)
+{
+	struct t_source *src, *next_src;
+	struct t_file *file, *next_file;
+	struct t_cachefile *cache, *next_cache;
+
+	if (ctx == NULL)
+		return;
+
+	/* the threads reading the include files */
+	prefetch_stop(ctx);
+
+	/* symbols, macros, functions and procs */
+	st_free(&ctx->sym_tbl);
+	arena_free(&ctx->sym_arena);
+	arena_free(&ctx->symext_arena);
+	arena_free(&ctx->macro_arena);
+	arena_free(&ctx->func_arena);
+	arena_free(&ctx->proc_arena);
+	arena_free(&ctx->expr_arena);
+	arena_free(&ctx->fix_arena);
+	name_free(&ctx->names);
+
+	/* source and binary files */
+	for (src = ctx->src_list; src; src = next_src) {
+		next_src = src->next;
+		src_free(src);
+	}
+	for (file = ctx->file_list; file; file = next_file) {
+		next_file = file->next;
+		if (file->shared == NULL)
+			free(file->data);
+		free(file);
+	}
+	dir_free(ctx->dir_list);
+	if (ctx->snap) {
+		free(ctx->snap->names);
+		free(ctx->snap);
+	}
+
+	/* build cache */
+	for (cache = ctx->dep_list; cache; cache = next_cache) {
+		next_cache = cache->next;
+		free(cache);
+	}
+	for (cache = ctx->out_list; cache; cache = next_cache) {
+		next_cache = cache->next;
+		free(cache);
+	}
+
+	/* outputs */
+	buf_free(&ctx->msg_buf);
+	buf_free(&ctx->lst_buf);
+	buf_free(&ctx->sym_buf);
+	buf_free(&ctx->out_buf);
+
+	/* regions of the last pass */
+	free(ctx->region);
+	free(ctx->reg_write);
+	free(ctx->reg_call);
+
+	/* misc */
+	if (!ctx->pcx_shared)
+		free(ctx->pcx_buf);
+	cleanup_path(ctx);
+	free(ctx);
+}
+
+
+/* ----
+ * pceas_set_option()
+ * ----
+ * set an assembler option, return 0 if the option is unknown
+ */
+
+int
+pceas_set_option(struct t_context *ctx, int opt, int value)
+{
+	switch (opt) {
+	case PCEAS_OPT_LIST:
+		/* check range */
+		if (value < 0 || value > 3)
+			value = 2;
+		ctx->list_level = value;
+		break;
+
+	case PCEAS_OPT_MACRO:
+		ctx->mlist_opt = value;
+		break;
+
+	case PCEAS_OPT_HEADER:
+		ctx->header_opt = value;
+		break;
+
+	case PCEAS_OPT_CD:
+		ctx->cd_opt  = value ? STANDARD_CD : 0;
+		ctx->scd_opt = 0;
+		break;
+
+	case PCEAS_OPT_SCD:
+		ctx->scd_opt = value ? SUPER_CD : 0;
+		ctx->cd_opt  = 0;
+		break;
+
+	case PCEAS_OPT_OVERLAY:
+		ctx->overlayflag = value;
+		break;
+
+	case PCEAS_OPT_DEVELO:
+		ctx->develo_opt = value;
+		break;
+
+	case PCEAS_OPT_MX:
+		ctx->mx_opt = value;
+		break;
+
+	case PCEAS_OPT_SREC:
+		ctx->srec_opt = value;
+		break;
+
+	case PCEAS_OPT_SNAPSHOT:
+		ctx->snap_opt = value;
+		break;
+
+	case PCEAS_OPT_SINGLE:
+		ctx->single_opt = value;
+		break;
+
+	case PCEAS_OPT_OBJECT:
+		ctx->obj_opt = value;
+		break;
+
+	case PCEAS_OPT_PREFETCH:
+		ctx->prefetch_opt = value;
+		break;
+
+	case PCEAS_OPT_JOBS:
+		ctx->jobs = value;
+		break;
+
+	default:
+		return (0);
+	}
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * pceas_add_path()
+ * ----
+ * add a path to includes
+ */
+
+int
+pceas_add_path(struct t_context *ctx, const char *path)
+{
+	return (add_path(ctx, (char *)path, strlen(path) + 1));
+}
+
+
+/* ----
+ * pceas_add_file()
+ * ----
+ * add an in-memory file, it is used instead of any file
+ * of the same name in the include paths; the data is copied
+ */
+
+int
+pceas_add_file(struct t_context *ctx, const char *name, const void *data, int size)
+{
+	unsigned char *copy;
+
+	if ((copy = (void *)malloc(size + 1)) == NULL)
+		return (0);
+	memcpy(copy, data, size);
+
+	return (add_file(ctx, (char *)name, copy, size, NULL) != NULL);
+}
+
+
+/* ----
+ * pceas_set_reader()
+ * ----
+ * set the callback used to get the files not added
+ * with pceas_add_file()
+ */
+
+void
+pceas_set_reader(struct t_context *ctx, pceas_reader reader, void *user)
+{
+	ctx->file_reader = reader;
+	ctx->file_user = user;
+}
+
+
+/* ----
+ * pceas_shared_new()
+ * ----
+ * create a store for the include files and pictures shared
+ * by several assemblies, the assemblies may run in parallel
+ */
+
+struct t_shared *
+pceas_shared_new(void)
+{
+	return (shared_new());
+}
+
+
+/* ----
+ * pceas_shared_delete()
+ * ----
+ * free a shared store, the assemblies using it must have
+ * been deleted before
+ */
+
+void
+pceas_shared_delete(struct t_shared *sh)
+{
+	shared_free(sh);
+}
+
+
+/* ----
+ * pceas_set_shared()
+ * ----
+ * use a shared store for the files found in the include paths
+ */
+
+void
+pceas_set_shared(struct t_context *ctx, struct t_shared *sh)
+{
+	ctx->shared = sh;
+}
+
+
+/* ----
+ * pceas_set_messages()
+ * ----
+ * send the assembler messages to a file instead of
+ * keeping them in memory
+ */
+
+void
+pceas_set_messages(struct t_context *ctx, FILE *fp)
+{
+	ctx->msg_fp = fp;
+}
+
+
+/* ----
+ * pceas_use_snapshot()
+ * ----
+ * load a snapshot before assembling, it is searched like
+ * the include files
+ */
+
+int
+pceas_use_snapshot(struct t_context *ctx, const char *name)
+{
+	if (strlen(name) >= sizeof(ctx->snap_fname))
+		return (0);
+
+	strcpy(ctx->snap_fname, name);
+	return (1);
+}
+
+
+/* ----
+ * pceas_output()
+ * ----
+ * get an output of the assembly, return NULL if not available
+ */
+
+const unsigned char *
+pceas_output(struct t_context *ctx, int type, int *size)
+{
+	struct t_buffer *buf;
+
+	switch (type) {
+	case PCEAS_OUT_ROM:
+		buf = (ctx->snap_opt || ctx->obj_opt) ? NULL : &ctx->out_buf;
+		break;
+
+	case PCEAS_OUT_SYM:
+		buf = &ctx->sym_buf;
+		break;
+
+	case PCEAS_OUT_LST:
+		buf = &ctx->lst_buf;
+		break;
+
+	case PCEAS_OUT_MSG:
+		buf = &ctx->msg_buf;
+		break;
+
+	case PCEAS_OUT_SNAPSHOT:
+		buf = ctx->snap_opt ? &ctx->out_buf : NULL;
+		break;
+
+	case PCEAS_OUT_OBJECT:
+		buf = (ctx->obj_opt && !ctx->snap_opt) ? &ctx->out_buf : NULL;
+		break;
+
+	default:
+		buf = NULL;
+		break;
+	}
+
+	if ((buf == NULL) || (buf->data == NULL)) {
+		if (size)
+			*size = 0;
+		return (NULL);
+	}
+	if (size)
+		*size = buf->size;
+	return ((unsigned char *)buf->data);
+}
+
+
+/* ----
+ * pceas_assemble()
+ * ----
+ * assemble a file, return 0 if the outputs are ready or
+ * the number of errors
+ */
+
+int
+pceas_assemble(struct t_context *ctx, const char *name)
+{
+	char fname[128];
+	int i, j;
+	int ram_bank;
+	int start;
+
+	/* open the input file, the files it includes
+	 * are read ahead when enabled
+	 */
+	strncpy(fname, name, sizeof(fname) - 1);
+	fname[sizeof(fname) - 1] = '\0';
+
+	prefetch_start(ctx);
+	if (open_input(ctx, fname)) {
+		msg_printf(ctx, "Can not open input file '%s'!\n", fname);
+		return (1);
+	}
+
+	/* clear the ROM array */
+	init_rom(ctx);
+
+	/* the symbols set after the first pass, the linker sets
+	 * them for the object files
+	 */
+	if (!ctx->obj_opt) {
+		lablset(ctx, "_bss_end", 0);
+		lablset(ctx, "_bank_base", 0);
+		lablset(ctx, "_nb_bank", 1);
+		lablset(ctx, "_call_bank", 0);
+	}
+
+	/* declarations of the snapshot */
+	if (ctx->snap_fname[0]) {
+		if (snap_load(ctx, ctx->snap_fname))
+			return (1);
+	}
+
+	/* the single pass generates the code as the last pass, it
+	 * goes on as a first pass if it can not be done in one go;
+	 * the rom layouts of the develo and the cd-roms are only
+	 * known after the first pass
+	 */
+	start = FIRST_PASS;
+	if (ctx->single_opt && !ctx->snap_opt && !ctx->obj_opt &&
+	   !(ctx->develo_opt || ctx->mx_opt || ctx->cd_opt || ctx->scd_opt)) {
+		fixup_start(ctx);
+		start = LAST_PASS;
+	}
+
+	/* the first pass finds where the last pass can be split
+	 * into regions assembled in parallel
+	 */
+	ctx->region_nb = 0;
+	ctx->region_step = 0;
+	if (ctx->jobs > 1) {
+		if (ctx->snap_opt)
+			msg_printf(ctx, "   (Note. The last pass uses one thread with --snapshot)\n");
+		else if (ctx->obj_opt)
+			msg_printf(ctx, "   (Note. The last pass uses one thread with --object)\n");
+		else if (start != FIRST_PASS)
+			msg_printf(ctx, "   (Note. The last pass uses one thread with --single)\n");
+		else
+			ctx->region_step = REGION_LINES;
+	}
+
+	/* assemble */
+	for (ctx->pass = start; ctx->pass <= LAST_PASS; ctx->pass++) {
+		ctx->infile_error = -1;
+		ctx->page = 7;
+		ctx->bank = 0;
+		ctx->loccnt = 0;
+		ctx->slnum = 0;
+		ctx->mcounter = 0;
+		ctx->mcntmax = 0;
+		ctx->mcntlast = -1;
+		ctx->xlist = 0;
+		ctx->glablptr = NULL;
+		ctx->lastlabl = NULL;
+		ctx->skip_lines = 0;
+		ctx->skip_start = NULL;
+		ctx->rsbase = 0;
+		ctx->proc_nb = 0;
+		ctx->line_cnt = 0;
+
+		/* reset assembler options */
+		ctx->asm_opt[OPT_LIST] = 0;
+		ctx->asm_opt[OPT_MACRO] = ctx->mlist_opt;
+		ctx->asm_opt[OPT_WARNING] = 0;
+		ctx->asm_opt[OPT_OPTIMIZE] = 0;
+
+		/* reset bank arrays */
+		for (i = 0; i < 4; i++) {
+			for (j = 0; j < 256; j++) {
+				ctx->bank_loccnt[i][j] = 0;
+				ctx->bank_glabl[i][j]  = NULL;
+				ctx->bank_page[i][j]   = 0;
+			}
+		}
+
+		/* reset sections */
+		ram_bank = ctx->machine->ram_bank;
+		ctx->section  = S_CODE;
+
+		/* .zp */
+		ctx->section_bank[S_ZP]           = ram_bank;
+		ctx->bank_page[S_ZP][ram_bank]    = ctx->machine->ram_page;
+		ctx->bank_loccnt[S_ZP][ram_bank]  = 0x0000;
+
+		/* .bss */
+		ctx->section_bank[S_BSS]          = ram_bank;
+		ctx->bank_page[S_BSS][ram_bank]   = ctx->machine->ram_page;
+		ctx->bank_loccnt[S_BSS][ram_bank] = 0x0200;
+
+		/* .code */
+		ctx->section_bank[S_CODE]         = 0x00;
+		ctx->bank_page[S_CODE][0x00]      = 0x07;
+		ctx->bank_loccnt[S_CODE][0x00]    = 0x0000;
+
+		/* .data */
+		ctx->section_bank[S_DATA]         = 0x00;
+		ctx->bank_page[S_DATA][0x00]      = 0x07;
+		ctx->bank_loccnt[S_DATA][0x00]    = 0x0000;
+
+		/* the sections as they were at the end of the snapshot */
+		if (ctx->snap)
+			snap_apply(ctx);
+
+		/* pass message */
+		msg_printf(ctx, "pass %i\n", ctx->single_pass ? 1 : ctx->pass + 1);
+
+		/* assemble, the regions of the last pass in parallel
+		 * and then the remaining lines
+		 */
+		if (!region_run(ctx))
+			pass_run(ctx);
+
+		/* end of the single pass */
+		if (ctx->single_pass)
+			fixup_end(ctx);
+
+		/* the next passes use the files already loaded */
+		prefetch_stop(ctx);
+
+		/* relocate procs */
+		if (ctx->pass == FIRST_PASS)
+			proc_reloc(ctx);
+
+		/* abord pass on errors */
+		if (ctx->errcnt) {
+			msg_printf(ctx, "# %d error(s)\n", ctx->errcnt);
+			return (ctx->errcnt);
+		}
+
+		/* adjust bank base */
+		if (ctx->pass == FIRST_PASS)
+			ctx->bank_base = calc_bank_base(ctx);
+
+		/* update predefined symbols */
+		if ((ctx->pass == FIRST_PASS) && !ctx->obj_opt) {
+			lablset(ctx, "_bss_end", ctx->machine->ram_base + ctx->max_bss);
+			lablset(ctx, "_bank_base", ctx->bank_base);
+			lablset(ctx, "_call_bank", ctx->bank_base + ctx->max_bank + 1);
+			lablset(ctx, "_nb_bank", ctx->max_bank + 2);
+		}
+
+		/* adjust the symbol table for the develo or for cd-roms */
+		if (ctx->pass == FIRST_PASS) {
+			if (ctx->develo_opt || ctx->mx_opt || ctx->cd_opt || ctx->scd_opt)
+				lablremap(ctx);
+		}
+
+		/* start the listing */
+		if (ctx->pass == FIRST_PASS) {
+			if (ctx->xlist && ctx->list_level)
+				buf_printf(&ctx->lst_buf, "#[1]   %s\n", ctx->input_file[1].name);
+		}
+
+		/* patch the forward references, or run the last pass */
+		if (ctx->single_pass) {
+			ctx->single_pass = 0;
+			if (fixup_apply(ctx)) {
+				ctx->pass = LAST_PASS;
+				break;
+			}
+			fixup_reset(ctx);
+		}
+	}
+
+	/* snapshot, object file or rom */
+	if (ctx->snap_opt) {
+		if (snap_save(ctx, &ctx->out_buf))
+			return (1);
+	}
+	else if (ctx->obj_opt) {
+		if (obj_save(ctx, &ctx->out_buf))
+			return (1);
+	}
+	else if (write_rom(ctx, &ctx->out_buf))
+		return (1);
+
+	/* symbol table */
+	labldump(ctx, &ctx->sym_buf);
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * pass_run()
+ * ----
+ * assemble the lines of the pass, until the end of the region
+ * when it's a region of the last pass
+ */
+
+void
+pass_run(struct t_context *ctx)
+{
+	while (((ctx->region_end == 0) || (ctx->line_cnt < ctx->region_end)) &&
+		   (readline(ctx) != -1)) {
+		assemble(ctx);
+		if (ctx->fix_pend)
+			fixup_fail(ctx);
+		if (ctx->loccnt > 0x2000) {
+			ctx->loccnt&=0x1fff;
+			ctx->page++;
+			ctx->bank++;
+			if(ctx->pass==FIRST_PASS || ctx->single_pass)
+			msg_printf(ctx, "   (Warning. Opcode crossing page boundary $%04X, bank $%02X)\n",(ctx->page*0x2000),ctx->bank);
+		}
+		if (ctx->stop_pass)
+			break;
+
+		/* the first pass marks the region boundaries */
+		ctx->line_cnt++;
+		if (ctx->region_step)
+			region_mark(ctx);
+	}
+}
+
+
+/* ----
+ * pceas_link()
+ * ----
+ * link object files, the rom is made of their sections and
+ * the symbols they import are patched; return 0 if the outputs
+ * are ready or the number of errors
+ */
+
+int
+pceas_link(struct t_context *ctx, const char **names, int nb)
+{
+	/* clear the ROM array */
+	init_rom(ctx);
+
+	/* load and patch the objects */
+	if (obj_link(ctx, (char **)names, nb)) {
+		msg_printf(ctx, "# %d error(s)\n", ctx->errcnt);
+		return (ctx->errcnt ? ctx->errcnt : 1);
+	}
+
+	/* rom */
+	if (write_rom(ctx, &ctx->out_buf))
+		return (1);
+
+	/* symbol table */
+	labldump(ctx, &ctx->sym_buf);
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * init_rom()
+ * ----
+ * clear the rom and set the predefined symbols and the
+ * limits of the target
+ */
+
+void
+init_rom(struct t_context *ctx)
+{
+	/* clear the ROM array */
+	memset(ctx->rom, 0xFF, 8192 * 128);
+	memset(ctx->map, 0xFF, 8192 * 128);
+
+	/* predefined symbols */
+	lablset(ctx, "MAGICKIT", 1);
+	lablset(ctx, "DEVELO", ctx->develo_opt | ctx->mx_opt);
+	lablset(ctx, "CDROM", ctx->cd_opt | ctx->scd_opt);
+
+	/* init global variables */
+	ctx->max_zp = 0x01;
+	ctx->max_bss = 0x0201;
+	ctx->max_bank = 0;
+	ctx->rom_limit = 0x100000;		/* 1MB */
+	ctx->bank_limit = 0x7F;
+	ctx->bank_base = 0;
+	ctx->errcnt = 0;
+
+	if (ctx->cd_opt) {
+		ctx->rom_limit  = 0x10000;	/* 64KB */
+		ctx->bank_limit = 0x07;
+	}
+	else if (ctx->scd_opt) {
+		ctx->rom_limit  = 0x40000;	/* 256KB */
+		ctx->bank_limit = 0x1F;
+	}
+	else if (ctx->develo_opt || ctx->mx_opt) {
+		ctx->rom_limit  = 0x30000;	/* 192KB */
+		ctx->bank_limit = 0x17;
+	}
+}
+
+
+/* ----
+ * write_rom()
+ * ----
+ * generate the rom image, return 1 on error
+ */
+
+int
+write_rom(struct t_context *ctx, struct t_buffer *buf)
+{
+	struct t_file *ipl;
+	int size;
+	int ok = 1;
+
+	/* cd-rom */
+	if (ctx->cd_opt || ctx->scd_opt) {
+		/* boot code */
+		if ((ctx->header_opt) && (ctx->overlayflag == 0)) {
+			/* open ipl binary file */
+			if ((ipl = open_file(ctx, "ipl.bin")) == NULL) {
+				msg_printf(ctx, "Can not find CD boot file 'ipl.bin'!\n");
+				return (1);
+			}
+
+			/* load ipl */
+			size = (ipl->size < 4096) ? ipl->size : 4096;
+			memcpy(ctx->ipl_buffer, ipl->data, size);
+
+			memset(&ctx->ipl_buffer[0x800], 0, 32);
+			/* prg sector base */
+			ctx->ipl_buffer[0x802] = 2;
+			/* nb sectors */
+			ctx->ipl_buffer[0x803] = 16;
+			/* loading address */
+			ctx->ipl_buffer[0x804] = 0x00;
+			ctx->ipl_buffer[0x805] = 0x40;
+			/* starting address */
+			ctx->ipl_buffer[0x806] = BOOT_ENTRY_POINT & 0xFF;
+			ctx->ipl_buffer[0x807] = (BOOT_ENTRY_POINT >> 8) & 0xFF;
+			/* mpr registers */
+			ctx->ipl_buffer[0x808] = 0x00;
+			ctx->ipl_buffer[0x809] = 0x01;
+			ctx->ipl_buffer[0x80A] = 0x02;
+			ctx->ipl_buffer[0x80B] = 0x03;
+			ctx->ipl_buffer[0x80C] = 0x00;	/* boot loader @ $C000 */
+			/* load mode */
+			ctx->ipl_buffer[0x80D] = 0x60;
+
+			/* write boot code */
+			ok &= buf_write(buf, ctx->ipl_buffer, 4096);
+		}
+
+		/* write rom */
+		ok &= buf_write(buf, ctx->rom, 8192 * (ctx->max_bank + 1));
+
+		/* write trailing zeroes to fill */
+		/* at least 4 seconds of CDROM */
+		if (ctx->overlayflag == 0)
+		{
+			memset(ctx->zeroes, 0, 2048);
+
+			/* calculate number of trailing zero sectors      */
+			/* rule 1: track must be at least 6 seconds total */
+			ctx->zero_need = (6*75) - 2 - (4 * (ctx->max_bank + 1));
+
+			/* rule 2: track should have at least 2 seconds     */
+			/*         of trailing zeroes before an audio track */
+			if (ctx->zero_need < (2*75))
+				ctx->zero_need = (2*75);
+
+			while (ctx->zero_need > 0) {
+				ok &= buf_write(buf, ctx->zeroes, 2048);
+				ctx->zero_need--;
+			}
+		}
+	}
+
+	/* develo box */
+	else if (ctx->develo_opt || ctx->mx_opt) {
+		ctx->page = (ctx->map[0][0] >> 5);
+
+		/* mx file */
+		if ((ctx->page + ctx->max_bank) < 7)
+			/* old format */
+			ok = write_srec(ctx, buf, ctx->page << 13);
+		else
+			/* new format */
+			ok = write_srec(ctx, buf, 0xD0000);
+	}
+
+	/* s-record file */
+	else if (ctx->srec_opt)
+		ok = write_srec(ctx, buf, 0);
+
+	/* binary file */
+	else {
+		/* write header */
+		if (ctx->header_opt)
+			ctx->machine->write_header(ctx, buf, ctx->max_bank + 1);
+
+		/* write rom */
+		ok &= buf_write(buf, ctx->rom, 8192 * (ctx->max_bank + 1));
+	}
+
+	/* check that the whole image fits in memory */
+	if (!ok || (buf->data == NULL)) {
+		msg_printf(ctx, "Not enough memory!\n");
+		return (1);
+	}
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * calc_bank_base()
+ * ----
+ * calculate rom bank base
+ */
+
+int
+calc_bank_base(struct t_context *ctx)
+{
+	int base;
+
+	/* cd */
+	if (ctx->cd_opt)
+		base = 0x80;
+
+	/* super cd */
+	else if (ctx->scd_opt)
+		base = 0x68;
+
+	/* develo */
+	else if (ctx->develo_opt || ctx->mx_opt) {
+		if (ctx->max_bank < 4)
+			base = 0x84;
+		else
+			base = 0x68;
+	}
+
+	/* default */
+	else {
+		base = 0;
+	}
+
+	return (base);
+}
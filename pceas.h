@@ -0,0 +1,113 @@
+#ifndef PCEAS_H
+#define PCEAS_H
+
+/*
+ *  libpceas
+ *  ----
+ *  The MagicKit assembler as a library. Source files, include files
+ *  and binaries are searched in the files added with pceas_add_file(),
+ *  then asked to the reader callback and finally loaded from the
+ *  include paths. The outputs are kept in memory.
+ *
+ *  The files found in the include paths and the pictures decoded
+ *  from them can be shared by several contexts with a store created
+ *  by pceas_shared_new(). The contexts sharing a store can assemble
+ *  in different threads.
+ *
+ *  A snapshot keeps the symbols, macros and functions declared by
+ *  a set of include files. It is made by assembling them with the
+ *  PCEAS_OPT_SNAPSHOT option, and used with pceas_use_snapshot()
+ *  as if they were included at the beginning of the source.
+ *
+ *  With the PCEAS_OPT_SINGLE option the code is generated by the
+ *  first pass, the forward references are patched at its end. The
+ *  second pass is only run for the sources needing it.
+ *
+ *  With the PCEAS_OPT_OBJECT option the source can use symbols it
+ *  doesn't define, an object file is made instead of a rom. The
+ *  object files are combined by pceas_link(), the values using the
+ *  symbols they import are then patched. The sections are placed
+ *  by the sources, they are not moved by the linker.
+ *
+ *  With the PCEAS_OPT_PREFETCH option the include files are read
+ *  and split into lines by threads while the source is assembled.
+ *
+ *  With the PCEAS_OPT_JOBS option the last pass is split into
+ *  regions at points found by the first pass, they are assembled
+ *  by threads at the same time. A region doing something that
+ *  depends on the other regions is assembled again in order,
+ *  the outputs are the same as with a single thread. It isn't
+ *  used with the SNAPSHOT, OBJECT and SINGLE options.
+ *
+ *  A context is used for a single assembly:
+ *
+ *    ctx = pceas_new(PCEAS_PCE);
+ *    pceas_add_file(ctx, "main.asm", text, strlen(text));
+ *    if (pceas_assemble(ctx, "main.asm") == 0)
+ *        rom = pceas_output(ctx, PCEAS_OUT_ROM, &size);
+ *    pceas_delete(ctx);
+ */
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct t_context;
+struct t_shared;
+
+/* machines */
+#define PCEAS_PCE	0
+#define PCEAS_NES	1
+
+/* options */
+#define PCEAS_OPT_LIST		0	/* listing level (0-3), 2 by default */
+#define PCEAS_OPT_MACRO		1	/* force macro expansion in the listing */
+#define PCEAS_OPT_HEADER	2	/* add a ROM header, set by default */
+#define PCEAS_OPT_CD		3	/* create a CD-ROM track image */
+#define PCEAS_OPT_SCD		4	/* create a Super CD-ROM track image */
+#define PCEAS_OPT_OVERLAY	5	/* create an overlay program segment */
+#define PCEAS_OPT_DEVELO	6	/* assemble for the Develo Box */
+#define PCEAS_OPT_MX		7	/* create a Develo MX file */
+#define PCEAS_OPT_SREC		8	/* create a Motorola S-record file */
+#define PCEAS_OPT_SNAPSHOT	9	/* create a snapshot instead of a rom */
+#define PCEAS_OPT_SINGLE	10	/* assemble in a single pass when possible */
+#define PCEAS_OPT_OBJECT	11	/* create an object file instead of a rom */
+#define PCEAS_OPT_JOBS		12	/* threads of the last pass, 1 by default */
+#define PCEAS_OPT_PREFETCH	13	/* read the include files ahead in threads */
+
+/* outputs */
+#define PCEAS_OUT_ROM	0	/* rom image, CD-ROM track, MX or S-record file */
+#define PCEAS_OUT_SYM	1	/* symbol table */
+#define PCEAS_OUT_LST	2	/* listing, if enabled by the source */
+#define PCEAS_OUT_MSG	3	/* messages, when they are not sent to a file */
+#define PCEAS_OUT_SNAPSHOT	4	/* snapshot of the declarations */
+#define PCEAS_OUT_OBJECT	5	/* object file */
+
+/* reader callback, it must return 1 and a buffer allocated
+ * with malloc() when the file is found, the buffer is then
+ * owned by the assembler; return 0 to search the include paths
+ */
+typedef int (*pceas_reader)(void *user, const char *name, unsigned char **data, int *size);
+
+struct t_context *pceas_new(int machine);
+void pceas_delete(struct t_context *ctx);
+int  pceas_set_option(struct t_context *ctx, int opt, int value);
+int  pceas_add_path(struct t_context *ctx, const char *path);
+int  pceas_add_file(struct t_context *ctx, const char *name, const void *data, int size);
+void pceas_set_reader(struct t_context *ctx, pceas_reader reader, void *user);
+struct t_shared *pceas_shared_new(void);
+void pceas_shared_delete(struct t_shared *sh);
+void pceas_set_shared(struct t_context *ctx, struct t_shared *sh);
+void pceas_set_messages(struct t_context *ctx, FILE *fp);
+int  pceas_use_snapshot(struct t_context *ctx, const char *name);
+int  pceas_assemble(struct t_context *ctx, const char *name);
+int  pceas_link(struct t_context *ctx, const char **names, int nb);
+const unsigned char *pceas_output(struct t_context *ctx, int type, int *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
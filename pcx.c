@@ -9,37 +9,9 @@
 
 #define uEOF ((unsigned int)EOF)
 
-/* globals */
-char pcx_name[128];		/* pcx file name */
-int  pcx_w, pcx_h;		/* pcx dimensions */
-int  pcx_nb_colors;		/* number of colors in the pcx */
-int  pcx_nb_args;		/* number of argument */
-unsigned int   pcx_arg[8];	/* pcx args array */
-unsigned char *pcx_buf;		/* pointer to the pcx buffer */
-unsigned char  pcx_pal[256][3];		/* palette */
-unsigned char  pcx_plane[128][4];	/* plane buffer */
-unsigned int     tile_offset;	/* offset in the tile reference table */
-struct t_tile    tile[256];		/* tile info table */
-struct t_tile   *tile_tbl[256];	/* tile hash table */
-struct t_symbol *tile_lablptr;	/* tile symbol reference */
-struct PCX_HEADER {		/* pcx file header */
-	unsigned char manufacturer, version;
-	unsigned char encoding;
-	unsigned char bpp;
-	unsigned char xmin[2], ymin[2], xmax[2], ymax[2];
-	unsigned char xdpi[2], ydpi[2];
-	unsigned char colormap[16][3];
-	unsigned char reserved;
-	unsigned char np;
-	unsigned char bytes_per_line[2];
-	unsigned char palette_info[2];
-	unsigned char xscreen[2], yscreen[2];
-	unsigned char pad[54];
-} pcx;
-
-/* externs */
-extern struct t_symbol *expr_lablptr;	/* pointer to the lastest label */
-extern int expr_lablcnt;	/* number of label seen in an expression */
+/* get a byte from a pcx file */
+#define PCX_GETC(f, pos) (((pos) < (f)->size) ? (f)->data[(pos)++] : uEOF)
+
 
 /* macros */
 #define GET_SHORT(a) ((a[1] << 8) + a[0])
@@ -51,15 +23,15 @@ extern int expr_lablcnt;	/* number of label seen in an expression */
  */
 
 int
-pcx_pack_8x8_tile(unsigned char *buffer, int x, int y)
+pcx_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, int x, int y)
 {
 	unsigned char *ptr;
 
 	/* tile address */
-	ptr = pcx_buf + x + (y * pcx_w);
+	ptr = ctx->pcx_buf + x + (y * ctx->pcx_w);
 
 	/* encode the tile */
-	return (machine->pack_8x8_tile(buffer, ptr, pcx_w, CHUNKY_TILE));
+	return (ctx->machine->pack_8x8_tile(ctx, buffer, ptr, ctx->pcx_w, CHUNKY_TILE));
 }
 
 
@@ -69,15 +41,15 @@ pcx_pack_8x8_tile(unsigned char *buffer, int x, int y)
  */
 
 int
-pcx_pack_16x16_tile(unsigned char *buffer, int x, int y)
+pcx_pack_16x16_tile(struct t_context *ctx, unsigned char *buffer, int x, int y)
 {
 	unsigned char *ptr;
 
 	/* tile address */
-	ptr = pcx_buf + x + (y * pcx_w);
+	ptr = ctx->pcx_buf + x + (y * ctx->pcx_w);
 
 	/* encode the tile */
-	return (machine->pack_16x16_tile(buffer, ptr, pcx_w, CHUNKY_TILE));
+	return (ctx->machine->pack_16x16_tile(ctx, buffer, ptr, ctx->pcx_w, CHUNKY_TILE));
 }
 
 
@@ -87,15 +59,15 @@ pcx_pack_16x16_tile(unsigned char *buffer, int x, int y)
  */
 
 int
-pcx_pack_16x16_sprite(unsigned char *buffer, int x, int y)
+pcx_pack_16x16_sprite(struct t_context *ctx, unsigned char *buffer, int x, int y)
 {
 	unsigned char *ptr;
 
 	/* sprite address */
-	ptr = pcx_buf + x + (y * pcx_w);
+	ptr = ctx->pcx_buf + x + (y * ctx->pcx_w);
 
 	/* encode the sprite */
-	return (machine->pack_16x16_sprite(buffer, ptr, pcx_w, CHUNKY_TILE));
+	return (ctx->machine->pack_16x16_sprite(ctx, buffer, ptr, ctx->pcx_w, CHUNKY_TILE));
 }
 
 
@@ -105,7 +77,7 @@ pcx_pack_16x16_sprite(unsigned char *buffer, int x, int y)
  */
 
 int
-pcx_set_tile(struct t_symbol *ref, unsigned int offset)
+pcx_set_tile(struct t_context *ctx, struct t_symbol *ref, unsigned int offset)
 {
 	int i;
 	int hash;
@@ -115,29 +87,37 @@ pcx_set_tile(struct t_symbol *ref, unsigned int offset)
 	int nb;
 
 	/* do nothing in first passes */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (1);
 
 	/* same tile set? */
 	if (ref == NULL)
 		return (1);
-	if ((ref == tile_lablptr) && (offset == tile_offset))
+	if ((ref == ctx->tile_lablptr) && (offset == ctx->tile_offset))
+		return (1);
+
+	/* the tiles may be in the rom of another region
+	 * of a parallel last pass
+	 */
+	if (ctx->in_region) {
+		region_abort(ctx);
 		return (1);
+	}
 
 	/* check symbol */
 	if (ref->nb == 0) {
 		if ((ref->type == IFUNDEF) || (ref->type == UNDEF))
-			error("Tile table undefined!");
+			fixup_error(ctx, "Tile table undefined!");
 		else
-			error("Incorrect tile table reference!");
+			fixup_error(ctx, "Incorrect tile table reference!");
 
 		/* no tile table */
-		tile_lablptr = NULL;
+		ctx->tile_lablptr = NULL;
 		return (1);
 	}
 	if (ref->size == 0) {
-		error("Tile table has not been compiled yet!");
-		tile_lablptr = NULL;
+		fixup_error(ctx, "Tile table has not been compiled yet!");
+		ctx->tile_lablptr = NULL;
 		return (1);
 	}
 
@@ -153,12 +133,12 @@ pcx_set_tile(struct t_symbol *ref, unsigned int offset)
 
 	/* reset tile hash table */
 	for (i = 0; i < 256; i++)
-		tile_tbl[i] = NULL;
+		ctx->tile_tbl[i] = NULL;
 
 	/* get infos */
 	nb   = ref->nb - (start / ref->size);
 	size = ref->size;
-	data = &rom[ref->bank - bank_base][ref->value & 0x1FFF] + start;
+	data = &ctx->rom[ref->bank - ctx->bank_base][ref->value & 0x1FFF] + start;
 
 	/* 256 tiles max */
 	if (nb > 256)
@@ -171,25 +151,25 @@ pcx_set_tile(struct t_symbol *ref, unsigned int offset)
 		hash = (crc & 0xFF);
 
 		/* insert the tile in the tile table */
-		tile[i].next = tile_tbl[hash];
-		tile[i].index = i;
-		tile[i].data = data;
-		tile[i].crc = crc;
-		tile_tbl[hash] = &tile[i];
+		ctx->tile[i].next = ctx->tile_tbl[hash];
+		ctx->tile[i].index = i;
+		ctx->tile[i].data = data;
+		ctx->tile[i].crc = crc;
+		ctx->tile_tbl[hash] = &ctx->tile[i];
 
 		/* next */
 		data += size;
 	}
 
 	/* ok */
-	tile_lablptr = ref;
-	tile_offset  = offset;
+	ctx->tile_lablptr = ref;
+	ctx->tile_offset  = offset;
 	return (1);
 
 	/* error */
 err:
-	tile_lablptr = NULL;
-	error("Incorrect tile table reference!");
+	ctx->tile_lablptr = NULL;
+	fixup_error(ctx, "Incorrect tile table reference!");
 	return (1);
 }
 
@@ -200,24 +180,24 @@ err:
  */
 
 int
-pcx_search_tile(unsigned char *data, int size)
+pcx_search_tile(struct t_context *ctx, unsigned char *data, int size)
 {
 	struct t_tile *tile;
 	unsigned int crc;
 
 	/* do nothing in first passes */
-	if (pass != LAST_PASS)
+	if (ctx->pass != LAST_PASS)
 		return (0);
 
 	/* quick check */
-	if (tile_lablptr == NULL)
+	if (ctx->tile_lablptr == NULL)
 		return (-1);
-	if (tile_lablptr->size != size)
+	if (ctx->tile_lablptr->size != size)
 		return (-1);
 
 	/* calculate tile crc */
 	crc  = crc_calc(data, size);
-	tile = tile_tbl[crc & 0xFF];
+	tile = ctx->tile_tbl[crc & 0xFF];
 
 	/* search tile */
 	while (tile) {
@@ -240,62 +220,62 @@ pcx_search_tile(unsigned char *data, int size)
  */
 
 int
-pcx_get_args(int *ip)
+pcx_get_args(struct t_context *ctx, int *ip)
 {
 	char name[128];
 	char c;
 
 	/* get pcx file name */
-	if (!getstring(ip, name, 127))
+	if (!getstring(ctx, ip, name, 127))
 		return (0);
 
 	/* reset args counter */
-	pcx_nb_args = 0;
+	ctx->pcx_nb_args = 0;
 
 	/* get args */
 	for (;;) {
 		/* skip spaces */
-		while (isspace(c = prlnbuf[(*ip)++]));
+		while (isspace(c = ctx->prlnbuf[(*ip)++]));
 
 		/* check syntax */
 		if ((c != ',') && (c != ';') && (c != 0)) {
-			error("Syntax error!");
+			error(ctx, "Syntax error!");
 			return (0);
 		}
 		if (c != ',')
 			break;
 
 		/* get arg */
-		if (!evaluate(ip, 0))
+		if (!evaluate(ctx, ip, 0))
 			return (0);
 
 		/* store arg */
-		pcx_arg[pcx_nb_args++] = value;
+		ctx->pcx_arg[ctx->pcx_nb_args++] = ctx->value;
 
 		/* check number of args */
-		if (pcx_nb_args == 7)
+		if (ctx->pcx_nb_args == 7)
 			break;
 	}			
 
 	/* check number of args */
-	if (optype & (1 << pcx_nb_args)) {
-		error("Invalid number of arguments!");
+	if (ctx->optype & (1 << ctx->pcx_nb_args)) {
+		error(ctx, "Invalid number of arguments!");
 		return (0);
 	}
 
 	/* load and unpack the pcx */
-	if (!pcx_load(name))
+	if (!pcx_load(ctx, name))
 		return (0);
 
 	/* parse tiles */
-	if (opval == P_INCMAP) {
-		if (expr_lablcnt == 0)
-			error("No tile table reference!");
-		if (expr_lablcnt > 1) {
-			expr_lablcnt = 0;
-			error("Too many tile table references!");
+	if (ctx->opval == P_INCMAP) {
+		if (ctx->expr_lablcnt == 0)
+			error(ctx, "No tile table reference!");
+		if (ctx->expr_lablcnt > 1) {
+			ctx->expr_lablcnt = 0;
+			error(ctx, "Too many tile table references!");
 		}
-		if (!pcx_set_tile(expr_lablptr, value))
+		if (!pcx_set_tile(ctx, ctx->expr_lablptr, ctx->value))
 			return (0);
 	}
 
@@ -311,7 +291,7 @@ pcx_get_args(int *ip)
  */
 
 int
-pcx_parse_args(int i, int nb, int *a, int *b, int *c, int *d, int size)
+pcx_parse_args(struct t_context *ctx, int i, int nb, int *a, int *b, int *c, int *d, int size)
 {
 	int x, y, w, h;
 
@@ -320,23 +300,23 @@ pcx_parse_args(int i, int nb, int *a, int *b, int *c, int *d, int size)
 
 	/* get coordinates */
 	if (nb == 0) {			/* no arg */
-		w = (pcx_w / size);
-		h = (pcx_h / size);
+		w = (ctx->pcx_w / size);
+		h = (ctx->pcx_h / size);
 	}
 	else if (nb == 2) {		/* 2 args */
-		w = pcx_arg[i];
-		h = pcx_arg[i+1];
+		w = ctx->pcx_arg[i];
+		h = ctx->pcx_arg[i+1];
 	}
 	else {					/* 4 args */
-		x = pcx_arg[i];
-		y = pcx_arg[i+1];
-		w = pcx_arg[i+2];
-		h = pcx_arg[i+3];
+		x = ctx->pcx_arg[i];
+		y = ctx->pcx_arg[i+1];
+		w = ctx->pcx_arg[i+2];
+		h = ctx->pcx_arg[i+3];
 	}
 
 	/* check */
-	if (((x + w * size) > pcx_w) || ((y + h * size) > pcx_h)) {
-		error("Coordinates out of range!");
+	if (((x + w * size) > ctx->pcx_w) || ((y + h * size) > ctx->pcx_h)) {
+		error(ctx, "Coordinates out of range!");
 		return (0);
 	}
 
@@ -358,71 +338,119 @@ pcx_parse_args(int i, int nb, int *a, int *b, int *c, int *d, int size)
  */
 
 int
-pcx_load(char *name)
+pcx_load(struct t_context *ctx, char *name)
 {
-	FILE *f;
+	struct t_file *f;
+	struct t_image *image;
+	int errcnt;
 
 	/* check if the file is the same as the previously loaded one;
 	 * if this is the case do not reload it
 	 */
-	if (strlen(name) && (strcasecmp(pcx_name, name) == 0))
+	if (strlen(name) && (strcasecmp(ctx->pcx_name, name) == 0))
 		return (1);
 	else {
 		/* no it's a new file - ok let's prepare loading */
-		if (pcx_buf)
-			free(pcx_buf);
-		pcx_buf = NULL;
-		pcx_name[0] = '\0';
+		if (ctx->pcx_buf && !ctx->pcx_shared)
+			free(ctx->pcx_buf);
+		ctx->pcx_buf = NULL;
+		ctx->pcx_shared = 0;
+		ctx->pcx_name[0] = '\0';
 	}
 
 	/* open the file */
-	if ((f = open_file(name, "rb")) == NULL) {
-		error("Can not open file!");
+	if ((f = open_file(ctx, name)) == NULL) {
+		error(ctx, "Can not open file!");
+		return (0);
+	}
+
+	/* the picture may have been decoded by another assembly */
+	if (f->shared && ((image = shared_image(ctx->shared, f->shared)) != NULL)) {
+		pcx_use_image(ctx, image);
+		strcpy(ctx->pcx_name, name);
+		return (1);
+	}
+	if (f->size < 128) {
+		error(ctx, "Unsupported or invalid PCX format!");
 		return (0);
 	}
 
 	/* get the picture size */
-	fread(&pcx, 128, 1, f);
-	pcx_w = (GET_SHORT(pcx.xmax) - GET_SHORT(pcx.xmin) + 1);
-	pcx_h = (GET_SHORT(pcx.ymax) - GET_SHORT(pcx.ymin) + 1);
+	memcpy(&ctx->pcx, f->data, 128);
+	ctx->pcx_w = (GET_SHORT(ctx->pcx.xmax) - GET_SHORT(ctx->pcx.xmin) + 1);
+	ctx->pcx_h = (GET_SHORT(ctx->pcx.ymax) - GET_SHORT(ctx->pcx.ymin) + 1);
 
 	/* adjust picture width */
-	if (pcx_w & 0x01)
-		pcx_w++;
+	if (ctx->pcx_w & 0x01)
+		ctx->pcx_w++;
 
 	/* check size range */
-	if ((pcx_w > 1024) || (pcx_h > 768)) {
-		error("Picture size too big, max. 1024x768!");
+	if ((ctx->pcx_w > 1024) || (ctx->pcx_h > 768)) {
+		error(ctx, "Picture size too big, max. 1024x768!");
 		return (0);
 	}
-	if ((pcx_w < 16) || (pcx_h < 16)) {
-		error("Picture size too small, min. 16x16!");
+	if ((ctx->pcx_w < 16) || (ctx->pcx_h < 16)) {
+		error(ctx, "Picture size too small, min. 16x16!");
 		return (0);
 	}
 
 	/* malloc a buffer */
-    pcx_buf = malloc(pcx_w * pcx_h);
-	if (pcx_buf == NULL) {
-		error("Can not load file, not enough memory!");
+    ctx->pcx_buf = malloc(ctx->pcx_w * ctx->pcx_h);
+	if (ctx->pcx_buf == NULL) {
+		error(ctx, "Can not load file, not enough memory!");
 		return (0);
 	}
 
 	/* decode the picture */
-	if ((pcx.bpp == 8) && (pcx.np == 1))
-		decode_256(f, pcx_w, pcx_h);
-	else if ((pcx.bpp == 1) && (pcx.np <= 4))
-		decode_16(f, pcx_w, pcx_h);
+	errcnt = ctx->errcnt;
+
+	if ((ctx->pcx.bpp == 8) && (ctx->pcx.np == 1))
+		decode_256(ctx, f, ctx->pcx_w, ctx->pcx_h);
+	else if ((ctx->pcx.bpp == 1) && (ctx->pcx.np <= 4))
+		decode_16(ctx, f, ctx->pcx_w, ctx->pcx_h);
 	else {
-		error("Unsupported or invalid PCX format!");
+		error(ctx, "Unsupported or invalid PCX format!");
 		return (0);
 	}
 
-	fclose(f);
-	strcpy(pcx_name, name);
+	/* share the decoded picture */
+	if (f->shared && (ctx->errcnt == errcnt)) {
+		if ((image = (void *)malloc(sizeof(struct t_image))) != NULL) {
+			image->header = ctx->pcx;
+			image->w = ctx->pcx_w;
+			image->h = ctx->pcx_h;
+			image->nb_colors = ctx->pcx_nb_colors;
+			image->buf = ctx->pcx_buf;
+			memcpy(image->pal, ctx->pcx_pal, 768);
+			image = shared_set_image(ctx->shared, f->shared, image);
+			pcx_use_image(ctx, image);
+		}
+	}
+
+	strcpy(ctx->pcx_name, name);
 	return (1);
 }
 
 
+/* ----
+ * pcx_use_image()
+ * ----
+ * use a picture decoded by another assembly
+ */
+
+void
+pcx_use_image(struct t_context *ctx, struct t_image *image)
+{
+	ctx->pcx = image->header;
+	ctx->pcx_w = image->w;
+	ctx->pcx_h = image->h;
+	ctx->pcx_nb_colors = image->nb_colors;
+	ctx->pcx_buf = image->buf;
+	ctx->pcx_shared = 1;
+	memcpy(ctx->pcx_pal, image->pal, 768);
+}
+
+
 /* ----
  * decode_256()
  * ----
@@ -430,34 +458,38 @@ pcx_load(char *name)
  */
 
 void
-decode_256(FILE *f, unsigned int w, unsigned int h)
+decode_256(struct t_context *ctx, struct t_file *f, unsigned int w, unsigned int h)
 {
 	unsigned int   i, c, x, y;
 	unsigned char *ptr;
+	int pos;
 
-	ptr = pcx_buf;
+	ptr = ctx->pcx_buf;
+	pos = 128;
 	x = 0;
 	y = 0;
 
 	/* decode */
-	switch (pcx.encoding) {
+	switch (ctx->pcx.encoding) {
 	case 0:
 		/* raw */
-		fread(pcx_buf, w, h, f);
-		c = fgetc(f);
+		i = f->size - pos;
+		if (i > (w * h))
+			i = (w * h);
+		memcpy(ctx->pcx_buf, &f->data[pos], i);
 		return;
 
 	case 1:
 		/* simple run-length encoding */
 		do {
-			c = fgetc(f);
+			c = PCX_GETC(f, pos);
 			if (c ==  uEOF)
 				break;
 			if ((c & 0xC0) != 0xC0)
 				i = 1;
 			else {
 				i = (c & 0x3F);
-				c = fgetc(f);
+				c = PCX_GETC(f, pos);
 			}
 			do {
 				x++;
@@ -471,20 +503,20 @@ decode_256(FILE *f, unsigned int w, unsigned int h)
 		break;
 
 	default:
-		error("Unsupported PCX encoding scheme!");
+		error(ctx, "Unsupported PCX encoding scheme!");
 		return;
 	}			
 
 	/* get the palette */
 	if (c != uEOF)
-		c = fgetc(f);
+		c = PCX_GETC(f, pos);
 	while ((c != 12) && (c != uEOF))
-		c = fgetc(f);
-	if (c == 12)
-		fread(pcx_pal, 768, 1, f);
+		c = PCX_GETC(f, pos);
+	if ((c == 12) && ((f->size - pos) >= 768))
+		memcpy(ctx->pcx_pal, &f->data[pos], 768);
 
 	/* number of colors */
-	pcx_nb_colors = 256;
+	ctx->pcx_nb_colors = 256;
 }
 
 
@@ -495,31 +527,33 @@ decode_256(FILE *f, unsigned int w, unsigned int h)
  */
 
 void
-decode_16(FILE *f, unsigned int w, unsigned int h)
+decode_16(struct t_context *ctx, struct t_file *f, unsigned int w, unsigned int h)
 {
     int k;
 	unsigned int i, j, n;
 	unsigned int x, y, p;
 	unsigned int c, pix;
 	unsigned char *ptr;
+	int pos;
 
-	ptr = pcx_buf;
+	ptr = ctx->pcx_buf;
+	pos = 128;
 	x = 0;
 	y = 0;
 	p = 0;
 
 	/* decode */
-	switch (pcx.encoding) {
+	switch (ctx->pcx.encoding) {
 	case 0:
 		/* raw */
-		error("Unsupported PCX encoding scheme!");
+		error(ctx, "Unsupported PCX encoding scheme!");
 		break;
 
 	case 1:
 		/* simple run-length encoding */
 		do {
 			/* get a char */
-			c = fgetc(f);
+			c = PCX_GETC(f, pos);
 			if (c == uEOF)
 				break;
 
@@ -528,12 +562,12 @@ decode_16(FILE *f, unsigned int w, unsigned int h)
 				i = 1;
 			else {
 				i = (c & 0x3F);
-				c = fgetc(f);
+				c = PCX_GETC(f, pos);
 			}
 
 			/* unpack */
 			do {
-			    pcx_plane[x >> 3][p] = c;
+			    ctx->pcx_plane[x >> 3][p] = c;
 				x += 8;
 
 				/* end of line */
@@ -542,7 +576,7 @@ decode_16(FILE *f, unsigned int w, unsigned int h)
 					p++;
 
 					/* plane to chunky conversion */
-					if (p == pcx.np) {
+					if (p == ctx->pcx.np) {
 						p = 0;
 						n = (w + 7) >> 3;
 						y++;
@@ -553,15 +587,15 @@ decode_16(FILE *f, unsigned int w, unsigned int h)
 								/* get pixel index */
 								pix = 0;
 
-								switch (pcx.np) {
+								switch (ctx->pcx.np) {
 								case 4:
-									pix |= ((pcx_plane[j][3] >> k) & 0x01) << 3;
+									pix |= ((ctx->pcx_plane[j][3] >> k) & 0x01) << 3;
 								case 3:
-									pix |= ((pcx_plane[j][2] >> k) & 0x01) << 2;
+									pix |= ((ctx->pcx_plane[j][2] >> k) & 0x01) << 2;
 								case 2:
-									pix |= ((pcx_plane[j][1] >> k) & 0x01) << 1;
+									pix |= ((ctx->pcx_plane[j][1] >> k) & 0x01) << 1;
 								case 1:
-									pix |= ((pcx_plane[j][0] >> k) & 0x01);
+									pix |= ((ctx->pcx_plane[j][0] >> k) & 0x01);
 									break;
 								}
 
@@ -582,15 +616,15 @@ decode_16(FILE *f, unsigned int w, unsigned int h)
 		break;
 
 	default:
-		error("Unsupported PCX encoding scheme!");
+		error(ctx, "Unsupported PCX encoding scheme!");
 		return;
 	}			
 
 	/* get the palette */
-	memset(pcx_pal, 0, 768);
-	memcpy(pcx_pal, pcx.colormap, (1 << pcx.np) * 3);
+	memset(ctx->pcx_pal, 0, 768);
+	memcpy(ctx->pcx_pal, ctx->pcx.colormap, (1 << ctx->pcx.np) * 3);
 
 	/* number of colors */
-	pcx_nb_colors = 16;
+	ctx->pcx_nb_colors = 16;
 }
 
@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+/* there are no threads on windows, the files are read when
+ * they are included
+ */
+#ifdef WIN32
+#define prefetch_lock(pf)
+#define prefetch_unlock(pf)
+#define prefetch_sleep(pf)
+#define prefetch_wakeup(pf)
+#else
+#define prefetch_lock(pf)   pthread_mutex_lock(&(pf)->lock)
+#define prefetch_unlock(pf) pthread_mutex_unlock(&(pf)->lock)
+#define prefetch_sleep(pf)  pthread_cond_wait(&(pf)->cond, &(pf)->lock)
+#define prefetch_wakeup(pf) pthread_cond_broadcast(&(pf)->cond)
+#endif
+
+
+/* ----
+ * prefetch_start()
+ * ----
+ * start the threads reading the include files ahead, the files
+ * given by the caller reader can't be read by them
+ */
+
+void
+prefetch_start(struct t_context *ctx)
+{
+#ifndef WIN32
+	struct t_prefetch *pf;
+	int i;
+
+	if (!ctx->prefetch_opt || ctx->prefetch || ctx->file_reader)
+		return;
+	if ((pf = (void *)calloc(1, sizeof(struct t_prefetch))) == NULL)
+		return;
+	if (pthread_mutex_init(&pf->lock, NULL)) {
+		free(pf);
+		return;
+	}
+	if (pthread_cond_init(&pf->cond, NULL)) {
+		pthread_mutex_destroy(&pf->lock);
+		free(pf);
+		return;
+	}
+	ctx->prefetch = pf;
+
+	/* the files not taken by a thread are read when
+	 * they are included
+	 */
+	for (i = 0; i < PREFETCH_JOBS; i++) {
+		if (pthread_create(&pf->thread[pf->nb_threads], NULL, prefetch_worker, ctx) == 0)
+			pf->nb_threads++;
+	}
+#endif
+}
+
+
+/* ----
+ * prefetch_stop()
+ * ----
+ * stop the threads and free the files that were not used
+ */
+
+void
+prefetch_stop(struct t_context *ctx)
+{
+	struct t_prefetch *pf = ctx->prefetch;
+	struct t_pfitem *item, *next;
+
+	if (pf == NULL)
+		return;
+
+#ifndef WIN32
+	prefetch_lock(pf);
+	pf->stop = 1;
+	prefetch_wakeup(pf);
+	prefetch_unlock(pf);
+
+	while (pf->nb_threads)
+		pthread_join(pf->thread[--pf->nb_threads], NULL);
+
+	pthread_cond_destroy(&pf->cond);
+	pthread_mutex_destroy(&pf->lock);
+#endif
+
+	for (item = pf->list; item; item = next) {
+		next = item->next;
+		if (item->shared == NULL)
+			free(item->data);
+		src_free(item->src);
+		free(item);
+	}
+	free(pf);
+	ctx->prefetch = NULL;
+}
+
+
+/* ----
+ * prefetch_worker()
+ * ----
+ * read the files queued until the threads are stopped
+ */
+
+void *
+prefetch_worker(void *arg)
+{
+	struct t_context *ctx = arg;
+	struct t_prefetch *pf = ctx->prefetch;
+	struct t_pfitem *item;
+
+	prefetch_lock(pf);
+	for (;;) {
+		/* get a file */
+		for (item = pf->list; item; item = item->next) {
+			if (item->state == PF_QUEUED)
+				break;
+		}
+		if (item == NULL) {
+			if (pf->stop)
+				break;
+			prefetch_sleep(pf);
+			continue;
+		}
+		item->state = PF_BUSY;
+		prefetch_unlock(pf);
+
+		/* read it */
+		prefetch_load(ctx, item);
+
+		prefetch_lock(pf);
+		item->state = PF_READY;
+		prefetch_wakeup(pf);
+	}
+	prefetch_unlock(pf);
+
+	return (NULL);
+}
+
+
+/* ----
+ * prefetch_add()
+ * ----
+ * queue an include file, the name is the one given to
+ * src_open(); a file is only queued once
+ */
+
+void
+prefetch_add(struct t_context *ctx, char *name)
+{
+	struct t_prefetch *pf = ctx->prefetch;
+	struct t_pfitem *item, **last;
+
+	prefetch_lock(pf);
+	for (last = &pf->list; (item = *last) != NULL; last = &item->next) {
+		if (!strcmp(item->name, name))
+			break;
+	}
+	if ((item == NULL) && ((item = (void *)calloc(1, sizeof(struct t_pfitem))) != NULL)) {
+		strcpy(item->name, name);
+		item->state = PF_QUEUED;
+		*last = item;
+		prefetch_wakeup(pf);
+	}
+	prefetch_unlock(pf);
+}
+
+
+/* ----
+ * prefetch_scan()
+ * ----
+ * queue the files included by a source, the names given by
+ * macro arguments are not known
+ */
+
+void
+prefetch_scan(struct t_context *ctx, struct t_source *src)
+{
+	char  name[128];
+	char *ptr, *end;
+	int   i;
+
+	for (i = 0; i < src->nb_lines; i++) {
+		ptr = src->line[i].data;
+
+		/* skip the label */
+		if (*ptr && !isspace((unsigned char)*ptr) && (*ptr != ';')) {
+			while (*ptr && !isspace((unsigned char)*ptr))
+				ptr++;
+		}
+		while (isspace((unsigned char)*ptr))
+			ptr++;
+
+		/* .include "name" */
+		if (*ptr == '.')
+			ptr++;
+		if (strncasecmp(ptr, "include", 7) || !isspace((unsigned char)ptr[7]))
+			continue;
+		ptr += 8;
+		while (isspace((unsigned char)*ptr))
+			ptr++;
+		if ((*ptr != '\"') || ((end = strchr(++ptr, '\"')) == NULL))
+			continue;
+		if ((end == ptr) || ((end - ptr) > 100) || memchr(ptr, '\\', end - ptr))
+			continue;
+
+		memcpy(name, ptr, end - ptr);
+		name[end - ptr] = '\0';
+		input_name(name);
+		prefetch_add(ctx, name);
+	}
+}
+
+
+/* ----
+ * prefetch_load()
+ * ----
+ * read a file and split it into lines, the files it includes
+ * are queued too; it runs in the threads, only the include
+ * paths and the shared store of the context are used
+ */
+
+void
+prefetch_load(struct t_context *ctx, struct t_pfitem *item)
+{
+	unsigned char *data;
+	FILE *fp;
+	int   size, i;
+
+	/* same search as search_file() */
+	strcpy(item->path, item->name);
+	fp = fopen(item->path, "rb");
+
+	for (i = 0; (fp == NULL) && (i < ctx->incpathCount); i++) {
+		if (strlen(ctx->incpath + ctx->str_offset[i])) {
+			strcpy(item->path, ctx->incpath + ctx->str_offset[i]);
+			strcat(item->path, PATH_SEPARATOR_STRING);
+			strcat(item->path, item->name);
+			fp = fopen(item->path, "rb");
+		}
+	}
+	if (fp == NULL)
+		return;
+
+	/* the files shared with other assemblies are read once */
+	if (ctx->shared) {
+		item->shared = shared_load(ctx->shared, item->path, fp);
+		fclose(fp);
+		if (item->shared == NULL)
+			return;
+		data = item->shared->data;
+		size = item->shared->size;
+	}
+	else {
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		if ((data = (void *)malloc(size + 1)) == NULL) {
+			fclose(fp);
+			return;
+		}
+		size = fread(data, 1, size, fp);
+		fclose(fp);
+	}
+	item->data = data;
+	item->size = size;
+
+	/* lines */
+	if ((item->src = src_get(ctx, data, size, item->shared)) != NULL)
+		prefetch_scan(ctx, item->src);
+}
+
+
+/* ----
+ * prefetch_get()
+ * ----
+ * get the lines of an include file read ahead, it's read now
+ * if no thread took it yet; return NULL if the file was not
+ * queued or not found, it's then opened as usual
+ */
+
+struct t_source *
+prefetch_get(struct t_context *ctx, char *name)
+{
+	struct t_prefetch *pf = ctx->prefetch;
+	struct t_pfitem *item;
+	struct t_source *src;
+	struct t_file *file;
+
+	if (pf == NULL)
+		return (NULL);
+
+	/* the files given by the caller come first */
+	for (file = ctx->file_list; file; file = file->next) {
+		if (!strcmp(file->name, name))
+			return (NULL);
+	}
+
+	prefetch_lock(pf);
+	for (item = pf->list; item; item = item->next) {
+		if (!strcmp(item->name, name))
+			break;
+	}
+	if ((item == NULL) || (item->state == PF_DONE)) {
+		prefetch_unlock(pf);
+		return (NULL);
+	}
+
+	/* not read yet, don't wait for a thread */
+	if (item->state == PF_QUEUED) {
+		item->state = PF_BUSY;
+		prefetch_unlock(pf);
+		prefetch_load(ctx, item);
+		prefetch_lock(pf);
+		item->state = PF_READY;
+		prefetch_wakeup(pf);
+	}
+	while (item->state == PF_BUSY)
+		prefetch_sleep(pf);
+
+	/* the file and its lines now belong to the context */
+	src = item->src;
+	item->state = PF_DONE;
+	item->src = NULL;
+	prefetch_unlock(pf);
+
+	if (src == NULL) {
+		if (item->shared == NULL)
+			free(item->data);
+		item->data = NULL;
+		return (NULL);
+	}
+
+	/* the build cache needs to know all the files used */
+	if (ctx->cache_dir[0])
+		cache_dep(ctx, name, item->path);
+
+	if ((file = add_file(ctx, name, item->data, item->size, item->shared)) != NULL)
+		strcpy(file->path, item->path);
+	item->data = NULL;
+	item->shared = NULL;
+
+	return (src);
+}
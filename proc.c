@@ -6,18 +6,11 @@
 #include "externs.h"
 #include "protos.h"
 
-struct t_proc *proc_tbl[256];
-struct t_proc *proc_ptr;
-struct t_proc *proc_first;
-struct t_proc *proc_last;
-int proc_nb;
-int call_ptr;
-int call_bank;
 
 /* protos */
-struct t_proc *proc_look(void);
-int            proc_install(void);
-void           poke(int addr, int data);
+struct t_proc *proc_look(struct t_context *ctx);
+int            proc_install(struct t_context *ctx);
+void           poke(struct t_context *ctx, int addr, int data);
 
 
 /* ----
@@ -27,96 +20,118 @@ void           poke(int addr, int data);
  */
 
 void
-do_call(int *ip)
+do_call(struct t_context *ctx, int *ip)
 {
 	struct t_proc *ptr;
 	int value;
 
+	/* the procs are relocated after the first pass */
+	if (ctx->single_pass)
+		fixup_abort(ctx);
+
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* update location counter */
-	data_loccnt = loccnt;
-	loccnt += 3;
+	ctx->data_loccnt = ctx->loccnt;
+	ctx->loccnt += 3;
 
 	/* generate code */
-	if (pass == LAST_PASS) {
+	if (ctx->pass == LAST_PASS) {
 		/* skip spaces */
-		while (isspace(prlnbuf[*ip]))
+		while (isspace(ctx->prlnbuf[*ip]))
 			(*ip)++;
 
 		/* extract name */
-		if (!colsym(ip)) {
-			if (symbol[0] == 0)
-				fatal_error("Syntax error!");
+		if (!colsym(ctx, ip)) {
+			if (ctx->symbol[0] == 0)
+				fatal_error(ctx, "Syntax error!");
 			return;
 		}
 
 		/* check end of line */
-		check_eol(ip);
+		check_eol(ctx, ip);
 
 		/* lookup proc table */
-		if((ptr = proc_look())) {
+		if((ptr = proc_look(ctx))) {
 			/* check banks */
-			if (bank == ptr->bank)
+			if (ctx->bank == ptr->bank)
 				value = ptr->org + 0xA000;
-			else {
-				/* different */
-				if (ptr->call)
-					value = ptr->call;
-				else {
-					/* new call */
-					value = call_ptr + 0x8000;
-					ptr->call = value;
-
-					/* init */
-					if (call_ptr == 0) {
-						call_bank = ++max_bank;
-					}
-
-					/* install */
-					poke(call_ptr++, 0xA8);			// tay
-					poke(call_ptr++, 0x43);			// tma #5
-					poke(call_ptr++, 0x20);
-					poke(call_ptr++, 0x48);			// pha
-					poke(call_ptr++, 0xA9);			// lda #...
-					poke(call_ptr++, ptr->bank+bank_base);
-					poke(call_ptr++, 0x53);			// tam #5
-					poke(call_ptr++, 0x20);
-					poke(call_ptr++, 0x98);			// tya
-					poke(call_ptr++, 0x20);			// jsr ...
-					poke(call_ptr++, (ptr->org & 0xFF));
-					poke(call_ptr++, (ptr->org >> 8) + 0xA0);
-					poke(call_ptr++, 0xA8);			// tay
-					poke(call_ptr++, 0x68);			// pla
-					poke(call_ptr++, 0x53);			// tam #5
-					poke(call_ptr++, 0x20);
-					poke(call_ptr++, 0x98);			// tya
-					poke(call_ptr++, 0x60);			// rts
-				}
-			}
+			else
+				value = proc_call(ctx, ptr);
 		}
 		else {
 			/* lookup symbol table */
-			if ((lablptr = stlook(0)) == NULL) {
-				fatal_error("Undefined destination!");
+			if ((ctx->lablptr = stlook(ctx, 0)) == NULL) {
+				fatal_error(ctx, "Undefined destination!");
 				return;
 			}
 
 			/* get symbol value */
-			value = lablptr->value;
+			value = ctx->lablptr->value;
 		}
 
 		/* opcode */
-		putbyte(data_loccnt, 0x20);
-		putword(data_loccnt+1, value);
+		putbyte(ctx, ctx->data_loccnt, 0x20);
+		putword(ctx, ctx->data_loccnt+1, value);
 
 		/* output line */
-		println();
+		println(ctx);
 	}
 }
 
 
+/* ----
+ * proc_call()
+ * ----
+ * get the address of the code calling a proc in another bank,
+ * a region keeps the call and gets it when it's kept
+ */
+
+int
+proc_call(struct t_context *ctx, struct t_proc *ptr)
+{
+	int value;
+
+	if (ptr->call)
+		return (ptr->call);
+	if (ctx->in_region) {
+		region_call(ctx, ptr);
+		return (0);
+	}
+
+	/* new call */
+	value = ctx->call_ptr + 0x8000;
+	ptr->call = value;
+
+	/* init */
+	if (ctx->call_ptr == 0) {
+		ctx->call_bank = ++ctx->max_bank;
+	}
+
+	/* install */
+	poke(ctx, ctx->call_ptr++, 0xA8);			// tay
+	poke(ctx, ctx->call_ptr++, 0x43);			// tma #5
+	poke(ctx, ctx->call_ptr++, 0x20);
+	poke(ctx, ctx->call_ptr++, 0x48);			// pha
+	poke(ctx, ctx->call_ptr++, 0xA9);			// lda #...
+	poke(ctx, ctx->call_ptr++, ptr->bank+ctx->bank_base);
+	poke(ctx, ctx->call_ptr++, 0x53);			// tam #5
+	poke(ctx, ctx->call_ptr++, 0x20);
+	poke(ctx, ctx->call_ptr++, 0x98);			// tya
+	poke(ctx, ctx->call_ptr++, 0x20);			// jsr ...
+	poke(ctx, ctx->call_ptr++, (ptr->org & 0xFF));
+	poke(ctx, ctx->call_ptr++, (ptr->org >> 8) + 0xA0);
+	poke(ctx, ctx->call_ptr++, 0xA8);			// tay
+	poke(ctx, ctx->call_ptr++, 0x68);			// pla
+	poke(ctx, ctx->call_ptr++, 0x53);			// tam #5
+	poke(ctx, ctx->call_ptr++, 0x20);
+	poke(ctx, ctx->call_ptr++, 0x98);			// tya
+	poke(ctx, ctx->call_ptr++, 0x60);			// rts
+	return (value);
+}
+
+
 /* ----
  * do_proc()
  * ----
@@ -124,98 +139,108 @@ do_call(int *ip)
  */
 
 void
-do_proc(int *ip)
+do_proc(struct t_context *ctx, int *ip)
 {
 	struct t_proc *ptr;
 
+	/* the procs are relocated after the first pass */
+	if (ctx->single_pass)
+		fixup_abort(ctx);
+
 	/* check if nesting procs/groups */
-	if (proc_ptr) {
-		if (optype == P_PGROUP) {
-			fatal_error("Can not declare a group inside a proc/group!");
+	if (ctx->proc_ptr) {
+		if (ctx->optype == P_PGROUP) {
+			fatal_error(ctx, "Can not declare a group inside a proc/group!");
 			return;
 		}
 		else {
-			if (proc_ptr->type == P_PROC) {
-				fatal_error("Can not nest procs!");
+			if (ctx->proc_ptr->type == P_PROC) {
+				fatal_error(ctx, "Can not nest procs!");
 				return;
 			}
 		}
 	}
 
 	/* get proc name */
-	if (lablptr) {
-		strcpy(&symbol[1], &lablptr->name[1]);
-		symbol[0] = strlen(&symbol[1]);
+	if (ctx->lablptr) {
+		strcpy(&ctx->symbol[1], &ctx->lablptr->name[1]);
+		ctx->symbol[0] = strlen(&ctx->symbol[1]);
 	}
 	else {
 		/* skip spaces */
-		while (isspace(prlnbuf[*ip]))
+		while (isspace(ctx->prlnbuf[*ip]))
 			(*ip)++;
 
 		/* extract name */
-		if (!colsym(ip)) {
-			if (symbol[0])
+		if (!colsym(ctx, ip)) {
+			if (ctx->symbol[0])
 				return;
-			if (optype == P_PROC) {
-				fatal_error("Proc name is missing!");
+			if (ctx->optype == P_PROC) {
+				fatal_error(ctx, "Proc name is missing!");
 				return;
 			}
 
 			/* default name */
-			sprintf(&symbol[1], "__group_%i__", proc_nb + 1);
-			symbol[0] = strlen(&symbol[1]);
+			sprintf(&ctx->symbol[1], "__group_%i__", ctx->proc_nb + 1);
+			ctx->symbol[0] = strlen(&ctx->symbol[1]);
 		}
 
 		/* lookup symbol table */
-		if ((lablptr = stlook(1)) == NULL)
+		if ((ctx->lablptr = stlook(ctx, 1)) == NULL)
 			return;
 	}
 
 	/* check symbol */
-	if (symbol[1] == '.' || symbol[1] == '@') {
-		fatal_error("Proc/group name can not be local!");
+	if (ctx->symbol[1] == '.' || ctx->symbol[1] == '@') {
+		fatal_error(ctx, "Proc/group name can not be local!");
 		return;
 	}
 
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
-	/* search (or create new) proc */
-	if((ptr = proc_look()))
-		proc_ptr = ptr;
+	/* search (or create new) proc, a region only finds the
+	 * procs of the first pass
+	 */
+	if((ptr = proc_look(ctx)))
+		ctx->proc_ptr = ptr;
 	else {
-		if (!proc_install())
+		if (ctx->in_region) {
+			region_abort(ctx);
+			return;
+		}
+		if (!proc_install(ctx))
 			return;
 	}
-	if (proc_ptr->refcnt) {
-		fatal_error("Proc/group multiply defined!");
+	if (ctx->proc_ptr->refcnt) {
+		fatal_error(ctx, "Proc/group multiply defined!");
 		return;
 	}
 
 	/* incrememte proc ref counter */
-	proc_ptr->refcnt++;
+	region_set(ctx, &ctx->proc_ptr->refcnt, ctx->proc_ptr->refcnt + 1);
 
 	/* backup current bank infos */
-	bank_glabl[section][bank]  = glablptr;
-	bank_loccnt[section][bank] = loccnt;
-	bank_page[section][bank]   = page;
-	proc_ptr->old_bank = bank;
-	proc_nb++;
+	ctx->bank_glabl[ctx->section][ctx->bank]  = ctx->glablptr;
+	ctx->bank_loccnt[ctx->section][ctx->bank] = ctx->loccnt;
+	ctx->bank_page[ctx->section][ctx->bank]   = ctx->page;
+	ctx->proc_ptr->old_bank = ctx->bank;
+	ctx->proc_nb++;
 
 	/* set new bank infos */
-	bank     = proc_ptr->bank;
-	page     = 5;
-	loccnt   = proc_ptr->org;
-	glablptr = lablptr;
+	ctx->bank     = ctx->proc_ptr->bank;
+	ctx->page     = 5;
+	ctx->loccnt   = ctx->proc_ptr->org;
+	ctx->glablptr = ctx->lablptr;
 
 	/* define label */
-	labldef(loccnt, 1);
+	labldef(ctx, ctx->loccnt, 1);
 
 	/* output */
-	if (pass == LAST_PASS) {
-		loadlc((page << 13) + loccnt, 0);
-		println();
+	if (ctx->pass == LAST_PASS) {
+		loadlc(ctx, (ctx->page << 13) + ctx->loccnt, 0);
+		println(ctx);
 	}
 }
 
@@ -227,36 +252,36 @@ do_proc(int *ip)
  */
 
 void
-do_endp(int *ip)
+do_endp(struct t_context *ctx, int *ip)
 {
-	if (proc_ptr == NULL) {
-		fatal_error("Unexpected ENDP/ENDPROCGROUP!");
+	if (ctx->proc_ptr == NULL) {
+		fatal_error(ctx, "Unexpected ENDP/ENDPROCGROUP!");
 		return;
 	}
-	if (optype != proc_ptr->type) {
-		fatal_error("Unexpected ENDP/ENDPROCGROUP!");
+	if (ctx->optype != ctx->proc_ptr->type) {
+		fatal_error(ctx, "Unexpected ENDP/ENDPROCGROUP!");
 		return;
 	}
 
 	/* check end of line */
-	if (!check_eol(ip))
+	if (!check_eol(ctx, ip))
 		return;
 
 	/* record proc size */
-	bank = proc_ptr->old_bank;
-	proc_ptr->size = loccnt - proc_ptr->base;
-	proc_ptr = proc_ptr->group;
+	ctx->bank = ctx->proc_ptr->old_bank;
+	ctx->proc_ptr->size = ctx->loccnt - ctx->proc_ptr->base;
+	ctx->proc_ptr = ctx->proc_ptr->group;
 
 	/* restore previous bank settings */
-	if (proc_ptr == NULL) {
-		page     = bank_page[section][bank];
-		loccnt   = bank_loccnt[section][bank];
-		glablptr = bank_glabl[section][bank];
+	if (ctx->proc_ptr == NULL) {
+		ctx->page     = ctx->bank_page[ctx->section][ctx->bank];
+		ctx->loccnt   = ctx->bank_loccnt[ctx->section][ctx->bank];
+		ctx->glablptr = ctx->bank_glabl[ctx->section][ctx->bank];
 	}
 
 	/* output */
-	if (pass == LAST_PASS)
-		println();
+	if (ctx->pass == LAST_PASS)
+		println(ctx);
 }
 
 
@@ -267,7 +292,7 @@ do_endp(int *ip)
  */
 
 void
-proc_reloc(void)
+proc_reloc(struct t_context *ctx)
 {
 	struct t_symbol *sym;
 	struct t_symbol *local;
@@ -276,92 +301,86 @@ proc_reloc(void)
 	int addr;
 	int tmp;
 
-	if (proc_nb == 0)
+	if (ctx->proc_nb == 0)
 		return;
 
 	/* init */
-	proc_ptr = proc_first;
-	bank = max_bank + 1;
+	ctx->proc_ptr = ctx->proc_first;
+	ctx->bank = ctx->max_bank + 1;
 	addr = 0;
 
 	/* alloc memory */
-	while (proc_ptr) {
+	while (ctx->proc_ptr) {
 		/* proc */
-		if (proc_ptr->group == NULL) {
-			tmp = addr + proc_ptr->size;
+		if (ctx->proc_ptr->group == NULL) {
+			tmp = addr + ctx->proc_ptr->size;
 	
 			/* bank change */
 			if (tmp > 0x2000) {
-				bank++;
+				ctx->bank++;
 				addr = 0;
 			}
-			if (bank > bank_limit) {
-				fatal_error("Not enough ROM space for procs!");
+			if (ctx->bank > ctx->bank_limit) {
+				fatal_error(ctx, "Not enough ROM space for procs!");
 				return;
 			}
 
 			/* reloc proc */
-			proc_ptr->bank = bank;
-			proc_ptr->org = addr;
-			addr += proc_ptr->size;
+			ctx->proc_ptr->bank = ctx->bank;
+			ctx->proc_ptr->org = addr;
+			addr += ctx->proc_ptr->size;
 		}
 
 		/* group */
 		else {
 			/* reloc proc */
-			group = proc_ptr->group;
-			proc_ptr->bank = bank;
-			proc_ptr->org += (group->org - group->base);
+			group = ctx->proc_ptr->group;
+			ctx->proc_ptr->bank = ctx->bank;
+			ctx->proc_ptr->org += (group->org - group->base);
 		}
 
 		/* next */
-		max_bank = bank;
-		proc_ptr->refcnt = 0;
-		proc_ptr = proc_ptr->link;
+		ctx->max_bank = ctx->bank;
+		ctx->proc_ptr->refcnt = 0;
+		ctx->proc_ptr = ctx->proc_ptr->link;
 	}
 
 	/* remap proc symbols */
-	for (i = 0; i < 256; i++) {
-		sym = hash_tbl[i];
+	for (i = 0; i < ctx->sym_tbl.nb; i++) {
+		sym = ctx->sym_tbl.list[i];
+		ctx->proc_ptr = sym->ext->proc;
 
-		while (sym) {
-			proc_ptr = sym->proc;
+		/* remap addr */
+		if (sym->ext->proc) {
+			sym->bank   =  ctx->proc_ptr->bank;
+			sym->value += (ctx->proc_ptr->org - ctx->proc_ptr->base);
 
-			/* remap addr */
-			if (sym->proc) {
-				sym->bank   =  proc_ptr->bank;
-				sym->value += (proc_ptr->org - proc_ptr->base);
+			/* local symbols */
+			if (sym->local) {
+				local = sym->local;
 
-				/* local symbols */
-				if (sym->local) {
-					local = sym->local;
-	
-					while (local) {
-						proc_ptr = local->proc;
-			
-						/* remap addr */
-						if (local->proc) {
-							local->bank   =  proc_ptr->bank;
-							local->value += (proc_ptr->org - proc_ptr->base);
-						}
+				while (local) {
+					ctx->proc_ptr = local->ext->proc;
 		
-						/* next */
-						local = local->next;
+					/* remap addr */
+					if (local->ext->proc) {
+						local->bank   =  ctx->proc_ptr->bank;
+						local->value += (ctx->proc_ptr->org - ctx->proc_ptr->base);
 					}
+	
+					/* next */
+					local = local->next;
 				}
 			}
-
-			/* next */
-			sym = sym->next;
 		}
 	}
 
 	/* reserve call bank */
-	lablset("_call_bank", bank_base + max_bank + 1);
+	lablset(ctx, "_call_bank", ctx->bank_base + ctx->max_bank + 1);
 
 	/* reset */
-	proc_ptr = NULL;
-	proc_nb = 0;
+	ctx->proc_ptr = NULL;
+	ctx->proc_nb = 0;
 }
 
 
@@ -372,16 +391,19 @@ proc_reloc(void)
  */
 
 struct t_proc *
-proc_look(void)
+proc_look(struct t_context *ctx)
 {
 	struct t_proc *ptr;
+	char *name;
 	int hash;
 
 	/* search the procedure in the hash table */
-	hash = symhash();
-	ptr = proc_tbl[hash];
+	if ((name = name_look(&ctx->names, ctx->symbol, st_hash(ctx->symbol))) == NULL)
+		return (NULL);
+	hash = symhash(ctx);
+	ptr = ctx->proc_tbl[hash];
 	while (ptr) {
-		if (!strcmp(&symbol[1], ptr->name))
+		if (ptr->name == name)
 			break;			
 		ptr = ptr->next;
 	}
@@ -399,41 +421,44 @@ proc_look(void)
  */
 
 int
-proc_install(void)
+proc_install(struct t_context *ctx)
 {
 	struct t_proc *ptr;
 	int hash;
 
 	/* allocate a new proc struct */
-	if ((ptr = (void *)malloc(sizeof(struct t_proc))) == NULL) {
-		error("Out of memory!");
+	if ((ptr = arena_alloc(&ctx->proc_arena, sizeof(struct t_proc))) == NULL) {
+		error(ctx, "Out of memory!");
 		return (0);
 	}
 
 	/* initialize it */
-	strcpy(ptr->name, &symbol[1]);
-	hash = symhash();
-	ptr->bank = (optype == P_PGROUP)  ? GROUP_BANK : PROC_BANK;
-	ptr->base = proc_ptr ? loccnt : 0;
+	if ((ptr->name = name_intern(&ctx->names, ctx->symbol, st_hash(ctx->symbol))) == NULL) {
+		error(ctx, "Out of memory!");
+		return (0);
+	}
+	hash = symhash(ctx);
+	ptr->bank = (ctx->optype == P_PGROUP)  ? GROUP_BANK : PROC_BANK;
+	ptr->base = ctx->proc_ptr ? ctx->loccnt : 0;
 	ptr->org = ptr->base;
 	ptr->size = 0;
 	ptr->call = 0;
 	ptr->refcnt = 0;
 	ptr->link = NULL;
-	ptr->next = proc_tbl[hash];
-	ptr->group = proc_ptr;
-	ptr->type = optype;
-	proc_ptr = ptr;
-	proc_tbl[hash] = proc_ptr;
+	ptr->next = ctx->proc_tbl[hash];
+	ptr->group = ctx->proc_ptr;
+	ptr->type = ctx->optype;
+	ctx->proc_ptr = ptr;
+	ctx->proc_tbl[hash] = ctx->proc_ptr;
 
 	/* link it */
-	if (proc_first == NULL) {
-		proc_first = proc_ptr;
-		proc_last  = proc_ptr;
+	if (ctx->proc_first == NULL) {
+		ctx->proc_first = ctx->proc_ptr;
+		ctx->proc_last  = ctx->proc_ptr;
 	}
 	else {
-		proc_last->link = proc_ptr;
-		proc_last = proc_ptr;
+		ctx->proc_last->link = ctx->proc_ptr;
+		ctx->proc_last = ctx->proc_ptr;
 	}
 
 	/* ok */
@@ -448,9 +473,9 @@ proc_install(void)
  */
 
 void
-poke(int addr, int data)
+poke(struct t_context *ctx, int addr, int data)
 {
-	rom[call_bank][addr] = data;
-	map[call_bank][addr] = S_CODE + (4 << 5);
+	ctx->rom[ctx->call_bank][addr] = data;
+	ctx->map[ctx->call_bank][addr] = S_CODE + (4 << 5);
 }
 
@@ -1,52 +1,80 @@
 
+/* ARENA.C */
+void *arena_alloc(struct t_arena *arena, int size);
+char *arena_strdup(struct t_arena *arena, const char *str);
+void  arena_free(struct t_arena *arena);
+
 /* ASSEMBLE.C */
-void assemble(void);
-int  oplook(int *idx);
-void addinst(struct t_opcode *optbl);
-int  check_eol(int *ip);
-void do_if(int *ip);
-void do_else(int *ip);
-void do_endif(int *ip);
-void do_ifdef(int *ip);
+void assemble(struct t_context *ctx);
+int  oplook(struct t_context *ctx, int *idx);
+int  opfind(struct t_context *ctx, struct t_lexline *lx);
+void lexsave(struct t_context *ctx, struct t_lexinfo *lex, int state, int flag, int ip);
+int  lexload(struct t_context *ctx, struct t_lexinfo *lex);
+int  opinit(struct t_machine *mach, const struct t_ophash *hash, struct t_opcode **optbl);
+int  check_eol(struct t_context *ctx, int *ip);
+void do_if(struct t_context *ctx, int *ip);
+void do_else(struct t_context *ctx, int *ip);
+void do_endif(struct t_context *ctx, int *ip);
+void do_ifdef(struct t_context *ctx, int *ip);
+void skip_begin(struct t_context *ctx);
+void skip_end(struct t_context *ctx);
+void skip_scan(struct t_context *ctx);
+
+/* BATCH.C */
+int  batch_run(int argc, char **argv);
+int  batch_parse(char *line, char **argv, int max);
+void *batch_worker(void *arg);
+
+/* CACHE.C */
+unsigned long long cache_hash(unsigned long long hash, void *data, int len);
+int  cache_filehash(char *name, unsigned long long *hash);
+int  cache_copy(char *dst, char *src, unsigned long long hash);
+void cache_add(struct t_context *ctx, struct t_cachefile **list, char *name, char *path);
+void cache_dep(struct t_context *ctx, char *name, char *path);
+void cache_out(struct t_context *ctx, char *name);
+void cache_manifest(struct t_context *ctx, char *name);
+int  cache_skip(char *arg);
+int  cache_lookup(struct t_context *ctx, int argc, char **argv);
+void cache_store(struct t_context *ctx);
 
 /* CODE.C */
-void class1(int *ip);
-void class2(int *ip);
-void class3(int *ip);
-void class4(int *ip);
-void class5(int *ip);
-void class6(int *ip);
-void class7(int *ip);
-void class8(int *ip);
-void class9(int *ip);
-void class10(int *ip);
-int  getoperand(int *ip, int flag, int last_char);
-int  getstring(int *ip, char *buffer, int size);
+void class1(struct t_context *ctx, int *ip);
+void class2(struct t_context *ctx, int *ip);
+void class3(struct t_context *ctx, int *ip);
+void class4(struct t_context *ctx, int *ip);
+void class5(struct t_context *ctx, int *ip);
+void class6(struct t_context *ctx, int *ip);
+void class7(struct t_context *ctx, int *ip);
+void class8(struct t_context *ctx, int *ip);
+void class9(struct t_context *ctx, int *ip);
+void class10(struct t_context *ctx, int *ip);
+int  getoperand(struct t_context *ctx, int *ip, int flag, int last_char);
+int  getstring(struct t_context *ctx, int *ip, char *buffer, int size);
 
 /* COMMAND.C */
-void do_pseudo(int *ip);
-void do_list(int *ip);
-void do_mlist(int *ip);
-void do_nolist(int *ip);
-void do_nomlist(int *ip);
-void do_db(int *ip);
-void do_dw(int *ip);
-void do_dwl(int *ip);
-void do_dwh(int *ip);
-void do_equ(int *ip);
-void do_page(int *ip);
-void do_org(int *ip);
-void do_bank(int *ip);
-void do_incbin(int *ip);
-void do_mx(char *fname);
-void do_include(int *ip);
-void do_rsset(int *ip);
-void do_rs(int *ip);
-void do_ds(int *ip);
-void do_fail(int *ip);
-void do_section(int *ip);
-void do_incchr(int *ip);
-void do_opt(int *ip);
+void do_pseudo(struct t_context *ctx, int *ip);
+void do_list(struct t_context *ctx, int *ip);
+void do_mlist(struct t_context *ctx, int *ip);
+void do_nolist(struct t_context *ctx, int *ip);
+void do_nomlist(struct t_context *ctx, int *ip);
+void do_db(struct t_context *ctx, int *ip);
+void do_dw(struct t_context *ctx, int *ip);
+void do_dwl(struct t_context *ctx, int *ip);
+void do_dwh(struct t_context *ctx, int *ip);
+void do_equ(struct t_context *ctx, int *ip);
+void do_page(struct t_context *ctx, int *ip);
+void do_org(struct t_context *ctx, int *ip);
+void do_bank(struct t_context *ctx, int *ip);
+void do_incbin(struct t_context *ctx, int *ip);
+void do_mx(struct t_context *ctx, char *fname);
+void do_include(struct t_context *ctx, int *ip);
+void do_rsset(struct t_context *ctx, int *ip);
+void do_rs(struct t_context *ctx, int *ip);
+void do_ds(struct t_context *ctx, int *ip);
+void do_fail(struct t_context *ctx, int *ip);
+void do_section(struct t_context *ctx, int *ip);
+void do_incchr(struct t_context *ctx, int *ip);
+void do_opt(struct t_context *ctx, int *ip);
 int  htoi(char *str, int nb);
 
 /* CRC.C */
@@ -54,86 +82,236 @@ void         crc_init(void);
 unsigned int crc_calc(unsigned char *data, int len);
 
 /* EXPR.C */
-int  evaluate(int *ip, char flag);
-int  push_val(int type);
-int  getsym(void);
-int  check_keyword(void);
-int  push_op(int op);
-int  do_op(void);
-int  check_func_args(char *func_name);
+int  evaluate(struct t_context *ctx, int *ip, char flag);
+int  getliteral(struct t_context *ctx, int *ip);
+int  push_val(struct t_context *ctx, int type);
+int  getsym(struct t_context *ctx);
+int  check_keyword(struct t_context *ctx);
+int  keyword_op(struct t_context *ctx);
+int  push_op(struct t_context *ctx, int op);
+int  do_op(struct t_context *ctx);
+int  exec_op(struct t_context *ctx, int op);
+int  check_func_args(struct t_context *ctx, char *func_name);
+void expr_emit(struct t_context *ctx, int op, int value, struct t_symbol *sym);
+int  expr_add(struct t_context *ctx, struct t_exprop *code, int nb, int op, int value, struct t_symbol *sym);
+void expr_save(struct t_context *ctx, struct t_lexinfo *lex, int start, int end, char last_char);
+int  expr_run(struct t_context *ctx, struct t_expr *ex, int *ip);
+int  expr_exec(struct t_context *ctx, struct t_exprop *code, int nb, struct t_funcarg *arg);
+int  expr_check(struct t_exprop *code, int nb, int *depth);
+
+/* FIXUP.C */
+void fixup_start(struct t_context *ctx);
+void fixup_abort(struct t_context *ctx);
+void fixup_reset(struct t_context *ctx);
+void fixup_fail(struct t_context *ctx);
+void fixup_defer(struct t_context *ctx, struct t_exprop *code, int nb);
+void fixup_operand(struct t_context *ctx, int type);
+void fixup_place(struct t_context *ctx, int offset);
+void fixup_probe(struct t_context *ctx, int type, char *name, unsigned int hash);
+int  fixup_error(struct t_context *ctx, char *msg);
+void fixup_end(struct t_context *ctx);
+int  fixup_apply(struct t_context *ctx);
+int  fixup_patch(struct t_context *ctx, struct t_fixup *fix);
+int  fixup_refs(struct t_context *ctx);
 
 /* FUNC.C */
-void do_func(int *ip);
-int  func_look(void);
-int  func_install(int ip);
-int  func_extract(int ip);
-int  func_getargs(void);
+void do_func(struct t_context *ctx, int *ip);
+int  func_look(struct t_context *ctx);
+int  func_install(struct t_context *ctx, int ip);
+int  func_extract(struct t_context *ctx, int ip);
+int  func_getargs(struct t_context *ctx);
+int  func_call(struct t_context *ctx, struct t_func *func);
+int  func_getarg(struct t_context *ctx, struct t_funcarg *arg, char *text);
+int  func_save(struct t_context *ctx);
+int  func_run(struct t_context *ctx, struct t_func *func, struct t_funcarg *arg);
 
 /* INPUT.C */
-int   add_path(char*, int);
-void  cleanup_path(void);
-int   init_path(void);
-int   readline(void);
-int   open_input(char *name);
-int   close_input(void);
-FILE *open_file(char *fname, char *mode);
+int   add_path(struct t_context *ctx, char*, int);
+void  cleanup_path(struct t_context *ctx);
+int   init_path(struct t_context *ctx);
+int   readline(struct t_context *ctx);
+int   open_input(struct t_context *ctx, char *name);
+void  input_name(char *name);
+int   close_input(struct t_context *ctx);
+struct t_file *open_file(struct t_context *ctx, char *name);
+struct t_file *add_file(struct t_context *ctx, char *name, unsigned char *data, int size, struct t_shfile *shared);
+FILE *search_file(struct t_context *ctx, char *fname, char *mode, char *path);
+struct t_dir  *dir_load(char *path);
+void  dir_free(struct t_dir *dir);
+int   dir_check(struct t_context *ctx, char *name);
+struct t_source *src_open(struct t_context *ctx, char *name);
+struct t_source *src_load(unsigned char *buf, int size);
+struct t_source *src_get(struct t_context *ctx, unsigned char *buf, int size, struct t_shfile *shared);
+void  src_free(struct t_source *src);
+
+/* LEX.C */
+void lexline(struct t_context *ctx, struct t_lexline *lx);
+void lexname(struct t_context *ctx, int pos, struct t_lexline *lx);
 
 /* MACRO.C */
-void do_macro(int *ip);
-void do_endm(int *ip);
-struct t_macro *macro_look(int *ip);
-int  macro_getargs(int ip);
-int  macro_install(void);
-int  macro_getargtype(char *arg);
+void do_macro(struct t_context *ctx, int *ip);
+void do_endm(struct t_context *ctx, int *ip);
+struct t_macro *macro_find(struct t_context *ctx, char *name, unsigned int hash);
+int  macro_getargs(struct t_context *ctx, int ip);
+int  macro_splitargs(struct t_context *ctx, int ip);
+void macro_setargs(struct t_context *ctx);
+int  macro_install(struct t_context *ctx);
+int  macro_parseline(struct t_context *ctx, struct t_line *line);
+int  macro_argclass(char *arg);
+int  macro_getargtype(struct t_context *ctx, char *arg);
 
 /* MAIN.C */
 int  main(int argc, char **argv);
-int  calc_bank_base(void);
-void help(void);
-void show_seg_usage(void);
+struct t_context *new_context(void);
+int  get_options(struct t_context *ctx, int argc, char **argv);
+int  assemble_target(struct t_context *ctx, int argc, char **argv);
+int  write_file(char *name, char *mode, const unsigned char *data, int size);
+int  write_deps(struct t_context *ctx, char *target);
+void write_deps_name(FILE *fp, char *name);
+void help(struct t_context *ctx);
+void show_seg_usage(struct t_context *ctx);
 
 /* MAP.C */
-int pce_load_map(char *fname, int mode);
+int pce_load_map(struct t_context *ctx, char *fname, int mode);
+
+/* OBJECT.C */
+int  obj_save(struct t_context *ctx, struct t_buffer *buf);
+int  obj_link(struct t_context *ctx, char **names, int nb);
+int  obj_load(struct t_context *ctx, char *name, struct t_stream *st);
+int  obj_patch(struct t_context *ctx, char *name, struct t_stream *st);
+int  obj_export(struct t_symbol *sym);
+int  obj_ref(struct t_symbol ***refs, int *nb, struct t_symbol *sym);
 
 /* OUTPUT.C */
-void println(void);
-void clearln(void);
-void loadlc(int offset, int f);
+void println(struct t_context *ctx);
+void clearln(struct t_context *ctx);
+void loadlc(struct t_context *ctx, int offset, int f);
 void hexcon(int digit, int num, char* out);
-void putbyte(int offset, int data);
-void putword(int offset, int data);
-void putbuffer(void *data, int size);
-void write_srec(char *fname, char *ext, int base);
-void error(char *stptr);
-void warning(char *stptr);
-void fatal_error(char *stptr);
+void putbyte(struct t_context *ctx, int offset, int data);
+void putword(struct t_context *ctx, int offset, int data);
+void putbytes(struct t_context *ctx, int offset, unsigned char *data, int size);
+void putwords(struct t_context *ctx, int offset, unsigned char *data, int size);
+void putbuf_start(struct t_putbuf *buf, int offset, int word);
+void putbuf_byte(struct t_context *ctx, struct t_putbuf *buf, int data);
+void putbuf_flush(struct t_context *ctx, struct t_putbuf *buf);
+void putbuffer(struct t_context *ctx, void *data, int size);
+int  write_srec(struct t_context *ctx, struct t_buffer *buf, int base);
+void error(struct t_context *ctx, char *stptr);
+void warning(struct t_context *ctx, char *stptr);
+void fatal_error(struct t_context *ctx, char *stptr);
+void msg_printf(struct t_context *ctx, const char *format, ...);
+int  buf_grow(struct t_buffer *buf, int size);
+int  buf_write(struct t_buffer *buf, const void *data, int size);
+int  buf_printf(struct t_buffer *buf, const char *format, ...);
+int  buf_vprintf(struct t_buffer *buf, const char *format, va_list args);
+void buf_free(struct t_buffer *buf);
+
+/* PCEAS.C */
+void init_rom(struct t_context *ctx);
+int  write_rom(struct t_context *ctx, struct t_buffer *buf);
+int  calc_bank_base(struct t_context *ctx);
+void pass_run(struct t_context *ctx);
 
 /* PCX.C */
-int  pcx_pack_8x8_tile(unsigned char *buffer, int x, int y);
-int  pcx_pack_16x16_tile(unsigned char *buffer, int x, int y);
-int  pcx_pack_16x16_sprite(unsigned char *buffer, int x, int y);
-int  pcx_set_tile(struct t_symbol *ref, unsigned int offset);
-int  pcx_search_tile(unsigned char *data, int size);
-int  pcx_get_args(int *ip);
-int  pcx_parse_args(int i, int nb, int *a, int *b, int *c, int *d, int size);
-int  pcx_load(char *name);
-void decode_256(FILE *fp, unsigned int w, unsigned int h);
-void decode_16(FILE *fp, unsigned int w, unsigned int h);
+int  pcx_pack_8x8_tile(struct t_context *ctx, unsigned char *buffer, int x, int y);
+int  pcx_pack_16x16_tile(struct t_context *ctx, unsigned char *buffer, int x, int y);
+int  pcx_pack_16x16_sprite(struct t_context *ctx, unsigned char *buffer, int x, int y);
+int  pcx_set_tile(struct t_context *ctx, struct t_symbol *ref, unsigned int offset);
+int  pcx_search_tile(struct t_context *ctx, unsigned char *data, int size);
+int  pcx_get_args(struct t_context *ctx, int *ip);
+int  pcx_parse_args(struct t_context *ctx, int i, int nb, int *a, int *b, int *c, int *d, int size);
+int  pcx_load(struct t_context *ctx, char *name);
+void pcx_use_image(struct t_context *ctx, struct t_image *image);
+void decode_256(struct t_context *ctx, struct t_file *file, unsigned int w, unsigned int h);
+void decode_16(struct t_context *ctx, struct t_file *file, unsigned int w, unsigned int h);
+
+/* PREFETCH.C */
+void prefetch_start(struct t_context *ctx);
+void prefetch_stop(struct t_context *ctx);
+void *prefetch_worker(void *arg);
+void prefetch_add(struct t_context *ctx, char *name);
+void prefetch_scan(struct t_context *ctx, struct t_source *src);
+void prefetch_load(struct t_context *ctx, struct t_pfitem *item);
+struct t_source *prefetch_get(struct t_context *ctx, char *name);
 
 /* PROC.C */
-void do_call(int *ip);
-void do_proc(int *ip);
-void do_endp(int *ip);
-void proc_reloc(void);
+void do_call(struct t_context *ctx, int *ip);
+void do_proc(struct t_context *ctx, int *ip);
+void do_endp(struct t_context *ctx, int *ip);
+int  proc_call(struct t_context *ctx, struct t_proc *ptr);
+void proc_reloc(struct t_context *ctx);
+
+/* REGION.C */
+void region_mark(struct t_context *ctx);
+void region_save(struct t_context *ctx, struct t_region *r);
+void region_load(struct t_context *ctx, struct t_region *r);
+int  region_run(struct t_context *ctx);
+int  region_flush(struct t_context *ctx, struct t_regjob *job, struct t_region **start, int p, int i, int nb);
+int  region_start(struct t_context *ctx, struct t_regjob *job, struct t_region *start, int end);
+void region_threads(struct t_regjob *job, int nb);
+void region_keep(struct t_context *ctx, struct t_context *w);
+void region_free(struct t_regjob *job);
+void *region_worker(void *arg);
+void region_abort(struct t_context *ctx);
+void region_check(struct t_context *ctx, int *ptr, int value);
+void region_set(struct t_context *ctx, int *ptr, int value);
+void region_call(struct t_context *ctx, struct t_proc *proc);
+
+/* SHARED.C */
+struct t_shared *shared_new(void);
+void shared_free(struct t_shared *sh);
+struct t_shfile *shared_search(struct t_shared *sh, char *path);
+struct t_shfile *shared_load(struct t_shared *sh, char *path, FILE *fp);
+int  shared_invalidate(struct t_shared *sh, char *path);
+struct t_dir    *shared_dir(struct t_shared *sh, char *path);
+void shared_flush_dirs(struct t_shared *sh);
+struct t_image  *shared_image(struct t_shared *sh, struct t_shfile *file);
+struct t_image  *shared_set_image(struct t_shared *sh, struct t_shfile *file, struct t_image *image);
+struct t_source *shared_source(struct t_shared *sh, struct t_shfile *file);
+struct t_source *shared_set_source(struct t_shared *sh, struct t_shfile *file, struct t_source *src);
+
+/* SNAPSHOT.C */
+int  snap_save(struct t_context *ctx, struct t_buffer *buf);
+int  snap_load(struct t_context *ctx, char *name);
+void snap_apply(struct t_context *ctx);
+int  snap_skip(struct t_context *ctx, char *name);
+struct t_symbol *snap_label(struct t_context *ctx, char *name);
+void snap_put_int(struct t_buffer *buf, int val);
+void snap_put_str(struct t_buffer *buf, char *str);
+void snap_put_sym(struct t_buffer *buf, struct t_symbol *sym);
+int  snap_get_int(struct t_stream *st);
+void snap_get_str(struct t_stream *st, char *str, int max);
+struct t_symbol *snap_get_sym(struct t_context *ctx, struct t_stream *st);
 
 /* SYMBOL.C */
-int  symhash(void);
-int  colsym(int *ip);
-struct t_symbol *stlook(int flag);
-struct t_symbol *stinstall(int hash, int type);
-int  labldef(int lval, int flag);
-void lablset(char *name, int val);
-int  lablexists(char *name);
-void lablremap(void);
-void labldump(FILE *fp);
+int  symhash(struct t_context *ctx);
+int  colsym(struct t_context *ctx, int *ip);
+int  setsym(struct t_context *ctx, int pos, int len);
+int  chksym(struct t_context *ctx);
+struct t_symbol *stlook(struct t_context *ctx, int flag);
+struct t_symbol *stlookh(struct t_context *ctx, unsigned int hash, int flag);
+struct t_symbol *stinstall(struct t_context *ctx, unsigned int hash, int type);
+unsigned int st_hash(char *name);
+struct t_symbol *st_search(struct t_symindex *idx, char *name, unsigned int hash);
+int  st_index(struct t_symindex *idx, struct t_symbol *sym, int min);
+int  st_add(struct t_symtab *tbl, struct t_symbol *sym);
+void st_free(struct t_symtab *tbl);
+char *name_look(struct t_namepool *pool, char *name, unsigned int hash);
+char *name_intern(struct t_namepool *pool, char *name, unsigned int hash);
+void  name_free(struct t_namepool *pool);
+int  labldef(struct t_context *ctx, int lval, int flag);
+void lablsize(struct t_context *ctx, int type, int size);
+void lablset(struct t_context *ctx, char *name, int val);
+int  lablexists(struct t_context *ctx, char *name);
+void lablremap(struct t_context *ctx);
+void labldump(struct t_context *ctx, struct t_buffer *buf);
 
+/* WATCH.C */
+int  watch_run(int argc, char **argv);
+int  watch_add(struct t_watch *watch, char *path);
+int  watch_wait(struct t_watch *watch, struct t_shared *sh, char *in_fname);
+int  watch_prefix(char *name, char *buf, int max);
+void watch_snapshot(struct t_watch *watch, struct t_context *ctx, struct t_shared *shared,
+					char *prefix, int len, int argc, char **argv);
+void watch_drop(struct t_watch *watch);
+int  watch_uses(struct t_watch *watch, char *path);
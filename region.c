@@ -0,0 +1,571 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+/* part of a region state compared with the next boundary */
+#define REGION_CMP	(sizeof(struct t_region) - offsetof(struct t_region, infile_num))
+
+
+/* ----
+ * region_mark()
+ * ----
+ * keep the state of the first pass at a region boundary, a region
+ * starts with a source line outside of a macro, a proc or a
+ * disabled block
+ */
+
+void
+region_mark(struct t_context *ctx)
+{
+	int last, i;
+
+	if (ctx->pass != FIRST_PASS)
+		return;
+
+	/* not before the next step */
+	last = ctx->region_nb ? ctx->region[ctx->region_nb - 1].line : 0;
+	if (ctx->line_cnt < last + ctx->region_step)
+		return;
+	if (ctx->expand_macro || ctx->in_macro || ctx->proc_ptr ||
+		ctx->skip_lines || (ctx->infile_num == 0))
+		return;
+
+	if (ctx->region == NULL) {
+		ctx->region = (void *)malloc(REGION_MAX * sizeof(struct t_region));
+		if (ctx->region == NULL) {
+			ctx->region_step = 0;
+			return;
+		}
+	}
+
+	/* too many boundaries, keep every other one */
+	if (ctx->region_nb == REGION_MAX) {
+		for (i = 0; i < REGION_MAX / 2; i++)
+			ctx->region[i] = ctx->region[2 * i + 1];
+		ctx->region_nb = REGION_MAX / 2;
+		ctx->region_step *= 2;
+		return;
+	}
+
+	region_save(ctx, &ctx->region[ctx->region_nb++]);
+}
+
+
+/* ----
+ * region_save()
+ * ----
+ * get the state carried from a line to the next one
+ */
+
+void
+region_save(struct t_context *ctx, struct t_region *r)
+{
+	int i;
+
+	/* cleared, the states are compared */
+	memset(r, 0, sizeof(struct t_region));
+
+	r->line = ctx->line_cnt;
+	if (ctx->in_region)
+		r->label_size = ctx->region_size;
+	else
+		r->label_size = ctx->lastlabl ? ctx->lastlabl->ext->data_size : 0;
+
+	/* input */
+	r->infile_num = ctx->infile_num;
+	for (i = 1; i <= ctx->infile_num; i++) {
+		r->input_file[i].src = ctx->input_file[i].src;
+		r->input_file[i].lnum = ctx->input_file[i].lnum;
+		r->input_file[i].if_level = ctx->input_file[i].if_level;
+		strcpy(r->input_file[i].name, ctx->input_file[i].name);
+	}
+	r->slnum = ctx->slnum;
+
+	/* location */
+	r->page = ctx->page;
+	r->bank = ctx->bank;
+	r->loccnt = ctx->loccnt;
+	r->section = ctx->section;
+	memcpy(r->section_bank, ctx->section_bank, sizeof(r->section_bank));
+	memcpy(r->bank_loccnt, ctx->bank_loccnt, sizeof(r->bank_loccnt));
+	memcpy(r->bank_page, ctx->bank_page, sizeof(r->bank_page));
+	memcpy(r->bank_glabl, ctx->bank_glabl, sizeof(r->bank_glabl));
+	r->glablptr = ctx->glablptr;
+	r->lastlabl = ctx->lastlabl;
+	r->skip_start = ctx->skip_start;
+	r->rsbase = ctx->rsbase;
+	r->proc_nb = ctx->proc_nb;
+
+	/* macro counters */
+	r->mcounter = ctx->mcounter;
+	r->mcntmax = ctx->mcntmax;
+	r->mcntlast = ctx->mcntlast;
+	strcpy(r->mcntstr, ctx->mcntstr);
+
+	/* options */
+	r->xlist = ctx->xlist;
+	memcpy(r->asm_opt, ctx->asm_opt, sizeof(r->asm_opt));
+
+	/* conditional assembly */
+	r->in_if = ctx->in_if;
+	r->if_level = ctx->if_level;
+	for (i = 0; i <= ctx->if_level; i++) {
+		r->if_state[i] = ctx->if_state[i];
+		r->if_flag[i] = ctx->if_flag[i];
+	}
+}
+
+
+/* ----
+ * region_load()
+ * ----
+ * restore the state of a region boundary
+ */
+
+void
+region_load(struct t_context *ctx, struct t_region *r)
+{
+	int i;
+
+	ctx->line_cnt = r->line;
+
+	/* input */
+	ctx->infile_num = r->infile_num;
+	for (i = 1; i <= r->infile_num; i++)
+		ctx->input_file[i] = r->input_file[i];
+	ctx->slnum = r->slnum;
+
+	/* location */
+	ctx->page = r->page;
+	ctx->bank = r->bank;
+	ctx->loccnt = r->loccnt;
+	ctx->section = r->section;
+	memcpy(ctx->section_bank, r->section_bank, sizeof(r->section_bank));
+	memcpy(ctx->bank_loccnt, r->bank_loccnt, sizeof(r->bank_loccnt));
+	memcpy(ctx->bank_page, r->bank_page, sizeof(r->bank_page));
+	memcpy(ctx->bank_glabl, r->bank_glabl, sizeof(r->bank_glabl));
+	ctx->glablptr = r->glablptr;
+	ctx->lastlabl = r->lastlabl;
+	if (ctx->in_region)
+		ctx->region_size = r->label_size;
+	else if (ctx->lastlabl)
+		ctx->lastlabl->ext->data_size = r->label_size;
+	ctx->skip_start = r->skip_start;
+	ctx->rsbase = r->rsbase;
+	ctx->proc_nb = r->proc_nb;
+
+	/* macro counters */
+	ctx->mcounter = r->mcounter;
+	ctx->mcntmax = r->mcntmax;
+	ctx->mcntlast = r->mcntlast;
+	strcpy(ctx->mcntstr, r->mcntstr);
+
+	/* options */
+	ctx->xlist = r->xlist;
+	memcpy(ctx->asm_opt, r->asm_opt, sizeof(r->asm_opt));
+
+	/* conditional assembly */
+	ctx->in_if = r->in_if;
+	ctx->if_level = r->if_level;
+	for (i = 0; i <= r->if_level; i++) {
+		ctx->if_state[i] = r->if_state[i];
+		ctx->if_flag[i] = r->if_flag[i];
+	}
+}
+
+
+/* ----
+ * region_run()
+ * ----
+ * assemble the regions of the last pass in parallel, each one in
+ * a copy of the context, and keep them in order; one that fails
+ * is assembled again in the context; return 1 if the whole pass
+ * was assembled
+ */
+
+int
+region_run(struct t_context *ctx)
+{
+	struct t_region *start[REGION_JOBS];
+	struct t_region first;
+	struct t_regjob *job;
+	struct t_context *w;
+	int total, jobs;
+	int valid, p;
+	int nb, i, j;
+
+	/* the boundaries are only used by the last pass */
+	if ((ctx->pass != LAST_PASS) || (ctx->region_step == 0))
+		return (0);
+
+	/* regions of about the same number of lines */
+	jobs = (ctx->jobs < REGION_JOBS) ? ctx->jobs : REGION_JOBS;
+	total = ctx->region_nb ? ctx->region[ctx->region_nb - 1].line + ctx->region_step : 0;
+	ctx->region_step = 0;
+
+	region_save(ctx, &first);
+	start[0] = &first;
+	nb = 1;
+	for (i = 0; (i < ctx->region_nb) && (nb < jobs); i++) {
+		if (ctx->region[i].line >= total / jobs * nb)
+			start[nb++] = &ctx->region[i];
+	}
+	if (nb < 2) {
+		msg_printf(ctx, "   (Note. The last pass is too short for more than one thread)\n");
+		return (0);
+	}
+	if ((job = (void *)calloc(nb, sizeof(struct t_regjob))) == NULL)
+		return (0);
+
+	/* the contexts of the regions, a region doing something
+	 * else is assembled again in this context
+	 */
+	for (i = 0; i < nb; i++) {
+		if (!region_start(ctx, &job[i], start[i], (i + 1 < nb) ? start[i + 1]->line : 0))
+			break;
+	}
+	region_threads(job, nb);
+
+	/* keep them in order, a region that can not be kept is
+	 * assembled again in this context; the next one is kept
+	 * if it starts from the state the first pass found there
+	 */
+	valid = 1;
+	p = 0;
+	for (i = 0; i < nb; i++) {
+		w = job[i].ctx;
+		if (valid && job[i].ok) {
+			/* the code of its far calls is added in order,
+			 * it is assembled again if it called a new one
+			 */
+			if (ctx->max_bank < w->max_bank)
+				ctx->max_bank = w->max_bank;
+			for (j = 0; j < w->call_nb; j++)
+				proc_call(ctx, w->reg_call[j]);
+			job[i].redo = (w->call_nb != 0);
+			region_load(ctx, &job[i].end);
+		}
+		else {
+			/* the regions before it are kept first */
+			if ((j = region_flush(ctx, job, start, p, i, nb)) >= 0) {
+				region_load(ctx, start[j]);
+				pass_run(ctx);
+				break;
+			}
+			p = i + 1;
+			region_free(&job[i]);
+			ctx->region_end = (i + 1 < nb) ? start[i + 1]->line : 0;
+			pass_run(ctx);
+			ctx->region_end = 0;
+			region_save(ctx, &job[i].end);
+		}
+		if (ctx->stop_pass || (i + 1 == nb) || (ctx->line_cnt != start[i + 1]->line)) {
+			if ((j = region_flush(ctx, job, start, p, i + 1, nb)) >= 0) {
+				region_load(ctx, start[j]);
+				pass_run(ctx);
+			}
+			break;
+		}
+		valid = !memcmp(&job[i].end.infile_num, &start[i + 1]->infile_num, REGION_CMP);
+	}
+
+	/* free the contexts */
+	for (i = 0; i < nb; i++)
+		region_free(&job[i]);
+	free(job);
+	return (1);
+}
+
+
+/* ----
+ * region_flush()
+ * ----
+ * keep the regions from 'p' to 'i' in order, the ones that called
+ * a new proc are assembled again now that its code is set; return
+ * the first one that can't be kept, -1 if they are all kept
+ */
+
+int
+region_flush(struct t_context *ctx, struct t_regjob *job, struct t_region **start, int p, int i, int nb)
+{
+	int k;
+
+	for (k = p; k < i; k++) {
+		if (job[k].redo) {
+			region_free(&job[k]);
+			region_start(ctx, &job[k], start[k], (k + 1 < nb) ? start[k + 1]->line : 0);
+		}
+	}
+	region_threads(&job[p], i - p);
+
+	for (k = p; k < i; k++) {
+		if (!job[k].ok || job[k].ctx->call_nb)
+			return (k);
+		region_keep(ctx, job[k].ctx);
+		region_free(&job[k]);
+	}
+	return (-1);
+}
+
+
+/* ----
+ * region_start()
+ * ----
+ * make the context of a region, a copy of the context sharing
+ * its files and its symbols; return 0 if out of memory
+ */
+
+int
+region_start(struct t_context *ctx, struct t_regjob *job, struct t_region *start, int end)
+{
+	struct t_context *w;
+
+	job->ok = 0;
+	job->redo = 0;
+	if ((w = (void *)malloc(sizeof(struct t_context))) == NULL)
+		return (0);
+	memcpy(w, ctx, sizeof(struct t_context));
+	w->in_region = 1;
+	w->region = NULL;
+	w->region_nb = 0;
+	w->region_end = end;
+	w->reg_write = NULL;
+	w->reg_nb = 0;
+	w->reg_max = 0;
+	w->reg_call = NULL;
+	w->call_nb = 0;
+	w->call_max = 0;
+	w->errcnt = 0;
+	w->stop_pass = 0;
+	w->msg_fp = NULL;
+	memset(&w->msg_buf, 0, sizeof(struct t_buffer));
+	memset(&w->lst_buf, 0, sizeof(struct t_buffer));
+	memset(&w->sym_buf, 0, sizeof(struct t_buffer));
+	memset(&w->out_buf, 0, sizeof(struct t_buffer));
+	memset(&w->sym_arena, 0, sizeof(struct t_arena));
+	memset(&w->symext_arena, 0, sizeof(struct t_arena));
+	memset(&w->macro_arena, 0, sizeof(struct t_arena));
+	memset(&w->func_arena, 0, sizeof(struct t_arena));
+	memset(&w->proc_arena, 0, sizeof(struct t_arena));
+	memset(&w->expr_arena, 0, sizeof(struct t_arena));
+	memset(&w->fix_arena, 0, sizeof(struct t_arena));
+	w->prefetch = NULL;
+	w->pcx_buf = NULL;
+	w->pcx_shared = 0;
+	w->pcx_name[0] = '\0';
+	region_load(w, start);
+	job->ctx = w;
+	return (1);
+}
+
+
+/* ----
+ * region_threads()
+ * ----
+ * assemble the regions not assembled yet, in this thread if there
+ * are no threads
+ */
+
+void
+region_threads(struct t_regjob *job, int nb)
+{
+	int i;
+
+#ifndef WIN32
+	for (i = 0; i < nb; i++) {
+		job[i].started = 0;
+		if (job[i].ctx && !job[i].ok)
+			if (pthread_create(&job[i].thread, NULL, region_worker, &job[i]) == 0)
+				job[i].started = 1;
+	}
+#endif
+	for (i = 0; i < nb; i++) {
+#ifndef WIN32
+		if (job[i].started) {
+			pthread_join(job[i].thread, NULL);
+			continue;
+		}
+#endif
+		if (job[i].ctx && !job[i].ok)
+			region_worker(&job[i]);
+	}
+}
+
+
+/* ----
+ * region_keep()
+ * ----
+ * add the outputs of a region to the context
+ */
+
+void
+region_keep(struct t_context *ctx, struct t_context *w)
+{
+	int i, j;
+
+	/* rom, the bytes it wrote */
+	for (i = 0; i < 128; i++) {
+		for (j = 0; j < 8192; j++) {
+			if (w->map[i][j] != 0xFF) {
+				ctx->rom[i][j] = w->rom[i][j];
+				ctx->map[i][j] = w->map[i][j];
+			}
+		}
+	}
+	if (ctx->max_bank < w->max_bank)
+		ctx->max_bank = w->max_bank;
+
+	/* listing and symbols */
+	if (w->lst_buf.size)
+		buf_write(&ctx->lst_buf, w->lst_buf.data, w->lst_buf.size);
+	for (i = 0; i < w->reg_nb; i++)
+		*w->reg_write[i].ptr = w->reg_write[i].value;
+}
+
+
+/* ----
+ * region_free()
+ * ----
+ * free the context of a region
+ */
+
+void
+region_free(struct t_regjob *job)
+{
+	struct t_context *w;
+
+	if ((w = job->ctx) == NULL)
+		return;
+	buf_free(&w->msg_buf);
+	buf_free(&w->lst_buf);
+	arena_free(&w->sym_arena);
+	arena_free(&w->symext_arena);
+	arena_free(&w->macro_arena);
+	arena_free(&w->func_arena);
+	arena_free(&w->proc_arena);
+	arena_free(&w->expr_arena);
+	arena_free(&w->fix_arena);
+	if (!w->pcx_shared)
+		free(w->pcx_buf);
+	free(w->reg_write);
+	free(w->reg_call);
+	free(w);
+	job->ctx = NULL;
+}
+
+
+/* ----
+ * region_worker()
+ * ----
+ * assemble a region, it can be kept if it reached its end
+ * without errors
+ */
+
+void *
+region_worker(void *arg)
+{
+	struct t_regjob *job = arg;
+	struct t_context *ctx = job->ctx;
+
+	pass_run(ctx);
+
+	job->ok = !ctx->region_err && !ctx->errcnt && !ctx->stop_pass &&
+			  ((ctx->region_end == 0) || (ctx->line_cnt == ctx->region_end));
+	region_save(ctx, &job->end);
+	return (NULL);
+}
+
+
+/* ----
+ * region_abort()
+ * ----
+ * stop a region that must be assembled again after the others,
+ * its messages are given by that assembly
+ */
+
+void
+region_abort(struct t_context *ctx)
+{
+	ctx->region_err = 1;
+	ctx->stop_pass = 1;
+}
+
+
+/* ----
+ * region_check()
+ * ----
+ * set a symbol field, a region can only check that it already
+ * has the value found by the first pass
+ */
+
+void
+region_check(struct t_context *ctx, int *ptr, int value)
+{
+	if (!ctx->in_region)
+		*ptr = value;
+	else if (*ptr != value)
+		region_abort(ctx);
+}
+
+
+/* ----
+ * region_set()
+ * ----
+ * set a symbol field only used by the last pass, a region sets
+ * it when it's kept
+ */
+
+void
+region_set(struct t_context *ctx, int *ptr, int value)
+{
+	struct t_regwrite *list;
+
+	if (!ctx->in_region) {
+		*ptr = value;
+		return;
+	}
+	if (*ptr == value)
+		return;
+
+	if (ctx->reg_nb == ctx->reg_max) {
+		list = (void *)realloc(ctx->reg_write, (ctx->reg_max + 64) * sizeof(struct t_regwrite));
+		if (list == NULL) {
+			region_abort(ctx);
+			return;
+		}
+		ctx->reg_write = list;
+		ctx->reg_max += 64;
+	}
+	ctx->reg_write[ctx->reg_nb].ptr = ptr;
+	ctx->reg_write[ctx->reg_nb].value = value;
+	ctx->reg_nb++;
+}
+
+
+/* ----
+ * region_call()
+ * ----
+ * keep a call to a proc in another bank that has no code yet,
+ * it's added when the region is kept
+ */
+
+void
+region_call(struct t_context *ctx, struct t_proc *proc)
+{
+	struct t_proc **list;
+
+	if (ctx->call_nb == ctx->call_max) {
+		list = (void *)realloc(ctx->reg_call, (ctx->call_max + 64) * sizeof(struct t_proc *));
+		if (list == NULL) {
+			region_abort(ctx);
+			return;
+		}
+		ctx->reg_call = list;
+		ctx->call_max += 64;
+	}
+	ctx->reg_call[ctx->call_nb++] = proc;
+}
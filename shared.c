@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+/* the store is only used by one thread on windows */
+#ifdef WIN32
+#define shared_lock(sh)
+#define shared_unlock(sh)
+#else
+#define shared_lock(sh)   pthread_mutex_lock(&(sh)->lock)
+#define shared_unlock(sh) pthread_mutex_unlock(&(sh)->lock)
+#endif
+
+
+/* ----
+ * shared_new()
+ * ----
+ * create a store for the files shared by several assemblies,
+ * it can be used by assemblies running in different threads
+ */
+
+struct t_shared *
+shared_new(void)
+{
+	struct t_shared *sh;
+
+	if ((sh = (void *)calloc(1, sizeof(struct t_shared))) == NULL)
+		return (NULL);
+
+#ifndef WIN32
+	if (pthread_mutex_init(&sh->lock, NULL)) {
+		free(sh);
+		return (NULL);
+	}
+#endif
+	return (sh);
+}
+
+
+/* ----
+ * shared_free()
+ * ----
+ * free a shared store and all its files, the assemblies
+ * using it must have been deleted before
+ */
+
+void
+shared_free(struct t_shared *sh)
+{
+	struct t_shfile *file, *next;
+
+	if (sh == NULL)
+		return;
+
+	for (file = sh->file_list; file; file = next) {
+		next = file->next;
+		if (file->image) {
+			free(file->image->buf);
+			free(file->image);
+		}
+		src_free(file->src);
+		free(file->data);
+		free(file);
+	}
+	dir_free(sh->dir_list);
+
+#ifndef WIN32
+	pthread_mutex_destroy(&sh->lock);
+#endif
+	free(sh);
+}
+
+
+/* ----
+ * shared_search()
+ * ----
+ * search a file in the shared store, the store must be locked
+ */
+
+struct t_shfile *
+shared_search(struct t_shared *sh, char *path)
+{
+	struct t_shfile *file;
+
+	for (file = sh->file_list; file; file = file->next) {
+		if (!strcmp(file->path, path))
+			return (file);
+	}
+	return (NULL);
+}
+
+
+/* ----
+ * shared_load()
+ * ----
+ * get a file from the shared store, 'fp' is the file found
+ * in the include path; it is only read if no other assembly
+ * loaded it before
+ */
+
+struct t_shfile *
+shared_load(struct t_shared *sh, char *path, FILE *fp)
+{
+	struct t_shfile *file, *found;
+	int size;
+
+	/* search the file */
+	shared_lock(sh);
+	file = shared_search(sh, path);
+	shared_unlock(sh);
+
+	if (file)
+		return (file);
+
+	/* read it, the store is not locked while reading
+	 * so other assemblies are not blocked
+	 */
+	if ((file = (void *)calloc(1, sizeof(struct t_shfile))) == NULL)
+		return (NULL);
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if ((file->data = (void *)malloc(size + 1)) == NULL) {
+		free(file);
+		return (NULL);
+	}
+	file->size = fread(file->data, 1, size, fp);
+	strncpy(file->path, path, sizeof(file->path) - 1);
+
+	/* add it, unless another assembly was faster */
+	shared_lock(sh);
+	if ((found = shared_search(sh, path)) == NULL) {
+		file->next = sh->file_list;
+		sh->file_list = file;
+	}
+	shared_unlock(sh);
+
+	if (found) {
+		free(file->data);
+		free(file);
+		return (found);
+	}
+	return (file);
+}
+
+
+/* ----
+ * shared_invalidate()
+ * ----
+ * remove a file that was modified from the shared store, it will
+ * be read again by the next assembly; the assemblies using it must
+ * have been deleted before; return 1 if the file was in the store
+ */
+
+int
+shared_invalidate(struct t_shared *sh, char *path)
+{
+	struct t_shfile *file, **last;
+
+	shared_lock(sh);
+	for (last = &sh->file_list; (file = *last) != NULL; last = &file->next) {
+		if (!strcmp(file->path, path)) {
+			*last = file->next;
+			break;
+		}
+	}
+	shared_unlock(sh);
+
+	if (file == NULL)
+		return (0);
+
+	if (file->image) {
+		free(file->image->buf);
+		free(file->image);
+	}
+	src_free(file->src);
+	free(file->data);
+	free(file);
+	return (1);
+}
+
+
+/* ----
+ * shared_dir()
+ * ----
+ * get the content of a directory, it is only read once for
+ * all the assemblies; return NULL if it can not be read
+ */
+
+struct t_dir *
+shared_dir(struct t_shared *sh, char *path)
+{
+	struct t_dir *dir, *found;
+
+	/* search the directory */
+	shared_lock(sh);
+	for (dir = sh->dir_list; dir; dir = dir->next) {
+		if (!strcmp(dir->path, path))
+			break;
+	}
+	shared_unlock(sh);
+
+	if (dir)
+		return (dir);
+
+	/* read it, unlocked like the files */
+	if ((dir = dir_load(path)) == NULL)
+		return (NULL);
+
+	shared_lock(sh);
+	for (found = sh->dir_list; found; found = found->next) {
+		if (!strcmp(found->path, path))
+			break;
+	}
+	if (found == NULL) {
+		dir->next = sh->dir_list;
+		sh->dir_list = dir;
+	}
+	shared_unlock(sh);
+
+	if (found) {
+		dir->next = NULL;
+		dir_free(dir);
+		return (found);
+	}
+	return (dir);
+}
+
+
+/* ----
+ * shared_flush_dirs()
+ * ----
+ * forget the directory contents, files may have been added
+ * or removed; the assemblies using the store must have been
+ * deleted before
+ */
+
+void
+shared_flush_dirs(struct t_shared *sh)
+{
+	shared_lock(sh);
+	dir_free(sh->dir_list);
+	sh->dir_list = NULL;
+	shared_unlock(sh);
+}
+
+
+/* ----
+ * shared_image()
+ * ----
+ * get the decoded picture of a shared file, NULL if the file
+ * was not decoded yet
+ */
+
+struct t_image *
+shared_image(struct t_shared *sh, struct t_shfile *file)
+{
+	struct t_image *image;
+
+	shared_lock(sh);
+	image = file->image;
+	shared_unlock(sh);
+
+	return (image);
+}
+
+
+/* ----
+ * shared_set_image()
+ * ----
+ * keep the decoded picture of a shared file, return the
+ * picture to use; the one given is freed if the file was
+ * decoded in the meantime
+ */
+
+struct t_image *
+shared_set_image(struct t_shared *sh, struct t_shfile *file, struct t_image *image)
+{
+	struct t_image *found;
+
+	shared_lock(sh);
+	if ((found = file->image) == NULL)
+		file->image = image;
+	shared_unlock(sh);
+
+	if (found) {
+		free(image->buf);
+		free(image);
+		return (found);
+	}
+	return (image);
+}
+
+
+/* ----
+ * shared_source()
+ * ----
+ * get the lines of a shared file, NULL if the file was not
+ * split yet; the assemblies use copies of its line index
+ */
+
+struct t_source *
+shared_source(struct t_shared *sh, struct t_shfile *file)
+{
+	struct t_source *src;
+
+	shared_lock(sh);
+	src = file->src;
+	shared_unlock(sh);
+
+	return (src);
+}
+
+
+/* ----
+ * shared_set_source()
+ * ----
+ * keep the lines of a shared file, return the lines to use;
+ * the ones given are freed if the file was split in the
+ * meantime
+ */
+
+struct t_source *
+shared_set_source(struct t_shared *sh, struct t_shfile *file, struct t_source *src)
+{
+	struct t_source *found;
+
+	shared_lock(sh);
+	if ((found = file->src) == NULL)
+		file->src = src;
+	shared_unlock(sh);
+
+	if (found) {
+		src_free(src);
+		return (found);
+	}
+	return (src);
+}
@@ -0,0 +1,596 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+
+#define SNAP_MAGIC "pceas-snapshot 5"
+
+
+/* ----
+ * snap_save()
+ * ----
+ * save the symbols, macros and functions defined by the files
+ * just assembled, and the state of the sections at the end of
+ * the assembly; the files must not generate code or data
+ */
+
+int
+snap_save(struct t_context *ctx, struct t_buffer *buf)
+{
+	struct t_symbol *sym, *local;
+	struct t_macro *macro;
+	struct t_line *line;
+	struct t_func *func;
+	struct t_source *src, *root;
+	struct t_file *file;
+	unsigned long long hash;
+	char *base;
+	int nb, i, j;
+
+	/* only declarations can be kept */
+	for (i = 0; i < 128; i++) {
+		for (j = 0; j < 8192; j++) {
+			if (ctx->map[i][j] != 0xFF) {
+				msg_printf(ctx, "A snapshot can not contain code or data!\n");
+				return (1);
+			}
+		}
+	}
+	for (i = 0; i < 256; i++) {
+		if (ctx->proc_tbl[i]) {
+			msg_printf(ctx, "A snapshot can not contain procs!\n");
+			return (1);
+		}
+	}
+
+	/* header, the predefined symbols must be the same */
+	buf->size = 0;
+	buf_write(buf, SNAP_MAGIC, strlen(SNAP_MAGIC) + 1);
+	snap_put_int(buf, ctx->machine->type);
+	snap_put_int(buf, ctx->develo_opt | ctx->mx_opt);
+	snap_put_int(buf, ctx->cd_opt | ctx->scd_opt);
+
+	/* sections */
+	snap_put_int(buf, ctx->rsbase);
+	snap_put_int(buf, ctx->mcntmax);
+	snap_put_int(buf, ctx->max_zp);
+	snap_put_int(buf, ctx->max_bss);
+	snap_put_int(buf, ctx->section);
+	snap_put_int(buf, ctx->bank);
+	snap_put_int(buf, ctx->page);
+	snap_put_int(buf, ctx->loccnt);
+	snap_put_str(buf, ctx->glablptr ? ctx->glablptr->name : "");
+
+	for (i = 0; i < 4; i++) {
+		j = ctx->section_bank[i];
+		snap_put_int(buf, j);
+		snap_put_int(buf, ctx->bank_loccnt[i][j]);
+		snap_put_int(buf, ctx->bank_page[i][j]);
+		snap_put_str(buf, ctx->bank_glabl[i][j] ? ctx->bank_glabl[i][j]->name : "");
+	}
+
+	/* files, they are checked when the snapshot is used */
+	for (nb = 0, file = ctx->file_list; file; file = file->next)
+		nb += file->path[0] ? 1 : 0;
+	snap_put_int(buf, nb);
+
+	for (file = ctx->file_list; file; file = file->next) {
+		if (file->path[0] == '\0')
+			continue;
+		hash = 0xcbf29ce484222325ULL;
+		hash = cache_hash(hash, file->data, file->size);
+		snap_put_str(buf, file->path);
+		snap_put_int(buf, (int)(hash & 0xFFFFFFFF));
+		snap_put_int(buf, (int)(hash >> 32));
+	}
+
+	/* sources, they are not included again; the file the
+	 * snapshot is made from, the first one opened, is also
+	 * included by its name in the include paths
+	 */
+	root = NULL;
+	for (nb = 0, src = ctx->src_list; src; src = src->next) {
+		root = src;
+		nb++;
+	}
+	base = root ? strrchr(root->name, PATH_SEPARATOR) : NULL;
+	snap_put_int(buf, base ? nb + 1 : nb);
+
+	for (src = ctx->src_list; src; src = src->next)
+		snap_put_str(buf, src->name);
+	if (base)
+		snap_put_str(buf, base + 1);
+
+	/* symbols */
+	snap_put_int(buf, ctx->sym_tbl.nb);
+
+	for (i = 0; i < ctx->sym_tbl.nb; i++) {
+		sym = ctx->sym_tbl.list[i];
+		if (sym->ext->proc) {
+			msg_printf(ctx, "A snapshot can not contain procs!\n");
+			return (1);
+		}
+		snap_put_sym(buf, sym);
+
+		for (nb = 0, local = sym->local; local; local = local->next)
+			nb++;
+		snap_put_int(buf, nb);
+
+		for (local = sym->local; local; local = local->next)
+			snap_put_sym(buf, local);
+	}
+
+	/* macros */
+	for (i = 0; i < 256; i++) {
+		for (nb = 0, macro = ctx->macro_tbl[i]; macro; macro = macro->next)
+			nb++;
+		snap_put_int(buf, nb);
+
+		for (macro = ctx->macro_tbl[i]; macro; macro = macro->next) {
+			snap_put_str(buf, macro->name);
+
+			for (nb = 0, line = macro->line; line; line = line->next)
+				nb++;
+			snap_put_int(buf, nb);
+
+			for (line = macro->line; line; line = line->next)
+				snap_put_str(buf, line->data);
+		}
+	}
+
+	/* functions */
+	for (i = 0; i < 256; i++) {
+		for (nb = 0, func = ctx->func_tbl[i]; func; func = func->next)
+			nb++;
+		snap_put_int(buf, nb);
+
+		for (func = ctx->func_tbl[i]; func; func = func->next) {
+			snap_put_str(buf, func->name);
+			snap_put_str(buf, func->line);
+		}
+	}
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * snap_load()
+ * ----
+ * load a snapshot before the first pass, as if the files it
+ * was made of were included at the beginning of the source;
+ * return 1 on error
+ */
+
+int
+snap_load(struct t_context *ctx, char *name)
+{
+	struct t_symbol *sym, *local, *found;
+	struct t_symbol **last_local;
+	struct t_macro *macro, **last_macro;
+	struct t_line *line, **last_line;
+	struct t_func *func, **last_func;
+	struct t_snapshot *snap;
+	struct t_stream st;
+	struct t_file *file;
+	unsigned long long hash, h;
+	char  str[256];
+	int   nb, nb_lines, i, j, k;
+
+	if ((file = open_file(ctx, name)) == NULL) {
+		msg_printf(ctx, "Can not open snapshot '%s'!\n", name);
+		return (1);
+	}
+	if ((snap = (void *)calloc(1, sizeof(struct t_snapshot))) == NULL) {
+		msg_printf(ctx, "Not enough memory!\n");
+		return (1);
+	}
+	ctx->snap = snap;
+
+	st.ptr = file->data;
+	st.end = file->data + file->size;
+	st.error = 0;
+
+	/* header */
+	if ((file->size < (int)sizeof(SNAP_MAGIC)) || memcmp(file->data, SNAP_MAGIC, sizeof(SNAP_MAGIC))) {
+		msg_printf(ctx, "'%s' is not a snapshot!\n", name);
+		return (1);
+	}
+	st.ptr += sizeof(SNAP_MAGIC);
+
+	if ((snap_get_int(&st) != ctx->machine->type) ||
+		(snap_get_int(&st) != (ctx->develo_opt | ctx->mx_opt)) ||
+		(snap_get_int(&st) != (ctx->cd_opt | ctx->scd_opt))) {
+		msg_printf(ctx, "Snapshot '%s' was made for other options!\n", name);
+		return (1);
+	}
+
+	/* sections */
+	snap->rsbase  = snap_get_int(&st);
+	snap->mcntmax = snap_get_int(&st);
+	ctx->max_zp   = snap_get_int(&st);
+	ctx->max_bss  = snap_get_int(&st);
+	snap->section = snap_get_int(&st) & 3;
+	snap->bank    = snap_get_int(&st) & 0xFF;
+	snap->page    = snap_get_int(&st);
+	snap->loccnt  = snap_get_int(&st);
+	snap_get_str(&st, snap->glabl, SBOLSZ);
+
+	for (i = 0; i < 4; i++) {
+		snap->section_bank[i] = snap_get_int(&st) & 0xFF;
+		snap->bank_loccnt[i]  = snap_get_int(&st);
+		snap->bank_page[i]    = snap_get_int(&st);
+		snap_get_str(&st, snap->bank_glabl[i], SBOLSZ);
+	}
+
+	/* check that the files didn't change */
+	nb = snap_get_int(&st);
+	for (i = 0; (i < nb) && !st.error; i++) {
+		snap_get_str(&st, str, sizeof(str));
+		hash  = (unsigned int)snap_get_int(&st);
+		hash |= (unsigned long long)(unsigned int)snap_get_int(&st) << 32;
+		if (!cache_filehash(str, &h) || (h != hash)) {
+			msg_printf(ctx, "Snapshot '%s' is out of date, '%s' was modified!\n", name, str);
+			return (1);
+		}
+	}
+
+	/* sources */
+	nb = snap_get_int(&st);
+	if ((nb < 0) || (nb > file->size)) {
+		msg_printf(ctx, "Snapshot '%s' is corrupted!\n", name);
+		return (1);
+	}
+	if ((snap->names = (void *)malloc((nb + 1) * sizeof(snap->names[0]))) == NULL) {
+		msg_printf(ctx, "Not enough memory!\n");
+		return (1);
+	}
+	for (i = 0; (i < nb) && !st.error; i++)
+		snap_get_str(&st, snap->names[i], sizeof(snap->names[0]));
+	snap->nb_names = nb;
+
+	/* symbols, in the same order; the predefined
+	 * symbols already exist
+	 */
+	nb = snap_get_int(&st);
+
+	for (i = 0; (i < nb) && !st.error; i++) {
+		if ((sym = snap_get_sym(ctx, &st)) == NULL)
+			break;
+
+		/* predefined symbol */
+		if ((found = st_search(&ctx->sym_tbl.idx, sym->name, sym->hash)) != NULL) {
+			found->refcnt += sym->refcnt;
+			sym = found;
+		}
+		else if (!st_add(&ctx->sym_tbl, sym))
+			break;
+
+		/* locals */
+		last_local = &sym->local;
+		k = snap_get_int(&st);
+
+		for (; (k > 0) && !st.error; k--) {
+			if ((local = snap_get_sym(ctx, &st)) == NULL)
+				break;
+			if (!st_index(&sym->ext->local_idx, local, 16))
+				break;
+			*last_local = local;
+			last_local = &local->next;
+		}
+		*last_local = NULL;
+		if (k > 0)
+			break;
+	}
+	if (i < nb)
+		st.error = 1;
+
+	/* macros */
+	for (i = 0; (i < 256) && !st.error; i++) {
+		last_macro = &ctx->macro_tbl[i];
+		nb = snap_get_int(&st);
+
+		for (j = 0; (j < nb) && !st.error; j++) {
+			if ((macro = arena_alloc(&ctx->macro_arena, sizeof(struct t_macro))) == NULL)
+				break;
+			memset(macro, 0, sizeof(struct t_macro));
+			*last_macro = macro;
+			last_macro = &macro->next;
+			snap_get_str(&st, str, SBOLSZ);
+			if ((macro->name = name_intern(&ctx->names, str, st_hash(str))) == NULL)
+				break;
+
+			last_line = &macro->line;
+			nb_lines = snap_get_int(&st);
+
+			for (k = 0; (k < nb_lines) && !st.error; k++) {
+				snap_get_str(&st, str, sizeof(str));
+				if ((line = arena_alloc(&ctx->macro_arena, sizeof(struct t_line))) == NULL)
+					break;
+				memset(line, 0, sizeof(struct t_line));
+				if ((line->data = arena_strdup(&ctx->macro_arena, str)) == NULL)
+					break;
+				if (!macro_parseline(ctx, line))
+					break;
+				*last_line = line;
+				last_line = &line->next;
+			}
+			if (k < nb_lines)
+				break;
+		}
+		if (j < nb)
+			st.error = 1;
+	}
+
+	/* functions */
+	for (i = 0; (i < 256) && !st.error; i++) {
+		last_func = &ctx->func_tbl[i];
+		nb = snap_get_int(&st);
+
+		for (j = 0; (j < nb) && !st.error; j++) {
+			if ((func = arena_alloc(&ctx->func_arena, sizeof(struct t_func))) == NULL) {
+				st.error = 1;
+				break;
+			}
+			memset(func, 0, sizeof(struct t_func));
+			*last_func = func;
+			last_func = &func->next;
+			snap_get_str(&st, str, SBOLSZ);
+			if ((func->name = name_intern(&ctx->names, str, st_hash(str))) == NULL) {
+				st.error = 1;
+				break;
+			}
+			snap_get_str(&st, func->line, sizeof(func->line));
+		}
+	}
+
+	if (st.error) {
+		msg_printf(ctx, "Snapshot '%s' is corrupted!\n", name);
+		return (1);
+	}
+
+	/* get the labels of the sections */
+	snap->glablptr = snap_label(ctx, snap->glabl);
+	for (i = 0; i < 4; i++)
+		snap->bank_glablptr[i] = snap_label(ctx, snap->bank_glabl[i]);
+
+	/* ok */
+	return (0);
+}
+
+
+/* ----
+ * snap_apply()
+ * ----
+ * restore the state of the sections at the beginning of a pass
+ */
+
+void
+snap_apply(struct t_context *ctx)
+{
+	struct t_snapshot *snap = ctx->snap;
+	int i, bank;
+
+	for (i = 0; i < 4; i++) {
+		bank = snap->section_bank[i];
+		ctx->section_bank[i] = bank;
+		ctx->bank_loccnt[i][bank] = snap->bank_loccnt[i];
+		ctx->bank_page[i][bank] = snap->bank_page[i];
+		ctx->bank_glabl[i][bank] = snap->bank_glablptr[i];
+	}
+	ctx->section  = snap->section;
+	ctx->bank     = snap->bank;
+	ctx->page     = snap->page;
+	ctx->loccnt   = snap->loccnt;
+	ctx->glablptr = snap->glablptr;
+	ctx->rsbase   = snap->rsbase;
+	ctx->mcntmax  = snap->mcntmax;
+}
+
+
+/* ----
+ * snap_skip()
+ * ----
+ * check if an include file is part of the snapshot
+ */
+
+int
+snap_skip(struct t_context *ctx, char *name)
+{
+	int i;
+
+	if (ctx->snap == NULL)
+		return (0);
+
+	for (i = 0; i < ctx->snap->nb_names; i++) {
+		if (!strcmp(ctx->snap->names[i], name))
+			return (1);
+	}
+	return (0);
+}
+
+
+/* ----
+ * snap_label()
+ * ----
+ * get a global label of the snapshot
+ */
+
+struct t_symbol *
+snap_label(struct t_context *ctx, char *name)
+{
+	unsigned int hash;
+
+	if (name[0] == '\0')
+		return (NULL);
+
+	hash = st_hash(name);
+	if ((name = name_look(&ctx->names, name, hash)) == NULL)
+		return (NULL);
+
+	return (st_search(&ctx->sym_tbl.idx, name, hash));
+}
+
+
+/* ----
+ * snap_put_int()
+ * ----
+ * write a 32-bit value, little-endian
+ */
+
+void
+snap_put_int(struct t_buffer *buf, int val)
+{
+	unsigned char tmp[4];
+
+	tmp[0] = val;
+	tmp[1] = val >> 8;
+	tmp[2] = val >> 16;
+	tmp[3] = val >> 24;
+	buf_write(buf, tmp, 4);
+}
+
+
+/* ----
+ * snap_put_str()
+ * ----
+ * write a string with its length
+ */
+
+void
+snap_put_str(struct t_buffer *buf, char *str)
+{
+	int len;
+
+	len = strlen(str);
+	snap_put_int(buf, len);
+	buf_write(buf, str, len);
+}
+
+
+/* ----
+ * snap_put_sym()
+ * ----
+ * write a symbol, its name starts with its length
+ */
+
+void
+snap_put_sym(struct t_buffer *buf, struct t_symbol *sym)
+{
+	buf_write(buf, sym->name, sym->name[0] + 1);
+	snap_put_int(buf, sym->type);
+	snap_put_int(buf, sym->value);
+	snap_put_int(buf, sym->bank);
+	snap_put_int(buf, sym->page);
+	snap_put_int(buf, sym->nb);
+	snap_put_int(buf, sym->size);
+	snap_put_int(buf, sym->ext->vram);
+	snap_put_int(buf, sym->ext->pal);
+	snap_put_int(buf, sym->refcnt);
+	snap_put_int(buf, sym->ext->reserved);
+	snap_put_int(buf, sym->ext->data_type);
+	snap_put_int(buf, sym->ext->data_size);
+}
+
+
+/* ----
+ * snap_get_int()
+ * ----
+ * read a 32-bit value
+ */
+
+int
+snap_get_int(struct t_stream *st)
+{
+	unsigned char *ptr = st->ptr;
+
+	if ((st->end - ptr) < 4) {
+		st->error = 1;
+		return (0);
+	}
+	st->ptr += 4;
+	return ((int)(ptr[0] | (ptr[1] << 8) | (ptr[2] << 16) | ((unsigned int)ptr[3] << 24)));
+}
+
+
+/* ----
+ * snap_get_str()
+ * ----
+ * read a string
+ */
+
+void
+snap_get_str(struct t_stream *st, char *str, int max)
+{
+	int len;
+
+	len = snap_get_int(st);
+	if ((len < 0) || (len >= max) || ((st->end - st->ptr) < len)) {
+		st->error = 1;
+		len = 0;
+	}
+	memcpy(str, st->ptr, len);
+	str[len] = '\0';
+	st->ptr += len;
+}
+
+
+/* ----
+ * snap_get_sym()
+ * ----
+ * read a symbol, return NULL on error
+ */
+
+struct t_symbol *
+snap_get_sym(struct t_context *ctx, struct t_stream *st)
+{
+	struct t_symbol *sym;
+	struct t_symext *ext;
+	char name[SBOLSZ + 1];
+	int len;
+
+	if ((st->ptr == st->end) || ((len = *st->ptr) >= SBOLSZ) || ((st->end - st->ptr) <= len)) {
+		st->error = 1;
+		return (NULL);
+	}
+	if ((sym = arena_alloc(&ctx->sym_arena, sizeof(struct t_symbol))) == NULL) {
+		st->error = 1;
+		return (NULL);
+	}
+	if ((ext = arena_alloc(&ctx->symext_arena, sizeof(struct t_symext))) == NULL) {
+		st->error = 1;
+		return (NULL);
+	}
+	memset(sym, 0, sizeof(struct t_symbol));
+	memset(ext, 0, sizeof(struct t_symext));
+	memcpy(name, st->ptr, len + 1);
+	name[len + 1] = '\0';
+	st->ptr += len + 1;
+
+	sym->ext  = ext;
+	sym->hash = st_hash(name);
+	if ((sym->name = name_intern(&ctx->names, name, sym->hash)) == NULL) {
+		st->error = 1;
+		return (NULL);
+	}
+
+	sym->type = snap_get_int(st);
+	sym->value = snap_get_int(st);
+	sym->bank = snap_get_int(st);
+	sym->page = snap_get_int(st);
+	sym->nb = snap_get_int(st);
+	sym->size = snap_get_int(st);
+	sym->ext->vram = snap_get_int(st);
+	sym->ext->pal = snap_get_int(st);
+	sym->refcnt = snap_get_int(st);
+	sym->ext->reserved = snap_get_int(st);
+	sym->ext->data_type = snap_get_int(st);
+	sym->ext->data_size = snap_get_int(st);
+
+	if (st->error)
+		return (NULL);
+	return (sym);
+}
@@ -14,15 +14,15 @@
  */
 
 int
-symhash(void)
+symhash(struct t_context *ctx)
 {
 	int i;
 	char c;
 	int hash = 0;
 
 	/* hash value */
-	for (i = 1; i <= symbol[0]; i++) {
-		c = symbol[i];
+	for (i = 1; i <= ctx->symbol[0]; i++) {
+		c = ctx->symbol[i];
 		hash += c;
 		hash  = (hash << 3) + (hash >> 5) + c;
 	}
@@ -41,35 +41,80 @@ symhash(void)
  */
 
 int
-colsym(int *ip)
+colsym(struct t_context *ctx, int *ip)
 {
-	int  err = 0;
 	int	 i = 0;
 	char c;
 	char local_check;
 
 	/* get the symbol */
-    local_check=prlnbuf[*ip];
+    local_check=ctx->prlnbuf[*ip];
 	for (;;) {
-		c = prlnbuf[*ip];
-		if (isdigit(c) && (i == 0))
+		c = ctx->prlnbuf[*ip];
+		if ((cclass(c) & CC_DIGIT) && (i == 0))
 			break;
-		if (!isalnum(c) && (c != '_') && (c != '.') && (c != '@'))
+		if (!(cclass(c) & (CC_ALNUM | CC_SYM)))
 		{ if((local_check=='.' || local_check=='@') && ((c=='-') || (c=='+')))
             { }
           else { break;}
 		}
 		if (i < (SBOLSZ - 1))
-			symbol[++i] = c;
+			ctx->symbol[++i] = c;
 		(*ip)++;
 	}
 
-	symbol[0] = i;
-	symbol[i+1] = '\0';
+	ctx->symbol[0] = i;
+	ctx->symbol[i+1] = '\0';
 
 	/* check if it's a reserved symbol */
-	if (i == 1) {
-		switch (toupper(symbol[1])) {
+	if (!chksym(ctx))
+		return (0);
+
+	/* ok */
+	return (i);
+}
+
+
+/* ----
+ * setsym()
+ * ----
+ * copy a symbol found by the line analysis into symbol[],
+ * returns 0 if it's a reserved symbol
+ */
+
+int
+setsym(struct t_context *ctx, int pos, int len)
+{
+	if (len > (SBOLSZ - 1))
+		len = SBOLSZ - 1;
+
+	ctx->symbol[0] = len;
+	memcpy(&ctx->symbol[1], &ctx->prlnbuf[pos], len);
+	ctx->symbol[len + 1] = '\0';
+
+	/* check if it's a reserved symbol */
+	if (!chksym(ctx))
+		return (0);
+
+	/* ok */
+	return (len);
+}
+
+
+/* ----
+ * chksym()
+ * ----
+ * check that the symbol in symbol[] is not a register
+ * or a function name, returns 0 if it is
+ */
+
+int
+chksym(struct t_context *ctx)
+{
+	int err = 0;
+
+	if (ctx->symbol[0] == 1) {
+		switch (cc_upper[(unsigned char)ctx->symbol[1]]) {
 		case 'A':
 		case 'X':
 		case 'Y':
@@ -77,19 +122,19 @@ colsym(int *ip)
 			break;
 		}
 	}
-	if (check_keyword())
+	if (check_keyword(ctx))
 		err = 1;
 
 	/* error */
 	if (err) {
-		fatal_error("Reserved symbol!");
+		fatal_error(ctx, "Reserved symbol!");
 //		symbol[0] = 0;
 //		symbol[1] = '\0';
 		return (0);
 	}
 
 	/* ok */
-	return (i);
+	return (1);
 }
 
 
@@ -101,34 +146,42 @@ colsym(int *ip)
  * else, install symbol as undefined and return pointer
  */
 
-struct t_symbol *stlook(int flag)
+struct t_symbol *stlook(struct t_context *ctx, int flag)
+{
+	return (stlookh(ctx, st_hash(ctx->symbol), flag));
+}
+
+
+/* ----
+ * stlookh()
+ * ----
+ * symbol table lookup, when the hash of the symbol
+ * is already known
+ */
+
+struct t_symbol *stlookh(struct t_context *ctx, unsigned int hash, int flag)
 {
 	struct t_symbol *sym;
 	int sym_flag = 0;
-	int hash;
+	char *name;
 
 	/* local symbol */
-	if (symbol[1] == '.' || symbol[1] == '@') {
-		if (glablptr) {
-			/* search the symbol in the local list */
-			sym = glablptr->local;
-
-			while (sym) {
-				if (!strcmp(symbol, sym->name))
-					break;
-				sym = sym->next;
-			}
+	if (ctx->symbol[1] == '.' || ctx->symbol[1] == '@') {
+		if (ctx->glablptr) {
+			/* search the symbol in the scope of the global symbol */
+			name = name_look(&ctx->names, ctx->symbol, hash);
+			sym  = name ? st_search(&ctx->glablptr->ext->local_idx, name, hash) : NULL;
 
 			/* new symbol */
 			if (sym == NULL) {
 				if (flag) {
-					sym = stinstall(0, 1);
+					sym = stinstall(ctx, hash, 1);
 					sym_flag = 1;
 				}
 			}
 		}
 		else {
-			error("Local symbol not allowed here!");
+			error(ctx, "Local symbol not allowed here!");
 			return (NULL);
 		}
 	}
@@ -136,25 +189,22 @@ struct t_symbol *stlook(int flag)
 	/* global symbol */
 	else {
 		/* search symbol */
-		hash = symhash();
-		sym  = hash_tbl[hash];
-		while (sym) {
-			if (!strcmp(symbol, sym->name))
-				break;
-			sym = sym->next;
-		}
+		name = name_look(&ctx->names, ctx->symbol, hash);
+		sym  = name ? st_search(&ctx->sym_tbl.idx, name, hash) : NULL;
 
 		/* new symbol */
 		if (sym == NULL) {
 			if (flag) {
-				sym = stinstall(hash, 0);
+				sym = stinstall(ctx, hash, 0);
 				sym_flag = 1;
 			}
 		}
 	}
 
-	/* incremente symbol reference counter */
-	if (sym_flag == 0) {
+	/* incremente symbol reference counter, not in the
+	 * regions of a parallel last pass, they share it
+	 */
+	if ((sym_flag == 0) && !ctx->in_region) {
 		if (sym)
 			sym->refcnt++;
 	}
@@ -170,43 +220,69 @@ struct t_symbol *stlook(int flag)
  * install symbol into symbol hash table
  */
 
-struct t_symbol *stinstall(int hash, int type)
+struct t_symbol *stinstall(struct t_context *ctx, unsigned int hash, int type)
 {
 	struct t_symbol *sym;
+	struct t_symext *ext;
+
+	/* a region of a parallel last pass can't add a symbol,
+	 * it's assembled again in order
+	 */
+	if (ctx->in_region) {
+		region_abort(ctx);
+		return (NULL);
+	}
 
 	/* allocate symbol structure */
-	if ((sym = (void *)malloc(sizeof(struct t_symbol))) == NULL) {
-		fatal_error("Out of memory!");
+	sym = arena_alloc(&ctx->sym_arena, sizeof(struct t_symbol));
+	ext = arena_alloc(&ctx->symext_arena, sizeof(struct t_symext));
+	if ((sym == NULL) || (ext == NULL)) {
+		fatal_error(ctx, "Out of memory!");
+		return (NULL);
+	}
+	if ((sym->name = name_intern(&ctx->names, ctx->symbol, hash)) == NULL) {
+		fatal_error(ctx, "Out of memory!");
 		return (NULL);
 	}
 
 	/* init the symbol struct */
-	sym->type  = if_expr ? IFUNDEF : UNDEF;
+	sym->type  = ctx->if_expr ? IFUNDEF : UNDEF;
 	sym->value = 0;
 	sym->local = NULL;
-	sym->proc  = NULL;
+	sym->ext   = ext;
 	sym->bank  = RESERVED_BANK;
 	sym->nb    = 0;
 	sym->size  = 0;
 	sym->page  = -1;
-	sym->vram  = -1;
-	sym->pal   = -1;
 	sym->refcnt = 0;
-	sym->reserved = 0;
-	sym->data_type = -1;
-	sym->data_size = 0;
-	strcpy(sym->name, symbol);
+	sym->hash = hash;
+
+	/* rarely used fields */
+	memset(&ext->local_idx, 0, sizeof(struct t_symindex));
+	ext->proc  = NULL;
+	ext->vram  = -1;
+	ext->pal   = -1;
+	ext->reserved = 0;
+	ext->data_type = -1;
+	ext->data_size = 0;
 
 	/* add the symbol to the hash table */
 	if (type) {
 		/* local */
-		sym->next = glablptr->local;
-		glablptr->local = sym;
+		if (!st_index(&ctx->glablptr->ext->local_idx, sym, 16)) {
+			fatal_error(ctx, "Out of memory!");
+			return (NULL);
+		}
+		sym->next = ctx->glablptr->local;
+		ctx->glablptr->local = sym;
 	}
 	else {
 		/* global */
-		sym->next = hash_tbl[hash];
-		hash_tbl[hash] = sym;
+		sym->next = NULL;
+		if (!st_add(&ctx->sym_tbl, sym)) {
+			fatal_error(ctx, "Out of memory!");
+			return (NULL);
+		}
 	}
 
 	/* ok */
@@ -214,6 +290,246 @@ struct t_symbol *stinstall(int hash, int type)
 }
 
 
+/* ----
+ * st_hash()
+ * ----
+ * 32-bit FNV-1a hash of a symbol name, the name
+ * starts with its length
+ */
+
+unsigned int
+st_hash(char *name)
+{
+	unsigned char *ptr = (unsigned char *)&name[1];
+	unsigned int hash = 0x811c9dc5;
+	int len = (unsigned char)name[0];
+
+	while (len--) {
+		hash ^= *ptr++;
+		hash *= 0x01000193;
+	}
+	return (hash);
+}
+
+
+/* ----
+ * st_search()
+ * ----
+ * search a symbol in an index, the name must be
+ * interned so only the pointers are compared
+ */
+
+struct t_symbol *
+st_search(struct t_symindex *idx, char *name, unsigned int hash)
+{
+	struct t_symslot *slot;
+	unsigned int i;
+
+	if (idx->size == 0)
+		return (NULL);
+
+	for (i = hash;; i++) {
+		slot = &idx->slot[i & (idx->size - 1)];
+		if (slot->sym == NULL)
+			return (NULL);
+		if (slot->sym->name == name)
+			return (slot->sym);
+	}
+}
+
+
+/* ----
+ * st_index()
+ * ----
+ * add a symbol to an index, the symbol must not be already
+ * in it; the index starts with 'min' slots and is grown when
+ * half full, return 0 if there is not enough memory
+ */
+
+int
+st_index(struct t_symindex *idx, struct t_symbol *sym, int min)
+{
+	struct t_symslot *slot;
+	unsigned int i;
+	int size, n;
+
+	/* grow the index, all the symbols are indexed again */
+	if ((idx->nb + 1) * 2 > idx->size) {
+		size = idx->size ? (idx->size * 2) : min;
+		if ((slot = (void *)calloc(size, sizeof(struct t_symslot))) == NULL)
+			return (0);
+
+		for (n = 0; n < idx->size; n++) {
+			if (idx->slot[n].sym == NULL)
+				continue;
+			for (i = idx->slot[n].hash; slot[i & (size - 1)].sym; i++)
+				;
+			slot[i & (size - 1)] = idx->slot[n];
+		}
+		free(idx->slot);
+		idx->slot = slot;
+		idx->size = size;
+	}
+
+	/* add the symbol */
+	for (i = sym->hash; idx->slot[i & (idx->size - 1)].sym; i++)
+		;
+	idx->slot[i & (idx->size - 1)].hash = sym->hash;
+	idx->slot[i & (idx->size - 1)].sym  = sym;
+	idx->nb++;
+
+	/* ok */
+	return (1);
+}
+
+
+/* ----
+ * st_add()
+ * ----
+ * add a global symbol, the symbol must not be already
+ * in the table; return 0 if there is not enough memory
+ */
+
+int
+st_add(struct t_symtab *tbl, struct t_symbol *sym)
+{
+	struct t_symbol **list;
+	int n;
+
+	/* grow the list */
+	if (tbl->nb == tbl->max) {
+		n = tbl->max ? (tbl->max * 2) : 1024;
+		if ((list = (void *)realloc(tbl->list, n * sizeof(struct t_symbol *))) == NULL)
+			return (0);
+		tbl->list = list;
+		tbl->max = n;
+	}
+
+	/* index the symbol */
+	if (!st_index(&tbl->idx, sym, 2048))
+		return (0);
+
+	/* ok */
+	tbl->list[tbl->nb++] = sym;
+	return (1);
+}
+
+
+/* ----
+ * st_free()
+ * ----
+ * free the symbol table, the symbols themselves
+ * are in the symbol arena
+ */
+
+void
+st_free(struct t_symtab *tbl)
+{
+	int i;
+
+	for (i = 0; i < tbl->nb; i++)
+		free(tbl->list[i]->ext->local_idx.slot);
+	free(tbl->list);
+	free(tbl->idx.slot);
+	memset(tbl, 0, sizeof(struct t_symtab));
+}
+
+
+/* ----
+ * name_look()
+ * ----
+ * search a name in the name pool, the name starts with
+ * its length; return NULL if it was never interned
+ */
+
+char *
+name_look(struct t_namepool *pool, char *name, unsigned int hash)
+{
+	struct t_nameslot *slot;
+	unsigned int i;
+
+	if (pool->size == 0)
+		return (NULL);
+
+	for (i = hash;; i++) {
+		slot = &pool->slot[i & (pool->size - 1)];
+		if (slot->name == NULL)
+			return (NULL);
+		if ((slot->hash == hash) && !memcmp(slot->name, name, name[0] + 1))
+			return (slot->name);
+	}
+}
+
+
+/* ----
+ * name_intern()
+ * ----
+ * get the pooled copy of a name, the same name always
+ * gives the same pointer; return NULL if there is not
+ * enough memory
+ */
+
+char *
+name_intern(struct t_namepool *pool, char *name, unsigned int hash)
+{
+	struct t_nameslot *slot;
+	unsigned int i;
+	char *str;
+	int size, n;
+
+	if ((str = name_look(pool, name, hash)) != NULL)
+		return (str);
+
+	/* grow the index when half full */
+	if ((pool->nb + 1) * 2 > pool->size) {
+		size = pool->size ? (pool->size * 2) : 4096;
+		if ((slot = (void *)calloc(size, sizeof(struct t_nameslot))) == NULL)
+			return (NULL);
+
+		for (n = 0; n < pool->size; n++) {
+			if (pool->slot[n].name == NULL)
+				continue;
+			for (i = pool->slot[n].hash; slot[i & (size - 1)].name; i++)
+				;
+			slot[i & (size - 1)] = pool->slot[n];
+		}
+		free(pool->slot);
+		pool->slot = slot;
+		pool->size = size;
+	}
+
+	/* copy the name, with its null char */
+	if ((str = arena_alloc(&pool->arena, name[0] + 2)) == NULL)
+		return (NULL);
+	memcpy(str, name, name[0] + 1);
+	str[name[0] + 1] = '\0';
+
+	for (i = hash; pool->slot[i & (pool->size - 1)].name; i++)
+		;
+	pool->slot[i & (pool->size - 1)].hash = hash;
+	pool->slot[i & (pool->size - 1)].name = str;
+	pool->nb++;
+
+	/* ok */
+	return (str);
+}
+
+
+/* ----
+ * name_free()
+ * ----
+ * free all the names
+ */
+
+void
+name_free(struct t_namepool *pool)
+{
+	free(pool->slot);
+	arena_free(&pool->arena);
+	memset(pool, 0, sizeof(struct t_namepool));
+}
+
+
 /* ----
  * labldef()
  * ----
@@ -222,91 +538,109 @@ struct t_symbol *stinstall(int hash, int type)
  */
 
 int
-labldef(int lval, int flag)
+labldef(struct t_context *ctx, int lval, int flag)
 {
+	struct t_proc *proc;
+	int  bank;
 	char c;
 
 	/* check for NULL ptr */
-	if (lablptr == NULL)
+	if (ctx->lablptr == NULL)
 		return (0);
 
 	/* adjust symbol address */
 	if (flag)
-		lval = (lval & 0x1FFF) | (page << 13);
+		lval = (lval & 0x1FFF) | (ctx->page << 13);
 
-	/* first pass */
-	if (pass == FIRST_PASS) {
-		switch (lablptr->type) {
+	/* first pass, or single pass */
+	if ((ctx->pass == FIRST_PASS) || ctx->single_pass) {
+		switch (ctx->lablptr->type) {
 		/* undefined */
 		case UNDEF:
-			lablptr->type = DEFABS;
-			lablptr->value = lval;
+			ctx->lablptr->type = DEFABS;
+			ctx->lablptr->value = lval;
 			break;
 
 		/* already defined - error */
 		case IFUNDEF:
-			error("Can not define this label, declared as undefined in an IF expression!");
+			error(ctx, "Can not define this label, declared as undefined in an IF expression!");
 			return (-1);
 
 		case MACRO:
-			error("Symbol already used by a macro!");
+			error(ctx, "Symbol already used by a macro!");
 			return (-1);
 
 		case FUNC:
-			error("Symbol already used by a function!");
+			error(ctx, "Symbol already used by a function!");
 			return (-1);
 
 		default:
 			/* reserved label */
-			if (lablptr->reserved) {
-				fatal_error("Reserved symbol!");
+			if (ctx->lablptr->ext->reserved) {
+				fatal_error(ctx, "Reserved symbol!");
 				return (-1);
 			}
 
-			/* compare the values */
-			if (lablptr->value == lval)
+			/* compare the values, a label moved to another bank
+			 * is a phase error the single pass can't see, it's
+			 * given up so the last pass reports it
+			 */
+			if (ctx->lablptr->value == lval) {
+				if (ctx->single_pass && flag && (ctx->bank < ctx->bank_limit) &&
+				   (ctx->lablptr->bank != ctx->bank_base + ctx->bank))
+					fixup_abort(ctx);
 				break;
+			}
 
 			/* normal label */
-			lablptr->type = MDEF;
-			lablptr->value = 0;
-			error("Label multiply defined!");
+			ctx->lablptr->type = MDEF;
+			ctx->lablptr->value = 0;
+			error(ctx, "Label multiply defined!");
 			return (-1);
 		}
 	}
 
 	/* second pass */
 	else {
-		if ((lablptr->value != lval) ||
-		   ((flag) && (bank < bank_limit) && (lablptr->bank  != bank_base + bank)))
+		if ((ctx->lablptr->value != lval) ||
+		   ((flag) && (ctx->bank < ctx->bank_limit) && (ctx->lablptr->bank  != ctx->bank_base + ctx->bank)))
 		{
-			fatal_error("Internal error[1]!");
+			fatal_error(ctx, "Internal error[1]!");
 			return (-1);
 		}
 	}
 
-	/* update symbol data */
+	/* update symbol data, a region of a parallel last pass
+	 * only checks it
+	 */
 	if (flag) {
-		if (section == S_CODE)
-			lablptr->proc = proc_ptr;
+		proc = (ctx->section == S_CODE) ? ctx->proc_ptr : ctx->lablptr->ext->proc;
 
-		if ((section == S_BSS) || (section == S_ZP))
-		{
-			lablptr->bank = bank;
-		} else {
-			lablptr->bank = bank_base + bank;
+		if ((ctx->section == S_BSS) || (ctx->section == S_ZP))
+			bank = ctx->bank;
+		else
+			bank = ctx->bank_base + ctx->bank;
+
+		if (!ctx->in_region) {
+			ctx->lablptr->ext->proc = proc;
+			ctx->lablptr->bank = bank;
+			ctx->lablptr->page = ctx->page;
 		}
-		lablptr->page = page;
+		else if ((ctx->lablptr->ext->proc != proc) || (ctx->lablptr->bank != bank) ||
+				 (ctx->lablptr->page != ctx->page))
+			region_abort(ctx);
 
 		/* check if it's a local or global symbol */
-		c = lablptr->name[1];
+		c = ctx->lablptr->name[1];
 		if (c == '.' || c == '@')
 			/* local */
-			lastlabl = NULL;
+			ctx->lastlabl = NULL;
 		else {
 			/* global */
-			glablptr = lablptr;
-			lastlabl = lablptr;
+			ctx->glablptr = ctx->lablptr;
+			ctx->lastlabl = ctx->lablptr;
+			if (ctx->in_region)
+				ctx->region_size = ctx->lablptr->ext->data_size;
 		}
 	}
 
@@ -315,6 +649,45 @@ labldef(int lval, int flag)
 }
 
 
+/* ----
+ * lablsize()
+ * ----
+ * set the size attributes of the label of the line, or add
+ * the size to the last label if it has the same type; the
+ * regions of a parallel last pass only keep the size of the
+ * last label
+ */
+
+void
+lablsize(struct t_context *ctx, int type, int size)
+{
+	if (ctx->in_region) {
+		if (ctx->lablptr) {
+			if (ctx->lablptr->ext->data_type != type)
+				region_abort(ctx);
+			else if (ctx->lablptr == ctx->lastlabl)
+				ctx->region_size = size;
+		}
+		else {
+			if (ctx->lastlabl && (ctx->lastlabl->ext->data_type == type))
+				ctx->region_size += size;
+		}
+		return;
+	}
+
+	if (ctx->lablptr) {
+		ctx->lablptr->ext->data_type = type;
+		ctx->lablptr->ext->data_size = size;
+	}
+	else {
+		if (ctx->lastlabl) {
+			if (ctx->lastlabl->ext->data_type == type)
+				ctx->lastlabl->ext->data_size += size;
+		}
+	}
+}
+
+
 /* ----
  * lablset()
  * ----
@@ -322,22 +695,22 @@ labldef(int lval, int flag)
  */
 
 void
-lablset(char *name, int val)
+lablset(struct t_context *ctx, char *name, int val)
 {
 	int len;
 
 	len = strlen(name);
-	lablptr = NULL;
+	ctx->lablptr = NULL;
 
 	if (len) {
-		symbol[0] = len;
-		strcpy(&symbol[1], name);
-		lablptr = stlook(1);
-
-		if (lablptr) {
-			lablptr->type = DEFABS;
-			lablptr->value = val;
-			lablptr->reserved = 1;
+		ctx->symbol[0] = len;
+		strcpy(&ctx->symbol[1], name);
+		ctx->lablptr = stlook(ctx, 1);
+
+		if (ctx->lablptr) {
+			ctx->lablptr->type = DEFABS;
+			ctx->lablptr->value = val;
+			ctx->lablptr->ext->reserved = 1;
 		}
 	}
 
@@ -353,19 +726,19 @@ lablset(char *name, int val)
  */
 
 int
-lablexists(char *name)
+lablexists(struct t_context *ctx, char *name)
 {
 	int len;
 
 	len = strlen(name);
-	lablptr = NULL;
+	ctx->lablptr = NULL;
 
 	if (len) {
-		symbol[0] = len;
-		strcpy(&symbol[1], name);
-		lablptr = stlook(1);
+		ctx->symbol[0] = len;
+		strcpy(&ctx->symbol[1], name);
+		ctx->lablptr = stlook(ctx, 1);
 
-		if (lablptr) {
+		if (ctx->lablptr) {
 			return(1);
 		}
 	}
@@ -380,35 +753,31 @@ lablexists(char *name)
  */
 
 void
-lablremap(void)
+lablremap(struct t_context *ctx)
 {
 	struct t_symbol *sym;
 	struct t_symbol *local;
 	int i;
 
 	/* browse the symbol table */
-	for (i = 0; i < 256; i++) {
-		sym = hash_tbl[i];
-		while (sym) {
-			/* remap the bank */
-			if (sym->bank <= bank_limit)
-				sym->bank += bank_base;
-
-			/* local symbols */
-			if (sym->local) {
-				local = sym->local;
-
-				while  (local) {
-					if (local->bank <= bank_limit)
-						local->bank += bank_base;
-
-					/* next */
-					local = local->next;
-				}
-			}
+	for (i = 0; i < ctx->sym_tbl.nb; i++) {
+		sym = ctx->sym_tbl.list[i];
+
+		/* remap the bank */
+		if (sym->bank <= ctx->bank_limit)
+			sym->bank += ctx->bank_base;
+
+		/* local symbols */
+		if (sym->local) {
+			local = sym->local;
+
+			while  (local) {
+				if (local->bank <= ctx->bank_limit)
+					local->bank += ctx->bank_base;
 
-			/* next */
-			sym = sym->next;
+				/* next */
+				local = local->next;
+			}
 		}
 	}
 }
@@ -420,48 +789,44 @@ lablremap(void)
  */
 
 void
-labldump(FILE *fp)
+labldump(struct t_context *ctx, struct t_buffer *buf)
 {
 	struct t_symbol *sym;
 	struct t_symbol *local;
 	int i;
 
-	fprintf(fp, "Label\t\t\t\tAddr\tBank\n");
-	fprintf(fp, "-----\t\t\t\t----\t----\n");
-
-	/* browse the symbol table */
-	for (i = 0; i < 256; i++) {
-		sym = hash_tbl[i];
-		while (sym) {
-			/* dump the label */
-			fprintf(fp, "%s\t", &(sym->name[1]));
-			if (strlen(&(sym->name[1])) < 8)
-				fprintf(fp, "\t");
-			if (strlen(&(sym->name[1])) < 16)
-				fprintf(fp, "\t");
-			if (strlen(&(sym->name[1])) < 24)
-				fprintf(fp, "\t");
-			fprintf(fp, "%4.4x\t %2.2x\n", sym->value, sym->bank);
-
-			/* local symbols */
-			if (sym->local) {
-				local = sym->local;
-
-				while  (local) {
-					fprintf(fp, "\t%s\t", &(local->name[1]));
-					if (strlen(&(local->name[1])) < 8)
-						fprintf(fp, "\t");
-					if (strlen(&(local->name[1])) < 16)
-						fprintf(fp, "\t");
-					fprintf(fp, "%4.4x\t %2.2x\n", local->value, local->bank);
-
-					/* next */
-					local = local->next;
-				}
+	buf_printf(buf, "Label\t\t\t\tAddr\tBank\n");
+	buf_printf(buf, "-----\t\t\t\t----\t----\n");
+
+	/* browse the symbol table, in definition order */
+	for (i = 0; i < ctx->sym_tbl.nb; i++) {
+		sym = ctx->sym_tbl.list[i];
+
+		/* dump the label */
+		buf_printf(buf, "%s\t", &(sym->name[1]));
+		if (strlen(&(sym->name[1])) < 8)
+			buf_printf(buf, "\t");
+		if (strlen(&(sym->name[1])) < 16)
+			buf_printf(buf, "\t");
+		if (strlen(&(sym->name[1])) < 24)
+			buf_printf(buf, "\t");
+		buf_printf(buf, "%4.4x\t %2.2x\n", sym->value, sym->bank);
+
+		/* local symbols */
+		if (sym->local) {
+			local = sym->local;
+
+			while  (local) {
+				buf_printf(buf, "\t%s\t", &(local->name[1]));
+				if (strlen(&(local->name[1])) < 8)
+					buf_printf(buf, "\t");
+				if (strlen(&(local->name[1])) < 16)
+					buf_printf(buf, "\t");
+				buf_printf(buf, "%4.4x\t %2.2x\n", local->value, local->bank);
+
+				/* next */
+				local = local->next;
 			}
-
-			/* next */
-			sym = sym->next;
 		}
 	}
 }
@@ -0,0 +1,7 @@
+#ifndef PCEAS_VERSION_H
+#define PCEAS_VERSION_H
+
+#define NES_ASM_VERSION ("NES Assembler (3.22, " __DATE__ ")")
+#define PCE_ASM_VERSION ("PC Engine Assembler 3.22, " __DATE__ ")")
+
+#endif /* PCEAS_VERSION_H */
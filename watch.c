@@ -0,0 +1,433 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "defs.h"
+#include "externs.h"
+#include "protos.h"
+#include "pceas.h"
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+/* delay to wait for the other changes of a save, in ms */
+#define WATCH_DELAY	50
+
+/* in-memory files of the snapshot */
+#define WATCH_SRC	"#watch.asm"
+#define WATCH_SNAP	"#watch.snp"
+
+
+#ifdef __linux__
+
+/* ----
+ * watch_run()
+ * ----
+ * resident mode, assemble the input file and assemble it again
+ * each time one of the files it uses is modified; the include
+ * files, their lines and the decoded pictures stay in memory
+ * between the builds, only the modified files are read again;
+ * the declarations of the files included at the start of the
+ * input file are kept in a snapshot
+ */
+
+int
+watch_run(int argc, char **argv)
+{
+	struct t_context *ctx;
+	struct t_shfile *file;
+	struct t_shared *shared;
+	struct t_watch *watch;
+	struct timespec start, end;
+	char  in_fname[256];
+	char  prefix[4096];
+	int   len, ret;
+
+	if ((shared = pceas_shared_new()) == NULL) {
+		printf("Not enough memory!\n");
+		return (1);
+	}
+	if ((watch = (void *)calloc(1, sizeof(struct t_watch))) == NULL) {
+		pceas_shared_delete(shared);
+		printf("Not enough memory!\n");
+		return (1);
+	}
+	if ((watch->fd = inotify_init()) < 0) {
+		free(watch);
+		pceas_shared_delete(shared);
+		printf("Can not watch the files!\n");
+		return (1);
+	}
+
+	for (;;) {
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		/* each build uses a new context, the options are
+		 * parsed again; the build cache is not used as the
+		 * files are already in memory
+		 */
+		if ((ctx = new_context()) == NULL) {
+			printf("Not enough memory!\n");
+			break;
+		}
+		get_options(ctx, argc, argv);
+		ctx->cache_dir[0] = '\0';
+		pceas_set_shared(ctx, shared);
+		init_path(ctx);
+		strcpy(in_fname, ctx->in_fname);
+
+		/* the snapshot is made again if the include
+		 * lines at the start of the input file changed
+		 */
+		len = watch_prefix(in_fname, prefix, sizeof(prefix));
+		if ((len != watch->snap_len) || memcmp(prefix, watch->snap_src, len))
+			watch_drop(watch);
+		if (watch->snap_state == WS_READY) {
+			pceas_add_file(ctx, WATCH_SNAP, watch->snap, watch->snap_size);
+			pceas_use_snapshot(ctx, WATCH_SNAP);
+		}
+
+		/* assemble */
+		ret = assemble_target(ctx, argc, argv);
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		printf("# build %s (%ld ms), waiting for changes...\n",
+			   ret ? "failed" : "done",
+			  (long)((end.tv_sec - start.tv_sec) * 1000 +
+					 (end.tv_nsec - start.tv_nsec) / 1000000));
+		fflush(stdout);
+
+		/* make the snapshot for the next builds */
+		if (!ret && (watch->snap_state == WS_NONE))
+			watch_snapshot(watch, ctx, shared, prefix, len, argc, argv);
+		pceas_delete(ctx);
+
+		/* watch the input file and all the files read */
+		watch_add(watch, in_fname);
+		for (file = shared->file_list; file; file = file->next)
+			watch_add(watch, file->path);
+
+		/* wait for a change */
+		if (watch_wait(watch, shared, in_fname) < 0)
+			break;
+
+		/* files may have been added, read the directories again */
+		shared_flush_dirs(shared);
+	}
+
+	close(watch->fd);
+	watch_drop(watch);
+	free(watch);
+	pceas_shared_delete(shared);
+	return (1);
+}
+
+
+/* ----
+ * watch_add()
+ * ----
+ * watch the directory of a file, editors often save a file
+ * by renaming a new one so the file itself can't be watched;
+ * return 0 if the directory can not be watched
+ */
+
+int
+watch_add(struct t_watch *watch, char *path)
+{
+	char  dir[256];
+	char *p;
+	int   wd, i;
+
+	/* get the directory */
+	strncpy(dir, path, sizeof(dir) - 1);
+	dir[sizeof(dir) - 1] = '\0';
+	if ((p = strrchr(dir, '/')) != NULL)
+		p[1] = '\0';
+	else
+		dir[0] = '\0';
+
+	/* check if it's already watched */
+	for (i = 0; i < watch->nb_dirs; i++) {
+		if (!strcmp(watch->dir[i], dir))
+			return (1);
+	}
+	if (watch->nb_dirs == 256)
+		return (0);
+
+	/* watch it */
+	wd = inotify_add_watch(watch->fd, dir[0] ? dir : ".",
+						   IN_CLOSE_WRITE | IN_MOVED_TO | IN_DELETE);
+	if (wd < 0)
+		return (0);
+
+	watch->wd[watch->nb_dirs] = wd;
+	strcpy(watch->dir[watch->nb_dirs], dir);
+	watch->nb_dirs++;
+	return (1);
+}
+
+
+/* ----
+ * watch_wait()
+ * ----
+ * wait until a file used by the last build is modified, the
+ * modified files are removed from the shared store and the
+ * snapshot is dropped if it uses one of them; return -1 on
+ * error
+ */
+
+int
+watch_wait(struct t_watch *watch, struct t_shared *sh, char *in_fname)
+{
+	struct inotify_event *event;
+	struct pollfd pfd;
+	char  buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+	char  path[512];
+	char *ptr;
+	int   changed;
+	int   len, i;
+
+	pfd.fd = watch->fd;
+	pfd.events = POLLIN;
+	changed = 0;
+
+	for (;;) {
+		/* once a file changed, wait a bit for the other
+		 * files saved at the same time
+		 */
+		if (poll(&pfd, 1, changed ? WATCH_DELAY : -1) < 0)
+			return (-1);
+		if (!(pfd.revents & POLLIN))
+			break;
+		if ((len = read(watch->fd, buf, sizeof(buf))) <= 0)
+			return (-1);
+
+		for (ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + event->len) {
+			event = (struct inotify_event *)ptr;
+			if (event->len == 0)
+				continue;
+
+			/* get the file path, as found in the include path */
+			for (i = 0; i < watch->nb_dirs; i++) {
+				if (watch->wd[i] == event->wd)
+					break;
+			}
+			if (i == watch->nb_dirs)
+				continue;
+			sprintf(path, "%s%s", watch->dir[i], event->name);
+
+			/* the outputs are in the same directory,
+			 * only the files used are checked
+			 */
+			if (shared_invalidate(sh, path) || !strcmp(path, in_fname))
+				changed = 1;
+
+			/* the snapshot is made again after the next build */
+			if (watch_uses(watch, path)) {
+				watch_drop(watch);
+				changed = 1;
+			}
+		}
+	}
+
+	return (changed);
+}
+
+
+/* ----
+ * watch_prefix()
+ * ----
+ * get the lines including files at the start of the input file,
+ * the comments between them are kept; return their length, 0
+ * if there are none
+ */
+
+int
+watch_prefix(char *name, char *buf, int max)
+{
+	FILE *fp;
+	char  line[256];
+	char *ptr;
+	int   len, nb, n;
+
+	if ((fp = fopen(name, "r")) == NULL)
+		return (0);
+
+	len = 0;
+	nb = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		n = strlen(line);
+		if ((n == 0) || ((line[n - 1] != '\n') && !feof(fp)))
+			break;
+
+		/* a label ends the declarations */
+		if (*line && !isspace((unsigned char)*line) && (*line != ';'))
+			break;
+
+		/* .include "name" or comment */
+		for (ptr = line; isspace((unsigned char)*ptr); ptr++)
+			;
+		if (*ptr && (*ptr != ';')) {
+			if (*ptr == '.')
+				ptr++;
+			if (strncasecmp(ptr, "include", 7) || !isspace((unsigned char)ptr[7]))
+				break;
+			nb++;
+		}
+
+		/* add it */
+		if ((len + n) >= max)
+			break;
+		memcpy(&buf[len], line, n);
+		len += n;
+	}
+	fclose(fp);
+
+	return (nb ? len : 0);
+}
+
+
+/* ----
+ * watch_snapshot()
+ * ----
+ * make a snapshot of the declarations of the files included
+ * at the start of the input file, 'ctx' is the build that just
+ * succeeded; the snapshot is only used if a build with it gives
+ * the same outputs
+ */
+
+void
+watch_snapshot(struct t_watch *watch, struct t_context *ctx, struct t_shared *shared,
+			   char *prefix, int len, int argc, char **argv)
+{
+	static const int out[3] = { PCEAS_OUT_ROM, PCEAS_OUT_LST, PCEAS_OUT_SYM };
+	const unsigned char *data, *ref;
+	struct t_context *snap_ctx, *test_ctx;
+	struct t_file *file;
+	int   size, ref_size;
+	int   i;
+
+	memcpy(watch->snap_src, prefix, len);
+	watch->snap_len = len;
+	watch->snap_state = WS_FAILED;
+
+	/* the other outputs are not checked */
+	if (!len || ctx->obj_opt || ctx->snap_opt || ctx->link_nb ||
+		ctx->snap_fname[0] || ctx->dep_fname[0])
+		return;
+
+	/* assemble the include lines alone */
+	if ((snap_ctx = new_context()) == NULL)
+		return;
+	get_options(snap_ctx, argc, argv);
+	snap_ctx->cache_dir[0] = '\0';
+	pceas_set_shared(snap_ctx, shared);
+	pceas_set_messages(snap_ctx, NULL);
+	pceas_set_option(snap_ctx, PCEAS_OPT_SNAPSHOT, 1);
+	init_path(snap_ctx);
+	pceas_add_file(snap_ctx, WATCH_SRC, prefix, len);
+
+	if (!pceas_assemble(snap_ctx, WATCH_SRC) &&
+		((data = pceas_output(snap_ctx, PCEAS_OUT_SNAPSHOT, &size)) != NULL) &&
+		((watch->snap = (void *)malloc(size)) != NULL)) {
+		memcpy(watch->snap, data, size);
+		watch->snap_size = size;
+	}
+
+	/* its files, a change drops it */
+	for (file = snap_ctx->file_list; file; file = file->next)
+		watch->nb_paths += file->path[0] ? 1 : 0;
+	if ((watch->path = (void *)malloc(watch->nb_paths * sizeof(watch->path[0]) + 1)) == NULL)
+		watch->nb_paths = 0;
+	for (i = 0, file = snap_ctx->file_list; file && (i < watch->nb_paths); file = file->next) {
+		if (file->path[0])
+			strcpy(watch->path[i++], file->path);
+	}
+	pceas_delete(snap_ctx);
+
+	if ((watch->snap == NULL) || (watch->path == NULL))
+		return;
+
+	/* check it */
+	if ((test_ctx = new_context()) == NULL)
+		return;
+	get_options(test_ctx, argc, argv);
+	test_ctx->cache_dir[0] = '\0';
+	pceas_set_shared(test_ctx, shared);
+	pceas_set_messages(test_ctx, NULL);
+	init_path(test_ctx);
+	pceas_add_file(test_ctx, WATCH_SNAP, watch->snap, watch->snap_size);
+	pceas_use_snapshot(test_ctx, WATCH_SNAP);
+
+	if (!pceas_assemble(test_ctx, test_ctx->in_fname)) {
+		for (i = 0; i < 3; i++) {
+			ref  = pceas_output(ctx, out[i], &ref_size);
+			data = pceas_output(test_ctx, out[i], &size);
+			if ((size != ref_size) || (size && memcmp(data, ref, size)))
+				break;
+		}
+		if (i == 3)
+			watch->snap_state = WS_READY;
+	}
+	pceas_delete(test_ctx);
+}
+
+
+/* ----
+ * watch_drop()
+ * ----
+ * forget the snapshot, it's made again after the next build
+ */
+
+void
+watch_drop(struct t_watch *watch)
+{
+	free(watch->snap);
+	free(watch->path);
+	watch->snap = NULL;
+	watch->snap_size = 0;
+	watch->snap_len = 0;
+	watch->path = NULL;
+	watch->nb_paths = 0;
+	watch->snap_state = WS_NONE;
+}
+
+
+/* ----
+ * watch_uses()
+ * ----
+ * check if a file is part of the snapshot
+ */
+
+int
+watch_uses(struct t_watch *watch, char *path)
+{
+	int i;
+
+	for (i = 0; i < watch->nb_paths; i++) {
+		if (!strcmp(watch->path[i], path))
+			return (1);
+	}
+	return (0);
+}
+
+#else
+
+/* ----
+ * watch_run()
+ * ----
+ * resident mode, only supported on linux
+ */
+
+int
+watch_run(int argc, char **argv)
+{
+	printf("Watch mode is not supported on this system!\n");
+	return (1);
+}
+
+#endif